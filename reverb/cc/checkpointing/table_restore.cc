@@ -0,0 +1,194 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/checkpointing/table_restore.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/types/optional.h"
+#include "reverb/cc/platform/checkpointing_utils.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/rate_limiter.h"
+#include "reverb/cc/support/trajectory_util.h"
+#include "reverb/cc/table_extensions/interface.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+// Number of items reconstructed by each task scheduled by `RestoreTables`.
+constexpr size_t kItemsPerTask = 1024;
+
+absl::StatusOr<Table::Item> MakeTableItem(PrioritizedItem checkpoint_item,
+                                          ChunkStore* chunk_store) {
+  if (checkpoint_item.has_deprecated_sequence_range()) {
+    std::vector<std::shared_ptr<ChunkStore::Chunk>> trajectory_chunks;
+    REVERB_RETURN_IF_ERROR(chunk_store->Get(
+        checkpoint_item.deprecated_chunk_keys(), &trajectory_chunks));
+
+    *checkpoint_item.mutable_flat_trajectory() = FlatTimestepTrajectory(
+        trajectory_chunks, checkpoint_item.deprecated_sequence_range().offset(),
+        checkpoint_item.deprecated_sequence_range().length());
+
+    checkpoint_item.clear_deprecated_sequence_range();
+    checkpoint_item.clear_deprecated_chunk_keys();
+  }
+
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks;
+  REVERB_RETURN_IF_ERROR(chunk_store->Get(
+      GetChunkKeys(checkpoint_item.flat_trajectory()), &chunks));
+  return Table::Item(std::move(checkpoint_item), std::move(chunks));
+}
+
+}  // namespace
+
+absl::StatusOr<size_t> GetTableIndex(
+    const std::vector<std::shared_ptr<Table>>& tables,
+    const std::string& name) {
+  for (size_t i = 0; i < tables.size(); i++) {
+    if (tables[i]->name() == name) {
+      return i;
+    }
+  }
+  std::vector<std::string> table_names(tables.size());
+  for (size_t i = 0; i < tables.size(); i++) {
+    table_names[i] = absl::StrCat("'", tables[i]->name(), "'");
+  }
+
+  return absl::InvalidArgumentError(absl::StrCat(
+      "Trying to load table '", name,
+      "' but table was not found in provided list of tables. Available "
+      "tables: [",
+      absl::StrJoin(table_names, ", "), "]"));
+}
+
+absl::Status CheckTrajectoryFormat(const PrioritizedItem& item) {
+  if (item.has_deprecated_sequence_range() && item.has_flat_trajectory()) {
+    return absl::InternalError(absl::StrCat(
+        "Item ", item.key(), " has both deprecated and new trajectory format: ",
+        item.DebugString(), "."));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status RestoreTables(
+    internal::flat_hash_map<std::string, PriorityTableCheckpoint> checkpoints,
+    internal::flat_hash_map<std::string, std::vector<PrioritizedItem>>
+        table_to_items,
+    ChunkStore* chunk_store, std::vector<std::shared_ptr<Table>>* tables,
+    absl::string_view path, TaskExecutor* executor) {
+  std::vector<std::shared_ptr<TableExtension>> all_table_extensions;
+
+  for (auto& checkpoint_ref : checkpoints) {
+    auto& checkpoint = checkpoint_ref.second;
+    REVERB_ASSIGN_OR_RETURN(size_t table_idx,
+                            GetTableIndex(*tables, checkpoint.table_name()));
+    std::shared_ptr<Table>& server_table = tables->at(table_idx);
+
+    auto sampler = MakeSelector(checkpoint.sampler());
+    auto remover = MakeSelector(checkpoint.remover());
+    auto rate_limiter =
+        std::make_shared<RateLimiter>(checkpoint.rate_limiter());
+    auto extensions = server_table->UnsafeClearExtensions();
+    auto signature =
+        checkpoint.has_signature()
+            ? absl::make_optional(std::move(checkpoint.signature()))
+            : absl::nullopt;
+
+    if (checkpoint.dense_keys() && !extensions.empty()) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Table ", checkpoint.table_name(),
+          " was checkpointed with dense keys but has extensions, which are "
+          "not supported by tables with dense keys."));
+    }
+
+    std::copy(extensions.begin(), extensions.end(),
+              std::back_inserter(all_table_extensions));
+
+    auto loaded_table = std::make_shared<Table>(
+        /*name=*/checkpoint.table_name(),
+        /*sampler=*/std::move(sampler),
+        /*remover=*/std::move(remover),
+        /*max_size=*/checkpoint.max_size(),
+        /*max_times_sampled=*/checkpoint.max_times_sampled(),
+        /*rate_limiter=*/std::move(rate_limiter),
+        /*extensions=*/std::move(extensions),
+        /*signature=*/std::move(signature),
+        /*num_shards=*/std::max(1, checkpoint.num_shards()),
+        /*dense_keys=*/checkpoint.dense_keys());
+    if (checkpoint.dense_keys()) {
+      loaded_table->set_next_dense_key_from_checkpoint(
+          checkpoint.next_dense_key());
+    }
+    loaded_table->set_num_deleted_episodes_from_checkpoint(
+        checkpoint.num_deleted_episodes());
+    loaded_table->set_num_unique_samples_from_checkpoint(
+        checkpoint.num_unique_samples());
+
+    server_table.swap(loaded_table);
+  }
+
+  // Notify the extensions about the updated list of tables so they can update
+  // their target table pointers (if any). It is important that we do this
+  // before the items are loaded to allow the extensions to handle `OnInsert`
+  // correctly.
+  for (auto& extension : all_table_extensions) {
+    extension->OnCheckpointLoaded(*tables);
+  }
+
+  for (auto& table : *tables) {
+    auto& checkpoint_items = table_to_items[table->name()];
+
+    std::vector<Table::Item> items(checkpoint_items.size());
+    const int num_tasks =
+        (checkpoint_items.size() + kItemsPerTask - 1) / kItemsPerTask;
+    REVERB_RETURN_IF_ERROR(ParallelFor(
+        executor, num_tasks, [&](int task) -> absl::Status {
+          const size_t end = std::min(checkpoint_items.size(),
+                                      (task + 1) * kItemsPerTask);
+          for (size_t i = task * kItemsPerTask; i < end; i++) {
+            REVERB_ASSIGN_OR_RETURN(
+                items[i],
+                MakeTableItem(std::move(checkpoint_items[i]), chunk_store));
+          }
+          return absl::OkStatus();
+        }));
+
+    for (auto& item : items) {
+      // The original table has already been destroyed so if this fails then
+      // there is way to recover.
+      REVERB_RETURN_IF_ERROR(table->InsertCheckpointItem(std::move(item)));
+    }
+
+    REVERB_LOG(REVERB_INFO)
+        << "Table " << table->name() << " and " << table->size()
+        << " items have been successfully loaded from checkpoint at path "
+        << path << ".";
+  }
+
+  REVERB_LOG(REVERB_INFO) << "Successfully loaded " << checkpoints.size()
+                          << " tables from " << path;
+
+  return absl::OkStatus();
+}
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
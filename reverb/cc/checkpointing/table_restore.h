@@ -0,0 +1,70 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_CHECKPOINTING_TABLE_RESTORE_H_
+#define REVERB_CC_CHECKPOINTING_TABLE_RESTORE_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "reverb/cc/checkpointing/checkpoint.pb.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/support/task_executor.h"
+#include "reverb/cc/table.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Helpers shared by the `Checkpointer` implementations for turning the
+// checkpointed table metadata and items back into tables. They are independent
+// of how the checkpoint is stored.
+
+// Returns the index of the table named `name` in `tables` or
+// InvalidArgumentError if no such table exists.
+absl::StatusOr<size_t> GetTableIndex(
+    const std::vector<std::shared_ptr<Table>>& tables, const std::string& name);
+
+// Returns InternalError if `item` uses both the deprecated and the new
+// trajectory format.
+absl::Status CheckTrajectoryFormat(const PrioritizedItem& item);
+
+// Replaces every table in `tables` which has a checkpoint in `checkpoints`
+// with a table constructed from the checkpoint and inserts the items of
+// `table_to_items` into it. The extensions of the replaced tables are moved
+// to the new tables. All chunks referenced by the items must already have been
+// inserted into `chunk_store`. `path` is only used for logging.
+//
+// If `executor` is set then the items are reconstructed (i.e their chunks are
+// looked up) in parallel on its threads. The items are always inserted into
+// the tables in their original order.
+absl::Status RestoreTables(
+    internal::flat_hash_map<std::string, PriorityTableCheckpoint> checkpoints,
+    internal::flat_hash_map<std::string, std::vector<PrioritizedItem>>
+        table_to_items,
+    ChunkStore* chunk_store, std::vector<std::shared_ptr<Table>>* tables,
+    absl::string_view path, TaskExecutor* executor = nullptr);
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_CHECKPOINTING_TABLE_RESTORE_H_
@@ -0,0 +1,71 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/chunk_compression_pool.h"
+
+#include <algorithm>
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "reverb/cc/platform/logging.h"
+
+namespace deepmind {
+namespace reverb {
+
+ChunkCompressionPool::ChunkCompressionPool(int num_threads,
+                                           int max_pending_chunks)
+    : max_pending_chunks_(max_pending_chunks),
+      executor_(num_threads, "ChunkCompressionPool") {
+  REVERB_CHECK_GT(num_threads, 0);
+  REVERB_CHECK_GT(max_pending_chunks, 0);
+}
+
+ChunkCompressionPool::~ChunkCompressionPool() { executor_.Close(); }
+
+std::shared_ptr<ChunkCompressionPool> ChunkCompressionPool::Default() {
+  static auto* pool = [] {
+    const int num_threads = std::clamp<int>(std::thread::hardware_concurrency(),
+                                            1, kMaxDefaultThreads);
+    return new std::shared_ptr<ChunkCompressionPool>(
+        std::make_shared<ChunkCompressionPool>(
+            num_threads, num_threads * kDefaultMaxPendingChunksPerThread));
+  }();
+  return *pool;
+}
+
+bool ChunkCompressionPool::TryReserve() {
+  int pending = num_pending_.load(std::memory_order_relaxed);
+  while (pending < max_pending_chunks_) {
+    if (num_pending_.compare_exchange_weak(pending, pending + 1,
+                                           std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ChunkCompressionPool::Schedule(internal::Task task) {
+  executor_.Schedule([this, task = std::move(task)]() mutable {
+    task();
+    task.Reset();
+    num_pending_.fetch_sub(1, std::memory_order_relaxed);
+  });
+}
+
+int ChunkCompressionPool::num_pending() const {
+  return num_pending_.load(std::memory_order_relaxed);
+}
+
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,77 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_CHUNK_COMPRESSION_POOL_H_
+#define REVERB_CC_CHUNK_COMPRESSION_POOL_H_
+
+#include <atomic>
+#include <memory>
+
+#include "reverb/cc/support/task_executor.h"
+
+namespace deepmind {
+namespace reverb {
+
+// Thread pool which `Chunker`s hand full chunks to so that they are encoded and
+// compressed in the background rather than on the thread which appended the
+// last row. The pool can be shared by any number of chunkers (and writers).
+//
+// The number of chunks which have been handed to the pool but not yet been
+// compressed is bounded by `max_pending_chunks`. Once the bound is reached
+// `TryReserve` fails and chunkers compress new chunks on the calling thread,
+// which slows the producers down to the rate at which the pool keeps up
+// rather than buffering an unbounded amount of uncompressed data.
+class ChunkCompressionPool {
+ public:
+  ChunkCompressionPool(int num_threads, int max_pending_chunks);
+
+  // Runs the chunks which are still pending before joining the threads.
+  ~ChunkCompressionPool();
+
+  // Returns a process wide pool with one thread per CPU (at most
+  // `kMaxDefaultThreads`) and `kDefaultMaxPendingChunksPerThread` pending
+  // chunks per thread. The pool is never destroyed.
+  static std::shared_ptr<ChunkCompressionPool> Default();
+
+  static constexpr int kMaxDefaultThreads = 8;
+  static constexpr int kDefaultMaxPendingChunksPerThread = 4;
+
+  // Reserves room for a pending chunk. Returns false if `max_pending_chunks`
+  // chunks are already pending.
+  bool TryReserve();
+
+  // Runs `task` on one of the threads of the pool. The room reserved by the
+  // preceding (successful) call to `TryReserve` is released once `task` has
+  // returned.
+  void Schedule(internal::Task task);
+
+  // Number of reserved chunks which have not yet been compressed.
+  int num_pending() const;
+
+  int max_pending_chunks() const { return max_pending_chunks_; }
+
+ private:
+  const int max_pending_chunks_;
+
+  std::atomic<int> num_pending_{0};
+
+  // Declared last so that its threads are joined before the other members are
+  // destroyed.
+  TaskExecutor executor_;
+};
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_CHUNK_COMPRESSION_POOL_H_
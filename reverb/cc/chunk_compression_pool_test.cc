@@ -0,0 +1,87 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/chunk_compression_pool.h"
+
+#include <atomic>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+TEST(ChunkCompressionPoolTest, TryReserveIsBounded) {
+  ChunkCompressionPool pool(1, 3);
+  EXPECT_TRUE(pool.TryReserve());
+  EXPECT_TRUE(pool.TryReserve());
+  EXPECT_TRUE(pool.TryReserve());
+  EXPECT_FALSE(pool.TryReserve());
+  EXPECT_EQ(pool.num_pending(), 3);
+
+  // Release the reservations again.
+  for (int i = 0; i < 3; i++) {
+    pool.Schedule([] {});
+  }
+}
+
+TEST(ChunkCompressionPoolTest, ReleasesReservationWhenTaskCompletes) {
+  ChunkCompressionPool pool(1, 1);
+  absl::Notification unblock;
+  absl::Notification done;
+
+  ASSERT_TRUE(pool.TryReserve());
+  pool.Schedule([&] {
+    unblock.WaitForNotification();
+    done.Notify();
+  });
+  EXPECT_FALSE(pool.TryReserve());
+
+  unblock.Notify();
+  done.WaitForNotification();
+  // The reservation is released just after the task returns.
+  while (pool.num_pending() != 0) {
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+  EXPECT_TRUE(pool.TryReserve());
+  pool.Schedule([] {});
+}
+
+TEST(ChunkCompressionPoolTest, RunsPendingTasksBeforeDestruction) {
+  std::atomic<int> count(0);
+  {
+    ChunkCompressionPool pool(2, 100);
+    for (int i = 0; i < 100; i++) {
+      ASSERT_TRUE(pool.TryReserve());
+      pool.Schedule([&count] { count++; });
+    }
+  }
+  EXPECT_EQ(count, 100);
+}
+
+TEST(ChunkCompressionPoolTest, DefaultIsShared) {
+  auto pool = ChunkCompressionPool::Default();
+  ASSERT_NE(pool, nullptr);
+  EXPECT_EQ(pool, ChunkCompressionPool::Default());
+  EXPECT_GE(pool->max_pending_chunks(),
+            ChunkCompressionPool::kDefaultMaxPendingChunksPerThread);
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
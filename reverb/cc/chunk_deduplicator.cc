@@ -0,0 +1,173 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/chunk_deduplicator.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "google/protobuf/util/message_differencer.h"
+#include "absl/hash/hash.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/schema.pb.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+constexpr size_t kMinSizeToRemoveExpiredEntries = 1024;
+
+// Hashes the payload of a chunk along with the fields required to interpret
+// it. Only the fields populated by `Chunker` are hashed, payloads with equal
+// hashes are compared in full before they are shared.
+struct PayloadHashView {
+  const ChunkData& chunk;
+
+  template <typename H>
+  friend H AbslHashValue(H h, const PayloadHashView& view) {
+    const ChunkData& chunk = view.chunk;
+    h = H::combine(std::move(h), chunk.delta_encoded(),
+                   static_cast<int>(chunk.compression_codec()),
+                   chunk.data().tensors_size());
+    for (const auto& tensor : chunk.data().tensors()) {
+      h = H::combine(std::move(h), static_cast<int>(tensor.dtype()),
+                     tensor.tensor_shape().dim_size());
+      for (const auto& dim : tensor.tensor_shape().dim()) {
+        h = H::combine(std::move(h), dim.size());
+      }
+      h = H::combine(std::move(h), absl::string_view(tensor.tensor_content()));
+      for (const auto& value : tensor.string_val()) {
+        h = H::combine(std::move(h), absl::string_view(value));
+      }
+    }
+    return h;
+  }
+};
+
+bool SamePayload(const ChunkData& a, const ChunkData& b) {
+  return a.delta_encoded() == b.delta_encoded() &&
+         a.compression_codec() == b.compression_codec() &&
+         google::protobuf::util::MessageDifferencer::Equals(a.data(), b.data());
+}
+
+}  // namespace
+
+ChunkDeduplicator::ChunkDeduplicator()
+    : remove_expired_at_size_(kMinSizeToRemoveExpiredEntries) {}
+
+std::shared_ptr<ChunkStore::Chunk> ChunkDeduplicator::NewChunk(
+    ChunkData data) {
+  if (data.data().tensors_size() == 0) {
+    absl::MutexLock lock(&mu_);
+    num_chunks_++;
+    return std::make_shared<ChunkStore::Chunk>(std::move(data));
+  }
+
+  const size_t hash = absl::Hash<PayloadHashView>()(PayloadHashView{data});
+  const int64_t payload_bytes = data.data().ByteSizeLong();
+  counters_->total_bytes.fetch_add(payload_bytes);
+
+  std::shared_ptr<const ChunkData> owner;
+  {
+    absl::MutexLock lock(&mu_);
+    num_chunks_++;
+    if (auto it = payloads_.find(hash); it != payloads_.end()) {
+      owner = it->second.lock();
+    }
+  }
+
+  // The payloads are compared without holding the lock as it is O(bytes).
+  if (owner != nullptr && SamePayload(*owner, data)) {
+    {
+      absl::MutexLock lock(&mu_);
+      num_hits_++;
+    }
+    data.clear_data();
+    auto* alias = new ChunkData(std::move(data));
+    alias->unsafe_arena_set_allocated_data(
+        const_cast<ChunkData::Data*>(&owner->data()));
+    // The alias keeps the owner alive and must give up the payload before it
+    // is deleted since it does not own it.
+    return std::make_shared<ChunkStore::Chunk>(std::shared_ptr<const ChunkData>(
+        alias, [owner = std::move(owner), counters = counters_,
+                payload_bytes](ChunkData* alias) {
+          alias->unsafe_arena_release_data();
+          delete alias;
+          counters->total_bytes.fetch_sub(payload_bytes);
+        }));
+  }
+
+  counters_->unique_bytes.fetch_add(payload_bytes);
+  counters_->num_unique.fetch_add(1);
+  owner = std::shared_ptr<const ChunkData>(
+      new ChunkData(std::move(data)),
+      [counters = counters_, payload_bytes](ChunkData* data) {
+        delete data;
+        counters->unique_bytes.fetch_sub(payload_bytes);
+        counters->num_unique.fetch_sub(1);
+      });
+  {
+    absl::MutexLock lock(&mu_);
+    // On hash collisions the first payload remains indexed.
+    std::weak_ptr<const ChunkData>& entry = payloads_[hash];
+    if (entry.expired()) {
+      entry = owner;
+    }
+    if (payloads_.size() >= remove_expired_at_size_) {
+      RemoveExpiredEntries();
+    }
+  }
+  // The data is shared with the aliases so it may outlive the chunk. The
+  // chunk therefore holds a handle which only releases its share of the
+  // total.
+  const ChunkData* raw = owner.get();
+  return std::make_shared<ChunkStore::Chunk>(std::shared_ptr<const ChunkData>(
+      raw, [owner = std::move(owner), counters = counters_,
+            payload_bytes](const ChunkData*) {
+        counters->total_bytes.fetch_sub(payload_bytes);
+      }));
+}
+
+ChunkDeduplicationStats ChunkDeduplicator::stats() const {
+  ChunkDeduplicationStats stats;
+  {
+    absl::MutexLock lock(&mu_);
+    stats.set_num_chunks(num_chunks_);
+    stats.set_num_hits(num_hits_);
+  }
+  stats.set_saved_bytes(counters_->total_bytes.load() -
+                        counters_->unique_bytes.load());
+  stats.set_num_unique_payloads(counters_->num_unique.load());
+  return stats;
+}
+
+void ChunkDeduplicator::RemoveExpiredEntries() {
+  for (auto it = payloads_.begin(); it != payloads_.end();) {
+    if (it->second.expired()) {
+      payloads_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  remove_expired_at_size_ =
+      std::max(kMinSizeToRemoveExpiredEntries, 2 * payloads_.size());
+}
+
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,96 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_CHUNK_DEDUPLICATOR_H_
+#define REVERB_CC_CHUNK_DEDUPLICATOR_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/schema.pb.h"
+
+namespace deepmind {
+namespace reverb {
+
+// Server wide index of chunk payloads (i.e the `data` field of `ChunkData`)
+// keyed by a hash of their content. Chunks created through the index whose
+// payload is identical to that of a chunk which is still alive share the
+// payload of that chunk instead of holding a copy of it. The remaining fields
+// (key, sequence range etc.) are never shared so items referencing the chunks
+// are unaffected.
+//
+// Environments often emit long runs of identical chunks (static frames,
+// padded episode tails, ...) in which case this reduces the memory used by
+// the server. The payload is hashed on every insertion so the index should
+// not be used when chunks are (almost) always unique.
+//
+// All public methods are thread safe.
+class ChunkDeduplicator {
+ public:
+  ChunkDeduplicator();
+
+  // ChunkDeduplicator is neither copyable nor movable.
+  ChunkDeduplicator(const ChunkDeduplicator&) = delete;
+  ChunkDeduplicator& operator=(const ChunkDeduplicator&) = delete;
+
+  // Creates a chunk holding `data`. If a live chunk created by this index has
+  // an identical payload then the payload of `data` is dropped and the chunk
+  // aliases the existing one.
+  std::shared_ptr<ChunkStore::Chunk> NewChunk(ChunkData data)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the current counters of the index.
+  ChunkDeduplicationStats stats() const ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  // Byte counters which are updated when the data of a chunk is destroyed.
+  // Shared with the deleters of the data as chunks may outlive the index.
+  struct PayloadCounters {
+    // Sum of the payload sizes of all live chunks created by the index.
+    std::atomic<int64_t> total_bytes{0};
+    // Sum of the sizes of the distinct payloads actually held in memory.
+    std::atomic<int64_t> unique_bytes{0};
+    std::atomic<int64_t> num_unique{0};
+  };
+
+  // Removes the entries of payloads which are no longer referenced by any
+  // chunk.
+  void RemoveExpiredEntries() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const std::shared_ptr<PayloadCounters> counters_ =
+      std::make_shared<PayloadCounters>();
+
+  mutable absl::Mutex mu_;
+
+  // Data of the chunks which own their payload, indexed by the hash of the
+  // payload. Expired entries are removed once the index has doubled in size
+  // since they were last removed.
+  internal::flat_hash_map<size_t, std::weak_ptr<const ChunkData>> payloads_
+      ABSL_GUARDED_BY(mu_);
+  size_t remove_expired_at_size_ ABSL_GUARDED_BY(mu_);
+
+  int64_t num_chunks_ ABSL_GUARDED_BY(mu_) = 0;
+  int64_t num_hits_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_CHUNK_DEDUPLICATOR_H_
@@ -0,0 +1,161 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/chunk_deduplicator.h"
+
+#include <memory>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/testing/proto_test_util.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+using ::deepmind::reverb::testing::EqualsProto;
+
+TEST(ChunkDeduplicatorTest, IdenticalPayloadsAreShared) {
+  ChunkDeduplicator deduplicator;
+  ChunkData first_data = testing::MakeChunkData(1);
+  ChunkData second_data = testing::MakeChunkData(2);
+  ASSERT_THAT(first_data.data(), EqualsProto(second_data.data()));
+
+  auto first = deduplicator.NewChunk(first_data);
+  auto second = deduplicator.NewChunk(second_data);
+
+  EXPECT_EQ(&first->Pin().value()->data(), &second->Pin().value()->data());
+  EXPECT_THAT(*first->Pin().value(), EqualsProto(first_data));
+  EXPECT_THAT(*second->Pin().value(), EqualsProto(second_data));
+
+  ChunkDeduplicationStats stats = deduplicator.stats();
+  EXPECT_EQ(stats.num_chunks(), 2);
+  EXPECT_EQ(stats.num_hits(), 1);
+  EXPECT_EQ(stats.num_unique_payloads(), 1);
+  EXPECT_EQ(stats.saved_bytes(), first_data.data().ByteSizeLong());
+}
+
+TEST(ChunkDeduplicatorTest, MetadataIsNotShared) {
+  ChunkDeduplicator deduplicator;
+  auto first = deduplicator.NewChunk(
+      testing::MakeChunkData(1, testing::MakeSequenceRange(10, 0, 1)));
+  auto second = deduplicator.NewChunk(
+      testing::MakeChunkData(2, testing::MakeSequenceRange(20, 5, 6)));
+
+  EXPECT_EQ(&first->Pin().value()->data(), &second->Pin().value()->data());
+  EXPECT_EQ(first->key(), 1);
+  EXPECT_EQ(second->key(), 2);
+  EXPECT_EQ(first->episode_id(), 10);
+  EXPECT_EQ(second->episode_id(), 20);
+  EXPECT_THAT(second->Pin().value()->sequence_range(),
+              EqualsProto(testing::MakeSequenceRange(20, 5, 6)));
+}
+
+TEST(ChunkDeduplicatorTest, DifferentPayloadsAreNotShared) {
+  ChunkDeduplicator deduplicator;
+  auto first = deduplicator.NewChunk(
+      testing::MakeChunkData(1, testing::MakeSequenceRange(1, 0, 1), 1));
+  auto second = deduplicator.NewChunk(
+      testing::MakeChunkData(2, testing::MakeSequenceRange(1, 0, 1), 2));
+  auto third = deduplicator.NewChunk(
+      testing::MakeChunkData(3, testing::MakeSequenceRange(1, 0, 2), 1));
+
+  EXPECT_NE(&first->Pin().value()->data(), &second->Pin().value()->data());
+  EXPECT_NE(&first->Pin().value()->data(), &third->Pin().value()->data());
+  EXPECT_EQ(second->Pin().value()->data().tensors_size(), 2);
+
+  ChunkDeduplicationStats stats = deduplicator.stats();
+  EXPECT_EQ(stats.num_chunks(), 3);
+  EXPECT_EQ(stats.num_hits(), 0);
+  EXPECT_EQ(stats.num_unique_payloads(), 3);
+  EXPECT_EQ(stats.saved_bytes(), 0);
+}
+
+TEST(ChunkDeduplicatorTest, DeltaEncodedPayloadsAreNotSharedWithPlain) {
+  ChunkDeduplicator deduplicator;
+  ChunkData encoded = testing::MakeChunkData(2);
+  encoded.set_delta_encoded(true);
+
+  auto first = deduplicator.NewChunk(testing::MakeChunkData(1));
+  auto second = deduplicator.NewChunk(encoded);
+
+  EXPECT_NE(&first->Pin().value()->data(), &second->Pin().value()->data());
+  EXPECT_TRUE(second->Pin().value()->delta_encoded());
+}
+
+TEST(ChunkDeduplicatorTest, StatsAreUpdatedWhenChunksAreDestroyed) {
+  ChunkDeduplicator deduplicator;
+  const int64_t payload_bytes =
+      testing::MakeChunkData(1).data().ByteSizeLong();
+
+  auto first = deduplicator.NewChunk(testing::MakeChunkData(1));
+  auto second = deduplicator.NewChunk(testing::MakeChunkData(2));
+  auto third = deduplicator.NewChunk(testing::MakeChunkData(3));
+  EXPECT_EQ(deduplicator.stats().saved_bytes(), 2 * payload_bytes);
+
+  // The payload is kept alive by the remaining aliases.
+  first = nullptr;
+  EXPECT_EQ(deduplicator.stats().saved_bytes(), payload_bytes);
+  EXPECT_EQ(deduplicator.stats().num_unique_payloads(), 1);
+  EXPECT_THAT(third->Pin().value()->data(),
+              EqualsProto(testing::MakeChunkData(3).data()));
+
+  second = nullptr;
+  third = nullptr;
+  ChunkDeduplicationStats stats = deduplicator.stats();
+  EXPECT_EQ(stats.saved_bytes(), 0);
+  EXPECT_EQ(stats.num_unique_payloads(), 0);
+  EXPECT_EQ(stats.num_chunks(), 3);
+  EXPECT_EQ(stats.num_hits(), 2);
+}
+
+TEST(ChunkDeduplicatorTest, ExpiredPayloadsAreNotShared) {
+  ChunkDeduplicator deduplicator;
+  auto first = deduplicator.NewChunk(testing::MakeChunkData(1));
+  first = nullptr;
+
+  auto second = deduplicator.NewChunk(testing::MakeChunkData(2));
+  auto third = deduplicator.NewChunk(testing::MakeChunkData(3));
+
+  EXPECT_EQ(&second->Pin().value()->data(), &third->Pin().value()->data());
+  ChunkDeduplicationStats stats = deduplicator.stats();
+  EXPECT_EQ(stats.num_hits(), 1);
+  EXPECT_EQ(stats.num_unique_payloads(), 1);
+}
+
+TEST(ChunkDeduplicatorTest, ExpiredEntriesAreRemoved) {
+  ChunkDeduplicator deduplicator;
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks;
+  for (int i = 0; i < 3000; i++) {
+    auto chunk = deduplicator.NewChunk(testing::MakeChunkData(
+        i, testing::MakeSequenceRange(i, 0, i % 100), 1 + i / 100));
+    if (i % 2 == 0) chunks.push_back(std::move(chunk));
+  }
+  EXPECT_EQ(deduplicator.stats().num_unique_payloads(), chunks.size());
+
+  // The live payloads are still indexed after the sweeps.
+  for (int i = 0; i < 3000; i += 2) {
+    auto chunk = deduplicator.NewChunk(testing::MakeChunkData(
+        i, testing::MakeSequenceRange(i, 0, i % 100), 1 + i / 100));
+    EXPECT_EQ(&chunk->Pin().value()->data(),
+              &chunks[i / 2]->Pin().value()->data());
+  }
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,374 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "reverb/cc/chunk_spill_tier.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/thread.h"
+#include "reverb/cc/schema.pb.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+// Maximum number of chunks evicted (or prefetched) per batch. The mutex of the
+// state is released between batches.
+constexpr size_t kBatchSize = 64;
+
+// Maximum number of queued cold and prefetch hints. The oldest hints are
+// dropped when the limit is exceeded.
+constexpr size_t kMaxQueuedHints = 1 << 16;
+
+// How often the eviction thread wakes up to check the budget when it isn't
+// woken up by the registration of a new chunk.
+constexpr auto kEvictionPollInterval = absl::Milliseconds(100);
+
+absl::Status ErrnoToStatus(absl::string_view what) {
+  return absl::InternalError(
+      absl::StrCat(what, " failed for chunk spill log: ", std::strerror(errno)));
+}
+
+}  // namespace
+
+namespace internal {
+
+ChunkSpillState::ChunkSpillState(int fd, int64_t memory_budget_bytes)
+    : fd_(fd), memory_budget_bytes_(memory_budget_bytes) {}
+
+ChunkSpillState::~ChunkSpillState() { close(fd_); }
+
+absl::Status ChunkSpillState::Write(const ChunkData& data, int64_t* offset,
+                                    int64_t* length) {
+  std::string serialized;
+  if (!data.SerializeToString(&serialized)) {
+    return absl::DataLossError(
+        absl::StrCat("Unable to serialize chunk ", data.chunk_key(), "."));
+  }
+  *length = serialized.size();
+  *offset = log_end_.fetch_add(*length, std::memory_order_relaxed);
+
+  size_t written = 0;
+  while (written < serialized.size()) {
+    ssize_t n = pwrite(fd_, serialized.data() + written,
+                       serialized.size() - written, *offset + written);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return ErrnoToStatus("pwrite");
+    }
+    written += n;
+  }
+  log_bytes_.fetch_add(*length, std::memory_order_relaxed);
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::shared_ptr<const ChunkData>> ChunkSpillState::Read(
+    int64_t offset, int64_t length) const {
+  std::string buffer(length, '\0');
+  size_t read = 0;
+  while (read < buffer.size()) {
+    ssize_t n =
+        pread(fd_, &buffer[read], buffer.size() - read, offset + read);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return ErrnoToStatus("pread");
+    }
+    if (n == 0) {
+      return absl::DataLossError(absl::StrCat(
+          "Chunk spill log ended at ", offset + read, " while reading [",
+          offset, ", ", offset + length, ")."));
+    }
+    read += n;
+  }
+
+  auto data = std::make_shared<ChunkData>();
+  if (!data->ParseFromString(buffer)) {
+    return absl::DataLossError(absl::StrCat(
+        "Could not parse ChunkData at offset ", offset, " of spill log."));
+  }
+  return data;
+}
+
+void ChunkSpillState::Register(std::weak_ptr<ChunkStore::Chunk> chunk,
+                               size_t bytes) {
+  absl::MutexLock lock(&mu_);
+  resident_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+  chunks_.push_back(std::move(chunk));
+}
+
+void ChunkSpillState::OnPagedIn(size_t bytes, bool prefetch,
+                                absl::Duration latency) {
+  resident_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+  if (prefetch) {
+    num_prefetches_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  num_faults_.fetch_add(1, std::memory_order_relaxed);
+  absl::MutexLock lock(&mu_);
+  total_fault_latency_ += latency;
+  max_fault_latency_ = std::max(max_fault_latency_, latency);
+}
+
+void ChunkSpillState::OnChunkDestroyed(size_t resident_bytes, int64_t offset,
+                                       int64_t length) {
+  resident_bytes_.fetch_sub(resident_bytes, std::memory_order_relaxed);
+  if (offset < 0) return;
+  log_bytes_.fetch_sub(length, std::memory_order_relaxed);
+#ifdef FALLOC_FL_PUNCH_HOLE
+  // Give the space back to the file system. The log is never compacted so
+  // without this it would grow for as long as the process lives.
+  if (fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset,
+                length) != 0) {
+    REVERB_LOG_EVERY_N(REVERB_WARNING, 1000)
+        << "Unable to release space of chunk spill log: "
+        << std::strerror(errno);
+  }
+#endif
+}
+
+void ChunkSpillState::Prefetch(std::weak_ptr<ChunkStore::Chunk> chunk) {
+  absl::MutexLock lock(&mu_);
+  if (closed_) return;
+  if (prefetch_.size() >= kMaxQueuedHints) prefetch_.pop_front();
+  prefetch_.push_back(std::move(chunk));
+}
+
+void ChunkSpillState::MarkCold(std::weak_ptr<ChunkStore::Chunk> chunk) {
+  absl::MutexLock lock(&mu_);
+  if (closed_) return;
+  if (cold_.size() >= kMaxQueuedHints) cold_.pop_front();
+  cold_.push_back(std::move(chunk));
+}
+
+std::vector<std::shared_ptr<ChunkStore::Chunk>> ChunkSpillState::PickVictims(
+    size_t max_victims) {
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> victims;
+  while (!cold_.empty() && victims.size() < max_victims) {
+    auto chunk = cold_.front().lock();
+    cold_.pop_front();
+    // The hint is ignored if the chunk has been accessed since.
+    if (chunk != nullptr &&
+        !chunk->referenced_.load(std::memory_order_relaxed) &&
+        chunk->evictable()) {
+      victims.push_back(std::move(chunk));
+    }
+  }
+
+  // Every chunk is visited at most twice so that recently referenced chunks
+  // get a second chance but the sweep terminates when nothing can be evicted.
+  for (size_t steps = 2 * chunks_.size();
+       steps > 0 && !chunks_.empty() && victims.size() < max_victims;
+       steps--) {
+    if (clock_hand_ >= chunks_.size()) clock_hand_ = 0;
+    auto chunk = chunks_[clock_hand_].lock();
+    if (chunk == nullptr) {
+      chunks_[clock_hand_] = std::move(chunks_.back());
+      chunks_.pop_back();
+      continue;
+    }
+    clock_hand_++;
+    if (chunk->referenced_.exchange(false, std::memory_order_relaxed)) {
+      continue;
+    }
+    if (chunk->evictable()) {
+      victims.push_back(std::move(chunk));
+    }
+  }
+  return victims;
+}
+
+bool ChunkSpillState::EvictUntilWithinBudget(absl::Duration timeout) {
+  {
+    absl::MutexLock lock(&mu_);
+    auto has_work = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return closed_ || OverBudget();
+    };
+    mu_.AwaitWithTimeout(absl::Condition(&has_work), timeout);
+    if (closed_) return false;
+  }
+
+  while (OverBudget()) {
+    std::vector<std::shared_ptr<ChunkStore::Chunk>> victims;
+    {
+      absl::MutexLock lock(&mu_);
+      if (closed_) return false;
+      victims = PickVictims(kBatchSize);
+    }
+    // Everything is either pinned or already spilled.
+    if (victims.empty()) break;
+
+    for (auto& chunk : victims) {
+      if (!OverBudget()) break;
+      auto bytes_or = chunk->Evict();
+      if (!bytes_or.ok()) {
+        // Back off for `timeout` rather than retrying right away as the error
+        // (e.g. a full disk) is unlikely to resolve itself. The tier is still
+        // over budget so waiting for work would return immediately.
+        REVERB_LOG_EVERY_N(REVERB_ERROR, 100)
+            << "Unable to spill chunk " << chunk->key() << ": "
+            << bytes_or.status();
+        absl::MutexLock lock(&mu_);
+        mu_.AwaitWithTimeout(absl::Condition(&closed_), timeout);
+        return !closed_;
+      }
+      if (*bytes_or > 0) {
+        resident_bytes_.fetch_sub(*bytes_or, std::memory_order_relaxed);
+        num_evictions_.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+  return true;
+}
+
+bool ChunkSpillState::ProcessPrefetches() {
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks;
+  {
+    absl::MutexLock lock(&mu_);
+    auto has_work = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return closed_ || !prefetch_.empty();
+    };
+    mu_.Await(absl::Condition(&has_work));
+    if (closed_) return false;
+    while (!prefetch_.empty() && chunks.size() < kBatchSize) {
+      if (auto chunk = prefetch_.front().lock()) {
+        chunks.push_back(std::move(chunk));
+      }
+      prefetch_.pop_front();
+    }
+  }
+  for (const auto& chunk : chunks) {
+    // Errors are reported again to the reader when the chunk is pinned.
+    auto data_or = chunk->PageIn(/*prefetch=*/true);
+    if (!data_or.ok()) {
+      REVERB_LOG_EVERY_N(REVERB_WARNING, 100)
+          << "Unable to prefetch chunk " << chunk->key() << ": "
+          << data_or.status();
+    }
+  }
+  return true;
+}
+
+void ChunkSpillState::Close() {
+  absl::MutexLock lock(&mu_);
+  closed_ = true;
+  cold_.clear();
+  prefetch_.clear();
+}
+
+ChunkSpillStats ChunkSpillState::stats() const {
+  ChunkSpillStats stats;
+  stats.resident_bytes = resident_bytes_.load(std::memory_order_relaxed);
+  stats.log_bytes = log_bytes_.load(std::memory_order_relaxed);
+  stats.num_evictions = num_evictions_.load(std::memory_order_relaxed);
+  stats.num_faults = num_faults_.load(std::memory_order_relaxed);
+  stats.num_prefetches = num_prefetches_.load(std::memory_order_relaxed);
+  absl::MutexLock lock(&mu_);
+  stats.total_fault_latency = total_fault_latency_;
+  stats.max_fault_latency = max_fault_latency_;
+  return stats;
+}
+
+}  // namespace internal
+
+absl::StatusOr<std::shared_ptr<ChunkSpillTier>> ChunkSpillTier::Create(
+    Options options) {
+  if (options.directory.empty()) {
+    return absl::InvalidArgumentError("directory must be set.");
+  }
+  if (options.memory_budget_bytes < 0) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "memory_budget_bytes must be >= 0 but got ",
+        options.memory_budget_bytes, "."));
+  }
+  if (options.num_prefetch_threads < 0) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "num_prefetch_threads must be >= 0 but got ",
+        options.num_prefetch_threads, "."));
+  }
+
+  std::string path = absl::StrCat(options.directory, "/reverb_chunks_XXXXXX");
+  int fd = mkstemp(&path[0]);
+  if (fd < 0) return ErrnoToStatus(absl::StrCat("mkstemp in ", path));
+  // The file remains accessible through `fd` and is removed by the file system
+  // when it is closed, even if the process crashes.
+  if (unlink(path.c_str()) != 0) {
+    auto status = ErrnoToStatus(absl::StrCat("unlink of ", path));
+    close(fd);
+    return status;
+  }
+
+  auto state = std::make_shared<internal::ChunkSpillState>(
+      fd, options.memory_budget_bytes);
+  return std::shared_ptr<ChunkSpillTier>(
+      new ChunkSpillTier(std::move(options), std::move(state)));
+}
+
+ChunkSpillTier::ChunkSpillTier(
+    Options options, std::shared_ptr<internal::ChunkSpillState> state)
+    : options_(std::move(options)), state_(std::move(state)) {
+  evict_thread_ = internal::StartThread("ChunkSpillEvict", [state = state_] {
+    while (state->EvictUntilWithinBudget(kEvictionPollInterval)) {
+    }
+  });
+  for (int i = 0; i < options_.num_prefetch_threads; i++) {
+    prefetch_threads_.push_back(
+        internal::StartThread("ChunkSpillPrefetch", [state = state_] {
+          while (state->ProcessPrefetches()) {
+          }
+        }));
+  }
+}
+
+ChunkSpillTier::~ChunkSpillTier() {
+  state_->Close();
+  evict_thread_ = nullptr;
+  prefetch_threads_.clear();
+}
+
+std::shared_ptr<ChunkStore::Chunk> ChunkSpillTier::NewChunk(
+    ChunkData data) const {
+  auto chunk = std::make_shared<ChunkStore::Chunk>(std::move(data), state_);
+  state_->Register(chunk, chunk->DataByteSizeLong());
+  return chunk;
+}
+
+ChunkSpillStats ChunkSpillTier::stats() const { return state_->stats(); }
+
+std::string ChunkSpillTier::DebugString() const {
+  return absl::StrCat("ChunkSpillTier(directory=", options_.directory,
+                      ", memory_budget_bytes=", options_.memory_budget_bytes,
+                      ", num_prefetch_threads=", options_.num_prefetch_threads,
+                      ")");
+}
+
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,212 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef REVERB_CC_CHUNK_SPILL_TIER_H_
+#define REVERB_CC_CHUNK_SPILL_TIER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/platform/thread.h"
+#include "reverb/cc/schema.pb.h"
+
+namespace deepmind {
+namespace reverb {
+
+struct ChunkSpillStats {
+  // Bytes of chunk data currently held in memory.
+  int64_t resident_bytes = 0;
+
+  // Bytes of chunk data currently stored in the spill log. Chunks which have
+  // been paged back in are still counted as the log copy is kept so that they
+  // can be evicted again without being rewritten.
+  int64_t log_bytes = 0;
+
+  // Number of times the data of a chunk was released from memory.
+  int64_t num_evictions = 0;
+
+  // Number of times a spilled chunk was accessed and had to be read from the
+  // log on the calling thread.
+  int64_t num_faults = 0;
+
+  // Number of spilled chunks paged in ahead of time by `Prefetch`.
+  int64_t num_prefetches = 0;
+
+  // Sum and maximum of the time spent by accessors waiting for faults.
+  absl::Duration total_fault_latency;
+  absl::Duration max_fault_latency;
+};
+
+namespace internal {
+
+// State shared by a `ChunkSpillTier` and the chunks registered with it. Chunks
+// hold a shared_ptr to the state (rather than to the tier) so that the threads
+// of the tier are never responsible for destroying it. If the tier is destroyed
+// before its chunks then spilled chunks can still be paged in but no further
+// evictions or prefetches are performed.
+class ChunkSpillState {
+ public:
+  // Takes ownership of `fd`, an open (and unlinked) file used as log.
+  ChunkSpillState(int fd, int64_t memory_budget_bytes);
+  ~ChunkSpillState();
+
+  // Appends `data` to the log.
+  absl::Status Write(const ChunkData& data, int64_t* offset, int64_t* length);
+
+  // Reads and parses a chunk previously written with `Write`.
+  absl::StatusOr<std::shared_ptr<const ChunkData>> Read(int64_t offset,
+                                                        int64_t length) const;
+
+  // Accounting hooks called by the chunks.
+  void Register(std::weak_ptr<ChunkStore::Chunk> chunk, size_t bytes);
+  void OnPagedIn(size_t bytes, bool prefetch, absl::Duration latency);
+  void OnChunkDestroyed(size_t resident_bytes, int64_t offset, int64_t length);
+
+  // Queues hints which are processed by the threads of the tier.
+  void Prefetch(std::weak_ptr<ChunkStore::Chunk> chunk);
+  void MarkCold(std::weak_ptr<ChunkStore::Chunk> chunk);
+
+  // Evicts chunks until the resident bytes are within the budget or no more
+  // chunks can be evicted. Blocks until there is something to evict or until
+  // `timeout` has passed. Returns false once `Close` has been called.
+  bool EvictUntilWithinBudget(absl::Duration timeout);
+
+  // Pages in the chunks queued by `Prefetch`. Blocks until the queue is
+  // non-empty. Returns false once `Close` has been called.
+  bool ProcessPrefetches();
+
+  // Unblocks `EvictUntilWithinBudget` and `ProcessPrefetches`.
+  void Close();
+
+  ChunkSpillStats stats() const;
+
+ private:
+  // Picks up to `max_victims` chunks to evict. Chunks marked as cold are picked
+  // first, after which the registered chunks are swept in CLOCK order.
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> PickVictims(
+      size_t max_victims) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  bool OverBudget() const {
+    return resident_bytes_.load(std::memory_order_relaxed) >
+           memory_budget_bytes_;
+  }
+
+  const int fd_;
+  const int64_t memory_budget_bytes_;
+
+  std::atomic<int64_t> log_end_{0};
+  std::atomic<int64_t> resident_bytes_{0};
+  std::atomic<int64_t> log_bytes_{0};
+  std::atomic<int64_t> num_evictions_{0};
+  std::atomic<int64_t> num_faults_{0};
+  std::atomic<int64_t> num_prefetches_{0};
+
+  mutable absl::Mutex mu_;
+  bool closed_ ABSL_GUARDED_BY(mu_) = false;
+  std::vector<std::weak_ptr<ChunkStore::Chunk>> chunks_ ABSL_GUARDED_BY(mu_);
+  size_t clock_hand_ ABSL_GUARDED_BY(mu_) = 0;
+  std::deque<std::weak_ptr<ChunkStore::Chunk>> cold_
+      ABSL_GUARDED_BY(mu_);
+  std::deque<std::weak_ptr<ChunkStore::Chunk>> prefetch_
+      ABSL_GUARDED_BY(mu_);
+  absl::Duration total_fault_latency_ ABSL_GUARDED_BY(mu_);
+  absl::Duration max_fault_latency_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace internal
+
+// Second, disk backed, tier for the data of `ChunkStore::Chunk`s which allows
+// tables to hold more data than fits in memory.
+//
+// Chunks created with `NewChunk` are registered with the tier. When the data of
+// the registered chunks exceeds `memory_budget_bytes`, a background thread
+// appends the data of cold chunks to a log file and releases the in memory
+// copy. The data is read back from the log on the next access (a fault).
+// Chunks are immutable so each chunk is written at most once and can be evicted
+// again for free after it has been paged back in. The log space of a chunk is
+// released (by punching a hole in the file where supported) when the chunk is
+// destroyed.
+//
+// Chunks are picked for eviction using the CLOCK algorithm, i.e. chunks which
+// have not been accessed since the last sweep are evicted first. Chunks can be
+// hinted as cold (e.g. because the items referencing them have low priority)
+// using `ChunkStore::Chunk::MarkCold`, in which case they are evicted before
+// any other chunk. `ChunkStore::Chunk::Prefetch` queues the chunk to be paged
+// in on a background thread so that the fault can be avoided. See
+// `ChunkTieringExtension` for a table extension that issues these hints.
+//
+// Chunks which are pinned (see `ChunkStore::Chunk::Pin`) are never evicted.
+//
+// All public methods are thread safe.
+class ChunkSpillTier {
+ public:
+  struct Options {
+    // Directory in which the log is created. Should be on a local SSD. The log
+    // is unlinked right after it has been created so it does not outlive the
+    // process.
+    std::string directory;
+
+    // Eviction starts when the data held in memory exceeds this many bytes.
+    int64_t memory_budget_bytes = 0;
+
+    // Number of threads paging in prefetched chunks.
+    int num_prefetch_threads = 1;
+  };
+
+  // Creates the log file and starts the background threads.
+  static absl::StatusOr<std::shared_ptr<ChunkSpillTier>> Create(
+      Options options);
+
+  // Stops the background threads. Chunks which are still alive remain
+  // readable.
+  ~ChunkSpillTier();
+
+  // Creates a chunk whose data may be spilled by the tier.
+  std::shared_ptr<ChunkStore::Chunk> NewChunk(ChunkData data) const;
+
+  // Returns the current counters of the tier.
+  ChunkSpillStats stats() const;
+
+  // Returns a summary string description.
+  std::string DebugString() const;
+
+  // ChunkSpillTier is neither copyable nor movable.
+  ChunkSpillTier(const ChunkSpillTier&) = delete;
+  ChunkSpillTier& operator=(const ChunkSpillTier&) = delete;
+
+ private:
+  ChunkSpillTier(Options options,
+                 std::shared_ptr<internal::ChunkSpillState> state);
+
+  const Options options_;
+  const std::shared_ptr<internal::ChunkSpillState> state_;
+  std::unique_ptr<internal::Thread> evict_thread_;
+  std::vector<std::unique_ptr<internal::Thread>> prefetch_threads_;
+};
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_CHUNK_SPILL_TIER_H_
@@ -0,0 +1,274 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "reverb/cc/chunk_spill_tier.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/testing/proto_test_util.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+using ::deepmind::reverb::testing::EqualsProto;
+
+std::string TempDir() {
+  const char* dir = std::getenv("TEST_TMPDIR");
+  return dir != nullptr ? dir : "/tmp";
+}
+
+std::shared_ptr<ChunkSpillTier> MakeTier(int64_t memory_budget_bytes,
+                                         int num_prefetch_threads = 1) {
+  ChunkSpillTier::Options options;
+  options.directory = TempDir();
+  options.memory_budget_bytes = memory_budget_bytes;
+  options.num_prefetch_threads = num_prefetch_threads;
+  auto tier_or = ChunkSpillTier::Create(options);
+  REVERB_CHECK(tier_or.ok()) << tier_or.status();
+  return std::move(tier_or).value();
+}
+
+// Polls `condition` until it is true or a generous deadline has passed.
+bool WaitFor(const std::function<bool()>& condition) {
+  const absl::Time deadline = absl::Now() + absl::Seconds(10);
+  while (!condition()) {
+    if (absl::Now() > deadline) return false;
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+  return true;
+}
+
+// All chunks share the same episode so that their sizes are identical.
+ChunkData MakeChunkData(uint64_t key) {
+  return testing::MakeChunkData(key, testing::MakeSequenceRange(1, 0, 1));
+}
+
+int64_t ChunkSize() { return MakeChunkData(1).ByteSizeLong(); }
+
+TEST(ChunkSpillTierTest, CreateValidatesOptions) {
+  ChunkSpillTier::Options options;
+  EXPECT_EQ(ChunkSpillTier::Create(options).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  options.directory = TempDir();
+  options.memory_budget_bytes = -1;
+  EXPECT_EQ(ChunkSpillTier::Create(options).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  options.memory_budget_bytes = 0;
+  options.num_prefetch_threads = -1;
+  EXPECT_EQ(ChunkSpillTier::Create(options).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(ChunkSpillTierTest, EvictsAndPagesInChunks) {
+  auto tier = MakeTier(/*memory_budget_bytes=*/0);
+  ChunkData data = MakeChunkData(1);
+  auto chunk = tier->NewChunk(data);
+
+  ASSERT_TRUE(WaitFor([&] { return !chunk->resident(); }));
+  EXPECT_EQ(tier->stats().resident_bytes, 0);
+  EXPECT_EQ(tier->stats().log_bytes, data.ByteSizeLong());
+  EXPECT_EQ(tier->stats().num_evictions, 1);
+
+  // Metadata is available without paging in the data.
+  EXPECT_EQ(chunk->key(), 1);
+  EXPECT_EQ(chunk->episode_id(), 1);
+  EXPECT_EQ(chunk->num_rows(), 2);
+  EXPECT_EQ(chunk->DataByteSizeLong(), data.ByteSizeLong());
+  EXPECT_FALSE(chunk->resident());
+
+  auto pinned = chunk->Pin();
+  REVERB_ASSERT_OK(pinned.status());
+  EXPECT_THAT(**pinned, EqualsProto(data));
+  EXPECT_TRUE(chunk->resident());
+  EXPECT_EQ(tier->stats().num_faults, 1);
+  EXPECT_GT(tier->stats().max_fault_latency, absl::ZeroDuration());
+}
+
+TEST(ChunkSpillTierTest, WireBytesOfEvictedChunksArePagedIn) {
+  auto tier = MakeTier(/*memory_budget_bytes=*/0);
+  ChunkData data = MakeChunkData(1);
+  auto chunk = tier->NewChunk(data);
+  grpc::Slice before = chunk->WireBytes().value();
+
+  // The slice outlives the eviction of the data it was serialized from.
+  ASSERT_TRUE(WaitFor([&] { return !chunk->resident(); }));
+  grpc::Slice after = chunk->WireBytes().value();
+  EXPECT_EQ(tier->stats().num_faults, 1);
+  EXPECT_EQ(std::string(before.begin(), before.end()),
+            std::string(after.begin(), after.end()));
+  EXPECT_EQ(after.size(), data.ByteSizeLong());
+}
+
+TEST(ChunkSpillTierTest, PinnedChunksAreNotEvicted) {
+  auto tier = MakeTier(/*memory_budget_bytes=*/0);
+  auto chunk = tier->NewChunk(MakeChunkData(1));
+  auto pinned = chunk->Pin().value();
+
+  absl::SleepFor(absl::Milliseconds(300));
+  EXPECT_TRUE(chunk->resident());
+  EXPECT_EQ(tier->stats().num_evictions, 0);
+
+  pinned = nullptr;
+  EXPECT_TRUE(WaitFor([&] { return !chunk->resident(); }));
+}
+
+TEST(ChunkSpillTierTest, EvictsChunksAgainWithoutRewritingThem) {
+  auto tier = MakeTier(/*memory_budget_bytes=*/0);
+  ChunkData data = MakeChunkData(1);
+  auto chunk = tier->NewChunk(data);
+
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(WaitFor([&] { return !chunk->resident(); }));
+    EXPECT_THAT(*chunk->Pin().value(), EqualsProto(data));
+  }
+  EXPECT_TRUE(WaitFor([&] { return tier->stats().num_evictions == 3; }));
+  EXPECT_EQ(tier->stats().log_bytes, data.ByteSizeLong());
+  EXPECT_EQ(tier->stats().num_faults, 3);
+}
+
+TEST(ChunkSpillTierTest, ColdChunksAreEvictedFirst) {
+  auto tier = MakeTier(/*memory_budget_bytes=*/2 * ChunkSize());
+  auto a = tier->NewChunk(MakeChunkData(1));
+  auto b = tier->NewChunk(MakeChunkData(2));
+  a->MarkCold();
+
+  auto c = tier->NewChunk(MakeChunkData(3));
+  ASSERT_TRUE(WaitFor([&] { return !a->resident(); }));
+  EXPECT_TRUE(b->resident());
+  EXPECT_TRUE(c->resident());
+  EXPECT_EQ(tier->stats().resident_bytes, 2 * ChunkSize());
+}
+
+TEST(ChunkSpillTierTest, PrefetchPagesInWithoutFault) {
+  auto tier = MakeTier(/*memory_budget_bytes=*/ChunkSize());
+  ChunkData data = MakeChunkData(1);
+  auto a = tier->NewChunk(data);
+  auto b = tier->NewChunk(MakeChunkData(2));
+  ASSERT_TRUE(WaitFor([&] { return !a->resident(); }));
+
+  // Make room for `a` to be paged in again.
+  b = nullptr;
+  a->Prefetch();
+  ASSERT_TRUE(WaitFor([&] { return a->resident(); }));
+  EXPECT_THAT(*a->Pin().value(), EqualsProto(data));
+
+  auto stats = tier->stats();
+  EXPECT_EQ(stats.num_prefetches, 1);
+  EXPECT_EQ(stats.num_faults, 0);
+}
+
+TEST(ChunkSpillTierTest, DestroyedChunksReleaseAccounting) {
+  auto tier = MakeTier(/*memory_budget_bytes=*/ChunkSize());
+  auto a = tier->NewChunk(MakeChunkData(1));
+  auto b = tier->NewChunk(MakeChunkData(2));
+  ASSERT_TRUE(WaitFor([&] { return tier->stats().num_evictions == 1; }));
+  EXPECT_GT(tier->stats().log_bytes, 0);
+
+  a = nullptr;
+  b = nullptr;
+  EXPECT_EQ(tier->stats().resident_bytes, 0);
+  EXPECT_EQ(tier->stats().log_bytes, 0);
+}
+
+TEST(ChunkSpillTierTest, ChunksOutliveTier) {
+  ChunkData data = MakeChunkData(1);
+  std::shared_ptr<ChunkStore::Chunk> chunk;
+  {
+    auto tier = MakeTier(/*memory_budget_bytes=*/0);
+    chunk = tier->NewChunk(data);
+    ASSERT_TRUE(WaitFor([&] { return !chunk->resident(); }));
+  }
+  EXPECT_THAT(*chunk->Pin().value(), EqualsProto(data));
+}
+
+TEST(ChunkSpillTierTest, ChunkStoreRegistersInsertedChunks) {
+  auto tier = MakeTier(/*memory_budget_bytes=*/0);
+  ChunkStore store(tier);
+  ChunkData data = MakeChunkData(1);
+  auto chunk = store.Insert(data);
+  ASSERT_TRUE(WaitFor([&] { return !chunk->resident(); }));
+
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks;
+  REVERB_ASSERT_OK(store.Get({1}, &chunks));
+  EXPECT_THAT(*chunks[0]->Pin().value(), EqualsProto(data));
+}
+
+// Returns an unlinked temporary file opened with `flags`.
+int OpenTempFile(int flags) {
+  std::string path = absl::StrCat(TempDir(), "/chunk_spill_tier_test_XXXXXX");
+  int fd = mkstemp(&path[0]);
+  REVERB_CHECK_GE(fd, 0);
+  close(fd);
+  fd = open(path.c_str(), flags);
+  REVERB_CHECK_GE(fd, 0);
+  unlink(path.c_str());
+  return fd;
+}
+
+TEST(ChunkSpillStateTest, PinFailsIfLogCannotBeRead) {
+  const int fd = OpenTempFile(O_RDWR);
+  const int log = dup(fd);
+  auto state = std::make_shared<internal::ChunkSpillState>(fd, 0);
+  auto chunk = std::make_shared<ChunkStore::Chunk>(MakeChunkData(1), state);
+  state->Register(chunk, chunk->DataByteSizeLong());
+  ASSERT_TRUE(state->EvictUntilWithinBudget(absl::ZeroDuration()));
+  ASSERT_FALSE(chunk->resident());
+
+  // Drop the spilled data from under the chunk.
+  ASSERT_EQ(ftruncate(log, 0), 0);
+  close(log);
+  EXPECT_EQ(chunk->Pin().status().code(), absl::StatusCode::kDataLoss);
+  EXPECT_EQ(chunk->WireBytes().status().code(), absl::StatusCode::kDataLoss);
+  EXPECT_FALSE(chunk->resident());
+}
+
+TEST(ChunkSpillStateTest, BacksOffWhenEvictionFails) {
+  // Writes to a read-only log fail.
+  auto state =
+      std::make_shared<internal::ChunkSpillState>(OpenTempFile(O_RDONLY), 0);
+  auto chunk = std::make_shared<ChunkStore::Chunk>(MakeChunkData(1), state);
+  state->Register(chunk, chunk->DataByteSizeLong());
+
+  const absl::Time start = absl::Now();
+  EXPECT_TRUE(state->EvictUntilWithinBudget(absl::Milliseconds(50)));
+  EXPECT_GE(absl::Now() - start, absl::Milliseconds(50));
+  EXPECT_TRUE(chunk->resident());
+
+  state->Close();
+  EXPECT_FALSE(state->EvictUntilWithinBudget(absl::Milliseconds(50)));
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
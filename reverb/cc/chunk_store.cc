@@ -14,60 +14,196 @@
 
 #include "reverb/cc/chunk_store.h"
 
+#include <algorithm>
 #include <memory>
 #include <utility>
 #include <vector>
 
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
+#include "reverb/cc/chunk_spill_tier.h"
 #include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/status_macros.h"
 #include "reverb/cc/schema.pb.h"
+#include "reverb/cc/support/grpc_util.h"
 
 namespace deepmind {
 namespace reverb {
 
-ChunkStore::Chunk::Chunk(ChunkData data) : data_(std::move(data)) {}
+ChunkStore::Chunk::Chunk(ChunkData data) : Chunk(std::move(data), nullptr) {}
+
+ChunkStore::Chunk::Chunk(std::shared_ptr<const ChunkData> data)
+    : Chunk(std::move(data), nullptr) {}
+
+ChunkStore::Chunk::Chunk(
+    ChunkData data, std::shared_ptr<internal::ChunkSpillState> spill_state)
+    : Chunk(std::make_shared<const ChunkData>(std::move(data)),
+            std::move(spill_state)) {}
+
+ChunkStore::Chunk::Chunk(
+    std::shared_ptr<const ChunkData> data,
+    std::shared_ptr<internal::ChunkSpillState> spill_state)
+    : key_(data->chunk_key()),
+      episode_id_(data->sequence_range().episode_id()),
+      num_rows_(data->sequence_range().end() -
+                data->sequence_range().start() + 1),
+      // If the field has not been populated then we use 1 to avoid potential
+      // zero division downstream.
+      uncompressed_data_size_(
+          std::max<size_t>(data->data_uncompressed_size(), 1)),
+      // The data of chunks with a spill state might not be resident when the
+      // number of columns is requested so it is always cached.
+      data_tensors_len_(data->data_tensors_len() != 0 || spill_state == nullptr
+                            ? data->data_tensors_len()
+                            : data->data().tensors_size()),
+      spill_state_(std::move(spill_state)),
+      data_(std::move(data)) {
+  if (spill_state_ != nullptr) {
+    // The size is needed for the accounting of the spill tier so compute it
+    // while the data is known to be resident.
+    DataByteSizeLong();
+  }
+}
+
+ChunkStore::Chunk::~Chunk() {
+  if (spill_state_ == nullptr) return;
+  absl::MutexLock lock(&mu_);
+  spill_state_->OnChunkDestroyed(data_ != nullptr ? DataByteSizeLong() : 0,
+                                 spill_offset_, spill_length_);
+}
+
+uint64_t ChunkStore::Chunk::key() const { return key_; }
+
+absl::StatusOr<std::shared_ptr<const ChunkData>> ChunkStore::Chunk::Pin()
+    const {
+  return PageIn(/*prefetch=*/false);
+}
+
+absl::StatusOr<std::shared_ptr<const ChunkData>> ChunkStore::Chunk::PageIn(
+    bool prefetch) const {
+  if (spill_state_ == nullptr) return unguarded_data();
+  referenced_.store(true, std::memory_order_relaxed);
+  {
+    absl::ReaderMutexLock lock(&mu_);
+    if (data_ != nullptr) return data_;
+  }
 
-uint64_t ChunkStore::Chunk::key() const { return data_.chunk_key(); }
+  const absl::Time start = absl::Now();
+  std::shared_ptr<const ChunkData> data;
+  {
+    absl::MutexLock lock(&mu_);
+    if (data_ != nullptr) return data_;
+    auto data_or = spill_state_->Read(spill_offset_, spill_length_);
+    if (!data_or.ok()) {
+      return absl::Status(data_or.status().code(),
+                          absl::StrCat("Unable to page in chunk ", key_, ": ",
+                                       data_or.status().message()));
+    }
+    data = data_ = std::move(data_or).value();
+  }
+  // Reported without holding `mu_` as the spill state acquires its own mutex
+  // before the one of the chunk.
+  spill_state_->OnPagedIn(DataByteSizeLong(), prefetch, absl::Now() - start);
+  return data;
+}
 
-const ChunkData& ChunkStore::Chunk::data() const { return data_; }
+absl::StatusOr<grpc::Slice> ChunkStore::Chunk::WireBytes() const {
+  {
+    absl::ReaderMutexLock lock(&mu_);
+    if (wire_bytes_.has_value()) return *wire_bytes_;
+  }
+  // The pin prevents the data from being evicted (which would release the
+  // cached bytes) until they have been stored.
+  REVERB_ASSIGN_OR_RETURN(std::shared_ptr<const ChunkData> data, Pin());
+  grpc::Slice bytes = SerializeToSlice(*data);
+  absl::MutexLock lock(&mu_);
+  if (!wire_bytes_.has_value()) {
+    wire_bytes_ = std::move(bytes);
+  }
+  return *wire_bytes_;
+}
+
+void ChunkStore::Chunk::Prefetch() const {
+  if (spill_state_ == nullptr) return;
+  referenced_.store(true, std::memory_order_relaxed);
+  if (resident()) return;
+  spill_state_->Prefetch(
+      std::const_pointer_cast<Chunk>(shared_from_this()));
+}
+
+void ChunkStore::Chunk::MarkCold() const {
+  if (spill_state_ == nullptr) return;
+  referenced_.store(false, std::memory_order_relaxed);
+  spill_state_->MarkCold(
+      std::const_pointer_cast<Chunk>(shared_from_this()));
+}
+
+bool ChunkStore::Chunk::resident() const {
+  absl::ReaderMutexLock lock(&mu_);
+  return data_ != nullptr;
+}
+
+bool ChunkStore::Chunk::evictable() const {
+  absl::ReaderMutexLock lock(&mu_);
+  // `data_` holds one reference so any other is held by a pin.
+  return data_ != nullptr && data_.use_count() == 1;
+}
+
+absl::StatusOr<size_t> ChunkStore::Chunk::Evict() {
+  absl::MutexLock lock(&mu_);
+  // `data_` holds one reference so any other is held by a pin.
+  if (data_ == nullptr || data_.use_count() > 1) return 0;
+  if (spill_offset_ < 0) {
+    REVERB_RETURN_IF_ERROR(
+        spill_state_->Write(*data_, &spill_offset_, &spill_length_));
+  }
+  data_ = nullptr;
+  wire_bytes_.reset();
+  return DataByteSizeLong();
+}
 
 size_t ChunkStore::Chunk::DataByteSizeLong() const {
-  absl::call_once(data_byte_size_once_,
-                  [this]() { data_byte_size_ = data_.ByteSizeLong(); });
+  // Chunks with a spill state compute the size in the constructor, while the
+  // data is known to be resident, so the data never has to be paged in here.
+  absl::call_once(data_byte_size_once_, [this]() {
+    data_byte_size_ = unguarded_data()->ByteSizeLong();
+  });
   return data_byte_size_;
 }
 
 size_t ChunkStore::Chunk::uncompressed_data_size() const {
-  // If the field has not been populated then we return 1 to avoid potential
-  // zero division downstream.
-  return std::max<size_t>(data_.data_uncompressed_size(), 1);
+  return uncompressed_data_size_;
 }
 
-uint64_t ChunkStore::Chunk::episode_id() const {
-  return data_.sequence_range().episode_id();
-}
+uint64_t ChunkStore::Chunk::episode_id() const { return episode_id_; }
 
-int32_t ChunkStore::Chunk::num_rows() const {
-  return data_.sequence_range().end() - data_.sequence_range().start() + 1;
-}
+int32_t ChunkStore::Chunk::num_rows() const { return num_rows_; }
 
 int ChunkStore::Chunk::num_columns() const {
   // Try to get number of columns without parsing lazy tensors field.
-  if (data_.data_tensors_len() != 0) {
-    return data_.data_tensors_len();
+  if (data_tensors_len_ != 0 || spill_state_ != nullptr) {
+    return data_tensors_len_;
   }
-  return data_.data().tensors_size();
+  return unguarded_data()->data().tensors_size();
 }
 
+ChunkStore::ChunkStore(std::shared_ptr<ChunkSpillTier> spill_tier)
+    : spill_tier_(std::move(spill_tier)) {}
+
 std::shared_ptr<ChunkStore::Chunk> ChunkStore::Insert(ChunkData item) {
   absl::WriterMutexLock lock(&mu_);
   std::weak_ptr<Chunk>& wp = data_[item.chunk_key()];
   std::shared_ptr<Chunk> sp = wp.lock();
   if (sp == nullptr) {
-    wp = (sp = std::make_shared<Chunk>(std::move(item)));
+    wp = (sp = spill_tier_ != nullptr
+                   ? spill_tier_->NewChunk(std::move(item))
+                   : std::make_shared<Chunk>(std::move(item)));
   }
   return sp;
 }
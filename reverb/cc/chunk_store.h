@@ -15,14 +15,19 @@
 #ifndef REVERB_CC_CHUNK_STORE_H_
 #define REVERB_CC_CHUNK_STORE_H_
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <utility>
 #include <vector>
 
+#include "grpcpp/support/slice.h"
 #include "absl/base/call_once.h"
 #include "absl/base/thread_annotations.h"
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/schema.pb.h"
@@ -30,6 +35,12 @@
 namespace deepmind {
 namespace reverb {
 
+class ChunkSpillTier;
+
+namespace internal {
+class ChunkSpillState;
+}  // namespace internal
+
 // Maintains a bijection from chunk keys to Chunks. For inserting, the caller
 // passes ChunkData which contains a chunk key and the actual data. We use the
 // key for the mapping and wrap the ChunkData with in a thin class which
@@ -65,29 +76,68 @@ namespace reverb {
 // Insert() returns a shared pointer, as otherwise the Chunk would be destroyed
 // right away.
 //
+// If the store is constructed with a `ChunkSpillTier` then the data of cold
+// chunks may be evicted to disk and transparently paged back in when accessed.
+// The metadata of a chunk (key, range, sizes) always remains in memory.
+//
 // All public methods are thread safe.
 class ChunkStore {
  public:
   using Key = uint64_t;
 
-  class Chunk {
+  class Chunk : public std::enable_shared_from_this<Chunk> {
    public:
     explicit Chunk(ChunkData data);
 
+    // Constructs a chunk which shares ownership of `data`. Used by
+    // `ChunkDeduplicator` to let chunks with identical payloads alias it.
+    explicit Chunk(std::shared_ptr<const ChunkData> data);
+
+    // Constructs a chunk whose data may be evicted to the log of
+    // `spill_state`. Use `ChunkSpillTier::NewChunk` rather than calling this
+    // directly.
+    Chunk(ChunkData data,
+          std::shared_ptr<internal::ChunkSpillState> spill_state);
+
+    Chunk(std::shared_ptr<const ChunkData> data,
+          std::shared_ptr<internal::ChunkSpillState> spill_state);
+
+    ~Chunk();
+
     // Unique identifier of the chunk.
     uint64_t key() const;
 
-    // Returns the proto data of the chunk.
-    const ChunkData& data() const;
+    // Returns the proto data of the chunk, paging it in if it has been spilled.
+    // The data is not evicted while the returned pointer is alive. Fails if
+    // the data could not be read back from the spill log.
+    absl::StatusOr<std::shared_ptr<const ChunkData>> Pin() const;
+
+    // Returns the data serialized as it is sent to clients. The bytes are
+    // serialized on the first call and cached, so responses to later samples
+    // can reference them without serializing or copying the data again. With a
+    // spill tier the cached bytes are released when the data is evicted.
+    absl::StatusOr<grpc::Slice> WireBytes() const;
+
+    // Hints to the spill tier that the data is about to be accessed and should
+    // be paged in asynchronously. Noop if the chunk has no spill tier.
+    void Prefetch() const;
+
+    // Hints to the spill tier that the data is unlikely to be accessed soon and
+    // should be evicted before chunks which have been accessed recently. Noop
+    // if the chunk has no spill tier.
+    void MarkCold() const;
+
+    // Whether the data is currently held in memory.
+    bool resident() const;
 
     // (Potentially cached) size of `data`.
     size_t DataByteSizeLong() const;
 
     // Size (bytes) of the tensors before compression. Alias for
-    // `data().data_uncompressed_size()`.
+    // `data_uncompressed_size()` of the data.
     size_t uncompressed_data_size() const;
 
-    // Alias for `data().sequence_range().episode_id()`.
+    // Alias for `sequence_range().episode_id()` of the data.
     uint64_t episode_id() const;
 
     // The number of tensors batched together in each column. Note that all
@@ -98,11 +148,58 @@ class ChunkStore {
     int num_columns() const;
 
    private:
-    ChunkData data_;
+    friend class internal::ChunkSpillState;
+
+    // Writes the data to the spill log (unless it has been written before) and
+    // releases the in memory copy. Returns the number of bytes released, which
+    // is 0 if the data is pinned or is not resident.
+    absl::StatusOr<size_t> Evict();
+
+    // Returns `data_` without locking. Only safe without a spill state, as
+    // `data_` is then never reset, or while the chunk is being constructed.
+    const std::shared_ptr<const ChunkData>& unguarded_data() const
+        ABSL_NO_THREAD_SAFETY_ANALYSIS {
+      return data_;
+    }
+
+    // Whether the data is resident and not pinned.
+    bool evictable() const;
+
+    // Implementation of `Pin`. Page-ins triggered by prefetching are not
+    // counted as faults.
+    absl::StatusOr<std::shared_ptr<const ChunkData>> PageIn(
+        bool prefetch) const;
+
+    // Metadata is cached so that it can be read without paging in the data.
+    const uint64_t key_;
+    const uint64_t episode_id_;
+    const int32_t num_rows_;
+    const size_t uncompressed_data_size_;
+    const int data_tensors_len_;
+    const std::shared_ptr<internal::ChunkSpillState> spill_state_;
+
+    mutable absl::Mutex mu_;
+    // Null while the data is spilled. Without a spill state it is never reset.
+    mutable std::shared_ptr<const ChunkData> data_ ABSL_GUARDED_BY(mu_);
+    // Location of the data in the spill log or -1 if it hasn't been written.
+    int64_t spill_offset_ ABSL_GUARDED_BY(mu_) = -1;
+    int64_t spill_length_ ABSL_GUARDED_BY(mu_) = 0;
+    // Serialized `data_`, populated by the first call to `WireBytes`.
+    mutable absl::optional<grpc::Slice> wire_bytes_ ABSL_GUARDED_BY(mu_);
+
+    // Set when the data is accessed and cleared by the eviction sweep of the
+    // spill tier (CLOCK).
+    mutable std::atomic<bool> referenced_{true};
+
     mutable size_t data_byte_size_;
     mutable absl::once_flag data_byte_size_once_;
   };
 
+  ChunkStore() = default;
+
+  // Chunks inserted into the store are registered with `spill_tier`.
+  explicit ChunkStore(std::shared_ptr<ChunkSpillTier> spill_tier);
+
   // Attempts to insert a Chunk into the map using the key inside `item`. If no
   // entry existed for the key, a new Chunk is created, inserted and returned.
   // Otherwise, the existing chunk is returned.
@@ -126,6 +223,9 @@ class ChunkStore {
 
   // Mutex protecting access to `data_`.
   mutable absl::Mutex mu_;
+
+  // Optional tier which chunks are registered with on insertion.
+  const std::shared_ptr<ChunkSpillTier> spill_tier_;
 };
 
 }  // namespace reverb
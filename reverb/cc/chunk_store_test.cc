@@ -144,6 +144,18 @@ TEST(ChunkTest, UncompressedDataSize_ReturnsValueIfDefined) {
   EXPECT_EQ(ChunkStore::Chunk(data).uncompressed_data_size(), 1337);
 }
 
+TEST(ChunkTest, WireBytesAreCachedSerializedData) {
+  ChunkData data = testing::MakeChunkData(3);
+  ChunkStore::Chunk chunk(data);
+  grpc::Slice first = chunk.WireBytes().value();
+  grpc::Slice second = chunk.WireBytes().value();
+  EXPECT_EQ(first.begin(), second.begin());
+
+  ChunkData parsed;
+  ASSERT_TRUE(parsed.ParseFromArray(first.begin(), first.size()));
+  EXPECT_THAT(parsed, testing::EqualsProto(data));
+}
+
 }  // namespace
 }  // namespace reverb
 }  // namespace deepmind
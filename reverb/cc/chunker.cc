@@ -15,6 +15,7 @@
 #include "reverb/cc/chunker.h"
 
 #include <algorithm>
+#include <functional>
 #include <limits>
 #include <memory>
 #include <numeric>
@@ -100,9 +101,18 @@ absl::Status CellRef::GetSpec(internal::TensorSpec* spec) const {
 
 Chunker::Chunker(internal::TensorSpec spec,
                  std::shared_ptr<ChunkerOptions> options)
+    : Chunker(std::move(spec), std::move(options),
+              /*compression_pool=*/nullptr, /*on_chunk_finalized=*/nullptr) {}
+
+Chunker::Chunker(internal::TensorSpec spec,
+                 std::shared_ptr<ChunkerOptions> options,
+                 std::shared_ptr<ChunkCompressionPool> compression_pool,
+                 std::function<void()> on_chunk_finalized)
     : spec_(std::move(spec)),
       options_(std::move(options)),
-      key_generator_(std::make_unique<internal::UniformKeyGenerator>()) {
+      key_generator_(std::make_unique<internal::UniformKeyGenerator>()),
+      compression_pool_(std::move(compression_pool)),
+      on_chunk_finalized_(std::move(on_chunk_finalized)) {
   if (!options_->GetCompressionDisabled()){
     REVERB_CHECK_GE(options_->GetNumKeepAliveRefs(),
                     options_->GetMaxChunkLength());
@@ -110,6 +120,11 @@ Chunker::Chunker(internal::TensorSpec spec,
   Reset();
 }
 
+Chunker::~Chunker() {
+  // Tasks scheduled on the pool hold a raw pointer to the chunker.
+  WaitForPendingChunks();
+}
+
 absl::Status Chunker::Append(const tensorflow::Tensor& tensor,
                              const CellRef::EpisodeInfo& episode_info,
                              std::weak_ptr<CellRef>* ref) {
@@ -130,6 +145,7 @@ absl::Status Chunker::Append(const tensorflow::Tensor& tensor,
   }
 
   absl::MutexLock lock(&mu_);
+  REVERB_RETURN_IF_ERROR(background_status_);
 
   if (!buffer_.empty() &&
       active_refs_.back()->episode_id() != episode_info.episode_id) {
@@ -157,10 +173,13 @@ absl::Status Chunker::Append(const tensorflow::Tensor& tensor,
   // `item`.
   tensorflow::Tensor batched_tensor(tensor.dtype(), shape);
   REVERB_CHECK(batched_tensor.CopyFrom(tensor, shape));
+  buffer_bytes_ += batched_tensor.TotalBytes();
   buffer_.push_back(std::move(batched_tensor));
 
   // Create the chunk if max buffer size reached.
-  if (buffer_.size() >= options_->GetMaxChunkLength()) {
+  const int64_t max_chunk_bytes = options_->GetMaxChunkBytes();
+  if (buffer_.size() >= options_->GetMaxChunkLength() ||
+      (max_chunk_bytes > 0 && buffer_bytes_ >= max_chunk_bytes)) {
     REVERB_RETURN_IF_ERROR(FlushLocked());
   }
 
@@ -236,9 +255,18 @@ std::vector<uint64_t> Chunker::GetKeepKeys() const {
 
 absl::Status Chunker::Flush() {
   absl::MutexLock lock(&mu_);
+  REVERB_RETURN_IF_ERROR(background_status_);
   return FlushLocked();
 }
 
+void Chunker::WaitForPendingChunks() {
+  absl::MutexLock lock(&mu_);
+  auto done = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return pending_chunk_keys_.empty();
+  };
+  mu_.Await(absl::Condition(&done));
+}
+
 absl::Status Chunker::FlushLocked() {
   if (options_->GetCompressionDisabled()) {
     return absl::FailedPreconditionError(
@@ -248,30 +276,78 @@ absl::Status Chunker::FlushLocked() {
     return absl::OkStatus();
   }
 
+  auto pending = std::make_unique<PendingChunk>();
+  pending->key = next_chunk_key_;
+  pending->buffer = std::move(buffer_);
+  pending->delta_encode = options_->GetDeltaEncode();
+  pending->compression_codec = options_->GetCompressionCodec();
+  for (const auto& ref : active_refs_) {
+    if (ref->chunk_key() == next_chunk_key_) {
+      pending->refs.push_back(ref);
+    }
+  }
+
+  buffer_.clear();
+  buffer_.reserve(options_->GetMaxChunkLength());
+  buffer_bytes_ = 0;
+  next_chunk_key_ = key_generator_->Generate();
+  offset_ = 0;
+
+  // If the pool is saturated then the chunk is finalized on this thread, which
+  // throttles the producer to the rate at which the pool keeps up.
+  if (compression_pool_ == nullptr || !compression_pool_->TryReserve()) {
+    REVERB_RETURN_IF_ERROR(FinalizeChunk(pending.get()));
+    RecordChunkLocked(*pending->chunk->get());
+    return absl::OkStatus();
+  }
+
+  pending_chunk_keys_.insert(pending->key);
+  compression_pool_->Schedule([this, pending = std::move(pending)] {
+    absl::Status status = FinalizeChunk(pending.get());
+    if (on_chunk_finalized_) {
+      on_chunk_finalized_();
+    }
+
+    absl::MutexLock lock(&mu_);
+    pending_chunk_keys_.erase(pending->key);
+    if (status.ok()) {
+      RecordChunkLocked(*pending->chunk->get());
+    } else if (background_status_.ok()) {
+      background_status_ = std::move(status);
+    }
+  });
+
+  return absl::OkStatus();
+}
+
+absl::Status Chunker::FinalizeChunk(PendingChunk* pending) {
   auto chunk = std::make_unique<ChunkData>();
-  chunk->set_chunk_key(next_chunk_key_);
+  chunk->set_chunk_key(pending->key);
 
   tensorflow::Tensor batched;
-  REVERB_RETURN_IF_ERROR(
-      FromTensorflowStatus(tensorflow::tensor::Concat(buffer_, &batched)));
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+      tensorflow::tensor::Concat(pending->buffer, &batched)));
 
   // Save the size of the tensor before compression is applied.
   chunk->set_data_uncompressed_size(batched.TotalBytes());
 
-  if (options_->GetDeltaEncode()) {
-    batched = DeltaEncode(batched, /*encode=*/true);
+  if (pending->delta_encode) {
+    // `batched` owns the buffer allocated by `Concat` so it can be encoded
+    // without allocating another tensor of the same size.
+    DeltaEncodeInPlace(&batched, /*encode=*/true);
     chunk->set_delta_encoded(true);
   }
 
-  CompressTensorAsProto(batched, chunk->mutable_data()->add_tensors());
+  // The codec falls back to `COMPRESSION_CODEC_NONE` if it fails so the one
+  // actually used must be recorded.
+  chunk->set_compression_codec(
+      CompressTensorAsProto(batched, chunk->mutable_data()->add_tensors(),
+                            pending->compression_codec));
   chunk->set_data_tensors_len(chunk->data().tensors_size());
 
   // Set the sequence range of the chunk.
-  for (const auto& ref : active_refs_) {
-    // active_refs_ is sorted by insertion time. Iterate over the list until
-    // the first cell belonging to the newly created chunk is found.
-    if (ref->chunk_key() != chunk->chunk_key()) continue;
-
+  for (const auto& ref : pending->refs) {
+    // The refs are sorted by insertion time.
     if (!chunk->has_sequence_range()) {
       // On the first ref belonging to this chunk, set the the episode ID and
       // set the episode length to 1 (i.e. start == end). The episode length
@@ -284,8 +360,8 @@ absl::Status Chunker::FlushLocked() {
       SequenceRange* range = chunk->mutable_sequence_range();
 
       // Sanity check: The ref belongs to this episode (and chunk) and the ref's
-      // step counter is monotonically increasing (i.e. active_refs_ is sorted
-      // by insertion time).
+      // step counter is monotonically increasing (i.e. the refs are sorted by
+      // insertion time).
       if (range->episode_id() != ref->episode_id() ||
           range->end() >= ref->episode_step()) {
         return absl::InternalError(absl::StrFormat(
@@ -312,22 +388,31 @@ absl::Status Chunker::FlushLocked() {
 
   // Now the chunk has been finalized we can notify the `CellRef`s.
   auto chunk_container = std::make_shared<ChunkDataContainer>(std::move(chunk));
-  for (std::shared_ptr<CellRef>& ref : active_refs_) {
-    if (ref->chunk_key() == chunk_container->chunk->chunk_key()) {
-      ref->SetChunk(chunk_container);
-    }
+  for (std::shared_ptr<CellRef>& ref : pending->refs) {
+    ref->SetChunk(chunk_container);
   }
-
-  buffer_.clear();
-  next_chunk_key_ = key_generator_->Generate();
-  offset_ = 0;
+  pending->chunk = std::move(chunk_container);
 
   return absl::OkStatus();
 }
 
+void Chunker::RecordChunkLocked(const ChunkData& chunk) {
+  statistics_.num_chunks++;
+  statistics_.num_rows += GetLength(chunk);
+  statistics_.uncompressed_bytes += chunk.data_uncompressed_size();
+  statistics_.compressed_bytes += chunk.ByteSizeLong();
+  options_->OnChunkFinalized(chunk);
+}
+
+ChunkStatistics Chunker::GetStatistics() const {
+  absl::MutexLock lock(&mu_);
+  return statistics_;
+}
+
 void Chunker::Reset() {
   absl::MutexLock lock(&mu_);
   buffer_.clear();
+  buffer_bytes_ = 0;
   if (!options_->GetCompressionDisabled()){
     buffer_.reserve(options_->GetMaxChunkLength());
   }
@@ -364,6 +449,13 @@ absl::Status Chunker::CopyDataForCell(const CellRef* ref,
   }
   absl::MutexLock lock(&mu_);
 
+  // If the chunk is being finalized in the background then the data is no
+  // longer in the buffer so we wait for the chunk instead.
+  auto not_pending = [this, ref]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return !pending_chunk_keys_.contains(ref->chunk_key());
+  };
+  mu_.Await(absl::Condition(&not_pending));
+
   // If the chunk has been finalized then we unpack it and slice out the data.
   if (ref->IsReady()) {
     tensorflow::Tensor column;
@@ -457,15 +549,21 @@ absl::Status ValidateChunkerOptions(const ChunkerOptions* options) {
         "num_keep_alive_refs (", options->GetNumKeepAliveRefs(),
         ") must be >= max_chunk_length (", options->GetMaxChunkLength(), ")."));
   }
+  if (!CompressionCodec_IsValid(options->GetCompressionCodec())) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unknown compression_codec ",
+                     static_cast<int>(options->GetCompressionCodec()), "."));
+  }
   return absl::OkStatus();
 }
 
-ConstantChunkerOptions::ConstantChunkerOptions(int max_chunk_length,
-                                               int num_keep_alive_refs,
-                                               bool delta_encode)
+ConstantChunkerOptions::ConstantChunkerOptions(
+    int max_chunk_length, int num_keep_alive_refs, bool delta_encode,
+    CompressionCodec compression_codec)
     : max_chunk_length_(max_chunk_length),
       num_keep_alive_refs_(num_keep_alive_refs),
-      delta_encode_(delta_encode) {}
+      delta_encode_(delta_encode),
+      compression_codec_(compression_codec) {}
 
 int ConstantChunkerOptions::GetMaxChunkLength() const {
   return max_chunk_length_;
@@ -479,6 +577,10 @@ bool ConstantChunkerOptions::GetDeltaEncode() const { return delta_encode_; }
 
 bool ConstantChunkerOptions::GetCompressionDisabled() const { return false; }
 
+CompressionCodec ConstantChunkerOptions::GetCompressionCodec() const {
+  return compression_codec_;
+}
+
 absl::Status ConstantChunkerOptions::OnItemFinalized(
     const PrioritizedItem& item,
     absl::Span<const std::shared_ptr<CellRef>> refs) {
@@ -486,15 +588,81 @@ absl::Status ConstantChunkerOptions::OnItemFinalized(
 }
 
 std::shared_ptr<ChunkerOptions> ConstantChunkerOptions::Clone() const {
-  return std::make_shared<ConstantChunkerOptions>(max_chunk_length_,
-                                                  num_keep_alive_refs_);
+  return std::make_shared<ConstantChunkerOptions>(
+      max_chunk_length_, num_keep_alive_refs_, delta_encode_,
+      compression_codec_);
+}
+
+ByteBudgetChunkerOptions::ByteBudgetChunkerOptions(
+    int64_t target_chunk_bytes, int num_keep_alive_refs,
+    bool target_compressed_bytes, bool delta_encode,
+    CompressionCodec compression_codec)
+    : target_chunk_bytes_(target_chunk_bytes),
+      num_keep_alive_refs_(num_keep_alive_refs),
+      target_compressed_bytes_(target_compressed_bytes),
+      delta_encode_(delta_encode),
+      compression_codec_(compression_codec) {}
+
+int ByteBudgetChunkerOptions::GetMaxChunkLength() const {
+  return num_keep_alive_refs_;
+}
+
+int64_t ByteBudgetChunkerOptions::GetMaxChunkBytes() const {
+  if (!target_compressed_bytes_) {
+    return target_chunk_bytes_;
+  }
+  return static_cast<int64_t>(target_chunk_bytes_ / compression_ratio());
+}
+
+int ByteBudgetChunkerOptions::GetNumKeepAliveRefs() const {
+  return num_keep_alive_refs_;
+}
+
+bool ByteBudgetChunkerOptions::GetDeltaEncode() const { return delta_encode_; }
+
+bool ByteBudgetChunkerOptions::GetCompressionDisabled() const { return false; }
+
+CompressionCodec ByteBudgetChunkerOptions::GetCompressionCodec() const {
+  return compression_codec_;
+}
+
+absl::Status ByteBudgetChunkerOptions::OnItemFinalized(
+    const PrioritizedItem& item,
+    absl::Span<const std::shared_ptr<CellRef>> refs) {
+  return absl::OkStatus();
 }
 
-AutoTunedChunkerOptions::AutoTunedChunkerOptions(int num_keep_alive_refs,
-                                                 double throughput_weight,
-                                                 bool delta_encode)
+void ByteBudgetChunkerOptions::OnChunkFinalized(const ChunkData& chunk) {
+  if (chunk.data_uncompressed_size() <= 0) return;
+
+  const double ratio = std::max(
+      kMinCompressionRatio, static_cast<double>(chunk.ByteSizeLong()) /
+                                chunk.data_uncompressed_size());
+  absl::MutexLock lock(&mu_);
+  compression_ratio_ +=
+      kCompressionRatioSmoothing * (ratio - compression_ratio_);
+}
+
+std::shared_ptr<ChunkerOptions> ByteBudgetChunkerOptions::Clone() const {
+  auto clone = std::make_shared<ByteBudgetChunkerOptions>(
+      target_chunk_bytes_, num_keep_alive_refs_, target_compressed_bytes_,
+      delta_encode_, compression_codec_);
+  absl::MutexLock lock(&clone->mu_);
+  clone->compression_ratio_ = compression_ratio();
+  return clone;
+}
+
+double ByteBudgetChunkerOptions::compression_ratio() const {
+  absl::MutexLock lock(&mu_);
+  return compression_ratio_;
+}
+
+AutoTunedChunkerOptions::AutoTunedChunkerOptions(
+    int num_keep_alive_refs, double throughput_weight, bool delta_encode,
+    CompressionCodec compression_codec)
     : num_keep_alive_refs_(num_keep_alive_refs),
       delta_encode_(delta_encode),
+      compression_codec_(compression_codec),
       throughput_weight_(throughput_weight),
       max_chunk_length_(1),
       prev_score_(Score{-1, -1}) {}
@@ -510,6 +678,9 @@ int AutoTunedChunkerOptions::GetNumKeepAliveRefs() const {
 
 bool AutoTunedChunkerOptions::GetDeltaEncode() const { return delta_encode_; }
 bool AutoTunedChunkerOptions::GetCompressionDisabled() const { return false; }
+CompressionCodec AutoTunedChunkerOptions::GetCompressionCodec() const {
+  return compression_codec_;
+}
 
 void AutoTunedChunkerOptions::PushItem(
     absl::Span<const std::shared_ptr<CellRef>> refs) {
@@ -656,8 +827,9 @@ void AutoTunedChunkerOptions::PushChunks(
 }
 
 std::shared_ptr<ChunkerOptions> AutoTunedChunkerOptions::Clone() const {
-  return std::make_shared<AutoTunedChunkerOptions>(num_keep_alive_refs_,
-                                                   throughput_weight_);
+  return std::make_shared<AutoTunedChunkerOptions>(
+      num_keep_alive_refs_, throughput_weight_, delta_encode_,
+      compression_codec_);
 }
 
 NeverCompressChunkerOptions::NeverCompressChunkerOptions(
@@ -678,6 +850,9 @@ bool NeverCompressChunkerOptions::GetDeltaEncode() const { return false; }
 bool NeverCompressChunkerOptions::GetCompressionDisabled() const {
   return true;
 }
+CompressionCodec NeverCompressChunkerOptions::GetCompressionCodec() const {
+  return CompressionCodec::COMPRESSION_CODEC_NONE;
+}
 
 absl::Status NeverCompressChunkerOptions::OnItemFinalized(
     const PrioritizedItem& item,
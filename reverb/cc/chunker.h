@@ -16,6 +16,7 @@
 #define REVERB_CC_CHUNKER_H_
 
 #include <deque>
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -24,7 +25,9 @@
 #include "absl/synchronization/mutex.h"
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
+#include "reverb/cc/chunk_compression_pool.h"
 #include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/platform/hash_set.h"
 #include "reverb/cc/platform/logging.h"
 #include "reverb/cc/schema.pb.h"
 #include "reverb/cc/support/key_generators.h"
@@ -149,26 +152,60 @@ class CellRef {
   std::shared_ptr<ChunkDataContainer> chunk_ ABSL_GUARDED_BY(mu_);
 };
 
-// Checks that `max_chunk_length` and `num_keep_alive_refs` is a valid `Chunker`
-// configuration and returns `InvalidArgumentError` if it isn't.
+// Checks that `max_chunk_length`, `num_keep_alive_refs` and `compression_codec`
+// is a valid `Chunker` configuration and returns `InvalidArgumentError` if it
+// isn't.
 absl::Status ValidateChunkerOptions(const ChunkerOptions* options);
 
+// Totals over the chunks created by a `Chunker`.
+struct ChunkStatistics {
+  // Number of chunks created.
+  int64_t num_chunks = 0;
+
+  // Total number of rows in the chunks.
+  int64_t num_rows = 0;
+
+  // Total size of the data in the chunks before compression.
+  int64_t uncompressed_bytes = 0;
+
+  // Total size of the serialized (compressed) chunks.
+  int64_t compressed_bytes = 0;
+};
+
 class Chunker : public std::enable_shared_from_this<Chunker> {
  public:
   Chunker(internal::TensorSpec spec, std::shared_ptr<ChunkerOptions> options);
 
+  // If `compression_pool` is set then chunks are encoded and compressed on the
+  // pool (unless it is full) and `on_chunk_finalized` (if set) is called on
+  // the pool thread after the `CellRef`s of such a chunk have been notified.
+  // `on_chunk_finalized` must not call back into the `Chunker`.
+  Chunker(internal::TensorSpec spec, std::shared_ptr<ChunkerOptions> options,
+          std::shared_ptr<ChunkCompressionPool> compression_pool,
+          std::function<void()> on_chunk_finalized);
+
+  // Blocks until the chunks handed to the compression pool have been
+  // finalized.
+  ~Chunker();
+
   // Validates `tensor` against `spec_` and `episode_info` against previous
   // calls, appends it to the active chunk and returns a reference to the new
   // row. If the active chunk now has `max_chunk_length` rows then it is
-  // finalized and its `CellRef`s notified (including `ref`).
+  // finalized and its `CellRef`s notified (including `ref`). With a
+  // compression pool the chunk is finalized in the background instead.
   absl::Status Append(const tensorflow::Tensor& tensor,
                       const CellRef::EpisodeInfo& episode_info,
                       std::weak_ptr<CellRef>* ref) ABSL_LOCKS_EXCLUDED(mu_);
 
   // Creates a chunk from the data in the buffer and calls `SetChunk` on its
-  // `CellRef`s.
+  // `CellRef`s. With a compression pool the chunk is created in the
+  // background so the `CellRef`s may not be ready when this returns.
   absl::Status Flush() ABSL_LOCKS_EXCLUDED(mu_);
 
+  // Blocks until all chunks which are finalized in the background have been
+  // created and their `CellRef`s notified.
+  void WaitForPendingChunks() ABSL_LOCKS_EXCLUDED(mu_);
+
   // Clears buffers of both references and data not yet committed to a Chunk.
   void Reset();
 
@@ -197,12 +234,18 @@ class Chunker : public std::enable_shared_from_this<Chunker> {
       const PrioritizedItem& item,
       absl::Span<const std::shared_ptr<CellRef>> child_refs);
 
+  // Returns the totals over all chunks created so far. Chunks which are still
+  // being finalized on the compression pool are not included.
+  ChunkStatistics GetStatistics() const ABSL_LOCKS_EXCLUDED(mu_);
+
  private:
   friend CellRef;
 
   // Get the data for referenced by `ref`. If the data has been finalized into
   // a ChunkData then the chunk is unpacked and the row extracted. If the
-  // chunk has not been finalized the data is copied from `buffer_`.
+  // chunk has not been finalized the data is copied from `buffer_`. If the
+  // chunk is being finalized on the compression pool then this blocks until
+  // it is done.
   absl::Status CopyDataForCell(const CellRef* ref,
                                tensorflow::Tensor* out) const;
 
@@ -218,8 +261,27 @@ class Chunker : public std::enable_shared_from_this<Chunker> {
                                            tensorflow::Tensor* out) const
       ABSL_LOCKS_EXCLUDED(mu_);
 
+  // Data and references of a chunk which is being finalized.
+  struct PendingChunk {
+    uint64_t key;
+    std::vector<tensorflow::Tensor> buffer;
+    std::vector<std::shared_ptr<CellRef>> refs;
+    bool delta_encode;
+    CompressionCodec compression_codec;
+    // Set by `FinalizeChunk`.
+    std::shared_ptr<ChunkDataContainer> chunk;
+  };
+
   absl::Status FlushLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
+  // Encodes and compresses the buffered data into a `ChunkData` and calls
+  // `SetChunk` on the `CellRef`s of the chunk.
+  static absl::Status FinalizeChunk(PendingChunk* pending);
+
+  // Adds `chunk` to `statistics_` and forwards it to `options_`.
+  void RecordChunkLocked(const ChunkData& chunk)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
   // Spec which all data in `Append` must follow.
   internal::TensorSpec spec_;
 
@@ -232,6 +294,9 @@ class Chunker : public std::enable_shared_from_this<Chunker> {
   // Data waiting for the next chunk to be constructed.
   std::vector<tensorflow::Tensor> buffer_ ABSL_GUARDED_BY(mu_);
 
+  // Total size of the tensors in `buffer_`.
+  int64_t buffer_bytes_ ABSL_GUARDED_BY(mu_);
+
   // If compression is disabled, we accumulate the data in a queue. Since chunks
   // are never constructed, data is always fetched from the queue in `GetData`.
   // To avoid growing the queue indefinitely, on `AppendInternal` we remove the
@@ -251,6 +316,23 @@ class Chunker : public std::enable_shared_from_this<Chunker> {
   // When the size exceeds `num_keep_alive_refs_` then the oldest item is
   // removed.
   std::deque<std::shared_ptr<CellRef>> active_refs_ ABSL_GUARDED_BY(mu_);
+
+  // Pool which full chunks are finalized on. Null if chunks are finalized by
+  // the thread which calls `Append` or `Flush`.
+  const std::shared_ptr<ChunkCompressionPool> compression_pool_;
+
+  // Called after a chunk has been finalized on `compression_pool_`.
+  const std::function<void()> on_chunk_finalized_;
+
+  // Keys of the chunks which are being finalized on `compression_pool_`.
+  internal::flat_hash_set<uint64_t> pending_chunk_keys_ ABSL_GUARDED_BY(mu_);
+
+  // First error encountered while finalizing a chunk on `compression_pool_`.
+  // Returned by all subsequent calls to `Append` and `Flush`.
+  absl::Status background_status_ ABSL_GUARDED_BY(mu_);
+
+  // Totals over the chunks created so far.
+  ChunkStatistics statistics_ ABSL_GUARDED_BY(mu_);
 };
 
 class ChunkerOptions {
@@ -263,6 +345,13 @@ class ChunkerOptions {
   // automatically called.
   virtual int GetMaxChunkLength() const = 0;
 
+  // Get current recommendation of the maximum (uncompressed) size of a chunk.
+  //
+  // Once the tensors in the buffer hold at least this many bytes then `Flush`
+  // is automatically called, even if the buffer holds less than
+  // `max_chunk_length` items. Values <= 0 (the default) disable the limit.
+  virtual int64_t GetMaxChunkBytes() const { return 0; }
+
   // Get current recommendation of `num_keep_alive_refs`.
   //
   // `num_keep_alive_refs` is the size of the buffer holding `CellRef` of the
@@ -276,6 +365,10 @@ class ChunkerOptions {
   // Whether to disable chunk compression.
   virtual bool GetCompressionDisabled() const = 0;
 
+  // Get the codec used to compress the data of new chunks. Unused when
+  // `GetCompressionDisabled` returns true.
+  virtual CompressionCodec GetCompressionCodec() const = 0;
+
   // Called by parent `Chunker` once an item is ready to be sent to the
   // server.
   //
@@ -294,6 +387,10 @@ class ChunkerOptions {
       const PrioritizedItem& item,
       absl::Span<const std::shared_ptr<CellRef>> refs) = 0;
 
+  // Called by parent `Chunker` every time it has created a chunk, regardless
+  // of whether the chunk is referenced by an item. The default is a noop.
+  virtual void OnChunkFinalized(const ChunkData& chunk) {}
+
   // Make a copy of this `ChunkerOptions` and state. This allows a particular
   // implementation
   // to be used as a template for all (or some) of the `Chunker`s owned by a
@@ -305,8 +402,10 @@ class ChunkerOptions {
 // `OnItemFinalized` is a noop.
 class ConstantChunkerOptions : public ChunkerOptions {
  public:
-  ConstantChunkerOptions(int max_chunk_length, int num_keep_alive_refs,
-                         bool delta_encode = false);
+  ConstantChunkerOptions(
+      int max_chunk_length, int num_keep_alive_refs, bool delta_encode = false,
+      CompressionCodec compression_codec =
+          CompressionCodec::COMPRESSION_CODEC_SNAPPY);
 
   int GetMaxChunkLength() const override;
 
@@ -316,6 +415,8 @@ class ConstantChunkerOptions : public ChunkerOptions {
 
   bool GetCompressionDisabled() const override;
 
+  CompressionCodec GetCompressionCodec() const override;
+
   absl::Status OnItemFinalized(
       const PrioritizedItem& item,
       absl::Span<const std::shared_ptr<CellRef>> refs) override;
@@ -326,6 +427,7 @@ class ConstantChunkerOptions : public ChunkerOptions {
   int max_chunk_length_;
   int num_keep_alive_refs_;
   bool delta_encode_;
+  CompressionCodec compression_codec_;
 };
 
 // Automatically tunes the `max_chunk_length` value within the range [1,
@@ -372,9 +474,11 @@ class AutoTunedChunkerOptions : public ChunkerOptions {
   static constexpr double kMaxChunkLengthError = 0.25;
 
   // TODO(b/180278134): Remove delta_encode argument once it is auto selected.
-  explicit AutoTunedChunkerOptions(int num_keep_alive_ref,
-                                   double throughput_weight = 1.0,
-                                   bool delta_encode = false);
+  explicit AutoTunedChunkerOptions(
+      int num_keep_alive_ref, double throughput_weight = 1.0,
+      bool delta_encode = false,
+      CompressionCodec compression_codec =
+          CompressionCodec::COMPRESSION_CODEC_SNAPPY);
 
   // Returns the recommendation of the maximum chunk length.
   int GetMaxChunkLength() const override;
@@ -387,6 +491,9 @@ class AutoTunedChunkerOptions : public ChunkerOptions {
 
   bool GetCompressionDisabled() const override;
 
+  // Returns the (constant) compression codec.
+  CompressionCodec GetCompressionCodec() const override;
+
   // Calculates performance statistics for the item and the chunks it
   // reference and uses thse to (potentially) update the result of
   // `GetMaxChunkLength`.
@@ -419,6 +526,9 @@ class AutoTunedChunkerOptions : public ChunkerOptions {
   // Whethr delta encoding should be used. This value is NOT tuned.
   bool delta_encode_;
 
+  // Codec used to compress chunks. This value is NOT tuned.
+  CompressionCodec compression_codec_;
+
   // Weight to multiply the score contribution from `items_` with. A higher
   // value results in more emphasise on the amount of data sent per item (i.e
   // sample speed) and lower values results in lower memory usage on the server
@@ -462,6 +572,73 @@ class AutoTunedChunkerOptions : public ChunkerOptions {
   std::deque<Statistic> chunks_ ABSL_GUARDED_BY(mu_);
 };
 
+// Closes chunks once the buffered rows reach a target size in bytes rather
+// than a fixed number of rows, so columns with small rows get long chunks and
+// columns with large rows get short ones.
+//
+// If `target_compressed_bytes` is false then `target_chunk_bytes` is the
+// maximum size of the chunk data before compression. If true then it is a
+// target for the size after compression: the uncompressed limit is derived
+// from the compression ratio observed in the chunks created so far (starting
+// at 1, i.e no compression), so chunks of data that compresses well grow
+// accordingly.
+//
+// Chunks never exceed `num_keep_alive_refs` rows, as rows of a chunk must stay
+// referenceable until the chunk is complete, nor have less than one row.
+class ByteBudgetChunkerOptions : public ChunkerOptions {
+ public:
+  // Weight of the most recent chunk in the moving average of the compression
+  // ratio.
+  static constexpr double kCompressionRatioSmoothing = 0.25;
+
+  // Lower bound of the compression ratio (compressed / uncompressed bytes)
+  // used to derive the uncompressed limit.
+  static constexpr double kMinCompressionRatio = 0.01;
+
+  ByteBudgetChunkerOptions(
+      int64_t target_chunk_bytes, int num_keep_alive_refs,
+      bool target_compressed_bytes = false, bool delta_encode = false,
+      CompressionCodec compression_codec =
+          CompressionCodec::COMPRESSION_CODEC_SNAPPY);
+
+  // Returns `num_keep_alive_refs`. Chunks are normally closed by the size
+  // limit before reaching it.
+  int GetMaxChunkLength() const override;
+
+  // Returns the (uncompressed) size limit derived from `target_chunk_bytes`.
+  int64_t GetMaxChunkBytes() const override;
+
+  int GetNumKeepAliveRefs() const override;
+
+  bool GetDeltaEncode() const override;
+
+  bool GetCompressionDisabled() const override;
+
+  CompressionCodec GetCompressionCodec() const override;
+
+  absl::Status OnItemFinalized(
+      const PrioritizedItem& item,
+      absl::Span<const std::shared_ptr<CellRef>> refs) override;
+
+  // Updates the observed compression ratio.
+  void OnChunkFinalized(const ChunkData& chunk) override;
+
+  // The copy starts from the compression ratio observed by this instance.
+  std::shared_ptr<ChunkerOptions> Clone() const override;
+
+  // Moving average of the compressed / uncompressed size of the chunks.
+  double compression_ratio() const;
+
+ private:
+  const int64_t target_chunk_bytes_;
+  const int num_keep_alive_refs_;
+  const bool target_compressed_bytes_;
+  const bool delta_encode_;
+  const CompressionCodec compression_codec_;
+
+  mutable absl::Mutex mu_;
+  double compression_ratio_ ABSL_GUARDED_BY(mu_) = 1.0;
+};
 
 class NeverCompressChunkerOptions : public ChunkerOptions {
  public:
@@ -472,6 +649,7 @@ class NeverCompressChunkerOptions : public ChunkerOptions {
   int GetNumKeepAliveRefs() const override;
   bool GetDeltaEncode() const override;
   bool GetCompressionDisabled() const override;
+  CompressionCodec GetCompressionCodec() const override;
 
   absl::Status OnItemFinalized(
       const PrioritizedItem& item,
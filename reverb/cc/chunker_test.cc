@@ -14,6 +14,7 @@
 
 #include "reverb/cc/chunker.h"
 
+#include <atomic>
 #include <deque>
 #include <memory>
 #include <string>
@@ -22,9 +23,12 @@
 #include "gtest/gtest.h"
 #include "absl/random/distributions.h"
 #include "absl/random/random.h"
+#include "absl/synchronization/notification.h"
 #include "absl/types/span.h"
+#include "reverb/cc/chunk_compression_pool.h"
 #include "reverb/cc/platform/logging.h"
 #include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/platform/thread.h"
 #include "reverb/cc/schema.pb.h"
 #include "reverb/cc/support/signature.h"
 #include "reverb/cc/testing/proto_test_util.h"
@@ -115,6 +119,7 @@ class MockChunkerOptions : public ChunkerOptions {
   MOCK_METHOD(int, GetNumKeepAliveRefs, (), (const override));
   MOCK_METHOD(bool, GetDeltaEncode, (), (const override));
   MOCK_METHOD(bool, GetCompressionDisabled, (), (const override));
+  MOCK_METHOD(CompressionCodec, GetCompressionCodec, (), (const override));
   MOCK_METHOD(absl::Status, OnItemFinalized,
               (const PrioritizedItem& item,
                absl::Span<const std::shared_ptr<CellRef>> refs),
@@ -765,6 +770,39 @@ TEST(Chunker, DeltaEncodeIsRespected) {
   EXPECT_TRUE(step.lock()->GetChunk()->get()->delta_encoded());
 }
 
+class ChunkerCompressionCodecTest
+    : public ::testing::TestWithParam<CompressionCodec> {};
+
+TEST_P(ChunkerCompressionCodecTest, CodecIsRecordedAndDataRoundTrips) {
+  internal::TensorSpec spec = {"0", tensorflow::DT_INT32, {3, 3}};
+  auto chunker = std::make_shared<Chunker>(
+      spec, std::make_shared<ConstantChunkerOptions>(
+                /*max_chunk_length=*/2, /*num_keep_alive_refs=*/2,
+                /*delta_encode=*/true, /*compression_codec=*/GetParam()));
+
+  std::weak_ptr<CellRef> first;
+  std::weak_ptr<CellRef> second;
+  auto want_first = MakeRandomTensor<tensorflow::DT_INT32>({3, 3}, 0, 100);
+  auto want_second = MakeRandomTensor<tensorflow::DT_INT32>({3, 3}, 0, 100);
+  REVERB_ASSERT_OK(chunker->Append(want_first, {1, 0}, &first));
+  REVERB_ASSERT_OK(chunker->Append(want_second, {1, 1}, &second));
+  ASSERT_TRUE(first.lock()->IsReady());
+  EXPECT_EQ(first.lock()->GetChunk()->get()->compression_codec(), GetParam());
+
+  tensorflow::Tensor got;
+  REVERB_ASSERT_OK(first.lock()->GetData(&got));
+  test::ExpectTensorEqual<tensorflow::int32>(got, want_first);
+  REVERB_ASSERT_OK(second.lock()->GetData(&got));
+  test::ExpectTensorEqual<tensorflow::int32>(got, want_second);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    AllCodecs, ChunkerCompressionCodecTest,
+    ::testing::Values(CompressionCodec::COMPRESSION_CODEC_SNAPPY,
+                      CompressionCodec::COMPRESSION_CODEC_NONE,
+                      CompressionCodec::COMPRESSION_CODEC_ZSTD,
+                      CompressionCodec::COMPRESSION_CODEC_LZ4));
+
 TEST(Chunker, DataUncompressedSizeIsPopulated) {
   auto chunker = MakeChunker(kIntSpec, /*max_chunk_length=*/2,
                              /*num_keep_alive_refs=*/2,
@@ -778,6 +816,110 @@ TEST(Chunker, DataUncompressedSizeIsPopulated) {
   EXPECT_GT(step.lock()->GetChunk()->get()->data_uncompressed_size(), 0);
 }
 
+// Occupies the only thread of `pool` until `unblock` is notified.
+void BlockPool(ChunkCompressionPool* pool, absl::Notification* unblock) {
+  REVERB_CHECK(pool->TryReserve());
+  pool->Schedule([unblock] { unblock->WaitForNotification(); });
+}
+
+TEST(Chunker, CompressesChunksOnPool) {
+  auto pool = std::make_shared<ChunkCompressionPool>(/*num_threads=*/1,
+                                                     /*max_pending_chunks=*/4);
+  std::atomic<int> num_finalized(0);
+  auto chunker = std::make_shared<Chunker>(
+      kIntSpec,
+      std::make_shared<ConstantChunkerOptions>(/*max_chunk_length=*/2,
+                                               /*num_keep_alive_refs=*/2),
+      pool, [&num_finalized] { num_finalized++; });
+
+  absl::Notification unblock;
+  BlockPool(pool.get(), &unblock);
+
+  std::weak_ptr<CellRef> first;
+  std::weak_ptr<CellRef> second;
+  REVERB_ASSERT_OK(chunker->Append(
+      MakeConstantTensor<tensorflow::DT_INT32>({1}, 1), {1, 0},
+      &first));
+  REVERB_ASSERT_OK(chunker->Append(
+      MakeConstantTensor<tensorflow::DT_INT32>({1}, 2), {1, 1},
+      &second));
+
+  // The chunk is full but the pool has not gotten to it yet.
+  EXPECT_FALSE(first.lock()->IsReady());
+  EXPECT_FALSE(second.lock()->IsReady());
+
+  unblock.Notify();
+  chunker->WaitForPendingChunks();
+
+  EXPECT_TRUE(first.lock()->IsReady());
+  EXPECT_TRUE(second.lock()->IsReady());
+  EXPECT_EQ(first.lock()->GetChunk(), second.lock()->GetChunk());
+  EXPECT_EQ(num_finalized, 1);
+
+  auto range = first.lock()->GetChunk()->get()->sequence_range();
+  EXPECT_EQ(range.episode_id(), 1);
+  EXPECT_EQ(range.start(), 0);
+  EXPECT_EQ(range.end(), 1);
+}
+
+TEST(Chunker, GetDataWaitsForChunkOnPool) {
+  auto pool = std::make_shared<ChunkCompressionPool>(/*num_threads=*/1,
+                                                     /*max_pending_chunks=*/4);
+  auto chunker = std::make_shared<Chunker>(
+      kIntSpec,
+      std::make_shared<ConstantChunkerOptions>(/*max_chunk_length=*/2,
+                                               /*num_keep_alive_refs=*/4),
+      pool, nullptr);
+
+  absl::Notification unblock;
+  BlockPool(pool.get(), &unblock);
+
+  std::weak_ptr<CellRef> first;
+  std::weak_ptr<CellRef> second;
+  std::weak_ptr<CellRef> third;
+  auto want = MakeConstantTensor<tensorflow::DT_INT32>({1}, 1);
+  REVERB_ASSERT_OK(chunker->Append(want, {1, 0}, &first));
+  REVERB_ASSERT_OK(chunker->Append(
+      MakeConstantTensor<tensorflow::DT_INT32>({1}, 2), {1, 1},
+      &second));
+
+  // The data of `third` is in the buffer where `first` used to be.
+  REVERB_ASSERT_OK(chunker->Append(
+      MakeConstantTensor<tensorflow::DT_INT32>({1}, 3), {1, 2},
+      &third));
+
+  tensorflow::Tensor got;
+  absl::Status status;
+  auto thread = internal::StartThread(
+      "GetData", [&] { status = first.lock()->GetData(&got); });
+  unblock.Notify();
+  thread = nullptr;
+
+  REVERB_ASSERT_OK(status);
+  test::ExpectTensorEqual<tensorflow::int32>(got, want);
+}
+
+TEST(Chunker, CompressesInlineWhenPoolIsFull) {
+  auto pool = std::make_shared<ChunkCompressionPool>(/*num_threads=*/1,
+                                                     /*max_pending_chunks=*/1);
+  auto chunker = std::make_shared<Chunker>(
+      kIntSpec,
+      std::make_shared<ConstantChunkerOptions>(/*max_chunk_length=*/1,
+                                               /*num_keep_alive_refs=*/1),
+      pool, nullptr);
+
+  absl::Notification unblock;
+  BlockPool(pool.get(), &unblock);
+
+  std::weak_ptr<CellRef> ref;
+  REVERB_ASSERT_OK(chunker->Append(
+      MakeZeroTensor<tensorflow::DT_INT32>(kIntSpec), {1, 0}, &ref));
+
+  // The pool is saturated so the chunk was created by `Append`.
+  EXPECT_TRUE(ref.lock()->IsReady());
+  unblock.Notify();
+}
+
 TEST(ValidateChunkerOptions, Valid) {
   auto options =
       std::make_unique<ConstantChunkerOptions>(/*max_chunk_length=*/2,
@@ -835,6 +977,17 @@ TEST(ValidateChunkerOptions, NumKeepAliveLtMaxChunkLength) {
                   "num_keep_alive_refs (5) must be >= max_chunk_length (6)."));
 }
 
+TEST(ValidateChunkerOptions, UnknownCompressionCodec) {
+  auto options = std::make_unique<ConstantChunkerOptions>(
+      /*max_chunk_length=*/2, /*num_keep_alive_refs=*/2,
+      /*delta_encode=*/false,
+      /*compression_codec=*/static_cast<CompressionCodec>(100));
+  auto status = ValidateChunkerOptions(options.get());
+  EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_THAT(std::string(status.message()),
+              ::testing::HasSubstr("Unknown compression_codec 100."));
+}
+
 TEST(AutoTunedChunkerOptions, SingleStepItemsAndRandomData) {
   auto options = std::make_shared<AutoTunedChunkerOptions>(10);
   auto chunker = std::make_shared<Chunker>(kLargeFloatSpec, options);
@@ -925,6 +1078,127 @@ TEST(AutoTunedChunkerOptions, ConstantNonOverlappingItems) {
   EXPECT_EQ(options->GetMaxChunkLength(), 10);
 }
 
+TEST(Chunker, GetStatistics) {
+  auto chunker = MakeChunker(kFloatSpec, /*max_chunk_length=*/2,
+                             /*num_keep_alive_refs=*/4);
+  EXPECT_EQ(chunker->GetStatistics().num_chunks, 0);
+
+  for (int i = 0; i < 5; i++) {
+    std::weak_ptr<CellRef> ref;
+    REVERB_ASSERT_OK(chunker->Append(
+        MakeZeroTensor<tensorflow::DT_FLOAT>(kFloatSpec),
+        {/*episode_id=*/1, /*step=*/i}, &ref));
+  }
+
+  // The last row is still in the buffer.
+  ChunkStatistics statistics = chunker->GetStatistics();
+  EXPECT_EQ(statistics.num_chunks, 2);
+  EXPECT_EQ(statistics.num_rows, 4);
+  EXPECT_EQ(statistics.uncompressed_bytes, 4 * 4);
+  EXPECT_GT(statistics.compressed_bytes, 0);
+
+  REVERB_ASSERT_OK(chunker->Flush());
+  statistics = chunker->GetStatistics();
+  EXPECT_EQ(statistics.num_chunks, 3);
+  EXPECT_EQ(statistics.num_rows, 5);
+}
+
+TEST(ByteBudgetChunkerOptions, FlushesWhenTargetBytesReached) {
+  // Each row of `kFloatSpec` holds 4 bytes.
+  auto chunker = std::make_shared<Chunker>(
+      kFloatSpec, std::make_shared<ByteBudgetChunkerOptions>(
+                      /*target_chunk_bytes=*/12, /*num_keep_alive_refs=*/10));
+
+  std::vector<std::weak_ptr<CellRef>> refs(4);
+  for (int i = 0; i < refs.size(); i++) {
+    REVERB_ASSERT_OK(chunker->Append(
+        MakeZeroTensor<tensorflow::DT_FLOAT>(kFloatSpec),
+        {/*episode_id=*/1, /*step=*/i}, &refs[i]));
+  }
+
+  EXPECT_TRUE(refs[0].lock()->IsReady());
+  EXPECT_TRUE(refs[2].lock()->IsReady());
+  EXPECT_FALSE(refs[3].lock()->IsReady());
+  EXPECT_EQ(refs[0].lock()->GetChunk()->get()->sequence_range().end(), 2);
+}
+
+TEST(ByteBudgetChunkerOptions, ChunkLengthIsBoundedByNumKeepAliveRefs) {
+  auto chunker = std::make_shared<Chunker>(
+      kFloatSpec, std::make_shared<ByteBudgetChunkerOptions>(
+                      /*target_chunk_bytes=*/1 << 20,
+                      /*num_keep_alive_refs=*/2));
+
+  std::weak_ptr<CellRef> first;
+  std::weak_ptr<CellRef> second;
+  REVERB_ASSERT_OK(
+      chunker->Append(MakeZeroTensor<tensorflow::DT_FLOAT>(kFloatSpec),
+                      {/*episode_id=*/1, /*step=*/0}, &first));
+  REVERB_ASSERT_OK(
+      chunker->Append(MakeZeroTensor<tensorflow::DT_FLOAT>(kFloatSpec),
+                      {/*episode_id=*/1, /*step=*/1}, &second));
+  EXPECT_TRUE(first.lock()->IsReady());
+}
+
+TEST(ByteBudgetChunkerOptions, UncompressedTargetIgnoresCompressionRatio) {
+  ByteBudgetChunkerOptions options(/*target_chunk_bytes=*/1000,
+                                   /*num_keep_alive_refs=*/10);
+  ChunkData chunk;
+  chunk.set_data_uncompressed_size(1000000);
+  options.OnChunkFinalized(chunk);
+
+  EXPECT_LT(options.compression_ratio(), 1);
+  EXPECT_EQ(options.GetMaxChunkBytes(), 1000);
+}
+
+TEST(ByteBudgetChunkerOptions, CompressedTargetAdaptsToCompressionRatio) {
+  ByteBudgetChunkerOptions options(/*target_chunk_bytes=*/1000,
+                                   /*num_keep_alive_refs=*/10,
+                                   /*target_compressed_bytes=*/true);
+
+  // No compression is assumed until chunks have been observed.
+  EXPECT_EQ(options.GetMaxChunkBytes(), 1000);
+
+  // Chunks which compress well allow more data per chunk.
+  ChunkData chunk;
+  chunk.set_data_uncompressed_size(1000000);
+  options.OnChunkFinalized(chunk);
+  EXPECT_LT(options.compression_ratio(), 1);
+  EXPECT_GT(options.GetMaxChunkBytes(), 1000);
+
+  // The ratio is inherited by clones.
+  auto clone = options.Clone();
+  EXPECT_EQ(clone->GetMaxChunkBytes(), options.GetMaxChunkBytes());
+}
+
+TEST(ByteBudgetChunkerOptions, CompressedTargetGrowsChunksOfCompressibleData) {
+  auto options = std::make_shared<ByteBudgetChunkerOptions>(
+      /*target_chunk_bytes=*/100 * 100 * sizeof(float),
+      /*num_keep_alive_refs=*/100,
+      /*target_compressed_bytes=*/true);
+  auto chunker = std::make_shared<Chunker>(kLargeFloatSpec, options);
+
+  std::weak_ptr<CellRef> ref;
+  for (int i = 0; i < 50; i++) {
+    REVERB_ASSERT_OK(chunker->Append(
+        MakeZeroTensor<tensorflow::DT_FLOAT>(kLargeFloatSpec),
+        {/*episode_id=*/1, /*step=*/i}, &ref));
+  }
+
+  // The first chunk closes after a single row but since zeros compress well
+  // the following chunks hold more rows.
+  ChunkStatistics statistics = chunker->GetStatistics();
+  EXPECT_GT(statistics.num_chunks, 1);
+  EXPECT_LT(statistics.num_chunks, 50);
+  EXPECT_LT(options->compression_ratio(), 1);
+}
+
+TEST(ValidateChunkerOptions, ByteBudgetOptionsAreValid) {
+  ByteBudgetChunkerOptions options(/*target_chunk_bytes=*/1024,
+                                   /*num_keep_alive_refs=*/3);
+  REVERB_EXPECT_OK(ValidateChunkerOptions(&options));
+  EXPECT_EQ(options.GetMaxChunkLength(), 3);
+}
+
 }  // namespace
 }  // namespace reverb
 }  // namespace deepmind
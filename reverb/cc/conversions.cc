@@ -14,8 +14,13 @@
 
 #include "reverb/cc/conversions.h"
 
+#include <cstdint>
+#include <vector>
+
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "tensorflow/core/framework/allocation_description.pb.h"
 
 namespace deepmind {
 namespace reverb {
@@ -29,6 +34,130 @@ struct PyDecrefDeleter {
 using Safe_PyObjectPtr = std::unique_ptr<PyObject, PyDecrefDeleter>;
 Safe_PyObjectPtr make_safe(PyObject *o) { return Safe_PyObjectPtr(o); }
 
+namespace {
+
+// Name of the capsules which own the tensors that ndarrays returned by
+// `TensorToNdArray` alias.
+constexpr char kTensorCapsuleName[] = "reverb.Tensor";
+
+// Tensors which alias an ndarray (see `NdArrayTensorBuffer`) can be destroyed
+// on threads which don't hold the GIL (e.g. when a chunk is built in the
+// background) so the reference to the ndarray is queued. The queue is drained
+// by a pending call (see `Py_AddPendingCall`), which the interpreter runs on
+// the main thread with the GIL held, and by the next conversion, whichever
+// comes first.
+class DelayedDecrefQueue {
+ public:
+  static DelayedDecrefQueue *Get() {
+    static auto *queue = new DelayedDecrefQueue();
+    return queue;
+  }
+
+  void Push(PyObject *o) {
+    if (PyGILState_Check()) {
+      Py_DECREF(o);
+      return;
+    }
+    bool schedule;
+    {
+      absl::MutexLock lock(&mu_);
+      pending_.push_back(o);
+      schedule = !drain_scheduled_;
+      drain_scheduled_ = true;
+    }
+    // `Py_AddPendingCall` doesn't require the GIL. It fails if the queue of
+    // pending calls is full in which case the next push tries again.
+    if (schedule && Py_AddPendingCall(&DrainPendingCall, this) != 0) {
+      absl::MutexLock lock(&mu_);
+      drain_scheduled_ = false;
+    }
+  }
+
+  // Must be called with the GIL held.
+  void Clear() {
+    std::vector<PyObject *> pending;
+    {
+      absl::MutexLock lock(&mu_);
+      if (pending_.empty()) return;
+      std::swap(pending, pending_);
+    }
+    for (PyObject *o : pending) {
+      Py_DECREF(o);
+    }
+  }
+
+ private:
+  static int DrainPendingCall(void *arg) {
+    auto *queue = static_cast<DelayedDecrefQueue *>(arg);
+    {
+      absl::MutexLock lock(&queue->mu_);
+      queue->drain_scheduled_ = false;
+    }
+    queue->Clear();
+    return 0;
+  }
+
+  absl::Mutex mu_;
+  std::vector<PyObject *> pending_ ABSL_GUARDED_BY(mu_);
+  // Whether a call to `DrainPendingCall` has been added but not yet run.
+  bool drain_scheduled_ ABSL_GUARDED_BY(mu_) = false;
+};
+
+// Buffer of a tensor which aliases the data of an ndarray. The ndarray is kept
+// alive until the last tensor referencing the buffer is destroyed. The buffer
+// does not own its memory so tensors backed by it are never encoded in place.
+class NdArrayTensorBuffer : public tensorflow::TensorBuffer {
+ public:
+  // Must be called with the GIL held.
+  explicit NdArrayTensorBuffer(PyArrayObject *array)
+      : tensorflow::TensorBuffer(PyArray_DATA(array)),
+        array_(reinterpret_cast<PyObject *>(array)),
+        size_(PyArray_NBYTES(array)) {
+    Py_INCREF(array_);
+  }
+
+  ~NdArrayTensorBuffer() override { DelayedDecrefQueue::Get()->Push(array_); }
+
+  size_t size() const override { return size_; }
+
+  tensorflow::TensorBuffer *root_buffer() override { return this; }
+
+  void FillAllocationDescription(
+      tensorflow::AllocationDescription *proto) const override {
+    proto->set_requested_bytes(size_);
+    proto->set_allocator_name("reverb_ndarray");
+  }
+
+  bool OwnsMemory() const override { return false; }
+
+ private:
+  PyObject *const array_;
+  const size_t size_;
+};
+
+// Returns true if `array` is a read-only view, possibly through other read-only
+// ndarrays, of a `bytes` object. The data of such an array can't be modified
+// while a reference to it is held. The WRITEABLE flag alone isn't enough as it
+// can be set again on arrays which own their data and as other (writeable)
+// views of the same memory may exist.
+bool IsImmutableBytesView(PyArrayObject *array) {
+  while (true) {
+    if (PyArray_ISWRITEABLE(array)) return false;
+    PyObject *base = PyArray_BASE(array);
+    if (base == nullptr) return false;
+    if (PyBytes_Check(base)) return true;
+    if (!PyArray_Check(base)) return false;
+    array = reinterpret_cast<PyArrayObject *>(base);
+  }
+}
+
+void DeleteTensorCapsule(PyObject *capsule) {
+  delete static_cast<tensorflow::Tensor *>(
+      PyCapsule_GetPointer(capsule, kTensorCapsuleName));
+}
+
+}  // namespace
+
 char const *NumpyTypeName(int numpy_type) {
   switch (numpy_type) {
 #define TYPE_CASE(s) \
@@ -264,7 +393,26 @@ absl::Status NdArrayToTensor(PyObject *ndarray,
     nelems *= dims[i];
   }
 
-  if (tensorflow::DataTypeCanUseMemcpy(dtype)) {
+  // The data is aliased rather than copied if nobody else can modify it while
+  // the tensor is alive. That is the case if the array was created by the
+  // conversion above or if it is a read-only view of a `bytes` object (e.g.
+  // the result of `np.frombuffer`). Everything else is copied.
+  const bool can_alias =
+      tensorflow::DataTypeCanUseMemcpy(dtype) && nelems > 0 &&
+      reinterpret_cast<uintptr_t>(PyArray_DATA(py_array)) %
+              EIGEN_MAX_ALIGN_BYTES ==
+          0 &&
+      ((array_safe.get() != ndarray &&
+        PyArray_CHKFLAGS(py_array, NPY_ARRAY_OWNDATA)) ||
+       IsImmutableBytesView(py_array));
+
+  DelayedDecrefQueue::Get()->Clear();
+  if (can_alias) {
+    auto *buffer = new NdArrayTensorBuffer(py_array);
+    *out_tensor =
+        tensorflow::Tensor(dtype, tensorflow::TensorShape(dims), buffer);
+    buffer->Unref();
+  } else if (tensorflow::DataTypeCanUseMemcpy(dtype)) {
     *out_tensor = tensorflow::Tensor(dtype, tensorflow::TensorShape(dims));
     size_t size = PyArray_NBYTES(py_array);
     memcpy(out_tensor->data(), PyArray_DATA(py_array), size);
@@ -297,6 +445,40 @@ absl::Status TensorToNdArray(const tensorflow::Tensor &tensor,
     dims[i] = tensor.dim_size(i);
   }
 
+  DelayedDecrefQueue::Get()->Clear();
+
+  // If no other tensor shares the buffer then the ndarray wraps it rather than
+  // copying the data. The buffer is kept alive by a copy of the tensor owned by
+  // the base object of the ndarray. Shared buffers (e.g. cached chunk columns)
+  // are still copied as writes to the ndarray would otherwise leak into them.
+  if (tensorflow::DataTypeCanUseMemcpy(tensor.dtype()) &&
+      tensor.NumElements() > 0 && tensor.RefCountIsOne()) {
+    auto *owner = new tensorflow::Tensor(tensor);
+    auto capsule = make_safe(
+        PyCapsule_New(owner, kTensorCapsuleName, &DeleteTensorCapsule));
+    if (!capsule) {
+      delete owner;
+      Py_DECREF(descr);
+      return absl::InternalError("Could not allocate ndarray base object");
+    }
+    // Steals the reference to `descr`.
+    auto safe_out_ndarray = make_safe(PyArray_NewFromDescr(
+        &PyArray_Type, descr, dims.size(), dims.data(), /*strides=*/nullptr,
+        const_cast<char *>(owner->tensor_data().data()), NPY_ARRAY_CARRAY,
+        /*obj=*/nullptr));
+    if (!safe_out_ndarray) {
+      return absl::InternalError("Could not allocate ndarray");
+    }
+    // Steals the reference to `capsule`, also when it fails.
+    if (PyArray_SetBaseObject(
+            reinterpret_cast<PyArrayObject *>(safe_out_ndarray.get()),
+            capsule.release()) != 0) {
+      return absl::InternalError("Could not set base object of ndarray");
+    }
+    *out_ndarray = safe_out_ndarray.release();
+    return tensorflow::OkStatus();
+  }
+
   // Allocate an empty array of the desired shape and type.
   auto safe_out_ndarray =
       make_safe(PyArray_Empty(dims.size(), dims.data(), descr, 0));
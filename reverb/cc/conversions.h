@@ -29,9 +29,15 @@ namespace pybind {
 // https://pythonextensionpatterns.readthedocs.io/en/latest/cpp_and_numpy.html
 void ImportNumpy();
 
+// Converts `tensor` to an ndarray. If the buffer of `tensor` isn't shared with
+// any other tensor then the ndarray wraps it instead of copying the data.
 absl::Status TensorToNdArray(const tensorflow::Tensor &tensor,
                              PyObject **out_ndarray);
 
+// Converts `ndarray` (or any object which numpy can convert to one) to a
+// tensor. Aligned, C-contiguous data is aliased rather than copied if it can't
+// be modified while the tensor is alive, i.e. if the array was created by the
+// conversion or is a read-only view of a `bytes` object.
 absl::Status NdArrayToTensor(PyObject *ndarray, tensorflow::Tensor *out_tensor);
 
 absl::Status GetPyDescrFromDataType(tensorflow::DataType dtype,
@@ -280,6 +280,53 @@ def reverb_cc_test(name, srcs, deps = [], **kwargs):
         **kwargs
     )
 
+def reverb_cc_benchmark(name, srcs, deps = [], **kwargs):
+    """Reverb-specific cc_binary for microbenchmarks using google/benchmark.
+
+    The binary is not run as part of the tests. Run it with
+    `bazel run -c opt //path/to:name -- --benchmark_filter=...`.
+
+    Args:
+      name: Target name.
+      srcs: Target sources.
+      deps: Target deps.
+      **kwargs: Additional args to cc_binary.
+    """
+    new_deps = [
+        "@com_google_benchmark//:benchmark_main",
+        "@tensorflow_includes//:includes",
+        "@tensorflow_solib//:framework_lib",
+    ]
+    native.cc_binary(
+        name = name,
+        copts = tf_copts(),
+        srcs = srcs,
+        deps = depset(deps + new_deps),
+        testonly = 1,
+        **kwargs
+    )
+
+def reverb_cc_binary(name, srcs, deps = [], **kwargs):
+    """Reverb-specific version of cc_binary.
+
+    Args:
+      name: Target name.
+      srcs: Target sources.
+      deps: Target deps.
+      **kwargs: Additional args to cc_binary.
+    """
+    new_deps = [
+        "@tensorflow_includes//:includes",
+        "@tensorflow_solib//:framework_lib",
+    ]
+    native.cc_binary(
+        name = name,
+        copts = tf_copts(),
+        srcs = srcs,
+        deps = depset(deps + new_deps),
+        **kwargs
+    )
+
 def reverb_gen_op_wrapper_py(name, out, kernel_lib, ops_lib = None, linkopts = [], **kwargs):
     """Generates the py_library `name` with a data dep on the ops in kernel_lib.
 
@@ -567,6 +614,7 @@ def reverb_absl_deps():
         "@com_google_absl//absl/base",
         "@com_google_absl//absl/base:core_headers",
         "@com_google_absl//absl/functional:bind_front",
+        "@com_google_absl//absl/functional:function_ref",
         "@com_google_absl//absl/memory",
         "@com_google_absl//absl/numeric:int128",
         "@com_google_absl//absl/random",
@@ -17,7 +17,7 @@
 #include <memory>
 
 #include "reverb/cc/checkpointing/checkpoint.pb.h"
-#include "reverb/cc/checkpointing/interface.h"
+#include "reverb/cc/platform/logging.h"
 #include "reverb/cc/selectors/fifo.h"
 #include "reverb/cc/selectors/heap.h"
 #include "reverb/cc/selectors/interface.h"
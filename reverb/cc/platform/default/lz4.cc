@@ -0,0 +1,52 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/platform/lz4.h"
+
+#include <limits>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "lz4.h"  // NOLINT(build/include)
+
+namespace deepmind {
+namespace reverb {
+
+template <>
+size_t Lz4CompressFromString(absl::string_view input, std::string* output) {
+  if (input.size() > LZ4_MAX_INPUT_SIZE) {
+    output->clear();
+    return 0;
+  }
+  output->resize(LZ4_compressBound(input.size()));
+  int size = LZ4_compress_default(input.data(), &(*output)[0], input.size(),
+                                  output->size());
+  output->resize(size);
+  return size;
+}
+
+template <>
+bool Lz4UncompressToString(const std::string& input, size_t output_capacity,
+                           char* output) {
+  if (input.size() > std::numeric_limits<int>::max() ||
+      output_capacity > std::numeric_limits<int>::max()) {
+    return false;
+  }
+  int size = LZ4_decompress_safe(input.data(), output, input.size(),
+                                 output_capacity);
+  return size >= 0 && static_cast<size_t>(size) == output_capacity;
+}
+
+}  // namespace reverb
+}  // namespace deepmind
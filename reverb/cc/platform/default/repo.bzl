@@ -357,6 +357,66 @@ def googletest_deps():
         ],
     )
 
+def benchmark_deps():
+    http_archive(
+        name = "com_google_benchmark",
+        sha256 = "6132883bc8c9b0df5375b16ab520fac1a85dc9e4cf5be59480448ece74b278d4",
+        strip_prefix = "benchmark-1.6.1",
+        urls = [
+            "https://github.com/google/benchmark/archive/v1.6.1.tar.gz",
+        ],
+    )
+
+def zstd_deps():
+    http_archive(
+        name = "com_github_facebook_zstd",
+        build_file_content = """
+cc_library(
+    name = "zstd",
+    srcs = glob([
+        "lib/common/*.c",
+        "lib/common/*.h",
+        "lib/compress/*.c",
+        "lib/compress/*.h",
+        "lib/decompress/*.c",
+        "lib/decompress/*.h",
+    ]),
+    hdrs = [
+        "lib/zdict.h",
+        "lib/zstd.h",
+        "lib/zstd_errors.h",
+    ],
+    copts = ["-DZSTD_DISABLE_ASM"],
+    includes = ["lib"],
+    visibility = ["//visibility:public"],
+)
+""",
+        sha256 = "7c42d56fac126929a6a85dbc73ff1db2411d04f104fae9bdea51305663a83fd0",
+        strip_prefix = "zstd-1.5.2",
+        urls = [
+            "https://github.com/facebook/zstd/releases/download/v1.5.2/zstd-1.5.2.tar.gz",
+        ],
+    )
+
+def lz4_deps():
+    http_archive(
+        name = "com_github_lz4_lz4",
+        build_file_content = """
+cc_library(
+    name = "lz4",
+    srcs = ["lib/lz4.c"],
+    hdrs = ["lib/lz4.h"],
+    includes = ["lib"],
+    visibility = ["//visibility:public"],
+)
+""",
+        sha256 = "030644df4611007ff7dc962d981f390361e6c97a34e5cbc393ddfbe019ffe2c1",
+        strip_prefix = "lz4-1.9.3",
+        urls = [
+            "https://github.com/lz4/lz4/archive/v1.9.3.tar.gz",
+        ],
+    )
+
 def absl_deps():
     http_archive(
         name = "com_google_absl",
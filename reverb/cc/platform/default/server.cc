@@ -19,6 +19,7 @@
 #include <memory>
 
 #include "grpcpp/server_builder.h"
+#include "absl/flags/flag.h"
 #include "absl/strings/str_cat.h"
 #include "reverb/cc/checkpointing/interface.h"
 #include "reverb/cc/client.h"
@@ -26,7 +27,14 @@
 #include "reverb/cc/platform/logging.h"
 #include "reverb/cc/platform/status_macros.h"
 #include "reverb/cc/reverb_service_impl.h"
+#include "reverb/cc/support/http_text_server.h"
 #include "reverb/cc/support/periodic_closure.h"
+#include "reverb/cc/support/prometheus_text.h"
+
+ABSL_FLAG(int, reverb_metrics_http_port, -1,
+          "If >= 0, the table metrics (including latency histograms) are "
+          "served in the Prometheus text format from "
+          "http://localhost:<port>/metrics. 0 picks an unused port.");
 
 namespace deepmind {
 namespace reverb {
@@ -52,11 +60,13 @@ class ServerImpl : public Server {
             absl::Milliseconds(250)) {}
 
   absl::Status Initialize(std::vector<std::shared_ptr<Table>> tables,
-                          std::shared_ptr<Checkpointer> checkpointer) {
+                          std::shared_ptr<Checkpointer> checkpointer,
+                          std::shared_ptr<ChunkSpillTier> spill_tier) {
     absl::WriterMutexLock lock(&mu_);
     REVERB_CHECK(!running_) << "Initialize() called twice?";
     REVERB_RETURN_IF_ERROR(ReverbServiceImpl::Create(
-        std::move(tables), std::move(checkpointer), &reverb_service_));
+        std::move(tables), std::move(checkpointer), std::move(spill_tier),
+        &reverb_service_));
     server_ = grpc::ServerBuilder()
                   .AddListeningPort(absl::StrCat("[::]:", port_),
                                     MakeServerCredentials())
@@ -69,6 +79,7 @@ class ServerImpl : public Server {
     }
     running_ = true;
     REVERB_LOG(REVERB_INFO) << "Started replay server on port " << port_;
+    REVERB_RETURN_IF_ERROR(MaybeStartMetricsServer());
     REVERB_RETURN_IF_ERROR(signal_worker_.Start());
     return absl::OkStatus();
   }
@@ -83,6 +94,7 @@ class ServerImpl : public Server {
     if (!running_) return;
     REVERB_LOG(REVERB_INFO) << "Shutting down replay server";
 
+    metrics_server_ = nullptr;
     reverb_service_->Close();
 
     // Set a deadline as the sampler streams never closes by themselves.
@@ -118,10 +130,28 @@ class ServerImpl : public Server {
   void SignalStop() { stop_signalled_ = true; }
 
  private:
+  absl::Status MaybeStartMetricsServer() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    const int port = absl::GetFlag(FLAGS_reverb_metrics_http_port);
+    if (port < 0) return absl::OkStatus();
+    const ReverbServiceImpl* service = reverb_service_.get();
+    auto server_or = internal::HttpTextServer::Start(port, [service] {
+      return internal::TableInfosToPrometheusText(service->TableInfos());
+    });
+    REVERB_RETURN_IF_ERROR(server_or.status());
+    metrics_server_ = std::move(server_or).value();
+    REVERB_LOG(REVERB_INFO) << "Serving metrics on http://localhost:"
+                            << metrics_server_->port() << "/metrics";
+    return absl::OkStatus();
+  }
+
   int port_;
   std::unique_ptr<ReverbServiceImpl> reverb_service_;
   std::unique_ptr<grpc::Server> server_ = nullptr;
 
+  // Serves the table metrics over HTTP. Stopped before the service is closed.
+  std::unique_ptr<internal::HttpTextServer> metrics_server_
+      ABSL_GUARDED_BY(mu_);
+
   absl::Mutex mu_;
   bool running_ ABSL_GUARDED_BY(mu_) = false;
 
@@ -140,9 +170,17 @@ class ServerImpl : public Server {
 absl::Status StartServer(std::vector<std::shared_ptr<Table>> tables, int port,
                          std::shared_ptr<Checkpointer> checkpointer,
                          std::unique_ptr<Server> *server) {
+  return StartServer(std::move(tables), port, std::move(checkpointer),
+                     /*spill_tier=*/nullptr, server);
+}
+
+absl::Status StartServer(std::vector<std::shared_ptr<Table>> tables, int port,
+                         std::shared_ptr<Checkpointer> checkpointer,
+                         std::shared_ptr<ChunkSpillTier> spill_tier,
+                         std::unique_ptr<Server> *server) {
   auto s = std::make_unique<ServerImpl>(port);
-  REVERB_RETURN_IF_ERROR(
-      s->Initialize(std::move(tables), std::move(checkpointer)));
+  REVERB_RETURN_IF_ERROR(s->Initialize(
+      std::move(tables), std::move(checkpointer), std::move(spill_tier)));
   *server = std::move(s);
   return absl::OkStatus();
 }
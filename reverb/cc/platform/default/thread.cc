@@ -14,6 +14,11 @@
 
 #include "reverb/cc/platform/thread.h"
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 #include <memory>
 #include <thread>  // NOLINT(build/c++11)
 
@@ -41,6 +46,19 @@ std::unique_ptr<Thread> StartThread(absl::string_view name,
   return {std::make_unique<StdThread>(std::move(fn))};
 }
 
+bool PinCurrentThreadToCpu(int cpu) {
+#ifdef __linux__
+  const int num_cpus = std::thread::hardware_concurrency();
+  if (num_cpus <= 0 || cpu < 0) return false;
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu % num_cpus, &cpus);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+  return false;
+#endif
+}
+
 }  // namespace internal
 }  // namespace reverb
 }  // namespace deepmind
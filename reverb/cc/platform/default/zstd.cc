@@ -0,0 +1,48 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/platform/zstd.h"
+
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "zstd.h"  // NOLINT(build/include)
+
+namespace deepmind {
+namespace reverb {
+
+template <>
+size_t ZstdCompressFromString(absl::string_view input, int level,
+                              std::string* output) {
+  output->resize(ZSTD_compressBound(input.size()));
+  size_t size = ZSTD_compress(&(*output)[0], output->size(), input.data(),
+                              input.size(), level);
+  if (ZSTD_isError(size)) {
+    output->clear();
+    return 0;
+  }
+  output->resize(size);
+  return size;
+}
+
+template <>
+bool ZstdUncompressToString(const std::string& input, size_t output_capacity,
+                            char* output) {
+  size_t size =
+      ZSTD_decompress(output, output_capacity, input.data(), input.size());
+  return !ZSTD_isError(size) && size == output_capacity;
+}
+
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,37 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_PLATFORM_LZ4_H_
+#define REVERB_CC_PLATFORM_LZ4_H_
+
+#include <cstddef>
+
+#include "absl/strings/string_view.h"
+
+namespace deepmind {
+namespace reverb {
+
+// Compress a string to a `Toutput` output. Return the number of bytes stored.
+template <typename Toutput>
+size_t Lz4CompressFromString(absl::string_view input, Toutput* output);
+
+// Uncompress an `input` containing lz4-compressed data to *output.
+template <typename Tinput>
+bool Lz4UncompressToString(const Tinput& input, size_t output_capacity,
+                           char* output);
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_PLATFORM_LZ4_H_
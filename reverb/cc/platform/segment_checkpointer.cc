@@ -0,0 +1,637 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/platform/segment_checkpointer.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "reverb/cc/checkpointing/checkpoint.pb.h"
+#include "reverb/cc/checkpointing/table_restore.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/platform/hash_set.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/support/tf_util.h"
+#include "reverb/cc/table.h"
+#include "tensorflow/core/lib/hash/crc32c.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/platform/coding.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/file_system.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+constexpr char kSegmentsDirName[] = "segments";
+constexpr char kSegmentSuffix[] = ".seg";
+constexpr char kTablesFileName[] = "tables.rec";
+constexpr char kItemsFileName[] = "items.rec";
+constexpr char kChunksFileName[] = "chunks.rec";
+constexpr char kDoneFileName[] = "DONE";
+
+// Every record starts with the length of the payload (fixed64) followed by the
+// masked CRC32C of the payload (fixed32).
+constexpr uint64_t kRecordHeaderSize = sizeof(uint64_t) + sizeof(uint32_t);
+
+std::string SegmentPath(absl::string_view root_dir, uint64_t segment_id) {
+  return tensorflow::io::JoinPath(
+      root_dir, kSegmentsDirName,
+      absl::StrFormat("%020d%s", segment_id, kSegmentSuffix));
+}
+
+// Appends records to a new file.
+class RecordFileWriter {
+ public:
+  static absl::StatusOr<std::unique_ptr<RecordFileWriter>> Open(
+      const std::string& path) {
+    std::unique_ptr<tensorflow::WritableFile> file;
+    REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+        tensorflow::Env::Default()->NewWritableFile(path, &file)));
+    return absl::WrapUnique(new RecordFileWriter(path, std::move(file)));
+  }
+
+  // Appends a record holding the serialized `proto`. If set, `offset` and
+  // `length` are populated with the position of the record in the file and
+  // the size of the serialized proto.
+  template <typename Proto>
+  absl::Status Append(const Proto& proto, uint64_t* offset = nullptr,
+                      uint64_t* length = nullptr) {
+    buffer_.clear();
+    if (!proto.AppendToString(&buffer_)) {
+      return absl::DataLossError(absl::StrCat(
+          "Unable to serialize proto of size ", proto.ByteSizeLong(),
+          " bytes when writing to ", path_,
+          ". Perhaps the proto is >2GB? Please check your logs."));
+    }
+
+    char header[kRecordHeaderSize];
+    tensorflow::core::EncodeFixed64(header, buffer_.size());
+    tensorflow::core::EncodeFixed32(
+        header + sizeof(uint64_t),
+        tensorflow::crc32c::Mask(
+            tensorflow::crc32c::Value(buffer_.data(), buffer_.size())));
+    REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+        file_->Append(absl::string_view(header, kRecordHeaderSize))));
+    REVERB_RETURN_IF_ERROR(FromTensorflowStatus(file_->Append(buffer_)));
+
+    if (offset != nullptr) *offset = size_;
+    if (length != nullptr) *length = buffer_.size();
+    size_ += kRecordHeaderSize + buffer_.size();
+    return absl::OkStatus();
+  }
+
+  // Flushes the file to stable storage and closes it.
+  absl::Status Close() {
+    REVERB_RETURN_IF_ERROR(FromTensorflowStatus(file_->Sync()));
+    return FromTensorflowStatus(file_->Close());
+  }
+
+ private:
+  RecordFileWriter(std::string path,
+                   std::unique_ptr<tensorflow::WritableFile> file)
+      : path_(std::move(path)), file_(std::move(file)) {}
+
+  const std::string path_;
+  std::unique_ptr<tensorflow::WritableFile> file_;
+  // Total number of bytes appended to `file_`.
+  uint64_t size_ = 0;
+  // Reused between calls to `Append` to avoid allocations.
+  std::string buffer_;
+};
+
+// Reads records from a file which is mapped into memory.
+class RecordFileReader {
+ public:
+  static absl::StatusOr<std::unique_ptr<RecordFileReader>> Open(
+      const std::string& path) {
+    auto* env = tensorflow::Env::Default();
+    uint64_t size;
+    REVERB_RETURN_IF_ERROR(
+        FromTensorflowStatus(env->GetFileSize(path, &size)));
+
+    // Empty files cannot be mapped.
+    std::unique_ptr<tensorflow::ReadOnlyMemoryRegion> region;
+    if (size > 0) {
+      REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+          env->NewReadOnlyMemoryRegionFromFile(path, &region)));
+    }
+    return absl::WrapUnique(new RecordFileReader(path, std::move(region)));
+  }
+
+  // Parses the record at `offset` into `proto`. If set, `next_offset` is
+  // populated with the offset of the following record.
+  template <typename Proto>
+  absl::Status ReadAt(uint64_t offset, Proto* proto,
+                      uint64_t* next_offset = nullptr) const {
+    if (offset > data_.size() || data_.size() - offset < kRecordHeaderSize) {
+      return absl::DataLossError(
+          absl::StrCat("Truncated record header at offset ", offset, " in ",
+                       path_, " (", data_.size(), " bytes)."));
+    }
+    const char* header = data_.data() + offset;
+    const uint64_t length = tensorflow::core::DecodeFixed64(header);
+    const uint32_t crc = tensorflow::crc32c::Unmask(
+        tensorflow::core::DecodeFixed32(header + sizeof(uint64_t)));
+    if (data_.size() - offset - kRecordHeaderSize < length ||
+        length > INT_MAX) {
+      return absl::DataLossError(
+          absl::StrCat("Record of ", length, " bytes at offset ", offset,
+                       " exceeds the size of ", path_, " (", data_.size(),
+                       " bytes)."));
+    }
+
+    const char* payload = header + kRecordHeaderSize;
+    if (tensorflow::crc32c::Value(payload, length) != crc) {
+      return absl::DataLossError(absl::StrCat(
+          "Checksum mismatch for record at offset ", offset, " in ", path_,
+          "."));
+    }
+    if (!proto->ParseFromArray(payload, length)) {
+      return absl::DataLossError(
+          absl::StrCat("Could not parse record at offset ", offset, " in ",
+                       path_, " as ", proto->GetTypeName(), "."));
+    }
+
+    if (next_offset != nullptr) {
+      *next_offset = offset + kRecordHeaderSize + length;
+    }
+    return absl::OkStatus();
+  }
+
+  // Parses every record in the file and calls `fn` with the result.
+  template <typename Proto, typename Fn>
+  absl::Status ForEach(Fn fn) const {
+    uint64_t offset = 0;
+    while (offset < data_.size()) {
+      Proto proto;
+      REVERB_RETURN_IF_ERROR(ReadAt(offset, &proto, &offset));
+      REVERB_RETURN_IF_ERROR(fn(std::move(proto)));
+    }
+    return absl::OkStatus();
+  }
+
+ private:
+  RecordFileReader(std::string path,
+                   std::unique_ptr<tensorflow::ReadOnlyMemoryRegion> region)
+      : path_(std::move(path)),
+        region_(std::move(region)),
+        data_(region_ == nullptr
+                  ? absl::string_view()
+                  : absl::string_view(
+                        static_cast<const char*>(region_->data()),
+                        region_->length())) {}
+
+  const std::string path_;
+  const std::unique_ptr<tensorflow::ReadOnlyMemoryRegion> region_;
+  const absl::string_view data_;
+};
+
+inline absl::Status WriteDone(const std::string& path) {
+  std::unique_ptr<tensorflow::WritableFile> file;
+  REVERB_RETURN_IF_ERROR(
+      FromTensorflowStatus(tensorflow::Env::Default()->NewWritableFile(
+          tensorflow::io::JoinPath(path, kDoneFileName), &file)));
+  return FromTensorflowStatus(file->Close());
+}
+
+inline bool HasDone(const std::string& path) {
+  return tensorflow::Env::Default()
+      ->FileExists(tensorflow::io::JoinPath(path, kDoneFileName))
+      .ok();
+}
+
+// Returns the paths of the checkpoint directories in `root_dir` from oldest to
+// most recent.
+absl::StatusOr<std::vector<std::string>> ListCheckpoints(
+    const std::string& root_dir) {
+  std::vector<std::string> paths;
+  REVERB_RETURN_IF_ERROR(
+      FromTensorflowStatus(tensorflow::Env::Default()->GetMatchingPaths(
+          tensorflow::io::JoinPath(root_dir, "*"), &paths)));
+  paths.erase(std::remove_if(paths.begin(), paths.end(),
+                             [](const std::string& path) {
+                               return tensorflow::io::Basename(path) ==
+                                      kSegmentsDirName;
+                             }),
+              paths.end());
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+// Returns the identifiers of the segments in `root_dir`.
+absl::StatusOr<std::vector<uint64_t>> ListSegments(
+    const std::string& root_dir) {
+  std::vector<std::string> paths;
+  REVERB_RETURN_IF_ERROR(
+      FromTensorflowStatus(tensorflow::Env::Default()->GetMatchingPaths(
+          tensorflow::io::JoinPath(root_dir, kSegmentsDirName,
+                                   absl::StrCat("*", kSegmentSuffix)),
+          &paths)));
+  std::vector<uint64_t> segment_ids;
+  segment_ids.reserve(paths.size());
+  for (const auto& path : paths) {
+    absl::string_view name = tensorflow::io::Basename(path);
+    uint64_t segment_id;
+    if (absl::ConsumeSuffix(&name, kSegmentSuffix) &&
+        absl::SimpleAtoi(name, &segment_id)) {
+      segment_ids.push_back(segment_id);
+    }
+  }
+  return segment_ids;
+}
+
+// Calls `fn` with the location of every chunk referenced by the checkpoint in
+// `path`.
+template <typename Fn>
+absl::Status ForEachChunkLocation(const std::string& path, Fn fn) {
+  REVERB_ASSIGN_OR_RETURN(
+      auto reader,
+      RecordFileReader::Open(tensorflow::io::JoinPath(path, kChunksFileName)));
+  return reader->ForEach<SegmentChunkLocation>(std::move(fn));
+}
+
+}  // namespace
+
+SegmentCheckpointer::SegmentCheckpointer(
+    std::string root_dir, std::string group,
+    absl::optional<std::string> fallback_checkpoint_path)
+    : root_dir_(std::move(root_dir)),
+      group_(std::move(group)),
+      fallback_checkpoint_path_(std::move(fallback_checkpoint_path)) {
+  REVERB_LOG(REVERB_INFO) << " Initializing SegmentCheckpointer in "
+                          << root_dir_
+                          << (fallback_checkpoint_path_.has_value()
+                                  ? absl::StrCat(
+                                        " and fallback directory ",
+                                        fallback_checkpoint_path_.value(), ".")
+                                  : ".");
+}
+
+absl::Status SegmentCheckpointer::Save(std::vector<Table*> tables,
+                                       int keep_latest, std::string* path) {
+  if (keep_latest <= 0) {
+    return absl::InvalidArgumentError(
+        "SegmentCheckpointer must have keep_latest > 0.");
+  }
+  if (!group_.empty()) {
+    return absl::InvalidArgumentError(
+        "Setting non-empty group is not supported");
+  }
+
+  absl::MutexLock lock(&mu_);
+  REVERB_RETURN_IF_ERROR(InitializeLocked());
+
+  std::string dir_path =
+      tensorflow::io::JoinPath(root_dir_, absl::FormatTime(absl::Now()));
+  REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+      tensorflow::Env::Default()->RecursivelyCreateDir(dir_path)));
+
+  // Write the table metadata and the items. The chunks are kept alive until
+  // they have been written to a segment.
+  internal::flat_hash_set<std::shared_ptr<ChunkStore::Chunk>> chunks;
+  {
+    REVERB_ASSIGN_OR_RETURN(auto table_writer,
+                            RecordFileWriter::Open(tensorflow::io::JoinPath(
+                                dir_path, kTablesFileName)));
+    REVERB_ASSIGN_OR_RETURN(auto item_writer,
+                            RecordFileWriter::Open(tensorflow::io::JoinPath(
+                                dir_path, kItemsFileName)));
+    for (Table* table : tables) {
+      auto checkpoint = table->Checkpoint();
+      chunks.merge(checkpoint.chunks);
+      REVERB_RETURN_IF_ERROR(table_writer->Append(checkpoint.checkpoint));
+      for (const auto& item : checkpoint.items) {
+        REVERB_RETURN_IF_ERROR(item_writer->Append(item));
+      }
+    }
+    REVERB_RETURN_IF_ERROR(table_writer->Close());
+    REVERB_RETURN_IF_ERROR(item_writer->Close());
+  }
+
+  // Append the chunks which are not part of any segment yet to a new segment.
+  std::vector<SegmentChunkLocation> new_locations;
+  {
+    std::unique_ptr<RecordFileWriter> segment_writer;
+    const uint64_t segment_id = next_segment_id_;
+    for (const auto& chunk : chunks) {
+      if (locations_.contains(chunk->key())) continue;
+
+      if (segment_writer == nullptr) {
+        next_segment_id_++;
+        REVERB_ASSIGN_OR_RETURN(
+            segment_writer,
+            RecordFileWriter::Open(SegmentPath(root_dir_, segment_id)));
+      }
+
+      uint64_t offset;
+      uint64_t length;
+      REVERB_ASSIGN_OR_RETURN(const auto data, chunk->Pin());
+      REVERB_RETURN_IF_ERROR(segment_writer->Append(*data, &offset, &length));
+
+      SegmentChunkLocation location;
+      location.set_chunk_key(chunk->key());
+      location.set_segment_id(segment_id);
+      location.set_offset(offset);
+      location.set_length(length);
+      new_locations.push_back(std::move(location));
+    }
+    if (segment_writer != nullptr) {
+      REVERB_RETURN_IF_ERROR(segment_writer->Close());
+    }
+  }
+
+  // The segment is complete so the new chunks can be referenced by this and
+  // future checkpoints.
+  for (auto& location : new_locations) {
+    const uint64_t key = location.chunk_key();
+    locations_[key] = std::move(location);
+  }
+  REVERB_LOG(REVERB_INFO) << "Checkpoint references " << chunks.size()
+                          << " chunks of which " << new_locations.size()
+                          << " were written to a new segment.";
+
+  {
+    REVERB_ASSIGN_OR_RETURN(auto chunk_writer,
+                            RecordFileWriter::Open(tensorflow::io::JoinPath(
+                                dir_path, kChunksFileName)));
+    for (const auto& chunk : chunks) {
+      REVERB_RETURN_IF_ERROR(chunk_writer->Append(locations_[chunk->key()]));
+    }
+    REVERB_RETURN_IF_ERROR(chunk_writer->Close());
+  }
+
+  // All data of the checkpoint has now been written so we can proceed to add
+  // the DONE-file.
+  REVERB_RETURN_IF_ERROR(WriteDone(dir_path));
+
+  REVERB_RETURN_IF_ERROR(DeleteOldDataLocked(keep_latest));
+
+  *path = std::move(dir_path);
+  return absl::OkStatus();
+}
+
+absl::Status SegmentCheckpointer::InitializeLocked() {
+  if (initialized_) return absl::OkStatus();
+
+  REVERB_RETURN_IF_ERROR(
+      FromTensorflowStatus(tensorflow::Env::Default()->RecursivelyCreateDir(
+          tensorflow::io::JoinPath(root_dir_, kSegmentsDirName))));
+
+  REVERB_ASSIGN_OR_RETURN(auto segment_ids, ListSegments(root_dir_));
+  internal::flat_hash_set<uint64_t> existing_segments(segment_ids.begin(),
+                                                      segment_ids.end());
+  for (uint64_t segment_id : segment_ids) {
+    next_segment_id_ = std::max(next_segment_id_, segment_id + 1);
+  }
+
+  // Chunks referenced by the most recent checkpoint do not have to be written
+  // again.
+  locations_.clear();
+  REVERB_ASSIGN_OR_RETURN(auto checkpoints, ListCheckpoints(root_dir_));
+  for (auto it = checkpoints.rbegin(); it != checkpoints.rend(); it++) {
+    if (!HasDone(*it)) continue;
+
+    REVERB_RETURN_IF_ERROR(ForEachChunkLocation(
+        *it, [&](SegmentChunkLocation location) {
+          if (existing_segments.contains(location.segment_id())) {
+            const uint64_t key = location.chunk_key();
+            locations_[key] = std::move(location);
+          }
+          return absl::OkStatus();
+        }));
+    REVERB_LOG(REVERB_INFO) << "Found " << locations_.size()
+                            << " chunks in the segments of checkpoint " << *it
+                            << ".";
+    break;
+  }
+
+  initialized_ = true;
+  return absl::OkStatus();
+}
+
+absl::Status SegmentCheckpointer::DeleteOldDataLocked(int keep_latest) {
+  auto* env = tensorflow::Env::Default();
+
+  REVERB_ASSIGN_OR_RETURN(auto checkpoints, ListCheckpoints(root_dir_));
+  const int num_to_delete =
+      std::max(0, static_cast<int>(checkpoints.size()) - keep_latest);
+  for (int i = 0; i < num_to_delete; i++) {
+    int64_t undeleted_files;
+    int64_t undeleted_dirs;
+    REVERB_RETURN_IF_ERROR(FromTensorflowStatus(env->DeleteRecursively(
+        checkpoints[i], &undeleted_files, &undeleted_dirs)));
+  }
+
+  internal::flat_hash_set<uint64_t> referenced_segments;
+  for (int i = num_to_delete; i < checkpoints.size(); i++) {
+    if (!HasDone(checkpoints[i])) continue;
+    REVERB_RETURN_IF_ERROR(ForEachChunkLocation(
+        checkpoints[i], [&](const SegmentChunkLocation& location) {
+          referenced_segments.insert(location.segment_id());
+          return absl::OkStatus();
+        }));
+  }
+
+  REVERB_ASSIGN_OR_RETURN(auto segment_ids, ListSegments(root_dir_));
+  internal::flat_hash_set<uint64_t> deleted_segments;
+  for (uint64_t segment_id : segment_ids) {
+    if (referenced_segments.contains(segment_id)) continue;
+    REVERB_RETURN_IF_ERROR(FromTensorflowStatus(
+        env->DeleteFile(SegmentPath(root_dir_, segment_id))));
+    deleted_segments.insert(segment_id);
+  }
+
+  if (!deleted_segments.empty()) {
+    for (auto it = locations_.begin(); it != locations_.end();) {
+      if (deleted_segments.contains(it->second.segment_id())) {
+        locations_.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+    REVERB_LOG(REVERB_INFO) << "Deleted " << deleted_segments.size()
+                            << " segments which are no longer referenced.";
+  }
+
+  return absl::OkStatus();
+}
+
+absl::Status SegmentCheckpointer::Load(
+    absl::string_view path, ChunkStore* chunk_store,
+    std::vector<std::shared_ptr<Table>>* tables) {
+  const std::string dir_path(path);
+  REVERB_LOG(REVERB_INFO) << "Loading checkpoint from " << dir_path;
+  if (!HasDone(dir_path)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Load called with invalid checkpoint path: ", dir_path));
+  }
+
+  // Load and verify the (relatively small) table metadata before reading the
+  // data referenced by the items.
+  internal::flat_hash_map<std::string, PriorityTableCheckpoint>
+      table_checkpoints;
+  {
+    REVERB_ASSIGN_OR_RETURN(auto reader,
+                            RecordFileReader::Open(tensorflow::io::JoinPath(
+                                dir_path, kTablesFileName)));
+    REVERB_RETURN_IF_ERROR(reader->ForEach<PriorityTableCheckpoint>(
+        [&](PriorityTableCheckpoint checkpoint) {
+          REVERB_RETURN_IF_ERROR(
+              internal::GetTableIndex(*tables, checkpoint.table_name())
+                  .status());
+          std::string table_name = checkpoint.table_name();
+          table_checkpoints[table_name] = std::move(checkpoint);
+          return absl::OkStatus();
+        }));
+  }
+
+  internal::flat_hash_map<std::string, std::vector<PrioritizedItem>>
+      table_to_items;
+  {
+    REVERB_ASSIGN_OR_RETURN(auto reader,
+                            RecordFileReader::Open(tensorflow::io::JoinPath(
+                                dir_path, kItemsFileName)));
+    REVERB_RETURN_IF_ERROR(
+        reader->ForEach<PrioritizedItem>([&](PrioritizedItem item) {
+          REVERB_RETURN_IF_ERROR(internal::CheckTrajectoryFormat(item));
+          if (!table_checkpoints.contains(item.table())) {
+            return absl::DataLossError(absl::StrCat(
+                "Unable to find table '", item.table(), "' for item '",
+                item.key(), "' in the set of tables loaded from metadata."));
+          }
+          std::string table_name = item.table();
+          table_to_items[table_name].push_back(std::move(item));
+          return absl::OkStatus();
+        }));
+  }
+
+  REVERB_LOG(REVERB_INFO)
+      << "Successfully loaded and verified metadata for all ("
+      << table_checkpoints.size()
+      << ") tables. We'll now proceed to read the data referenced by the items "
+         "in the table.";
+
+  // Read the chunks in the order they are stored in the segments so that the
+  // mapped files are accessed sequentially.
+  std::vector<SegmentChunkLocation> locations;
+  REVERB_RETURN_IF_ERROR(
+      ForEachChunkLocation(dir_path, [&](SegmentChunkLocation location) {
+        locations.push_back(std::move(location));
+        return absl::OkStatus();
+      }));
+  std::sort(locations.begin(), locations.end(),
+            [](const SegmentChunkLocation& a, const SegmentChunkLocation& b) {
+              return std::make_pair(a.segment_id(), a.offset()) <
+                     std::make_pair(b.segment_id(), b.offset());
+            });
+
+  // Keep the chunks around so that none of them are cleaned up before all the
+  // tables have been loaded.
+  const std::string root_dir(tensorflow::io::Dirname(dir_path));
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> loaded_chunks;
+  loaded_chunks.reserve(locations.size());
+  std::unique_ptr<RecordFileReader> segment_reader;
+  for (int i = 0; i < locations.size(); i++) {
+    const auto& location = locations[i];
+    if (i == 0 || location.segment_id() != locations[i - 1].segment_id()) {
+      REVERB_ASSIGN_OR_RETURN(
+          segment_reader,
+          RecordFileReader::Open(SegmentPath(root_dir, location.segment_id())));
+    }
+
+    ChunkData chunk_data;
+    uint64_t next_offset;
+    REVERB_RETURN_IF_ERROR(
+        segment_reader->ReadAt(location.offset(), &chunk_data, &next_offset));
+    if (chunk_data.chunk_key() != location.chunk_key() ||
+        next_offset - location.offset() !=
+            kRecordHeaderSize + location.length()) {
+      return absl::DataLossError(absl::StrCat(
+          "Record at offset ", location.offset(), " of segment ",
+          location.segment_id(), " does not hold chunk ",
+          location.chunk_key(), "."));
+    }
+    loaded_chunks.push_back(chunk_store->Insert(std::move(chunk_data)));
+
+    REVERB_LOG_EVERY_N(REVERB_INFO, 1000)
+        << "Still reading compressed trajectory data. " << loaded_chunks.size()
+        << " of " << locations.size() << " chunks have been read so far.";
+  }
+  segment_reader = nullptr;
+
+  REVERB_LOG(REVERB_INFO)
+      << "Completed reading compressed trajectory data. We'll now start "
+         "assembling the checkpointed tables.";
+
+  return internal::RestoreTables(std::move(table_checkpoints),
+                                 std::move(table_to_items), chunk_store,
+                                 tables, path);
+}
+
+absl::Status SegmentCheckpointer::LoadLatest(
+    std::vector<std::shared_ptr<Table>>* tables) {
+  ChunkStore chunk_store;
+  REVERB_LOG(REVERB_INFO) << "Loading latest checkpoint from " << root_dir_;
+  REVERB_ASSIGN_OR_RETURN(auto checkpoints, ListCheckpoints(root_dir_));
+  for (auto it = checkpoints.rbegin(); it != checkpoints.rend(); it++) {
+    if (HasDone(*it)) {
+      return Load(
+          tensorflow::io::JoinPath(root_dir_, tensorflow::io::Basename(*it)),
+          &chunk_store, tables);
+    }
+  }
+  return absl::NotFoundError(
+      absl::StrCat("No checkpoint found in ", root_dir_));
+}
+
+absl::Status SegmentCheckpointer::LoadFallbackCheckpoint(
+    std::vector<std::shared_ptr<Table>>* tables) {
+  ChunkStore chunk_store;
+  if (!fallback_checkpoint_path_.has_value()) {
+    return absl::NotFoundError("No fallback checkpoint path provided.");
+  }
+  if (HasDone(fallback_checkpoint_path_.value())) {
+    return Load(fallback_checkpoint_path_.value(), &chunk_store, tables);
+  }
+  return absl::NotFoundError(absl::StrCat("No checkpoint found in ",
+                                          fallback_checkpoint_path_.value()));
+}
+
+std::string SegmentCheckpointer::DebugString() const {
+  return absl::StrCat("SegmentCheckpointer(root_dir=", root_dir_,
+                      ", group=", group_, ")");
+}
+
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,137 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_PLATFORM_SEGMENT_CHECKPOINTER_H_
+#define REVERB_CC_PLATFORM_SEGMENT_CHECKPOINTER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "reverb/cc/checkpointing/checkpoint.pb.h"
+#include "reverb/cc/checkpointing/interface.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/table.h"
+
+namespace deepmind {
+namespace reverb {
+
+// Checkpointer which stores chunks in append-only segment files that are
+// shared by all checkpoints in `root_dir`.
+//
+// `TFRecordCheckpointer` writes every chunk referenced by the tables each time
+// `Save` is called. Chunks are immutable and identified by their key, so most
+// of that work is wasted when checkpoints are taken regularly. This
+// checkpointer instead remembers which chunks have already been written to a
+// segment and each `Save` only appends the chunks created since the previous
+// checkpoint to a new segment. The checkpoint itself only holds the table
+// metadata, the items and the location of every referenced chunk:
+//
+//   <root_dir>/
+//     segments/
+//       <segment id>.seg
+//     <timestamp of the checkpoint>/
+//       tables.rec
+//       items.rec
+//       chunks.rec
+//       DONE
+//
+// All files are sequences of records, each made up of a fixed size header
+// (payload length and masked CRC32C of the payload) followed by a serialized
+// proto: `ChunkData` in segments, `PriorityTableCheckpoint` in `tables.rec`,
+// `PrioritizedItem` in `items.rec` and `SegmentChunkLocation` in `chunks.rec`.
+// Nothing is compressed since the chunks are already compressed. `Load` maps
+// the files into memory and parses the records in place.
+//
+// DONE is written once the checkpoint is complete. After a successful `Save`
+// all but the `keep_latest` most recent checkpoints are deleted, together with
+// the segments which are no longer referenced by any remaining checkpoint.
+// Segments are never rewritten so a segment is only deleted once all chunks in
+// it have been dropped from the tables.
+//
+// `group` and `fallback_checkpoint_path` behave as in `TFRecordCheckpointer`.
+// The fallback checkpoint must also have been written by a
+// `SegmentCheckpointer`.
+class SegmentCheckpointer : public Checkpointer {
+ public:
+  explicit SegmentCheckpointer(
+      std::string root_dir, std::string group = "",
+      absl::optional<std::string> fallback_checkpoint_path = absl::nullopt);
+
+  // Saves a new checkpoint for every table in `tables` in a sub directory of
+  // `root_dir_` and appends the chunks which are not yet part of any segment
+  // to a new segment. If the call is successful, the ABSOLUTE path to the
+  // newly created checkpoint directory is returned.
+  absl::Status Save(std::vector<Table*> tables, int keep_latest,
+                    std::string* path) override;
+
+  // Attempts to load the checkpoint stored in the directory `path`.
+  absl::Status Load(absl::string_view path, ChunkStore* chunk_store,
+                    std::vector<std::shared_ptr<Table>>* tables) override;
+
+  // Finds the most recent checkpoint within `root_dir_` and calls `Load`.
+  absl::Status LoadLatest(std::vector<std::shared_ptr<Table>>* tables) override;
+
+  // Attempts to load the fallback checkpoint. If no fallback_checkpoint_path
+  // was set or if the no checkpoint found then `NotFoundError` is returned.
+  absl::Status LoadFallbackCheckpoint(
+      std::vector<std::shared_ptr<Table>>* tables) override;
+
+  // Returns a summary string description.
+  std::string DebugString() const override;
+
+  // SegmentCheckpointer is neither copyable nor movable.
+  SegmentCheckpointer(const SegmentCheckpointer&) = delete;
+  SegmentCheckpointer& operator=(const SegmentCheckpointer&) = delete;
+
+ private:
+  // Creates the segments directory and, the first time it is called, restores
+  // the locations of the chunks written by an earlier instance from the most
+  // recent checkpoint in `root_dir_`.
+  absl::Status InitializeLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Deletes all but the `keep_latest` most recent checkpoints and then the
+  // segments which are not referenced by any of the remaining checkpoints.
+  absl::Status DeleteOldDataLocked(int keep_latest)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const std::string root_dir_;
+  const std::string group_;
+  absl::optional<std::string> fallback_checkpoint_path_;
+
+  absl::Mutex mu_;
+
+  // True once `InitializeLocked` has completed successfully.
+  bool initialized_ ABSL_GUARDED_BY(mu_) = false;
+
+  // Identifier of the next segment to create.
+  uint64_t next_segment_id_ ABSL_GUARDED_BY(mu_) = 0;
+
+  // Location of every chunk which has been written to a segment that still
+  // exists.
+  internal::flat_hash_map<uint64_t, SegmentChunkLocation> locations_
+      ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_PLATFORM_SEGMENT_CHECKPOINTER_H_
@@ -0,0 +1,338 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/platform/segment_checkpointer.h"
+
+#include <cfloat>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "reverb/cc/chunk_store.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/rate_limiter.h"
+#include "reverb/cc/selectors/fifo.h"
+#include "reverb/cc/selectors/heap.h"
+#include "reverb/cc/selectors/prioritized.h"
+#include "reverb/cc/selectors/uniform.h"
+#include "reverb/cc/support/tf_util.h"
+#include "reverb/cc/table.h"
+#include "reverb/cc/testing/proto_test_util.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/platform/env.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+using ::deepmind::reverb::testing::EqualsProto;
+
+std::string MakeRoot() {
+  std::string name;
+  REVERB_CHECK(tensorflow::Env::Default()->LocalTempFilename(&name));
+  return name;
+}
+
+std::unique_ptr<Table> MakeUniformTable(const std::string& name) {
+  return std::make_unique<Table>(
+      name, std::make_unique<UniformSelector>(),
+      std::make_unique<FifoSelector>(), 1000, 0,
+      std::make_unique<RateLimiter>(1.0, 1, -DBL_MAX, DBL_MAX));
+}
+
+std::unique_ptr<Table> MakePrioritizedTable(const std::string& name,
+                                            double exponent) {
+  return std::make_unique<Table>(
+      name, std::make_unique<PrioritizedSelector>(exponent),
+      std::make_unique<HeapSelector>(), 1000, 0,
+      std::make_unique<RateLimiter>(1.0, 1, -DBL_MAX, DBL_MAX));
+}
+
+// Inserts `num_items` items, each referencing a new chunk, into every table
+// and returns the keys of the chunks. Chunk keys start at `first_key`.
+std::vector<ChunkStore::Key> InsertItems(
+    const std::vector<std::shared_ptr<Table>>& tables, ChunkStore* chunk_store,
+    int num_items, uint64_t first_key = 0) {
+  std::vector<ChunkStore::Key> chunk_keys;
+  for (int i = 0; i < num_items; i++) {
+    for (int j = 0; j < tables.size(); j++) {
+      chunk_keys.push_back(first_key + (j + 1) * 1000 + i);
+      auto chunk =
+          chunk_store->Insert(testing::MakeChunkData(chunk_keys.back()));
+      REVERB_EXPECT_OK(tables[j]->InsertOrAssign(
+          {testing::MakePrioritizedItem(tables[j]->name(), chunk_keys.back(),
+                                        i, {*chunk->Pin().value()}),
+           {chunk}}));
+    }
+  }
+  return chunk_keys;
+}
+
+std::vector<Table*> TablePtrs(
+    const std::vector<std::shared_ptr<Table>>& tables) {
+  std::vector<Table*> ptrs;
+  for (const auto& table : tables) {
+    ptrs.push_back(table.get());
+  }
+  return ptrs;
+}
+
+std::vector<std::string> ListSegments(const std::string& root) {
+  std::vector<std::string> filenames;
+  REVERB_CHECK_OK(
+      FromTensorflowStatus(tensorflow::Env::Default()->GetMatchingPaths(
+          tensorflow::io::JoinPath(root, "segments", "*"), &filenames)));
+  return filenames;
+}
+
+TEST(SegmentCheckpointerTest, CreatesDirectoryInRoot) {
+  std::string root = MakeRoot();
+  SegmentCheckpointer checkpointer(root);
+  std::string path;
+  auto* env = tensorflow::Env::Default();
+  REVERB_ASSERT_OK(checkpointer.Save(std::vector<Table*>{}, 1, &path));
+  ASSERT_EQ(tensorflow::io::Dirname(path), root);
+  REVERB_EXPECT_OK(FromTensorflowStatus(env->FileExists(path)));
+  EXPECT_THAT(ListSegments(root), ::testing::IsEmpty());
+}
+
+TEST(SegmentCheckpointerTest, SaveAndLoad) {
+  ChunkStore chunk_store;
+  std::vector<std::shared_ptr<Table>> tables;
+  tables.push_back(MakeUniformTable("uniform"));
+  tables.push_back(MakePrioritizedTable("prioritized_a", 0.5));
+  tables.push_back(MakePrioritizedTable("prioritized_b", 0.9));
+  auto chunk_keys = InsertItems(tables, &chunk_store, 100);
+
+  for (int i = 0; i < 100; i++) {
+    for (auto& table : tables) {
+      Table::SampledItem sample;
+      REVERB_EXPECT_OK(table->Sample(&sample));
+    }
+  }
+
+  SegmentCheckpointer checkpointer(MakeRoot());
+  std::string path;
+  REVERB_ASSERT_OK(checkpointer.Save(TablePtrs(tables), 1, &path));
+
+  ChunkStore loaded_chunk_store;
+  std::vector<std::shared_ptr<Table>> loaded_tables;
+  loaded_tables.push_back(MakeUniformTable("uniform"));
+  loaded_tables.push_back(MakePrioritizedTable("prioritized_a", 0.5));
+  loaded_tables.push_back(MakePrioritizedTable("prioritized_b", 0.9));
+  REVERB_ASSERT_OK(
+      checkpointer.Load(path, &loaded_chunk_store, &loaded_tables));
+
+  // Check that all the chunks have been added.
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks;
+  REVERB_EXPECT_OK(loaded_chunk_store.Get(chunk_keys, &chunks));
+  for (const auto& chunk : chunks) {
+    EXPECT_THAT(*chunk->Pin().value(),
+                EqualsProto(testing::MakeChunkData(chunk->key())));
+  }
+
+  // Check that the items and table state matches the original tables.
+  for (int i = 0; i < tables.size(); i++) {
+    ASSERT_EQ(loaded_tables[i]->size(), tables[i]->size());
+    internal::flat_hash_map<uint64_t, PrioritizedItem> loaded_items;
+    for (const auto& item : loaded_tables[i]->Copy()) {
+      loaded_items[item.key()] = item.AsPrioritizedItem();
+    }
+    for (const auto& item : tables[i]->Copy()) {
+      ASSERT_TRUE(loaded_items.contains(item.key()));
+      EXPECT_THAT(loaded_items[item.key()],
+                  EqualsProto(item.AsPrioritizedItem()));
+    }
+    EXPECT_THAT(loaded_tables[i]->info().rate_limiter_info(),
+                EqualsProto(tables[i]->info().rate_limiter_info()));
+  }
+}
+
+TEST(SegmentCheckpointerTest, SaveOnlyWritesNewChunks) {
+  ChunkStore chunk_store;
+  std::vector<std::shared_ptr<Table>> tables;
+  tables.push_back(MakeUniformTable("uniform"));
+  auto chunk_keys = InsertItems(tables, &chunk_store, 10);
+
+  auto root = MakeRoot();
+  SegmentCheckpointer checkpointer(root);
+  std::string path;
+  REVERB_ASSERT_OK(checkpointer.Save(TablePtrs(tables), 3, &path));
+  EXPECT_THAT(ListSegments(root), ::testing::SizeIs(1));
+
+  // Nothing has been inserted so no segment should be added.
+  REVERB_ASSERT_OK(checkpointer.Save(TablePtrs(tables), 3, &path));
+  EXPECT_THAT(ListSegments(root), ::testing::SizeIs(1));
+
+  // The new chunks are written to a new segment.
+  auto new_chunk_keys =
+      InsertItems(tables, &chunk_store, 10, /*first_key=*/100000);
+  chunk_keys.insert(chunk_keys.end(), new_chunk_keys.begin(),
+                    new_chunk_keys.end());
+  REVERB_ASSERT_OK(checkpointer.Save(TablePtrs(tables), 3, &path));
+  EXPECT_THAT(ListSegments(root), ::testing::SizeIs(2));
+
+  std::vector<std::shared_ptr<Table>> loaded_tables;
+  loaded_tables.push_back(MakeUniformTable("uniform"));
+  REVERB_ASSERT_OK(checkpointer.LoadLatest(&loaded_tables));
+  EXPECT_EQ(loaded_tables[0]->size(), 20);
+}
+
+TEST(SegmentCheckpointerTest, ReusesSegmentsOfEarlierInstance) {
+  ChunkStore chunk_store;
+  std::vector<std::shared_ptr<Table>> tables;
+  tables.push_back(MakeUniformTable("uniform"));
+  InsertItems(tables, &chunk_store, 10);
+
+  auto root = MakeRoot();
+  std::string path;
+  REVERB_ASSERT_OK(SegmentCheckpointer(root).Save(TablePtrs(tables), 1, &path));
+  REVERB_ASSERT_OK(SegmentCheckpointer(root).Save(TablePtrs(tables), 1, &path));
+  EXPECT_THAT(ListSegments(root), ::testing::SizeIs(1));
+}
+
+TEST(SegmentCheckpointerTest, SaveDeletesOldData) {
+  ChunkStore chunk_store;
+  std::vector<std::shared_ptr<Table>> tables;
+  tables.push_back(MakeUniformTable("uniform"));
+  tables.push_back(MakePrioritizedTable("prioritized_a", 0.5));
+  tables.push_back(MakePrioritizedTable("prioritized_b", 0.9));
+  InsertItems(tables, &chunk_store, 100);
+
+  auto test = [&tables](int keep_latest) {
+    auto root = MakeRoot();
+    SegmentCheckpointer checkpointer(root);
+
+    for (int i = 0; i < 10; i++) {
+      std::string path;
+      REVERB_ASSERT_OK(checkpointer.Save(TablePtrs(tables), keep_latest, &path));
+
+      std::vector<std::string> filenames;
+      REVERB_ASSERT_OK(
+          FromTensorflowStatus(tensorflow::Env::Default()->GetMatchingPaths(
+              tensorflow::io::JoinPath(root, "*"), &filenames)));
+      // The segments directory is not a checkpoint.
+      ASSERT_EQ(filenames.size(), std::min(keep_latest, i + 1) + 1);
+    }
+  };
+  test(1);  // Keep one checkpoint.
+  test(3);  // Edge case keep_latest == num_tables
+  test(5);  // Edge case keep_latest > num_tables
+}
+
+TEST(SegmentCheckpointerTest, SaveDeletesUnreferencedSegments) {
+  ChunkStore chunk_store;
+  std::vector<std::shared_ptr<Table>> tables;
+  tables.push_back(MakeUniformTable("uniform"));
+  InsertItems(tables, &chunk_store, 10);
+
+  auto root = MakeRoot();
+  SegmentCheckpointer checkpointer(root);
+  std::string path;
+  REVERB_ASSERT_OK(checkpointer.Save(TablePtrs(tables), 1, &path));
+  auto first_segments = ListSegments(root);
+  ASSERT_THAT(first_segments, ::testing::SizeIs(1));
+
+  // Replace all the items so the first segment is no longer referenced.
+  REVERB_ASSERT_OK(tables[0]->Reset());
+  InsertItems(tables, &chunk_store, 10, /*first_key=*/100000);
+  REVERB_ASSERT_OK(checkpointer.Save(TablePtrs(tables), 1, &path));
+  auto second_segments = ListSegments(root);
+  ASSERT_THAT(second_segments, ::testing::SizeIs(1));
+  EXPECT_NE(first_segments[0], second_segments[0]);
+
+  // The chunks of the deleted segment have to be written again if they are
+  // referenced by a later checkpoint.
+  REVERB_ASSERT_OK(tables[0]->Reset());
+  InsertItems(tables, &chunk_store, 10);
+  REVERB_ASSERT_OK(checkpointer.Save(TablePtrs(tables), 1, &path));
+
+  std::vector<std::shared_ptr<Table>> loaded_tables;
+  loaded_tables.push_back(MakeUniformTable("uniform"));
+  REVERB_ASSERT_OK(checkpointer.LoadLatest(&loaded_tables));
+  EXPECT_EQ(loaded_tables[0]->size(), 10);
+}
+
+TEST(SegmentCheckpointerTest, LoadDetectsCorruptSegment) {
+  ChunkStore chunk_store;
+  std::vector<std::shared_ptr<Table>> tables;
+  tables.push_back(MakeUniformTable("uniform"));
+  InsertItems(tables, &chunk_store, 10);
+
+  auto root = MakeRoot();
+  SegmentCheckpointer checkpointer(root);
+  std::string path;
+  REVERB_ASSERT_OK(checkpointer.Save(TablePtrs(tables), 1, &path));
+
+  auto segments = ListSegments(root);
+  ASSERT_THAT(segments, ::testing::SizeIs(1));
+  std::string data;
+  REVERB_ASSERT_OK(FromTensorflowStatus(tensorflow::ReadFileToString(
+      tensorflow::Env::Default(), segments[0], &data)));
+  data[data.size() / 2] ^= 0xff;
+  REVERB_ASSERT_OK(FromTensorflowStatus(tensorflow::WriteStringToFile(
+      tensorflow::Env::Default(), segments[0], data)));
+
+  ChunkStore loaded_chunk_store;
+  std::vector<std::shared_ptr<Table>> loaded_tables;
+  loaded_tables.push_back(MakeUniformTable("uniform"));
+  EXPECT_EQ(checkpointer.Load(path, &loaded_chunk_store, &loaded_tables).code(),
+            absl::StatusCode::kDataLoss);
+}
+
+TEST(SegmentCheckpointerTest, KeepLatestZeroReturnsError) {
+  SegmentCheckpointer checkpointer(MakeRoot());
+  std::string path;
+  EXPECT_EQ(checkpointer.Save(std::vector<Table*>{}, 0, &path).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(SegmentCheckpointerTest, LoadLatestInEmptyDir) {
+  SegmentCheckpointer checkpointer(MakeRoot());
+  std::vector<std::shared_ptr<Table>> tables;
+  EXPECT_EQ(checkpointer.LoadLatest(&tables).code(),
+            absl::StatusCode::kNotFound);
+}
+
+TEST(SegmentCheckpointerTest, LoadMissingFallbackCheckpoint) {
+  SegmentCheckpointer checkpointer(MakeRoot(), "", MakeRoot());
+  std::vector<std::shared_ptr<Table>> tables;
+  EXPECT_EQ(checkpointer.LoadFallbackCheckpoint(&tables).code(),
+            absl::StatusCode::kNotFound);
+}
+
+TEST(SegmentCheckpointerTest, LoadFallbackCheckpoint) {
+  ChunkStore chunk_store;
+  std::vector<std::shared_ptr<Table>> tables;
+  tables.push_back(MakeUniformTable("uniform"));
+  InsertItems(tables, &chunk_store, 10);
+
+  std::string path;
+  REVERB_ASSERT_OK(
+      SegmentCheckpointer(MakeRoot()).Save(TablePtrs(tables), 1, &path));
+
+  SegmentCheckpointer second_checkpointer(MakeRoot(), "", path);
+  std::vector<std::shared_ptr<Table>> loaded_tables;
+  loaded_tables.push_back(MakeUniformTable("uniform"));
+  REVERB_ASSERT_OK(second_checkpointer.LoadFallbackCheckpoint(&loaded_tables));
+  EXPECT_EQ(loaded_tables[0]->size(), 10);
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
@@ -20,6 +20,7 @@
 
 #include "absl/status/status.h"
 #include "reverb/cc/checkpointing/interface.h"
+#include "reverb/cc/chunk_spill_tier.h"
 #include "reverb/cc/client.h"
 #include "reverb/cc/table.h"
 
@@ -49,6 +50,13 @@ absl::Status StartServer(std::vector<std::shared_ptr<Table>> tables, int port,
                          std::shared_ptr<Checkpointer> checkpointer,
                          std::unique_ptr<Server> *server);
 
+// As above but the data of chunks inserted into the server may be spilled to
+// disk by `spill_tier`. See `ChunkSpillTier` for details.
+absl::Status StartServer(std::vector<std::shared_ptr<Table>> tables, int port,
+                         std::shared_ptr<Checkpointer> checkpointer,
+                         std::shared_ptr<ChunkSpillTier> spill_tier,
+                         std::unique_ptr<Server> *server);
+
 }  // namespace reverb
 }  // namespace deepmind
 
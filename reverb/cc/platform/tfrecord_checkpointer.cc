@@ -16,7 +16,6 @@
 
 #include <algorithm>
 #include <cstdint>
-#include <iterator>
 #include <memory>
 #include <string>
 #include <utility>
@@ -26,23 +25,21 @@
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
-#include "absl/strings/str_join.h"
+#include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "reverb/cc/checkpointing/checkpoint.pb.h"
+#include "reverb/cc/checkpointing/table_restore.h"
 #include "reverb/cc/chunk_store.h"
-#include "reverb/cc/platform/checkpointing_utils.h"
 #include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/platform/hash_set.h"
 #include "reverb/cc/platform/logging.h"
 #include "reverb/cc/platform/status_macros.h"
-#include "reverb/cc/rate_limiter.h"
 #include "reverb/cc/schema.pb.h"
+#include "reverb/cc/support/task_executor.h"
 #include "reverb/cc/support/tf_util.h"
-#include "reverb/cc/support/trajectory_util.h"
 #include "reverb/cc/table.h"
-#include "reverb/cc/table_extensions/interface.h"
 #include "tensorflow/core/lib/io/compression.h"
 #include "tensorflow/core/lib/io/path.h"
 #include "tensorflow/core/lib/io/record_reader.h"
@@ -56,7 +53,10 @@ namespace {
 
 constexpr char kTablesFileName[] = "tables.tfrecord";
 constexpr char kItemsFileName[] = "items.tfrecord";
-constexpr char kChunksFileName[] = "chunks.tfrecord";
+// Checkpoints written before chunks were sharded store all of them in a
+// single file.
+constexpr char kLegacyChunksFileName[] = "chunks.tfrecord";
+constexpr char kChunksShardGlob[] = "chunks-*-of-*.tfrecord";
 constexpr char kDoneFileName[] = "DONE";
 
 using RecordWriterUniquePtr =
@@ -102,6 +102,59 @@ absl::Status OpenReader(const std::string& path, RecordReaderUniquePtr* reader,
   return absl::OkStatus();
 }
 
+std::string ChunksShardFileName(int shard, int num_shards) {
+  return absl::StrFormat("chunks-%05d-of-%05d.tfrecord", shard, num_shards);
+}
+
+std::unique_ptr<TaskExecutor> MakeExecutor(int num_threads) {
+  if (num_threads <= 1) return nullptr;
+  return std::make_unique<TaskExecutor>(num_threads, "TFRecordCheckpointer");
+}
+
+absl::Status WriteItems(const std::string& path,
+                        const std::vector<PrioritizedItem>& items) {
+  RecordWriterUniquePtr item_writer;
+  REVERB_RETURN_IF_ERROR(OpenWriter(path, &item_writer));
+
+  for (const auto& item : items) {
+    std::string serialized;
+    if (!item.AppendToString(&serialized)) {
+      return absl::DataLossError(
+          absl::StrCat("Unable to serialize item.  Item key: '", item.key(),
+                       "' and proto size: ", item.ByteSizeLong(),
+                       " bytes.  Please check your logs."));
+    }
+    REVERB_RETURN_IF_ERROR(
+        FromTensorflowStatus(item_writer->WriteRecord(serialized)));
+  }
+  return FromTensorflowStatus(item_writer->Close());
+}
+
+// Writes every `num_shards`-th chunk of `chunks`, starting at `shard`, to a
+// new file at `path`.
+absl::Status WriteChunks(
+    const std::string& path,
+    const std::vector<std::shared_ptr<ChunkStore::Chunk>>& chunks, int shard,
+    int num_shards) {
+  RecordWriterUniquePtr chunk_writer;
+  REVERB_RETURN_IF_ERROR(OpenWriter(path, &chunk_writer));
+
+  for (size_t i = shard; i < chunks.size(); i += num_shards) {
+    REVERB_ASSIGN_OR_RETURN(const auto data, chunks[i]->Pin());
+    std::string serialized;
+    if (!data->AppendToString(&serialized)) {
+      return absl::DataLossError(absl::StrCat(
+          "Unable to serialize chunk.  Chunk key: '", data->chunk_key(),
+          "' and proto size: ", data->ByteSizeLong(),
+          " bytes.  Perhaps the proto is >2GB?  Please also check your "
+          "logs."));
+    }
+    REVERB_RETURN_IF_ERROR(
+        FromTensorflowStatus(chunk_writer->WriteRecord(serialized)));
+  }
+  return FromTensorflowStatus(chunk_writer->Close());
+}
+
 inline absl::Status WriteDone(const std::string& path) {
   std::unique_ptr<tensorflow::WritableFile> file;
   REVERB_RETURN_IF_ERROR(
@@ -122,43 +175,15 @@ inline bool HasItems(const std::string& path) {
       .ok();
 }
 
-absl::StatusOr<size_t> GetTableIndex(
-    const std::vector<std::shared_ptr<Table>>& tables,
-    const std::string& name) {
-  for (size_t i = 0; i < tables.size(); i++) {
-    if (tables[i]->name() == name) {
-      return i;
-    }
-  }
-  std::vector<std::string> table_names(tables.size());
-  for (size_t i = 0; i < tables.size(); i++) {
-    table_names[i] = absl::StrCat("'", tables[i]->name(), "'");
-  }
-
-  return absl::InvalidArgumentError(absl::StrCat(
-      "Trying to load table '", name,
-      "' but table was not found in provided list of tables. Available "
-      "tables: [",
-      absl::StrJoin(table_names, ", "), "]"));
-}
-
-absl::Status CheckTrajectoryFormat(const PrioritizedItem& item) {
-  if (item.has_deprecated_sequence_range() && item.has_flat_trajectory()) {
-    return absl::InternalError(absl::StrCat(
-        "Item ", item.key(), " has both deprecated and new trajectory format: ",
-        item.DebugString(), "."));
-  }
-  return absl::OkStatus();
-}
-
 }  // namespace
 
 TFRecordCheckpointer::TFRecordCheckpointer(
     std::string root_dir, std::string group,
-    absl::optional<std::string> fallback_checkpoint_path)
+    absl::optional<std::string> fallback_checkpoint_path, int num_threads)
     : root_dir_(std::move(root_dir)),
       group_(std::move(group)),
-      fallback_checkpoint_path_(std::move(fallback_checkpoint_path)) {
+      fallback_checkpoint_path_(std::move(fallback_checkpoint_path)),
+      num_threads_(std::max(1, num_threads)) {
   REVERB_LOG(REVERB_INFO) << " Initializing TFRecordCheckpointer in "
                           << root_dir_
                           << (fallback_checkpoint_path_.has_value()
@@ -213,44 +238,25 @@ absl::Status TFRecordCheckpointer::Save(std::vector<Table*> tables,
     REVERB_RETURN_IF_ERROR(FromTensorflowStatus(table_writer->Close()));
   }
 
-  {
-    RecordWriterUniquePtr item_writer;
-    REVERB_RETURN_IF_ERROR(OpenWriter(
-        tensorflow::io::JoinPath(dir_path, kItemsFileName), &item_writer));
-
-    for (const auto& item : items) {
-      std::string serialized;
-      if (!item.AppendToString(&serialized)) {
-        return absl::DataLossError(
-            absl::StrCat("Unable to serialize item.  Item key: '", item.key(),
-                         "' and proto size: ", item.ByteSizeLong(),
-                         " bytes.  Please check your logs."));
-      }
-      REVERB_RETURN_IF_ERROR(
-          FromTensorflowStatus(item_writer->WriteRecord(serialized)));
-    }
-    REVERB_RETURN_IF_ERROR(FromTensorflowStatus(item_writer->Close()));
-  }
-
-  {
-    RecordWriterUniquePtr chunk_writer;
-    REVERB_RETURN_IF_ERROR(OpenWriter(
-        tensorflow::io::JoinPath(dir_path, kChunksFileName), &chunk_writer));
-
-    for (const auto& chunk : chunks) {
-      std::string serialized;
-      if (!chunk->data().AppendToString(&serialized)) {
-        return absl::DataLossError(absl::StrCat(
-            "Unable to serialize chunk.  Chunk key: '", chunk->key(),
-            "' and proto size: ", chunk->data().ByteSizeLong(),
-            " bytes.  Perhaps the proto is >2GB?  Please also check your "
-            "logs."));
-      }
-      REVERB_RETURN_IF_ERROR(
-          FromTensorflowStatus(chunk_writer->WriteRecord(serialized)));
-    }
-    REVERB_RETURN_IF_ERROR(FromTensorflowStatus(chunk_writer->Close()));
-  }
+  // Chunks are spread over `num_shards` files so that they can be serialized
+  // and compressed in parallel, alongside the items.
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> chunk_list(chunks.begin(),
+                                                             chunks.end());
+  chunks.clear();
+  const int num_shards = std::max(
+      1, std::min(num_threads_, static_cast<int>(chunk_list.size())));
+  auto executor = MakeExecutor(num_threads_);
+  REVERB_RETURN_IF_ERROR(ParallelFor(
+      executor.get(), num_shards + 1, [&](int i) -> absl::Status {
+        if (i == 0) {
+          return WriteItems(
+              tensorflow::io::JoinPath(dir_path, kItemsFileName), items);
+        }
+        return WriteChunks(
+            tensorflow::io::JoinPath(dir_path,
+                                     ChunksShardFileName(i - 1, num_shards)),
+            chunk_list, i - 1, num_shards);
+      }));
 
   // Both chunks and table checkpoint has now been written so we can proceed to
   // add the DONE-file.
@@ -279,10 +285,68 @@ absl::Status TFRecordCheckpointer::Save(std::vector<Table*> tables,
 
 namespace {
 
+// Returns the paths of the files holding the chunks of the checkpoint in
+// `path`.
+absl::Status ListChunkFiles(const std::string& path,
+                            std::vector<std::string>* files) {
+  std::string legacy = tensorflow::io::JoinPath(path, kLegacyChunksFileName);
+  if (tensorflow::Env::Default()->FileExists(legacy).ok()) {
+    files->push_back(std::move(legacy));
+    return absl::OkStatus();
+  }
+  REVERB_RETURN_IF_ERROR(
+      FromTensorflowStatus(tensorflow::Env::Default()->GetMatchingPaths(
+          tensorflow::io::JoinPath(path, kChunksShardGlob), files)));
+  std::sort(files->begin(), files->end());
+  return absl::OkStatus();
+}
+
+// Reads all chunks from the file at `path` and inserts them into
+// `chunk_store`. The inserted chunks are appended to `chunks`.
+absl::Status ReadChunks(const std::string& path,
+                        const std::string& compression_type,
+                        ChunkStore* chunk_store,
+                        std::vector<std::shared_ptr<ChunkStore::Chunk>>* chunks) {
+  RecordReaderUniquePtr chunk_reader;
+  REVERB_RETURN_IF_ERROR(OpenReader(path, &chunk_reader, compression_type));
+
+  ChunkData chunk_data;
+  absl::Status chunk_status;
+  uint64_t chunk_offset = 0;
+  tensorflow::tstring chunk_record;
+  do {
+    chunk_status = FromTensorflowStatus(
+        chunk_reader->ReadRecord(&chunk_offset, &chunk_record));
+    if (!chunk_status.ok()) break;
+    if (!chunk_data.ParseFromArray(chunk_record.data(), chunk_record.size())) {
+      return absl::DataLossError(
+          absl::StrCat("Could not parse TFRecord as ChunkData: '",
+                       absl::string_view(chunk_record), "'"));
+    }
+    if (chunk_data.deprecated_data_size()) {
+      if (!chunk_data.data().tensors().empty()) {
+        return absl::InternalError(absl::StrCat(
+            "Checkpoint ChunkData at offset: ", chunk_offset, " of ", path,
+            " has both data and deprecated_data."));
+      }
+      chunk_data.mutable_data()->mutable_tensors()->Swap(
+          chunk_data.mutable_deprecated_data());
+    }
+    chunks->push_back(chunk_store->Insert(std::move(chunk_data)));
+
+    REVERB_LOG_EVERY_N(REVERB_INFO, 100)
+        << "Still reading compressed trajectory data. " << chunks->size()
+        << " records have been read from " << path << " so far.";
+  } while (chunk_status.ok());
+
+  return absl::IsOutOfRange(chunk_status) ? absl::OkStatus() : chunk_status;
+}
+
 absl::Status LoadWithCompression(absl::string_view path,
                                  ChunkStore* chunk_store,
                                  std::vector<std::shared_ptr<Table>>* tables,
-                                 const std::string& compression_type) {
+                                 const std::string& compression_type,
+                                 TaskExecutor* executor) {
   REVERB_LOG(REVERB_INFO) << "Loading checkpoint from " << std::string(path);
   if (!HasDone(std::string(path))) {
     return absl::InvalidArgumentError(absl::StrCat(
@@ -325,14 +389,14 @@ absl::Status LoadWithCompression(absl::string_view path,
       }
 
       REVERB_RETURN_IF_ERROR(
-          GetTableIndex(*tables, checkpoint.table_name()).status());
+          internal::GetTableIndex(*tables, checkpoint.table_name()).status());
 
       if (!checkpoint.deprecated_items().empty()) {
         auto& items = table_to_items[checkpoint.table_name()];
         items.reserve(checkpoint.deprecated_items().size());
         deprecated_items = absl::StrCat("'", checkpoint.table_name(), "'");
         for (auto& item : *checkpoint.mutable_deprecated_items()) {
-          REVERB_RETURN_IF_ERROR(CheckTrajectoryFormat(item));
+          REVERB_RETURN_IF_ERROR(internal::CheckTrajectoryFormat(item));
           items.push_back(std::move(item));
         }
         checkpoint.mutable_deprecated_items()->Clear();
@@ -353,13 +417,17 @@ absl::Status LoadWithCompression(absl::string_view path,
 
   bool non_deprecated_items = HasItems(std::string(path));
 
-  if (non_deprecated_items) {
-    if (!deprecated_items.empty()) {
-      return absl::InvalidArgumentError(absl::StrCat(
-          "Checkpoint loader found mix of deprecated_items field for table ",
-          deprecated_items, " and items file '",
-          tensorflow::io::JoinPath(std::string(path), kItemsFileName), "'"));
-    }
+  if (non_deprecated_items && !deprecated_items.empty()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Checkpoint loader found mix of deprecated_items field for table ",
+        deprecated_items, " and items file '",
+        tensorflow::io::JoinPath(std::string(path), kItemsFileName), "'"));
+  }
+
+  // The items only depend on the (already loaded) table metadata so they are
+  // read concurrently with the chunks.
+  auto read_items = [&]() -> absl::Status {
+    if (!non_deprecated_items) return absl::OkStatus();
 
     RecordReaderUniquePtr item_reader;
     REVERB_RETURN_IF_ERROR(
@@ -381,7 +449,7 @@ absl::Status LoadWithCompression(absl::string_view path,
                          absl::string_view(item_record), "'"));
       }
 
-      REVERB_RETURN_IF_ERROR(CheckTrajectoryFormat(item));
+      REVERB_RETURN_IF_ERROR(internal::CheckTrajectoryFormat(item));
 
       if (items == nullptr || items->empty() ||
           items->at(0).table() != item.table()) {
@@ -396,10 +464,8 @@ absl::Status LoadWithCompression(absl::string_view path,
       items->push_back(std::move(item));
     } while (item_status.ok());
 
-    if (!absl::IsOutOfRange(item_status)) {
-      return item_status;
-    }
-  }
+    return absl::IsOutOfRange(item_status) ? absl::OkStatus() : item_status;
+  };
 
   REVERB_LOG(REVERB_INFO)
       << "Successfully loaded and verified metadata for all ("
@@ -408,153 +474,43 @@ absl::Status LoadWithCompression(absl::string_view path,
          "in the table.";
 
   // Insert data first to ensure that all data referenced by the tables
-  // exists. Keep the map of chunks around so that none of the chunks are
-  // cleaned up before all the tables have been loaded.
-  internal::flat_hash_map<ChunkStore::Key, std::shared_ptr<ChunkStore::Chunk>>
-      chunk_by_key;
-  {
-    RecordReaderUniquePtr chunk_reader;
-    REVERB_RETURN_IF_ERROR(
-        OpenReader(tensorflow::io::JoinPath(std::string(path), kChunksFileName),
-                   &chunk_reader, compression_type));
-
-    ChunkData chunk_data;
-    absl::Status chunk_status;
-    uint64_t chunk_offset = 0;
-    tensorflow::tstring chunk_record;
-    do {
-      chunk_status = FromTensorflowStatus(
-          chunk_reader->ReadRecord(&chunk_offset, &chunk_record));
-      if (!chunk_status.ok()) break;
-      if (!chunk_data.ParseFromArray(chunk_record.data(),
-                                     chunk_record.size())) {
-        return absl::DataLossError(
-            absl::StrCat("Could not parse TFRecord as ChunkData: '",
-                         absl::string_view(chunk_record), "'"));
-      }
-      if (chunk_data.deprecated_data_size()) {
-        if (!chunk_data.data().tensors().empty()) {
-          return absl::InternalError(
-              absl::StrCat("Checkpoint ChunkData at offset: ", chunk_offset,
-                           " has both data and deprecated_data."));
-        }
-        chunk_data.mutable_data()->mutable_tensors()->Swap(
-            chunk_data.mutable_deprecated_data());
-      }
-      const auto key = chunk_data.chunk_key();
-      chunk_by_key[key] = chunk_store->Insert(std::move(chunk_data));
-
-      REVERB_LOG_EVERY_N(REVERB_INFO, 100)
-          << "Still reading compressed trajectory data. " << chunk_by_key.size()
-          << " records have been read so far.";
-    } while (chunk_status.ok());
-
-    if (!absl::IsOutOfRange(chunk_status)) {
-      return chunk_status;
-    }
-  }
+  // exists. Keep the chunks around so that none of them are cleaned up before
+  // all the tables have been loaded.
+  std::vector<std::string> chunk_files;
+  REVERB_RETURN_IF_ERROR(ListChunkFiles(std::string(path), &chunk_files));
+  std::vector<std::vector<std::shared_ptr<ChunkStore::Chunk>>> chunks(
+      chunk_files.size());
+  REVERB_RETURN_IF_ERROR(ParallelFor(
+      executor, chunk_files.size() + 1, [&](int i) -> absl::Status {
+        if (i == 0) return read_items();
+        return ReadChunks(chunk_files[i - 1], compression_type, chunk_store,
+                          &chunks[i - 1]);
+      }));
 
   REVERB_LOG(REVERB_INFO)
       << "Completed reading compressed trajectory data. We'll now start "
          "assembling the checkpointed tables.";
 
-  std::vector<std::shared_ptr<TableExtension>> all_table_extensions;
-
-  for (auto& checkpoint_ref : table_checkpoints) {
-    auto& checkpoint = checkpoint_ref.second;
-    REVERB_ASSIGN_OR_RETURN(size_t table_idx,
-                            GetTableIndex(*tables, checkpoint.table_name()));
-    std::shared_ptr<Table>& server_table = tables->at(table_idx);
-
-    auto sampler = MakeSelector(checkpoint.sampler());
-    auto remover = MakeSelector(checkpoint.remover());
-    auto rate_limiter =
-        std::make_shared<RateLimiter>(checkpoint.rate_limiter());
-    auto extensions = server_table->UnsafeClearExtensions();
-    auto signature =
-        checkpoint.has_signature()
-            ? absl::make_optional(std::move(checkpoint.signature()))
-            : absl::nullopt;
-
-    std::copy(extensions.begin(), extensions.end(),
-              std::back_inserter(all_table_extensions));
-
-    auto loaded_table = std::make_shared<Table>(
-        /*name=*/checkpoint.table_name(),
-        /*sampler=*/std::move(sampler),
-        /*remover=*/std::move(remover),
-        /*max_size=*/checkpoint.max_size(),
-        /*max_times_sampled=*/checkpoint.max_times_sampled(),
-        /*rate_limiter=*/std::move(rate_limiter),
-        /*extensions=*/std::move(extensions),
-        /*signature=*/std::move(signature));
-    loaded_table->set_num_deleted_episodes_from_checkpoint(
-        checkpoint.num_deleted_episodes());
-    loaded_table->set_num_unique_samples_from_checkpoint(
-        checkpoint.num_unique_samples());
-
-    server_table.swap(loaded_table);
-  }
-
-  // Notify the extensions about the updated list of tables so they can update
-  // their target table pointers (if any). It is important that we do this
-  // before the items are loaded to allow the extensions to handle `OnInsert`
-  // correctly.
-  for (auto& extension : all_table_extensions) {
-    extension->OnCheckpointLoaded(*tables);
-  }
-
-  for (auto& table : *tables) {
-    for (auto& checkpoint_item : table_to_items[table->name()]) {
-      if (checkpoint_item.has_deprecated_sequence_range()) {
-        std::vector<std::shared_ptr<ChunkStore::Chunk>> trajectory_chunks;
-        REVERB_RETURN_IF_ERROR(chunk_store->Get(
-            checkpoint_item.deprecated_chunk_keys(), &trajectory_chunks));
-
-        *checkpoint_item.mutable_flat_trajectory() =
-            internal::FlatTimestepTrajectory(
-                trajectory_chunks,
-                checkpoint_item.deprecated_sequence_range().offset(),
-                checkpoint_item.deprecated_sequence_range().length());
-
-        checkpoint_item.clear_deprecated_sequence_range();
-        checkpoint_item.clear_deprecated_chunk_keys();
-      }
-
-      std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks;
-      REVERB_RETURN_IF_ERROR(chunk_store->Get(
-          internal::GetChunkKeys(checkpoint_item.flat_trajectory()), &chunks));
-
-      // The original table has already been destroyed so if this fails then
-      // there is way to recover.
-      REVERB_RETURN_IF_ERROR(table->InsertCheckpointItem(
-          Table::Item(std::move(checkpoint_item), std::move(chunks))));
-    }
-
-    REVERB_LOG(REVERB_INFO)
-        << "Table " << table->name() << " and " << table->size()
-        << " items have been successfully loaded from checkpoint at path "
-        << path << ".";
-  }
-
-  REVERB_LOG(REVERB_INFO) << "Successfully loaded " << table_checkpoints.size()
-                          << " tables from " << path;
-
-  return absl::OkStatus();
+  return internal::RestoreTables(std::move(table_checkpoints),
+                                 std::move(table_to_items), chunk_store,
+                                 tables, path, executor);
 }
 }  // end namespace
 
 absl::Status TFRecordCheckpointer::Load(
     absl::string_view path, ChunkStore* chunk_store,
     std::vector<std::shared_ptr<Table>>* tables) {
+  auto executor = MakeExecutor(num_threads_);
   auto status = LoadWithCompression(
         path, chunk_store, tables,
-        /*compression_type=*/tensorflow::io::compression::kZlib);
+        /*compression_type=*/tensorflow::io::compression::kZlib,
+        executor.get());
   if (absl::IsDataLoss(status)) {
     // This may be an old checkpoint, written without compression.  Try again.
     status = LoadWithCompression(
         path, chunk_store, tables,
-        /*compression_type=*/tensorflow::io::compression::kNone);
+        /*compression_type=*/tensorflow::io::compression::kNone,
+        executor.get());
   }
   return status;
 }
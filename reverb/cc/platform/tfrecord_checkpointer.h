@@ -50,7 +50,9 @@ namespace reverb {
 //     <timestamp of the checkpoint>/
 //       tables.tfrecord
 //       items.tfrecord
-//       chunks.tfrecord
+//       chunks-00000-of-0000N.tfrecord
+//       ...
+//       chunks-0000(N-1)-of-0000N.tfrecord
 //       DONE
 //
 // DONE an empty file written once the checkpoint has been successfully written.
@@ -58,6 +60,10 @@ namespace reverb {
 // the operation was unexpectedly interrupted and the data should be considered
 // corrupt.
 //
+// The chunks are split over up to `num_threads` files so that they can be
+// compressed and parsed in parallel. Checkpoints written before the chunks were
+// sharded (with all chunks in a single `chunks.tfrecord`) can still be loaded.
+//
 // The most recent checkpoint can therefore be inferred from the name of the
 // directories within `root_dir`.
 //
@@ -70,9 +76,15 @@ namespace reverb {
 // initialization.
 class TFRecordCheckpointer : public Checkpointer {
  public:
+  // Default number of threads used to write and read a checkpoint.
+  static constexpr int kDefaultNumThreads = 8;
+
+  // `num_threads` limits the number of files that are written or read
+  // concurrently. If it is 1 then everything happens on the calling thread.
   explicit TFRecordCheckpointer(
       std::string root_dir, std::string group = "",
-      absl::optional<std::string> fallback_checkpoint_path = absl::nullopt);
+      absl::optional<std::string> fallback_checkpoint_path = absl::nullopt,
+      int num_threads = kDefaultNumThreads);
 
   // Save a new checkpoint for every table in `tables` in sub directory
   // inside `root_dir_`. If the call is successful, the ABSOLUTE path to the
@@ -115,6 +127,7 @@ class TFRecordCheckpointer : public Checkpointer {
   const std::string root_dir_;
   const std::string group_;
   absl::optional<std::string> fallback_checkpoint_path_;
+  const int num_threads_;
 };
 
 }  // namespace reverb
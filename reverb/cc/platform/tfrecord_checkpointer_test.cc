@@ -107,7 +107,7 @@ TEST(TFRecordCheckpointerTest, SaveAndLoad) {
           chunk_store.Insert(testing::MakeChunkData(chunk_keys.back()));
       REVERB_EXPECT_OK(tables[j]->InsertOrAssign(
           {testing::MakePrioritizedItem(tables[j]->name(), i, i,
-                                        {chunk->data()}),
+                                        {*chunk->Pin().value()}),
            {chunk}}));
     }
   }
@@ -167,6 +167,79 @@ TEST(TFRecordCheckpointerTest, SaveAndLoad) {
   }
 }
 
+TEST(TFRecordCheckpointerTest, LoadsShardsWithDifferentNumThreads) {
+  ChunkStore chunk_store;
+  auto table = MakeUniformTable("uniform");
+  std::vector<ChunkStore::Key> chunk_keys;
+  for (int i = 0; i < 100; i++) {
+    chunk_keys.push_back(i);
+    auto chunk = chunk_store.Insert(testing::MakeChunkData(i));
+    REVERB_EXPECT_OK(table->InsertOrAssign(
+        {testing::MakePrioritizedItem(table->name(), i, i,
+                                      {*chunk->Pin().value()}),
+         {chunk}}));
+  }
+
+  std::string root = MakeRoot();
+  std::string path;
+  REVERB_ASSERT_OK(TFRecordCheckpointer(root, "", absl::nullopt,
+                                        /*num_threads=*/4)
+                       .Save({table.get()}, 1, &path));
+
+  std::vector<std::string> shards;
+  REVERB_ASSERT_OK(
+      FromTensorflowStatus(tensorflow::Env::Default()->GetMatchingPaths(
+          tensorflow::io::JoinPath(path, "chunks-*-of-00004.tfrecord"),
+          &shards)));
+  EXPECT_EQ(shards.size(), 4);
+
+  for (int num_threads : {1, 2, 8}) {
+    ChunkStore loaded_chunk_store;
+    std::vector<std::shared_ptr<Table>> loaded_tables;
+    loaded_tables.push_back(MakeUniformTable("uniform"));
+    REVERB_ASSERT_OK(TFRecordCheckpointer(root, "", absl::nullopt, num_threads)
+                         .Load(path, &loaded_chunk_store, &loaded_tables));
+
+    std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks;
+    REVERB_EXPECT_OK(loaded_chunk_store.Get(chunk_keys, &chunks));
+    EXPECT_EQ(loaded_tables[0]->size(), table->size());
+  }
+}
+
+TEST(TFRecordCheckpointerTest, LoadsUnshardedChunks) {
+  ChunkStore chunk_store;
+  auto table = MakeUniformTable("uniform");
+  std::vector<ChunkStore::Key> chunk_keys;
+  for (int i = 0; i < 10; i++) {
+    chunk_keys.push_back(i);
+    auto chunk = chunk_store.Insert(testing::MakeChunkData(i));
+    REVERB_EXPECT_OK(table->InsertOrAssign(
+        {testing::MakePrioritizedItem(table->name(), i, i,
+                                      {*chunk->Pin().value()}),
+         {chunk}}));
+  }
+
+  TFRecordCheckpointer checkpointer(MakeRoot(), "", absl::nullopt,
+                                    /*num_threads=*/1);
+  std::string path;
+  REVERB_ASSERT_OK(checkpointer.Save({table.get()}, 1, &path));
+
+  // Older checkpoints stored all chunks in a single file.
+  REVERB_ASSERT_OK(FromTensorflowStatus(tensorflow::Env::Default()->RenameFile(
+      tensorflow::io::JoinPath(path, "chunks-00000-of-00001.tfrecord"),
+      tensorflow::io::JoinPath(path, "chunks.tfrecord"))));
+
+  ChunkStore loaded_chunk_store;
+  std::vector<std::shared_ptr<Table>> loaded_tables;
+  loaded_tables.push_back(MakeUniformTable("uniform"));
+  REVERB_ASSERT_OK(
+      checkpointer.Load(path, &loaded_chunk_store, &loaded_tables));
+
+  std::vector<std::shared_ptr<ChunkStore::Chunk>> chunks;
+  REVERB_EXPECT_OK(loaded_chunk_store.Get(chunk_keys, &chunks));
+  EXPECT_EQ(loaded_tables[0]->size(), table->size());
+}
+
 TEST(TFRecordCheckpointerTest, SaveDeletesOldData) {
   ChunkStore chunk_store;
 
@@ -183,7 +256,7 @@ TEST(TFRecordCheckpointerTest, SaveDeletesOldData) {
           chunk_store.Insert(testing::MakeChunkData(chunk_keys.back()));
       REVERB_EXPECT_OK(tables[j]->InsertOrAssign(
           {testing::MakePrioritizedItem(tables[j]->name(), i, i,
-                                        {chunk->data()}),
+                                        {*chunk->Pin().value()}),
            {chunk}}));
     }
   }
@@ -233,7 +306,7 @@ TEST(TFRecordCheckpointerTest, KeepLatestZeroReturnsError) {
           chunk_store.Insert(testing::MakeChunkData(chunk_keys.back()));
       REVERB_EXPECT_OK(tables[j]->InsertOrAssign(
           {testing::MakePrioritizedItem(tables[j]->name(), i, i,
-                                        {chunk->data()}),
+                                        {*chunk->Pin().value()}),
            {chunk}}));
     }
   }
@@ -285,7 +358,7 @@ TEST(TFRecordCheckpointerTest, LoadFallbackCheckpoint) {
           chunk_store.Insert(testing::MakeChunkData(chunk_keys.back()));
       REVERB_EXPECT_OK(tables[j]->InsertOrAssign(
           {testing::MakePrioritizedItem(tables[j]->name(), i, i,
-                                        {chunk->data()}),
+                                        {*chunk->Pin().value()}),
            {chunk}}));
     }
   }
@@ -51,6 +51,11 @@ class Thread {
 std::unique_ptr<Thread> StartThread(absl::string_view name_prefix,
                                     std::function<void()> fn);
 
+// Restricts the calling thread to run on `cpu` (modulo the number of CPUs).
+// Returns false if the platform does not support thread affinity or if the
+// operation failed.
+bool PinCurrentThreadToCpu(int cpu);
+
 }  // namespace internal
 }  // namespace reverb
 }  // namespace deepmind
@@ -34,6 +34,15 @@ TEST(ThreadStdTest, ThreadRuns) {
   EXPECT_EQ(x, 7);
 }
 
+#ifdef __linux__
+TEST(ThreadStdTest, PinCurrentThreadToCpu) {
+  bool pinned = false;
+  auto t = StartThread("", [&pinned] { pinned = PinCurrentThreadToCpu(0); });
+  t = nullptr;  // Joins the thread.
+  EXPECT_TRUE(pinned);
+}
+#endif
+
 }  // namespace
 }  // namespace internal
 }  // namespace reverb
@@ -0,0 +1,414 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/replay_benchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/flags/declare.h"
+#include "absl/flags/flag.h"
+#include "absl/random/random.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "reverb/cc/chunker.h"
+#include "reverb/cc/client.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/net.h"
+#include "reverb/cc/platform/server.h"
+#include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/platform/thread.h"
+#include "reverb/cc/rate_limiter.h"
+#include "reverb/cc/sampler.h"
+#include "reverb/cc/selectors/fifo.h"
+#include "reverb/cc/selectors/heap.h"
+#include "reverb/cc/selectors/interface.h"
+#include "reverb/cc/selectors/lifo.h"
+#include "reverb/cc/selectors/prioritized.h"
+#include "reverb/cc/selectors/uniform.h"
+#include "reverb/cc/support/cleanup.h"
+#include "reverb/cc/table.h"
+#include "reverb/cc/trajectory_writer.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/types.pb.h"
+
+ABSL_DECLARE_FLAG(bool, reverb_use_reactor_arenas);
+
+namespace {
+
+// Number of calls to the global operator new. Reported per operation to
+// compare how much allocator traffic the client and the server generate.
+std::atomic<int64_t> num_allocations(0);
+
+}  // namespace
+
+void* operator new(size_t size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+constexpr char kTable[] = "benchmark";
+
+// Operations measured by a single writer or sampler thread.
+struct WorkerStats {
+  absl::Status status;
+  int64_t operations = 0;
+  int64_t bytes = 0;
+  std::vector<int64_t> latencies_ns;
+};
+
+absl::StatusOr<std::shared_ptr<ItemSelector>> MakeSelector(
+    const std::string& name) {
+  if (name == "uniform") return std::make_shared<UniformSelector>();
+  if (name == "prioritized") {
+    return std::make_shared<PrioritizedSelector>(/*priority_exponent=*/0.8);
+  }
+  if (name == "fifo") return std::make_shared<FifoSelector>();
+  if (name == "lifo") return std::make_shared<LifoSelector>();
+  if (name == "heap") return std::make_shared<HeapSelector>();
+  return absl::InvalidArgumentError(
+      absl::StrCat("Unknown selector '", name,
+                   "'. Expected one of uniform, prioritized, fifo, lifo and "
+                   "heap."));
+}
+
+absl::StatusOr<std::shared_ptr<Table>> MakeTable(
+    const ReplayBenchmarkConfig& config) {
+  REVERB_ASSIGN_OR_RETURN(auto sampler, MakeSelector(config.sampler));
+  std::shared_ptr<RateLimiter> rate_limiter;
+  if (config.samples_per_insert == 0) {
+    rate_limiter = std::make_shared<RateLimiter>(
+        /*samples_per_insert=*/1.0, config.min_size_to_sample,
+        /*min_diff=*/-DBL_MAX, /*max_diff=*/DBL_MAX);
+  } else {
+    const double offset = config.samples_per_insert * config.min_size_to_sample;
+    rate_limiter = std::make_shared<RateLimiter>(
+        config.samples_per_insert, config.min_size_to_sample,
+        offset - config.error_buffer, offset + config.error_buffer);
+  }
+  return std::make_shared<Table>(
+      kTable, std::move(sampler), std::make_shared<FifoSelector>(),
+      config.max_size, /*max_times_sampled=*/0, std::move(rate_limiter));
+}
+
+absl::Status ValidateConfig(const ReplayBenchmarkConfig& config) {
+  if (config.num_writers < 1) {
+    return absl::InvalidArgumentError("num_writers must be >= 1.");
+  }
+  if (config.num_samplers < 0) {
+    return absl::InvalidArgumentError("num_samplers must be >= 0.");
+  }
+  if (config.chunk_length < 1 || config.item_length < 1 ||
+      config.episode_length < config.item_length) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "chunk_length (", config.chunk_length, ") and item_length (",
+        config.item_length, ") must be >= 1 and episode_length (",
+        config.episode_length, ") must be >= item_length."));
+  }
+  if (config.step_bytes < static_cast<int64_t>(sizeof(float))) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("step_bytes must be >= ", sizeof(float), "."));
+  }
+  if (config.max_in_flight_items < 1) {
+    return absl::InvalidArgumentError("max_in_flight_items must be >= 1.");
+  }
+  if (config.samples_per_insert < 0) {
+    return absl::InvalidArgumentError("samples_per_insert must be >= 0.");
+  }
+  if (config.duration <= absl::ZeroDuration()) {
+    return absl::InvalidArgumentError("duration must be > 0.");
+  }
+  return absl::OkStatus();
+}
+
+// Random data so that the compression ratio is representative of
+// observations rather than of zero filled buffers.
+tensorflow::Tensor MakeStep(int64_t step_bytes, int seed) {
+  const int64_t num_elements = step_bytes / sizeof(float);
+  tensorflow::Tensor tensor(tensorflow::DT_FLOAT,
+                            tensorflow::TensorShape({num_elements}));
+  absl::BitGen gen(std::seed_seq{seed});
+  auto flat = tensor.flat<float>();
+  for (int64_t i = 0; i < flat.size(); i++) {
+    flat(i) = absl::Uniform<float>(gen, -1, 1);
+  }
+  return tensor;
+}
+
+// Appends one step at a time and creates an item of the last `item_length`
+// steps after each step until `stop` is set.
+void RunWriter(const ReplayBenchmarkConfig& config, int seed,
+               const std::atomic<bool>* stop, TrajectoryWriter* writer,
+               WorkerStats* stats) {
+  const tensorflow::Tensor step = MakeStep(config.step_bytes, seed);
+  const size_t item_length = config.item_length;
+  absl::BitGen gen(std::seed_seq{seed});
+  std::deque<std::weak_ptr<CellRef>> window;
+  while (!stop->load(std::memory_order_relaxed)) {
+    const absl::Time start = absl::Now();
+    absl::Status status = [&]() -> absl::Status {
+      std::vector<absl::optional<std::weak_ptr<CellRef>>> refs;
+      REVERB_RETURN_IF_ERROR(writer->Append({step}, &refs));
+      window.push_back(*refs[0]);
+      if (window.size() > item_length) window.pop_front();
+      if (window.size() < item_length) return absl::OkStatus();
+
+      TrajectoryColumn column(
+          std::vector<std::weak_ptr<CellRef>>(window.begin(), window.end()),
+          /*squeeze=*/false);
+      REVERB_RETURN_IF_ERROR(
+          writer->CreateItem(kTable, absl::Uniform(gen, 0.1, 1.0), {column}));
+      return writer->Flush(config.max_in_flight_items);
+    }();
+    // Operations interrupted by the writer being closed are not counted.
+    if (stop->load(std::memory_order_relaxed)) break;
+    if (!status.ok()) {
+      stats->status = status;
+      return;
+    }
+    stats->bytes += step.TotalBytes();
+    if (window.size() == item_length) {
+      stats->operations++;
+      stats->latencies_ns.push_back(
+          absl::ToInt64Nanoseconds(absl::Now() - start));
+    }
+    if (writer->episode_steps() >= config.episode_length) {
+      window.clear();
+      status = writer->EndEpisode(/*clear_buffers=*/true);
+      if (stop->load(std::memory_order_relaxed)) break;
+      if (!status.ok()) {
+        stats->status = status;
+        return;
+      }
+    }
+  }
+}
+
+void RunSampler(const std::atomic<bool>* stop, Sampler* sampler,
+                WorkerStats* stats) {
+  std::vector<tensorflow::Tensor> data;
+  while (!stop->load(std::memory_order_relaxed)) {
+    const absl::Time start = absl::Now();
+    data.clear();
+    absl::Status status = sampler->GetNextTrajectory(&data);
+    if (stop->load(std::memory_order_relaxed)) break;
+    if (!status.ok()) {
+      stats->status = status;
+      return;
+    }
+    stats->latencies_ns.push_back(
+        absl::ToInt64Nanoseconds(absl::Now() - start));
+    stats->operations++;
+    for (const auto& tensor : data) {
+      stats->bytes += tensor.TotalBytes();
+    }
+  }
+}
+
+// Merges the stats of `workers` into the counters of an operation.
+absl::Status MergeStats(std::vector<WorkerStats> workers, int64_t* operations,
+                        int64_t* bytes, LatencySummary* latency) {
+  std::vector<int64_t> latencies_ns;
+  for (auto& worker : workers) {
+    REVERB_RETURN_IF_ERROR(worker.status);
+    *operations += worker.operations;
+    *bytes += worker.bytes;
+    latencies_ns.insert(latencies_ns.end(), worker.latencies_ns.begin(),
+                        worker.latencies_ns.end());
+  }
+  if (latencies_ns.empty()) return absl::OkStatus();
+
+  std::sort(latencies_ns.begin(), latencies_ns.end());
+  auto percentile = [&](double p) {
+    auto index = static_cast<size_t>(p * (latencies_ns.size() - 1));
+    return absl::Nanoseconds(latencies_ns[index]);
+  };
+  latency->count = latencies_ns.size();
+  latency->p50 = percentile(0.5);
+  latency->p99 = percentile(0.99);
+  latency->p999 = percentile(0.999);
+  latency->max = absl::Nanoseconds(latencies_ns.back());
+  return absl::OkStatus();
+}
+
+double PerSecond(int64_t value, absl::Duration elapsed) {
+  if (elapsed <= absl::ZeroDuration()) return 0;
+  return value / absl::ToDoubleSeconds(elapsed);
+}
+
+std::string LatencyToJson(const LatencySummary& latency) {
+  return absl::StrFormat(
+      "{\"count\": %d, \"p50_us\": %.3f, \"p99_us\": %.3f, "
+      "\"p999_us\": %.3f, \"max_us\": %.3f}",
+      latency.count, absl::ToDoubleMicroseconds(latency.p50),
+      absl::ToDoubleMicroseconds(latency.p99),
+      absl::ToDoubleMicroseconds(latency.p999),
+      absl::ToDoubleMicroseconds(latency.max));
+}
+
+}  // namespace
+
+double ReplayBenchmarkResult::inserts_per_second() const {
+  return PerSecond(inserts, elapsed);
+}
+
+double ReplayBenchmarkResult::samples_per_second() const {
+  return PerSecond(samples, elapsed);
+}
+
+double ReplayBenchmarkResult::bytes_inserted_per_second() const {
+  return PerSecond(bytes_inserted, elapsed);
+}
+
+double ReplayBenchmarkResult::bytes_sampled_per_second() const {
+  return PerSecond(bytes_sampled, elapsed);
+}
+
+double ReplayBenchmarkResult::allocations_per_operation() const {
+  const int64_t operations = inserts + samples;
+  if (operations == 0) return 0;
+  return static_cast<double>(allocations) / operations;
+}
+
+absl::StatusOr<ReplayBenchmarkResult> RunReplayBenchmark(
+    const ReplayBenchmarkConfig& config) {
+  REVERB_RETURN_IF_ERROR(ValidateConfig(config));
+  REVERB_ASSIGN_OR_RETURN(auto table, MakeTable(config));
+
+  // Read by the reactors when a stream is opened.
+  const bool reactor_arenas = absl::GetFlag(FLAGS_reverb_use_reactor_arenas);
+  absl::SetFlag(&FLAGS_reverb_use_reactor_arenas, config.reactor_arenas);
+  auto restore_flag = internal::MakeCleanup([reactor_arenas] {
+    absl::SetFlag(&FLAGS_reverb_use_reactor_arenas, reactor_arenas);
+  });
+
+  const int port = internal::PickUnusedPortOrDie();
+  std::unique_ptr<Server> server;
+  REVERB_RETURN_IF_ERROR(StartServer({std::move(table)}, port,
+                                     /*checkpointer=*/nullptr, &server));
+  Client client(absl::StrCat("localhost:", port));
+
+  std::vector<std::unique_ptr<TrajectoryWriter>> writers(config.num_writers);
+  for (auto& writer : writers) {
+    TrajectoryWriter::Options options;
+    options.chunker_options = std::make_shared<ConstantChunkerOptions>(
+        config.chunk_length, /*num_keep_alive_refs=*/config.item_length);
+    REVERB_RETURN_IF_ERROR(client.NewTrajectoryWriter(options, &writer));
+  }
+  std::vector<std::unique_ptr<Sampler>> samplers(config.num_samplers);
+  for (auto& sampler : samplers) {
+    Sampler::Options options;
+    options.num_workers = 1;
+    REVERB_RETURN_IF_ERROR(
+        client.NewSamplerWithoutSignatureCheck(kTable, options, &sampler));
+  }
+
+  std::atomic<bool> stop(false);
+  std::vector<WorkerStats> writer_stats(writers.size());
+  std::vector<WorkerStats> sampler_stats(samplers.size());
+  std::vector<std::unique_ptr<internal::Thread>> threads;
+  const int64_t start_allocations =
+      num_allocations.load(std::memory_order_relaxed);
+  const absl::Time start = absl::Now();
+  for (int i = 0; i < config.num_writers; i++) {
+    threads.push_back(internal::StartThread(
+        absl::StrCat("BenchmarkWriter_", i), [&, i] {
+          RunWriter(config, /*seed=*/i, &stop, writers[i].get(),
+                    &writer_stats[i]);
+        }));
+  }
+  for (int i = 0; i < config.num_samplers; i++) {
+    threads.push_back(internal::StartThread(
+        absl::StrCat("BenchmarkSampler_", i),
+        [&, i] { RunSampler(&stop, samplers[i].get(), &sampler_stats[i]); }));
+  }
+
+  absl::SleepFor(config.duration);
+  stop.store(true);
+  ReplayBenchmarkResult result;
+  result.elapsed = absl::Now() - start;
+  result.allocations =
+      num_allocations.load(std::memory_order_relaxed) - start_allocations;
+
+  // Workers may be blocked on the rate limiter so they have to be closed
+  // before the threads can be joined.
+  for (auto& sampler : samplers) sampler->Close();
+  for (auto& writer : writers) writer->Close();
+  threads.clear();
+  server->Stop();
+
+  REVERB_RETURN_IF_ERROR(MergeStats(std::move(writer_stats), &result.inserts,
+                                    &result.bytes_inserted,
+                                    &result.insert_latency));
+  REVERB_RETURN_IF_ERROR(MergeStats(std::move(sampler_stats), &result.samples,
+                                    &result.bytes_sampled,
+                                    &result.sample_latency));
+  return result;
+}
+
+std::string ReplayBenchmarkToJson(const ReplayBenchmarkConfig& config,
+                                  const ReplayBenchmarkResult& result) {
+  return absl::StrFormat(
+      "{\"config\": {\"num_writers\": %d, \"num_samplers\": %d, "
+      "\"chunk_length\": %d, \"item_length\": %d, \"step_bytes\": %d, "
+      "\"episode_length\": %d, \"max_in_flight_items\": %d, "
+      "\"sampler\": \"%s\", \"max_size\": %d, \"samples_per_insert\": %g, "
+      "\"min_size_to_sample\": %d, \"error_buffer\": %g, "
+      "\"reactor_arenas\": %s}, "
+      "\"elapsed_seconds\": %.3f, \"inserts\": %d, \"samples\": %d, "
+      "\"inserts_per_second\": %.1f, \"samples_per_second\": %.1f, "
+      "\"bytes_inserted_per_second\": %.1f, "
+      "\"bytes_sampled_per_second\": %.1f, "
+      "\"insert_latency\": %s, \"sample_latency\": %s, "
+      "\"allocations\": %d, \"allocations_per_operation\": %.1f}",
+      config.num_writers, config.num_samplers, config.chunk_length,
+      config.item_length, config.step_bytes, config.episode_length,
+      config.max_in_flight_items, config.sampler, config.max_size,
+      config.samples_per_insert, config.min_size_to_sample,
+      config.error_buffer, config.reactor_arenas ? "true" : "false",
+      absl::ToDoubleSeconds(result.elapsed),
+      result.inserts, result.samples, result.inserts_per_second(),
+      result.samples_per_second(), result.bytes_inserted_per_second(),
+      result.bytes_sampled_per_second(), LatencyToJson(result.insert_latency),
+      LatencyToJson(result.sample_latency), result.allocations,
+      result.allocations_per_operation());
+}
+
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,133 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_REPLAY_BENCHMARK_H_
+#define REVERB_CC_REPLAY_BENCHMARK_H_
+
+#include <cstdint>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+
+namespace deepmind {
+namespace reverb {
+
+// Configuration of an end-to-end benchmark run. See `RunReplayBenchmark`.
+struct ReplayBenchmarkConfig {
+  // Number of `TrajectoryWriter`s, each running in its own thread.
+  int num_writers = 1;
+
+  // Number of `Sampler`s, each running in its own thread.
+  int num_samplers = 1;
+
+  // Number of steps per chunk.
+  int chunk_length = 10;
+
+  // Number of steps referenced by each item. A writer creates an item for
+  // every step once it has appended at least `item_length` steps.
+  int item_length = 10;
+
+  // Size of the single float tensor appended in each step.
+  int64_t step_bytes = 1024;
+
+  // Number of steps before a writer ends the episode.
+  int episode_length = 1000;
+
+  // Maximum number of items a writer has sent to the server but which have not
+  // yet been confirmed. Writers block in `Flush` when the limit is reached.
+  int max_in_flight_items = 64;
+
+  // Selector used for sampling, one of "uniform", "prioritized", "fifo",
+  // "lifo" and "heap". Items are always removed in FIFO order.
+  std::string sampler = "uniform";
+
+  // Maximum number of items held by the table.
+  int64_t max_size = 100000;
+
+  // Rate limiter settings. When `samples_per_insert` is 0 the table uses a
+  // MinSize rate limiter, i.e writers and samplers are never blocked once the
+  // table holds `min_size_to_sample` items. Otherwise the ratio is enforced
+  // with the same semantics as `reverb.rate_limiters.SampleToInsertRatio`.
+  double samples_per_insert = 0;
+  int64_t min_size_to_sample = 1;
+  double error_buffer = 100;
+
+  // Wall time during which operations are measured.
+  absl::Duration duration = absl::Seconds(5);
+
+  // Whether the server builds stream messages on pooled protobuf arenas. Sets
+  // the `reverb_use_reactor_arenas` flag for the duration of the run so that
+  // allocation counts with and without arenas can be compared.
+  bool reactor_arenas = false;
+};
+
+// Percentiles of the latency of a single operation.
+struct LatencySummary {
+  int64_t count = 0;
+  absl::Duration p50;
+  absl::Duration p99;
+  absl::Duration p999;
+  absl::Duration max;
+};
+
+struct ReplayBenchmarkResult {
+  // Wall time during which the operations below were measured.
+  absl::Duration elapsed;
+
+  // Number of items created and trajectories sampled, and the number of bytes
+  // appended to the writers and returned by the samplers.
+  int64_t inserts = 0;
+  int64_t samples = 0;
+  int64_t bytes_inserted = 0;
+  int64_t bytes_sampled = 0;
+
+  // Time spent appending a single step and creating its item. This includes
+  // the time the writer is blocked on `max_in_flight_items` (and thus on the
+  // rate limiter).
+  LatencySummary insert_latency;
+
+  // Time spent in `Sampler::GetNextTrajectory`.
+  LatencySummary sample_latency;
+
+  // Number of calls to the global operator new while operations were
+  // measured. The server runs in the same process so this covers the writers,
+  // the samplers and the server.
+  int64_t allocations = 0;
+
+  double inserts_per_second() const;
+  double samples_per_second() const;
+  double bytes_inserted_per_second() const;
+  double bytes_sampled_per_second() const;
+
+  // Allocations per insert or sample.
+  double allocations_per_operation() const;
+};
+
+// Starts a server on localhost with a single table configured according to
+// `config`, runs `config.num_writers` writers and `config.num_samplers`
+// samplers against it concurrently for `config.duration` and returns the
+// measured throughput and latencies.
+absl::StatusOr<ReplayBenchmarkResult> RunReplayBenchmark(
+    const ReplayBenchmarkConfig& config);
+
+// Serializes `config` and `result` as a single line JSON object. Throughput is
+// reported per second and latencies in microseconds.
+std::string ReplayBenchmarkToJson(const ReplayBenchmarkConfig& config,
+                                  const ReplayBenchmarkResult& result);
+
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_REPLAY_BENCHMARK_H_
@@ -0,0 +1,94 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs a single end-to-end benchmark (see replay_benchmark.h) and prints the
+// configuration and results as a JSON object on stdout, e.g:
+//
+//   bazel run -c opt //reverb/cc:replay_benchmark_main --
+//     --num_writers=8 --num_samplers=8 --sampler=prioritized
+//     --samples_per_insert=4 --min_size_to_sample=1000 --duration=30s
+//
+// Pass --reverb_use_reactor_arenas=true to measure the allocations made by
+// the server with protobuf arenas.
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "absl/flags/declare.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/time/time.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/replay_benchmark.h"
+
+namespace {
+
+const deepmind::reverb::ReplayBenchmarkConfig kDefaults;
+
+}  // namespace
+
+// Defined by the server. Forwarded to `ReplayBenchmarkConfig::reactor_arenas`.
+ABSL_DECLARE_FLAG(bool, reverb_use_reactor_arenas);
+
+ABSL_FLAG(int, num_writers, kDefaults.num_writers,
+          "Number of concurrent TrajectoryWriters.");
+ABSL_FLAG(int, num_samplers, kDefaults.num_samplers,
+          "Number of concurrent Samplers.");
+ABSL_FLAG(int, chunk_length, kDefaults.chunk_length, "Steps per chunk.");
+ABSL_FLAG(int, item_length, kDefaults.item_length, "Steps per item.");
+ABSL_FLAG(int64_t, step_bytes, kDefaults.step_bytes, "Bytes per step.");
+ABSL_FLAG(int, episode_length, kDefaults.episode_length, "Steps per episode.");
+ABSL_FLAG(int, max_in_flight_items, kDefaults.max_in_flight_items,
+          "Unconfirmed items per writer before it blocks.");
+ABSL_FLAG(std::string, sampler, kDefaults.sampler,
+          "One of uniform, prioritized, fifo, lifo and heap.");
+ABSL_FLAG(int64_t, max_size, kDefaults.max_size, "Capacity of the table.");
+ABSL_FLAG(double, samples_per_insert, kDefaults.samples_per_insert,
+          "Samples per insert enforced by the rate limiter. 0 for MinSize.");
+ABSL_FLAG(int64_t, min_size_to_sample, kDefaults.min_size_to_sample,
+          "Minimum number of items in the table before sampling is allowed.");
+ABSL_FLAG(double, error_buffer, kDefaults.error_buffer,
+          "Error buffer of the samples per insert rate limiter.");
+ABSL_FLAG(absl::Duration, duration, kDefaults.duration,
+          "Wall time during which operations are measured.");
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+
+  deepmind::reverb::ReplayBenchmarkConfig config;
+  config.num_writers = absl::GetFlag(FLAGS_num_writers);
+  config.num_samplers = absl::GetFlag(FLAGS_num_samplers);
+  config.chunk_length = absl::GetFlag(FLAGS_chunk_length);
+  config.item_length = absl::GetFlag(FLAGS_item_length);
+  config.step_bytes = absl::GetFlag(FLAGS_step_bytes);
+  config.episode_length = absl::GetFlag(FLAGS_episode_length);
+  config.max_in_flight_items = absl::GetFlag(FLAGS_max_in_flight_items);
+  config.sampler = absl::GetFlag(FLAGS_sampler);
+  config.max_size = absl::GetFlag(FLAGS_max_size);
+  config.samples_per_insert = absl::GetFlag(FLAGS_samples_per_insert);
+  config.min_size_to_sample = absl::GetFlag(FLAGS_min_size_to_sample);
+  config.error_buffer = absl::GetFlag(FLAGS_error_buffer);
+  config.duration = absl::GetFlag(FLAGS_duration);
+  config.reactor_arenas = absl::GetFlag(FLAGS_reverb_use_reactor_arenas);
+
+  auto result = deepmind::reverb::RunReplayBenchmark(config);
+  if (!result.ok()) {
+    REVERB_LOG(REVERB_ERROR) << "Benchmark failed: " << result.status();
+    return 1;
+  }
+  std::cout << deepmind::reverb::ReplayBenchmarkToJson(config, *result)
+            << std::endl;
+  return 0;
+}
@@ -0,0 +1,144 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// End-to-end benchmarks of a server running on localhost with concurrent
+// `TrajectoryWriter`s and `Sampler`s. Each benchmark varies one parameter of
+// `BaseConfig()`. Throughput, latency percentiles and heap allocations per
+// operation are reported as counters, use `--benchmark_format=json` for
+// machine-readable output.
+
+#include <cstdint>
+#include <string>
+
+#include "benchmark/benchmark.h"
+#include "absl/time/time.h"
+#include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/replay_benchmark.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+constexpr const char* kSelectors[] = {"uniform", "prioritized", "fifo", "lifo",
+                                      "heap"};
+
+using ConfigSetter = void (*)(int64_t value, ReplayBenchmarkConfig* config);
+
+ReplayBenchmarkConfig BaseConfig() {
+  ReplayBenchmarkConfig config;
+  config.num_writers = 4;
+  config.num_samplers = 4;
+  config.chunk_length = 10;
+  config.item_length = 10;
+  config.step_bytes = 4096;
+  config.duration = absl::Seconds(2);
+  return config;
+}
+
+void BM_Replay(benchmark::State& state, ConfigSetter set) {
+  ReplayBenchmarkConfig config = BaseConfig();
+  set(state.range(0), &config);
+  state.SetLabel(config.sampler);
+  for (auto _ : state) {
+    auto result = RunReplayBenchmark(config);
+    REVERB_CHECK_OK(result.status());
+    state.SetIterationTime(absl::ToDoubleSeconds(result->elapsed));
+
+    state.counters["inserts_per_second"] = result->inserts_per_second();
+    state.counters["samples_per_second"] = result->samples_per_second();
+    state.counters["bytes_inserted_per_second"] =
+        result->bytes_inserted_per_second();
+    state.counters["bytes_sampled_per_second"] =
+        result->bytes_sampled_per_second();
+    const auto add_latency = [&](const char* name,
+                                 const LatencySummary& latency) {
+      const std::string prefix(name);
+      state.counters[prefix + "_p50_us"] =
+          absl::ToDoubleMicroseconds(latency.p50);
+      state.counters[prefix + "_p99_us"] =
+          absl::ToDoubleMicroseconds(latency.p99);
+      state.counters[prefix + "_p999_us"] =
+          absl::ToDoubleMicroseconds(latency.p999);
+    };
+    add_latency("insert", result->insert_latency);
+    add_latency("sample", result->sample_latency);
+    state.counters["allocations_per_op"] = result->allocations_per_operation();
+  }
+}
+
+void SetNumWriters(int64_t value, ReplayBenchmarkConfig* config) {
+  config->num_writers = value;
+}
+
+void SetNumSamplers(int64_t value, ReplayBenchmarkConfig* config) {
+  config->num_samplers = value;
+}
+
+void SetChunkLength(int64_t value, ReplayBenchmarkConfig* config) {
+  config->chunk_length = value;
+}
+
+void SetItemLength(int64_t value, ReplayBenchmarkConfig* config) {
+  config->item_length = value;
+}
+
+void SetStepBytes(int64_t value, ReplayBenchmarkConfig* config) {
+  config->step_bytes = value;
+}
+
+void SetSelector(int64_t value, ReplayBenchmarkConfig* config) {
+  config->sampler = kSelectors[value];
+}
+
+void SetReactorArenas(int64_t value, ReplayBenchmarkConfig* config) {
+  config->reactor_arenas = value != 0;
+}
+
+// 0 means that the table uses a MinSize rate limiter.
+void SetSamplesPerInsert(int64_t value, ReplayBenchmarkConfig* config) {
+  config->samples_per_insert = value;
+  config->min_size_to_sample = 1000;
+}
+
+// Registers `BM_Replay` with the settings shared by all the sweeps below.
+#define REVERB_REPLAY_BENCHMARK(name, setter)                              \
+  BENCHMARK_CAPTURE(BM_Replay, name, setter)                               \
+      ->Iterations(1)                                                      \
+      ->UseManualTime()                                                    \
+      ->Unit(benchmark::kMillisecond)
+
+REVERB_REPLAY_BENCHMARK(writers, &SetNumWriters)->Arg(1)->Arg(4)->Arg(16);
+REVERB_REPLAY_BENCHMARK(samplers, &SetNumSamplers)->Arg(1)->Arg(4)->Arg(16);
+REVERB_REPLAY_BENCHMARK(chunk_length, &SetChunkLength)
+    ->Arg(1)
+    ->Arg(10)
+    ->Arg(100);
+REVERB_REPLAY_BENCHMARK(item_length, &SetItemLength)->Arg(1)->Arg(10)->Arg(100);
+REVERB_REPLAY_BENCHMARK(step_bytes, &SetStepBytes)
+    ->Arg(64)
+    ->Arg(4 << 10)
+    ->Arg(256 << 10);
+REVERB_REPLAY_BENCHMARK(selector, &SetSelector)->DenseRange(0, 4);
+REVERB_REPLAY_BENCHMARK(samples_per_insert, &SetSamplesPerInsert)
+    ->Arg(0)
+    ->Arg(1)
+    ->Arg(8)
+    ->Arg(32);
+REVERB_REPLAY_BENCHMARK(reactor_arenas, &SetReactorArenas)->Arg(0)->Arg(1);
+
+#undef REVERB_REPLAY_BENCHMARK
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
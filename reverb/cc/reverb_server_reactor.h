@@ -89,6 +89,11 @@ class ReverbServerReactor
   // Starts sending another queued response to the client (if available).
   void MaybeSendNextResponse() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
+  // Called right before `response` is written to the stream. Lets reactors
+  // which build responses incrementally finalize the payload. Noop by default.
+  virtual void PrepareResponse(ResponseCtx* response)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {}
+
  protected:
   // Incoming messages are handled one at a time. That is StartRead is not
   // called until `request_` has been completely salvaged. Fields accessed
@@ -124,6 +129,7 @@ void ReverbServerReactor<Request, Response,
   if (responses_to_send_.empty() || is_finished_) {
     return;
   }
+  PrepareResponse(&responses_to_send_.front());
   grpc::WriteOptions options;
   options.set_no_compression();
   grpc::ServerBidiReactor<Request, Response>::StartWrite(
@@ -15,12 +15,14 @@
 #include "reverb/cc/reverb_service_impl.h"
 
 #include <algorithm>
+#include <cstring>
 #include <limits>
 #include <list>
 #include <memory>
 #include <queue>
 #include <vector>
 
+#include "google/protobuf/arena.h"
 #include "absl/base/thread_annotations.h"
 #include "absl/flags/flag.h"
 #include "absl/status/status.h"
@@ -30,6 +32,7 @@
 #include "absl/synchronization/mutex.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "reverb/cc/checkpointing/interface.h"
 #include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/platform/logging.h"
@@ -37,13 +40,46 @@
 #include "reverb/cc/reverb_server_reactor.h"
 #include "reverb/cc/reverb_service.pb.h"
 #include "reverb/cc/schema.pb.h"
+#include "reverb/cc/support/arena_pool.h"
+#include "reverb/cc/support/chunk_slicer.h"
 #include "reverb/cc/support/grpc_util.h"
+#include "reverb/cc/support/sample_stream_response_builder.h"
+#include "reverb/cc/support/shared_memory_ring.h"
 #include "reverb/cc/support/trajectory_util.h"
 #include "reverb/cc/support/uint128.h"
 #include "reverb/cc/task_worker.h"
 
 ABSL_FLAG(size_t, reverb_callback_executor_num_threads, 32,
           "Number of threads in the callback executor thread pool.");
+ABSL_FLAG(bool, reverb_callback_executor_pin_threads, false,
+          "Whether to pin each thread of the callback executor to a CPU.");
+ABSL_FLAG(bool, reverb_cache_chunk_wire_bytes, false,
+          "Whether chunks cache their serialized bytes the first time they are "
+          "sampled so that they don't have to be serialized again. Trades "
+          "memory for CPU: every sampled chunk takes up to twice as much "
+          "memory for as long as it is stored, so only enable this when the "
+          "server has the memory to spare.");
+ABSL_FLAG(bool, reverb_deduplicate_chunks, false,
+          "Whether inserted chunks with identical payloads share a single copy "
+          "of the payload. Every inserted chunk is hashed so this should only "
+          "be enabled when duplicates are common. Ignored when a spill tier "
+          "is used.");
+ABSL_FLAG(bool, reverb_use_reactor_arenas, false,
+          "Whether the insert and sample stream reactors build messages on "
+          "protobuf arenas recycled through a per-reactor pool rather than on "
+          "the heap. Inserted chunks are copied out of the arena of the "
+          "request they were received in, which costs an extra copy of the "
+          "payload but keeps arenas from being retained by the table.");
+ABSL_FLAG(bool, reverb_slice_sampled_chunks, false,
+          "Whether sample responses only include the rows of each chunk which "
+          "are referenced by the sampled item. The server then decompresses, "
+          "slices and compresses chunks again, which trades server CPU for "
+          "network bandwidth when items reference a small part of long "
+          "chunks.");
+ABSL_FLAG(int64_t, reverb_sliced_chunk_cache_bytes, int64_t{256} << 20,
+          "Maximum size of the serialized chunk slices kept by the server so "
+          "that chunks of frequently sampled items don't have to be sliced "
+          "again. Only used with `--reverb_slice_sampled_chunks`.");
 
 namespace deepmind {
 namespace reverb {
@@ -69,6 +105,24 @@ constexpr int64_t kInitialGrpcSampleBatchSize = 64;
 // reactor.
 constexpr absl::Duration kCallbackWaitTime = absl::Milliseconds(1);
 
+// Size of the block which each pooled arena keeps across resets. It fits the
+// messages built for a sampled item and the metadata of a typical insert
+// request, the (large) tensor payloads of inserted chunks are allocated
+// outside of it.
+constexpr size_t kArenaBlockSize = 4 << 10;
+
+// Maximum number of idle arenas retained by the pool of a single reactor.
+constexpr size_t kMaxPooledArenas = 2;
+
+// With `--reverb_slice_sampled_chunks`, chunks are only sliced if the sampled
+// item references at most this fraction of their rows. Otherwise the few bytes
+// saved don't make up for decompressing and compressing the chunk again.
+constexpr double kMaxSlicedRowsFraction = 0.5;
+
+// Upper bound of the shared memory rings created for local samplers. Larger
+// requests are capped to this size.
+constexpr int64_t kMaxSharedMemoryRingBytes = int64_t{1} << 30;
+
 inline grpc::Status TableNotFound(absl::string_view name) {
   return grpc::Status(grpc::StatusCode::NOT_FOUND,
                       absl::StrCat("Priority table ", name, " was not found"));
@@ -80,16 +134,42 @@ inline grpc::Status Internal(const std::string& message) {
 
 }  // namespace
 
-ReverbServiceImpl::ReverbServiceImpl(std::shared_ptr<Checkpointer> checkpointer)
-    : checkpointer_(std::move(checkpointer)) {}
+ReverbServiceImpl::ReverbServiceImpl(
+    std::shared_ptr<Checkpointer> checkpointer,
+    std::shared_ptr<ChunkSpillTier> spill_tier)
+    : checkpointer_(std::move(checkpointer)),
+      spill_tier_(std::move(spill_tier)) {
+  if (absl::GetFlag(FLAGS_reverb_deduplicate_chunks)) {
+    if (spill_tier_ != nullptr) {
+      REVERB_LOG(REVERB_WARNING)
+          << "Chunk deduplication is not supported together with a spill "
+             "tier and has been disabled.";
+    } else {
+      deduplicator_ = std::make_shared<ChunkDeduplicator>();
+    }
+  }
+  if (absl::GetFlag(FLAGS_reverb_slice_sampled_chunks)) {
+    sliced_chunk_cache_ = std::make_unique<internal::SlicedChunkCache>(
+        absl::GetFlag(FLAGS_reverb_sliced_chunk_cache_bytes));
+  }
+}
 
 absl::Status ReverbServiceImpl::Create(
     std::vector<std::shared_ptr<Table>> tables,
     std::shared_ptr<Checkpointer> checkpointer,
     std::unique_ptr<ReverbServiceImpl>* service) {
+  return Create(std::move(tables), std::move(checkpointer),
+                /*spill_tier=*/nullptr, service);
+}
+
+absl::Status ReverbServiceImpl::Create(
+    std::vector<std::shared_ptr<Table>> tables,
+    std::shared_ptr<Checkpointer> checkpointer,
+    std::shared_ptr<ChunkSpillTier> spill_tier,
+    std::unique_ptr<ReverbServiceImpl>* service) {
   // Can't use make_unique because it can't see the Impl's private constructor.
-  auto new_service = std::unique_ptr<ReverbServiceImpl>(
-      new ReverbServiceImpl(std::move(checkpointer)));
+  auto new_service = std::unique_ptr<ReverbServiceImpl>(new ReverbServiceImpl(
+      std::move(checkpointer), std::move(spill_tier)));
   REVERB_RETURN_IF_ERROR(new_service->Initialize(std::move(tables)));
   std::swap(new_service, *service);
   return absl::OkStatus();
@@ -127,9 +207,12 @@ absl::Status ReverbServiceImpl::Initialize(
     tables_[name] = std::move(table);
   }
 
+  TaskExecutor::Options executor_options;
+  executor_options.pin_threads =
+      absl::GetFlag(FLAGS_reverb_callback_executor_pin_threads);
   auto executor = std::make_shared<TaskExecutor>(
       absl::GetFlag(FLAGS_reverb_callback_executor_num_threads),
-      "TableCallbackExecutor");
+      "TableCallbackExecutor", executor_options);
   for (auto& table : tables_) {
     table.second->SetCallbackExecutor(executor);
   }
@@ -164,19 +247,25 @@ grpc::ServerUnaryReactor* ReverbServiceImpl::Checkpoint(
   return reactor;
 }
 
-grpc::ServerBidiReactor<InsertStreamRequest, InsertStreamResponse>*
+grpc::ServerBidiReactor<grpc::ByteBuffer, grpc::ByteBuffer>*
 ReverbServiceImpl::InsertStream(grpc::CallbackServerContext* context) {
+  // `response` is serialized into `payload` right before it is written.
   struct InsertStreamResponseCtx {
-    InsertStreamResponse payload;
+    InsertStreamResponse response;
+    grpc::ByteBuffer payload;
   };
 
   class WorkerlessInsertReactor
-      : public ReverbServerReactor<InsertStreamRequest, InsertStreamResponse,
+      : public ReverbServerReactor<grpc::ByteBuffer, grpc::ByteBuffer,
                                    InsertStreamResponseCtx> {
    public:
     WorkerlessInsertReactor(ReverbServiceImpl* server)
         : ReverbServerReactor(),
           server_(server),
+          arena_pool_(absl::GetFlag(FLAGS_reverb_use_reactor_arenas)
+                          ? std::make_unique<internal::ArenaPool>(
+                                kArenaBlockSize, kMaxPooledArenas)
+                          : nullptr),
           insert_completed_(
               std::make_shared<Table::InsertCallback>([&](uint64_t key) {
                 absl::MutexLock lock(&mu_);
@@ -187,7 +276,7 @@ ReverbServiceImpl::InsertStream(grpc::CallbackServerContext* context) {
                   if (responses_to_send_.size() < 2) {
                     responses_to_send_.emplace();
                   }
-                  responses_to_send_.back().payload.add_keys(key);
+                  responses_to_send_.back().response.add_keys(key);
                   if (responses_to_send_.size() == 1) {
                     MaybeSendNextResponse();
                   }
@@ -207,8 +296,25 @@ ReverbServiceImpl::InsertStream(grpc::CallbackServerContext* context) {
       }
     }
 
-    grpc::Status ProcessIncomingRequest(InsertStreamRequest* request) override
+    grpc::Status ProcessIncomingRequest(grpc::ByteBuffer* buffer) override
         ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      // Chunks and items are copied out of the arena (see `SaveChunks`) so it
+      // is returned to the pool as soon as the request has been processed.
+      std::shared_ptr<google::protobuf::Arena> arena;
+      if (arena_pool_ != nullptr) {
+        arena = arena_pool_->Acquire();
+      }
+      auto* request =
+          google::protobuf::Arena::CreateMessage<InsertStreamRequest>(
+              arena.get());
+      std::unique_ptr<InsertStreamRequest> owned_request(
+          arena == nullptr ? request : nullptr);
+      if (!grpc::SerializationTraits<InsertStreamRequest>::Deserialize(
+               buffer, request)
+               .ok()) {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                            "Unable to parse InsertStreamRequest.");
+      }
       if (request->chunks_size() == 0 && request->items_size() == 0) {
         return grpc::Status(
             grpc::StatusCode::INVALID_ARGUMENT,
@@ -256,13 +362,23 @@ ReverbServiceImpl::InsertStream(grpc::CallbackServerContext* context) {
       return grpc::Status::OK;
     }
 
+    void PrepareResponse(InsertStreamResponseCtx* response) override
+        ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      bool own_buffer;
+      grpc::SerializationTraits<InsertStreamResponse>::Serialize(
+          response->response, &response->payload, &own_buffer);
+    }
+
    private:
+    // Chunks are stored on the heap. When `request` is allocated on an arena
+    // the move copies the chunk out of it, as a chunk referencing the arena
+    // in place would keep the whole request alive for as long as the chunk
+    // is stored.
     grpc::Status SaveChunks(InsertStreamRequest* request) {
       for (auto& chunk : *request->mutable_chunks()) {
         ChunkStore::Key key = chunk.chunk_key();
-        if (!chunks_.contains(key)) {
-          chunks_[key] = std::make_shared<ChunkStore::Chunk>(std::move(chunk));
-        }
+        if (chunks_.contains(key)) continue;
+        chunks_[key] = server_->NewChunk(std::move(chunk));
       }
 
       return grpc::Status::OK;
@@ -322,6 +438,9 @@ ReverbServiceImpl::InsertStream(grpc::CallbackServerContext* context) {
     // Used to lookup tables when inserting items.
     const ReverbServiceImpl* server_;
 
+    // Arenas which requests are parsed into. Null if arenas are disabled.
+    const std::unique_ptr<internal::ArenaPool> arena_pool_;
+
     // Callback called by the table when insert operation is completed.
     std::shared_ptr<Table::InsertCallback> insert_completed_;
   };
@@ -455,37 +574,19 @@ grpc::ServerUnaryReactor* ReverbServiceImpl::Reset(
   return reactor;
 }
 
-grpc::ServerBidiReactor<SampleStreamRequest, SampleStreamResponse>*
+grpc::ServerBidiReactor<grpc::ByteBuffer, grpc::ByteBuffer>*
 ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
+  // Responses are built as a sequence of slices which reference the wire bytes
+  // of the sampled chunks (cached when `reverb_cache_chunk_wire_bytes` is set,
+  // see `ChunkStore::Chunk::WireBytes`) rather than as a `SampleStreamResponse`
+  // which gRPC would serialize again.
   struct SampleStreamResponseCtx {
-    SampleStreamResponseCtx() {}
-    SampleStreamResponseCtx(const SampleStreamResponseCtx&) = delete;
-    SampleStreamResponseCtx& operator=(const SampleStreamResponseCtx&) = delete;
-    SampleStreamResponseCtx(SampleStreamResponseCtx&& response) = default;
-    SampleStreamResponseCtx& operator=(SampleStreamResponseCtx&& response) =
-        default;
-
-    ~SampleStreamResponseCtx() {
-      // SampleStreamResponseCtx does not own immutable parts of the payload.
-      // We need to make sure not to destroy them while destructing the payload.
-      for (auto& entry : *payload.mutable_entries()) {
-        if (entry.info().has_item()) {
-          auto* item = entry.mutable_info()->mutable_item();
-          item->/*unsafe_arena_*/release_inserted_at();
-          item->/*unsafe_arena_*/release_flat_trajectory();
-        }
-        while (entry.data_size() != 0) {
-          entry.mutable_data()->UnsafeArenaReleaseLast();
-        }
-      }
-    }
-
-    void AddTableItem(std::shared_ptr<TableItem> item) {
-      table_items.push_back(std::move(item));
-    }
+    internal::SampleStreamResponseBuilder builder;
+    grpc::ByteBuffer payload;
 
-    SampleStreamResponse payload;
-    std::vector<std::shared_ptr<TableItem>> table_items;
+    // Bytes left out of the response by slicing the chunks of its entries.
+    // Chunks written to shared memory are included as they are also sliced.
+    int64_t bytes_saved = 0;
   };
 
   // Maximal number of queued SampleStreamResponse-messages waiting to be send
@@ -495,14 +596,22 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
   static constexpr int kMaxQueuedResponses = 3;
 
   class WorkerlessSampleReactor
-      : public ReverbServerReactor<SampleStreamRequest, SampleStreamResponse,
+      : public ReverbServerReactor<grpc::ByteBuffer, grpc::ByteBuffer,
                                    SampleStreamResponseCtx> {
    public:
     using SamplingCallback = std::function<void(Table::SampleRequest*)>;
 
-    WorkerlessSampleReactor(ReverbServiceImpl* server)
+    WorkerlessSampleReactor(grpc::CallbackServerContext* context,
+                            ReverbServiceImpl* server)
         : ReverbServerReactor(),
           server_(server),
+          is_local_(IsLoopbackOrInProcess(context->peer())),
+          cache_wire_bytes_(absl::GetFlag(FLAGS_reverb_cache_chunk_wire_bytes)),
+          sliced_chunk_cache_(server->sliced_chunk_cache_.get()),
+          arena_pool_(absl::GetFlag(FLAGS_reverb_use_reactor_arenas)
+                          ? std::make_unique<internal::ArenaPool>(
+                                kArenaBlockSize, kMaxPooledArenas)
+                          : nullptr),
           sampling_done_(std::make_shared<SamplingCallback>(
               [&](Table::SampleRequest* sample) {
                 absl::MutexLock lock(&mu_);
@@ -516,7 +625,13 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
                 task_info_.fetched_samples += sample->samples.size();
                 bool already_writing = !responses_to_send_.empty();
                 for (Table::SampledItem& sample : sample->samples) {
-                  ProcessSample(&sample, already_writing);
+                  auto status = ProcessSample(&sample, already_writing);
+                  if (!status.ok()) {
+                    if (!is_finished_) {
+                      SetReactorAsFinished(ToGrpcStatus(status));
+                    }
+                    return;
+                  }
                 }
                 if (!already_writing) {
                   MaybeSendNextResponse();
@@ -552,8 +667,16 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
       MaybeStartSampling();
     }
 
-    grpc::Status ProcessIncomingRequest(SampleStreamRequest* request) override
+    grpc::Status ProcessIncomingRequest(grpc::ByteBuffer* buffer) override
         ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      SampleStreamRequest parsed_request;
+      if (!grpc::SerializationTraits<SampleStreamRequest>::Deserialize(
+               buffer, &parsed_request)
+               .ok()) {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                            "Unable to parse SampleStreamRequest.");
+      }
+      const SampleStreamRequest* request = &parsed_request;
       if (request->num_samples() <= 0) {
         return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
                             absl::StrCat("`num_samples` must be > 0 (got",
@@ -571,6 +694,16 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
       if (task_info_.table == nullptr) {
         return TableNotFound(request->table());
       }
+      if (!shared_memory_negotiated_) {
+        shared_memory_negotiated_ = true;
+        MaybeCreateSharedMemoryRing(request->shared_memory_ring_bytes());
+      }
+      if (request->shared_memory_ring_mapped() &&
+          shared_memory_ring_ != nullptr && !shared_memory_ring_mapped_) {
+        // Nobody else needs to open the ring once the client has mapped it.
+        shared_memory_ring_->Unlink();
+        shared_memory_ring_mapped_ = true;
+      }
       task_info_.fetched_samples = 0;
       task_info_.requested_samples = request->num_samples();
       MaybeStartSampling();
@@ -578,6 +711,164 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
     }
 
    private:
+    // Creates the shared memory ring requested by the client. Chunks are sent
+    // inline if the client is remote or if the ring cannot be created.
+    void MaybeCreateSharedMemoryRing(int64_t bytes)
+        ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (bytes <= 0 || !is_local_) return;
+      auto ring_or = internal::SharedMemoryRing::Create(
+          std::min(bytes, kMaxSharedMemoryRingBytes));
+      if (!ring_or.ok()) {
+        REVERB_LOG_EVERY_N(REVERB_WARNING, 100)
+            << "Falling back to sending samples over gRPC: "
+            << ring_or.status();
+        return;
+      }
+      shared_memory_ring_ = std::move(ring_or).value();
+    }
+
+    // Returns the serialized data of `chunk`, which the caller has pinned as
+    // `data`.
+    grpc::Slice WireBytes(const ChunkStore::Chunk& chunk,
+                          const ChunkData& data) const {
+      if (cache_wire_bytes_) {
+        // The data is resident while it is pinned so this only fails if the
+        // serialization itself fails, which is retried below.
+        auto bytes_or = chunk.WireBytes();
+        if (bytes_or.ok()) return std::move(bytes_or).value();
+      }
+      return SerializeToSlice(data);
+    }
+
+    // Reserves `length` bytes of the client's shared memory ring. Returns null
+    // if there is no ring, if the client has not mapped it yet or if it is
+    // full. Otherwise the block must be passed to `CommitSharedMemory` once
+    // the payload has been written.
+    char* MaybeAllocateSharedMemory(size_t length, uint64_t* offset)
+        ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (!shared_memory_ring_mapped_) return nullptr;
+      char* data;
+      if (!shared_memory_ring_->Allocate(length, offset, &data)) {
+        return nullptr;
+      }
+      return data;
+    }
+
+    // Publishes the written block to the client and references it from
+    // `entry`.
+    void CommitSharedMemory(uint64_t offset, size_t length,
+                            SampleStreamResponse::SampleEntry* entry)
+        ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      shared_memory_ring_->Commit(offset, length);
+      auto* block = entry->add_shared_memory_data();
+      block->set_offset(offset);
+      block->set_length(length);
+    }
+
+    // Writes `chunk`, which the caller has pinned as `data`, to the client's
+    // shared memory ring and references it from `entry`. Returns false if
+    // there is no ring or if it is full.
+    bool MaybeWriteToSharedMemory(const ChunkStore::Chunk& chunk,
+                                  const ChunkData& data,
+                                  SampleStreamResponse::SampleEntry* entry)
+        ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      const size_t length = chunk.DataByteSizeLong();
+      uint64_t offset;
+      char* out = MaybeAllocateSharedMemory(length, &offset);
+      if (out == nullptr) return false;
+      if (cache_wire_bytes_) {
+        grpc::Slice bytes = WireBytes(chunk, data);
+        std::memcpy(out, bytes.begin(), bytes.size());
+      } else {
+        data.SerializeToArray(out, length);
+      }
+      CommitSharedMemory(offset, length, entry);
+      return true;
+    }
+
+    // Same as above but for the serialized data of a sliced chunk.
+    bool MaybeWriteToSharedMemory(const grpc::Slice& bytes,
+                                  SampleStreamResponse::SampleEntry* entry)
+        ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      uint64_t offset;
+      char* data = MaybeAllocateSharedMemory(bytes.size(), &offset);
+      if (data == nullptr) return false;
+      std::memcpy(data, bytes.begin(), bytes.size());
+      CommitSharedMemory(offset, bytes.size(), entry);
+      return true;
+    }
+
+    // Slices the chunks of `sample`, whose data is pinned in `pinned`, down to
+    // the rows referenced by the item (see `--reverb_slice_sampled_chunks`).
+    // Sets `sliced[i]` to the serialized data of the i:th chunk if it was
+    // sliced and leaves it empty otherwise. Returns a copy of the flat
+    // trajectory of the item which references the sliced chunks, allocated on
+    // `arena`, or null if no chunk was sliced.
+    FlatTrajectory* SliceChunks(
+        const Table::SampledItem& sample,
+        absl::Span<const std::shared_ptr<const ChunkData>> pinned,
+        google::protobuf::Arena* arena, std::vector<grpc::Slice>* sliced) {
+      const auto& chunks = sample.ref->chunks();
+      const FlatTrajectory& trajectory = sample.ref->flat_trajectory();
+
+      // Range of rows referenced by the item in each chunk.
+      internal::flat_hash_map<uint64_t, std::pair<int, int>> ranges;
+      for (const auto& column : trajectory.columns()) {
+        for (const auto& slice : column.chunk_slices()) {
+          const int begin = slice.offset();
+          const int end = slice.offset() + slice.length();
+          auto [it, inserted] =
+              ranges.try_emplace(slice.chunk_key(), begin, end);
+          if (!inserted) {
+            it->second.first = std::min(it->second.first, begin);
+            it->second.second = std::max(it->second.second, end);
+          }
+        }
+      }
+
+      sliced->resize(chunks.size());
+      bool any_sliced = false;
+      for (int i = 0; i < chunks.size(); i++) {
+        auto it = ranges.find(chunks[i]->key());
+        if (it == ranges.end()) continue;
+        const auto [begin, end] = it->second;
+        if (end - begin > kMaxSlicedRowsFraction * chunks[i]->num_rows()) {
+          ranges.erase(it);
+          continue;
+        }
+        if (pinned[i]->sequence_range().sparse()) {
+          ranges.erase(it);
+          continue;
+        }
+        auto bytes_or = sliced_chunk_cache_->GetOrSlice(*pinned[i], begin, end);
+        if (!bytes_or.ok()) {
+          REVERB_LOG(REVERB_WARNING)
+              << "Sending chunk " << chunks[i]->key()
+              << " without slicing it: " << bytes_or.status();
+          ranges.erase(it);
+          continue;
+        }
+        (*sliced)[i] = std::move(bytes_or).value();
+        any_sliced = true;
+      }
+      if (!any_sliced) return nullptr;
+
+      auto* sliced_trajectory =
+          google::protobuf::Arena::CreateMessage<FlatTrajectory>(arena);
+      *sliced_trajectory = trajectory;
+      for (auto& column : *sliced_trajectory->mutable_columns()) {
+        for (auto& slice : *column.mutable_chunk_slices()) {
+          auto it = ranges.find(slice.chunk_key());
+          if (it == ranges.end()) continue;
+          const auto [begin, end] = it->second;
+          slice.set_chunk_key(
+              internal::SlicedChunkKey(slice.chunk_key(), begin, end));
+          slice.set_offset(slice.offset() - begin);
+        }
+      }
+      return sliced_trajectory;
+    }
+
     void MaybeStartSampling() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
       // We start with a batch size of `kInitialGrpcSampleBatchSize` to not
       // pre-allocate too long response vector if there is not enough items in
@@ -605,7 +896,23 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
                                            task_info_.timeout);
     }
 
-    void ProcessSample(Table::SampledItem* sample, bool write_in_flight)
+    void PrepareResponse(SampleStreamResponseCtx* response) override
+        ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (!response->builder.empty()) {
+        task_info_.table->RecordSampleResponseBytes(
+            response->builder.ByteSizeLong());
+        if (sliced_chunk_cache_ != nullptr) {
+          task_info_.table->RecordSampleResponseBytesSaved(
+              response->bytes_saved);
+        }
+        response->payload = response->builder.Build();
+      }
+    }
+
+    // Appends `sample` to the responses to send. Fails if the data of a chunk
+    // could not be paged in.
+    absl::Status ProcessSample(Table::SampledItem* sample,
+                               bool write_in_flight)
         ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
       if (responses_to_send_.empty() ||
           (responses_to_send_.size() == 1 && write_in_flight) ||
@@ -616,9 +923,40 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
         current_response_size_bytes_ = 0;
       }
       SampleStreamResponseCtx* response = &responses_to_send_.back();
-      auto* entry = response->payload.add_entries();
-      for (int i = 0; i < sample->ref->chunks().size(); i++) {
-        entry->set_end_of_sequence(i + 1 == sample->ref->chunks().size());
+      if (shared_memory_ring_ != nullptr && !shared_memory_ring_announced_) {
+        SampleStreamResponse fields;
+        fields.set_shared_memory_ring(shared_memory_ring_->name());
+        response->builder.AddFields(fields);
+        shared_memory_ring_announced_ = true;
+      }
+      const auto& chunks = sample->ref->chunks();
+      // The chunks are pinned before anything is built so that a failure to
+      // page in their data can be returned right away.
+      std::vector<std::shared_ptr<const ChunkData>> pinned(chunks.size());
+      for (int i = 0; i < chunks.size(); i++) {
+        REVERB_ASSIGN_OR_RETURN(pinned[i], chunks[i]->Pin());
+      }
+      // The entry only lives until it has been serialized into the response so
+      // it is built on an arena which is reset once the sample is processed.
+      std::shared_ptr<google::protobuf::Arena> arena;
+      if (arena_pool_ != nullptr) {
+        arena = arena_pool_->Acquire();
+      }
+      auto* entry = google::protobuf::Arena::CreateMessage<
+          SampleStreamResponse::SampleEntry>(arena.get());
+      std::unique_ptr<SampleStreamResponse::SampleEntry> owned_entry(
+          arena == nullptr ? entry : nullptr);
+      // The sliced trajectory is owned by `entry` whereas the trajectory of
+      // the item is only borrowed.
+      std::vector<grpc::Slice> sliced_chunks;
+      FlatTrajectory* sliced_trajectory = nullptr;
+      if (sliced_chunk_cache_ != nullptr) {
+        sliced_trajectory =
+            SliceChunks(*sample, pinned, arena.get(), &sliced_chunks);
+      }
+      std::vector<grpc::Slice> entry_data;
+      for (int i = 0; i < chunks.size(); i++) {
+        entry->set_end_of_sequence(i + 1 == chunks.size());
         // Attach the info to the first message.
         if (i == 0) {
           auto* item = entry->mutable_info()->mutable_item();
@@ -626,37 +964,89 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
           item->set_table(std::string(sample->ref->table()));
           item->set_priority(sample->priority);
           item->set_times_sampled(sample->times_sampled);
-          // ~SampleStreamResponseCtx releases these fields from the proto
-          // upon destruction of the item.
-          item->/*unsafe_arena_*/set_allocated_inserted_at(
+          // Borrowed from the item while the entry is serialized and released
+          // right after (see below).
+          item->unsafe_arena_set_allocated_inserted_at(
               sample->ref->unsafe_mutable_inserted_at());
-          item->/*unsafe_arena_*/set_allocated_flat_trajectory(
-              sample->ref->unsafe_mutable_flat_trajectory());
+          if (sliced_trajectory != nullptr) {
+            item->set_allocated_flat_trajectory(sliced_trajectory);
+          } else {
+            item->unsafe_arena_set_allocated_flat_trajectory(
+                sample->ref->unsafe_mutable_flat_trajectory());
+          }
           entry->mutable_info()->set_probability(sample->probability);
           entry->mutable_info()->set_table_size(sample->table_size);
           entry->mutable_info()->set_rate_limited(sample->rate_limited);
         }
-        ChunkData* chunk =
-            const_cast<ChunkData*>(&sample->ref->chunks()[i]->data());
-        current_response_size_bytes_ += chunk->ByteSizeLong();
-        entry->mutable_data()->UnsafeArenaAddAllocated(chunk);
-        if (i < sample->ref->chunks().size() - 1 &&
+        if (!sliced_chunks.empty() && sliced_chunks[i].size() != 0) {
+          // Credited to the response which the chunk is sent with, as the
+          // entries of a sample may be spread over several responses.
+          response->bytes_saved +=
+              static_cast<int64_t>(chunks[i]->DataByteSizeLong()) -
+              static_cast<int64_t>(sliced_chunks[i].size());
+          if (!MaybeWriteToSharedMemory(sliced_chunks[i], entry)) {
+            entry_data.push_back(sliced_chunks[i]);
+            current_response_size_bytes_ += entry_data.back().size();
+          }
+        } else if (!MaybeWriteToSharedMemory(*chunks[i], *pinned[i], entry)) {
+          entry_data.push_back(WireBytes(*chunks[i], *pinned[i]));
+          current_response_size_bytes_ += entry_data.back().size();
+        }
+        if (i + 1 == chunks.size() ||
+            current_response_size_bytes_ > kMaxSampleResponseSizeBytes) {
+          response->builder.AddEntry(*entry, entry_data);
+          if (entry->info().has_item()) {
+            auto* item = entry->mutable_info()->mutable_item();
+            item->unsafe_arena_release_inserted_at();
+            if (sliced_trajectory == nullptr) {
+              item->unsafe_arena_release_flat_trajectory();
+            }
+          }
+          entry->Clear();
+          entry_data.clear();
+        }
+        if (i + 1 < chunks.size() &&
             current_response_size_bytes_ > kMaxSampleResponseSizeBytes) {
           // Current response is too big, start a new one.
           responses_to_send_.emplace();
           current_response_size_bytes_ = 0;
           response = &responses_to_send_.back();
-          entry = response->payload.add_entries();
         }
       }
-      // Reference sample only in the last response containing it, so it is
-      // released when fully sent to the client.
-      response->AddTableItem(sample->ref);
+      return absl::OkStatus();
     }
 
     // Used to lookup tables when inserting items.
     const ReverbServiceImpl* server_;
 
+    // True if the client runs on the same host as the server.
+    const bool is_local_;
+
+    // Whether chunks should cache their serialized data when sampled.
+    const bool cache_wire_bytes_;
+
+    // Cache of the server which sliced chunks are looked up in. Null unless
+    // `--reverb_slice_sampled_chunks` is set.
+    internal::SlicedChunkCache* const sliced_chunk_cache_;
+
+    // Arenas which sample entries are built on. Null if arenas are disabled.
+    const std::unique_ptr<internal::ArenaPool> arena_pool_;
+
+    // True once the first request of the stream has been processed.
+    bool shared_memory_negotiated_ ABSL_GUARDED_BY(mu_) = false;
+
+    // Ring created for the client to receive chunk payloads. Null when chunks
+    // are sent inline in the responses.
+    std::unique_ptr<internal::SharedMemoryRing> shared_memory_ring_
+        ABSL_GUARDED_BY(mu_);
+
+    // True once the name of `shared_memory_ring_` has been added to a response.
+    bool shared_memory_ring_announced_ ABSL_GUARDED_BY(mu_) = false;
+
+    // True once the client has confirmed that it mapped `shared_memory_ring_`.
+    // Chunks are only written to the ring after that.
+    bool shared_memory_ring_mapped_ ABSL_GUARDED_BY(mu_) = false;
+
     // Context of the current sample request.
     SampleTaskInfo task_info_ ABSL_GUARDED_BY(mu_);
 
@@ -672,7 +1062,7 @@ ReverbServiceImpl::SampleStream(grpc::CallbackServerContext* context) {
     bool waiting_for_enqueued_sample_ ABSL_GUARDED_BY(mu_);
   };
 
-  return new WorkerlessSampleReactor(this);
+  return new WorkerlessSampleReactor(context, this);
 }
 
 std::shared_ptr<Table> ReverbServiceImpl::TableByName(
@@ -706,14 +1096,37 @@ grpc::ServerUnaryReactor* ReverbServiceImpl::ServerInfo(
     grpc::CallbackServerContext* context, const ServerInfoRequest* request,
     ServerInfoResponse* response) {
   grpc::ServerUnaryReactor* reactor = context->DefaultReactor();
-  for (const auto& iter : tables_) {
-    *response->add_table_info() = iter.second->info();
+  for (auto& info : TableInfos()) {
+    *response->add_table_info() = std::move(info);
   }
   *response->mutable_tables_state_id() = Uint128ToMessage(tables_state_id_);
   reactor->Finish(grpc::Status::OK);
   return reactor;
 }
 
+std::vector<TableInfo> ReverbServiceImpl::TableInfos() const {
+  std::vector<TableInfo> infos;
+  infos.reserve(tables_.size());
+  for (const auto& iter : tables_) {
+    infos.push_back(iter.second->info());
+    if (deduplicator_ != nullptr) {
+      *infos.back().mutable_chunk_deduplication() = deduplicator_->stats();
+    }
+  }
+  return infos;
+}
+
+std::shared_ptr<ChunkStore::Chunk> ReverbServiceImpl::NewChunk(
+    ChunkData data) const {
+  if (spill_tier_ != nullptr) {
+    return spill_tier_->NewChunk(std::move(data));
+  }
+  if (deduplicator_ != nullptr) {
+    return deduplicator_->NewChunk(std::move(data));
+  }
+  return std::make_shared<ChunkStore::Chunk>(std::move(data));
+}
+
 internal::flat_hash_map<std::string, std::shared_ptr<Table>>
 ReverbServiceImpl::tables() const {
   return tables_;
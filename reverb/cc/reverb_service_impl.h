@@ -16,31 +16,59 @@
 #define REVERB_CC__REVERB_SERVICE_IMPL_H_
 
 #include <memory>
+#include <vector>
 
 #include "grpcpp/grpcpp.h"
+#include "grpcpp/support/byte_buffer.h"
 #include "absl/numeric/int128.h"
 #include "absl/random/random.h"
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
 #include "reverb/cc/checkpointing/interface.h"
+#include "reverb/cc/chunk_deduplicator.h"
+#include "reverb/cc/chunk_spill_tier.h"
 #include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/reverb_service.grpc.pb.h"
 #include "reverb/cc/reverb_service.pb.h"
 #include "reverb/cc/schema.pb.h"
+#include "reverb/cc/support/chunk_slicer.h"
 #include "reverb/cc/table.h"
 
 namespace deepmind {
 namespace reverb {
 
+// `ReverbService::CallbackService` except that InsertStream and SampleStream
+// are registered as raw methods, i.e they read and write `grpc::ByteBuffer`s.
+// This allows sample responses to reference the serialized chunks instead of
+// gRPC serializing a `SampleStreamResponse`, and insert requests to be parsed
+// into arenas owned by the reactor. The messages on the wire are unchanged.
+using ReverbCallbackService = ReverbService::WithCallbackMethod_Checkpoint<
+    ReverbService::WithRawCallbackMethod_InsertStream<
+        ReverbService::WithCallbackMethod_MutatePriorities<
+            ReverbService::WithCallbackMethod_Reset<
+                ReverbService::WithRawCallbackMethod_SampleStream<
+                    ReverbService::WithCallbackMethod_ServerInfo<
+                        ReverbService::WithCallbackMethod_InitializeConnection<
+                            /* grpc_gen:: */ReverbService::Service>>>>>>>;
+
 // Implements ReverbService asynchronously. See reverb_service.proto for
 // documentation.
-class ReverbServiceImpl : public /* grpc_gen:: */ReverbService::CallbackService {
+class ReverbServiceImpl : public ReverbCallbackService {
  public:
   static absl::Status Create(
       std::vector<std::shared_ptr<Table>> tables,
       std::shared_ptr<Checkpointer> checkpointer,
       std::unique_ptr<ReverbServiceImpl>* service);
 
+  // As above but the data of inserted chunks may be spilled by `spill_tier`
+  // when the server holds more data than fits in memory. If `spill_tier` is
+  // null then all data is kept in memory.
+  static absl::Status Create(
+      std::vector<std::shared_ptr<Table>> tables,
+      std::shared_ptr<Checkpointer> checkpointer,
+      std::shared_ptr<ChunkSpillTier> spill_tier,
+      std::unique_ptr<ReverbServiceImpl>* service);
+
   grpc::ServerUnaryReactor* Checkpoint(grpc::CallbackServerContext* context,
                                        const CheckpointRequest* request,
                                        CheckpointResponse* response) override;
@@ -73,8 +101,11 @@ class ReverbServiceImpl : public /* grpc_gen:: */ReverbService::CallbackService
   // 3. When the last scheduled insertion runs, we reactivate the reads even if
   // the number of items in the queue exceeds max_queue_size_to_read as it is
   // the last opportunity we have to resume reads.
-  grpc::ServerBidiReactor<InsertStreamRequest, InsertStreamResponse>*
-  InsertStream(grpc::CallbackServerContext* context) override;
+  //
+  // Requests and responses are serialized `InsertStreamRequest` and
+  // `InsertStreamResponse` messages (see `ReverbCallbackService`).
+  grpc::ServerBidiReactor<grpc::ByteBuffer, grpc::ByteBuffer>* InsertStream(
+      grpc::CallbackServerContext* context) override;
 
   grpc::ServerUnaryReactor* MutatePriorities(
       grpc::CallbackServerContext* context,
@@ -98,8 +129,11 @@ class ReverbServiceImpl : public /* grpc_gen:: */ReverbService::CallbackService
   //    first message of the batch.
   //    3.c. if there are still messages to be sent,
   //    writes one message.
-  grpc::ServerBidiReactor<SampleStreamRequest, SampleStreamResponse>*
-  SampleStream(grpc::CallbackServerContext* context) override;
+  //
+  // Requests and responses are serialized `SampleStreamRequest` and
+  // `SampleStreamResponse` messages (see `ReverbCallbackService`).
+  grpc::ServerBidiReactor<grpc::ByteBuffer, grpc::ByteBuffer>* SampleStream(
+      grpc::CallbackServerContext* context) override;
 
   grpc::ServerUnaryReactor* ServerInfo(grpc::CallbackServerContext* context,
                                        const ServerInfoRequest* request,
@@ -112,6 +146,9 @@ class ReverbServiceImpl : public /* grpc_gen:: */ReverbService::CallbackService
   // Gets a copy of the table lookup.
   internal::flat_hash_map<std::string, std::shared_ptr<Table>> tables() const;
 
+  // Returns the info of every table, as sent in `ServerInfo` responses.
+  std::vector<TableInfo> TableInfos() const;
+
   // Closes all tables and the chunk store.
   void Close();
 
@@ -120,18 +157,34 @@ class ReverbServiceImpl : public /* grpc_gen:: */ReverbService::CallbackService
 
  private:
   explicit ReverbServiceImpl(
-      std::shared_ptr<Checkpointer> checkpointer = nullptr);
+      std::shared_ptr<Checkpointer> checkpointer = nullptr,
+      std::shared_ptr<ChunkSpillTier> spill_tier = nullptr);
 
   absl::Status Initialize(std::vector<std::shared_ptr<Table>> tables);
 
   // Lookups the table for a given name. Returns nullptr if not found.
   std::shared_ptr<Table> TableByName(absl::string_view name) const;
 
+  // Creates a chunk for inserted `data` using the spill tier or the
+  // deduplicator when configured.
+  std::shared_ptr<ChunkStore::Chunk> NewChunk(ChunkData data) const;
+
   // Checkpointer used to restore state in the constructor and to save data
   // when `Checkpoint` is called. Note that if `checkpointer_` is nullptr then
   // `Checkpoint` will return an `InvalidArgumentError`.
   std::shared_ptr<Checkpointer> checkpointer_;
 
+  // Optional tier which inserted chunks are registered with.
+  std::shared_ptr<ChunkSpillTier> spill_tier_;
+
+  // Index which inserted chunks are deduplicated through. Only set when the
+  // `reverb_deduplicate_chunks` flag is enabled and no spill tier is used.
+  std::shared_ptr<ChunkDeduplicator> deduplicator_;
+
+  // Cache of chunks sliced down to the rows referenced by sampled items. Only
+  // set when the `reverb_slice_sampled_chunks` flag is enabled.
+  std::unique_ptr<internal::SlicedChunkCache> sliced_chunk_cache_;
+
   // Priority tables.
   internal::flat_hash_map<std::string, std::shared_ptr<Table>> tables_;
 
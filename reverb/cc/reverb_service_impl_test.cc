@@ -27,14 +27,18 @@
 #include "grpcpp/test/default_reactor_test_peer.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "absl/flags/declare.h"
+#include "absl/flags/flag.h"
 #include "absl/memory/memory.h"
 #include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
 #include "absl/synchronization/blocking_counter.h"
 #include "absl/synchronization/notification.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "absl/types/optional.h"
 #include "reverb/cc/platform/checkpointing.h"
+#include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/platform/status_macros.h"
 #include "reverb/cc/platform/status_matchers.h"
 #include "reverb/cc/platform/thread.h"
@@ -43,12 +47,22 @@
 #include "reverb/cc/selectors/fifo.h"
 #include "reverb/cc/selectors/interface.h"
 #include "reverb/cc/selectors/uniform.h"
+#include "reverb/cc/support/chunk_slicer.h"
+#include "reverb/cc/support/cleanup.h"
+#include "reverb/cc/support/shared_memory_ring.h"
+#include "reverb/cc/support/trajectory_util.h"
 #include "reverb/cc/task_worker.h"
+#include "reverb/cc/tensor_compression.h"
 #include "reverb/cc/testing/proto_test_util.h"
+#include "reverb/cc/testing/tensor_testutil.h"
+#include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/protobuf/struct.pb.h"
 
+ABSL_DECLARE_FLAG(bool, reverb_slice_sampled_chunks);
+ABSL_DECLARE_FLAG(bool, reverb_use_reactor_arenas);
+
 namespace deepmind {
 namespace reverb {
 namespace {
@@ -84,6 +98,8 @@ class FakeSelector : public ItemSelector {
 
   void Clear() override{};
 
+  double TotalWeight() const override { return 1; }
+
   KeyDistributionOptions options() const override {
     return KeyDistributionOptions();
   }
@@ -182,6 +198,178 @@ std::unique_ptr<ReverbServiceImpl> MakeService(int max_size) {
   return MakeService(max_size, nullptr);
 }
 
+// Returns a service which slices sampled chunks (see
+// `--reverb_slice_sampled_chunks`) if `slice_chunks` is set.
+std::unique_ptr<ReverbServiceImpl> MakeSlicingService(bool slice_chunks) {
+  const bool previous = absl::GetFlag(FLAGS_reverb_slice_sampled_chunks);
+  absl::SetFlag(&FLAGS_reverb_slice_sampled_chunks, slice_chunks);
+  auto service = MakeService(10);
+  absl::SetFlag(&FLAGS_reverb_slice_sampled_chunks, previous);
+  return service;
+}
+
+// Returns a chunk of `num_columns` columns, each holding `rows` steps of
+// random (and thus incompressible) int32 rows of `row_size` elements.
+ChunkData MakeRandomChunk(uint64_t key, int32_t start, int rows, int row_size,
+                          int num_columns) {
+  ChunkData chunk;
+  chunk.set_chunk_key(key);
+  for (int i = 0; i < num_columns; i++) {
+    tensorflow::Tensor tensor(tensorflow::DT_INT32, {rows, row_size});
+    tensor.flat<int32_t>().setRandom();
+    CompressTensorAsProto(tensor, chunk.mutable_data()->add_tensors());
+  }
+  chunk.set_data_tensors_len(num_columns);
+  *chunk.mutable_sequence_range() =
+      testing::MakeSequenceRange(/*episode_id=*/1, start, start + rows - 1);
+  return chunk;
+}
+
+// Appends a slice of rows [offset, offset + length) of the chunk `chunk_key`
+// to `column`.
+void AddSlice(FlatTrajectory::Column* column, uint64_t chunk_key, int index,
+              int offset, int length) {
+  auto* slice = column->add_chunk_slices();
+  slice->set_chunk_key(chunk_key);
+  slice->set_index(index);
+  slice->set_offset(offset);
+  slice->set_length(length);
+}
+
+// Inserts `chunks` and an item with `trajectory` into the table "dist".
+void InsertItem(ReverbService::Stub* stub, const std::vector<ChunkData>& chunks,
+                const FlatTrajectory& trajectory) {
+  grpc::ClientContext context;
+  auto stream = stub->InsertStream(&context);
+  for (const auto& chunk : chunks) {
+    InsertStreamRequest request;
+    *request.add_chunks() = chunk;
+    ASSERT_TRUE(stream->Write(request));
+  }
+  InsertStreamRequest request;
+  auto* item = request.add_items();
+  item->set_key(nextId++);
+  item->set_table("dist");
+  item->set_priority(1);
+  *item->mutable_flat_trajectory() = trajectory;
+  for (const auto& chunk : chunks) {
+    request.add_keep_chunk_keys(chunk.chunk_key());
+  }
+  ASSERT_TRUE(stream->Write(request));
+  InsertStreamResponse response;
+  ASSERT_TRUE(stream->Read(&response));
+  ASSERT_TRUE(stream->WritesDone());
+  REVERB_ASSERT_OK(stream->Finish());
+}
+
+// Samples a single item with `request` and returns the responses it was
+// sent in.
+std::vector<SampleStreamResponse> SampleItem(ReverbService::Stub* stub,
+                                             SampleStreamRequest request) {
+  request.set_num_samples(1);
+  grpc::ClientContext context;
+  auto stream = stub->SampleStream(&context);
+  EXPECT_TRUE(stream->Write(request));
+  EXPECT_TRUE(stream->WritesDone());
+  std::vector<SampleStreamResponse> responses;
+  SampleStreamResponse response;
+  while (stream->Read(&response)) {
+    responses.push_back(std::move(response));
+  }
+  REVERB_EXPECT_OK(stream->Finish());
+  return responses;
+}
+
+// Samples the item of table "dist" twice on a stream which asks for a shared
+// memory ring. The first sample is sent before the ring has been mapped and
+// the second after. Returns the responses of the second sample and the mapped
+// ring in `ring`.
+std::vector<SampleStreamResponse> SampleThroughSharedMemoryRing(
+    ReverbService::Stub* stub,
+    std::unique_ptr<internal::SharedMemoryRing>* ring) {
+  grpc::ClientContext context;
+  auto stream = stub->SampleStream(&context);
+  SampleStreamRequest request = SampleRequest("dist", 1);
+  request.set_shared_memory_ring_bytes(1 << 20);
+  EXPECT_TRUE(stream->Write(request));
+
+  // The ring is announced in the first response but not used until the
+  // client has confirmed that it is mapped.
+  SampleStreamResponse response;
+  EXPECT_TRUE(stream->Read(&response));
+  EXPECT_FALSE(response.shared_memory_ring().empty());
+  for (const auto& entry : response.entries()) {
+    EXPECT_EQ(entry.shared_memory_data_size(), 0);
+  }
+  auto ring_or =
+      internal::SharedMemoryRing::Open(response.shared_memory_ring());
+  REVERB_EXPECT_OK(ring_or.status());
+  if (ring_or.ok()) *ring = std::move(ring_or).value();
+
+  request = SampleRequest("dist", 1);
+  request.set_shared_memory_ring_mapped(true);
+  EXPECT_TRUE(stream->Write(request));
+  EXPECT_TRUE(stream->WritesDone());
+  std::vector<SampleStreamResponse> responses;
+  while (stream->Read(&response)) {
+    EXPECT_TRUE(response.shared_memory_ring().empty());
+    responses.push_back(std::move(response));
+  }
+  REVERB_EXPECT_OK(stream->Finish());
+
+  // The server unlinks the ring once it has been mapped.
+  if (ring_or.ok()) {
+    EXPECT_FALSE(internal::SharedMemoryRing::Open((*ring)->name()).ok());
+  }
+  return responses;
+}
+
+struct DecodedSample {
+  // Trajectory of the sampled item as sent to the client.
+  FlatTrajectory trajectory;
+
+  // Chunks sent with the sample, both inline and through `ring`.
+  internal::flat_hash_map<uint64_t, ChunkData> chunks;
+
+  // Rows referenced by each chunk slice of the trajectory, column by column.
+  std::vector<tensorflow::Tensor> slices;
+};
+
+// Collects the entries of a sample from `responses` and unpacks the rows
+// referenced by its trajectory.
+DecodedSample DecodeSample(const std::vector<SampleStreamResponse>& responses,
+                           const internal::SharedMemoryRing* ring = nullptr) {
+  DecodedSample sample;
+  for (const auto& response : responses) {
+    for (const auto& entry : response.entries()) {
+      if (entry.info().has_item()) {
+        sample.trajectory = entry.info().item().flat_trajectory();
+      }
+      for (const auto& chunk : entry.data()) {
+        sample.chunks[chunk.chunk_key()] = chunk;
+      }
+      for (const auto& block : entry.shared_memory_data()) {
+        auto bytes = ring->Get(block.offset(), block.length()).value();
+        ChunkData chunk;
+        EXPECT_TRUE(chunk.ParseFromArray(bytes.data(), bytes.size()));
+        sample.chunks[chunk.chunk_key()] = std::move(chunk);
+      }
+    }
+  }
+  for (const auto& column : sample.trajectory.columns()) {
+    for (const auto& slice : column.chunk_slices()) {
+      auto it = sample.chunks.find(slice.chunk_key());
+      EXPECT_NE(it, sample.chunks.end());
+      if (it == sample.chunks.end()) continue;
+      tensorflow::Tensor tensor;
+      REVERB_EXPECT_OK(
+          internal::UnpackChunkColumnAndSlice(it->second, slice, &tensor));
+      sample.slices.push_back(std::move(tensor));
+    }
+  }
+  return sample;
+}
+
 TEST(ReverbServiceImplTest, InsertSameItemWorks) {
   std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
   std::unique_ptr<grpc::Server> server(
@@ -261,6 +449,192 @@ TEST(ReverbServiceImplTest, SampleAfterInsertWorks) {
   }
 }
 
+TEST(ReverbServiceImplTest, SampleWritesChunksToSharedMemoryRing) {
+  std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+  grpc::ClientContext context;
+  auto insert_stream = stub.InsertStream(&context);
+  ASSERT_TRUE(insert_stream->Write(InsertMultiChunkRequest({1, 2})));
+  InsertStreamRequest insert_request = InsertItemRequest("dist", {1, 2});
+  InsertStreamResponse response;
+  ASSERT_TRUE(insert_stream->Write(insert_request));
+  ASSERT_TRUE(insert_stream->Read(&response));
+  ASSERT_TRUE(insert_stream->WritesDone());
+  REVERB_EXPECT_OK(insert_stream->Finish());
+
+  std::unique_ptr<internal::SharedMemoryRing> ring;
+  std::vector<SampleStreamResponse> responses =
+      SampleThroughSharedMemoryRing(&stub, &ring);
+  ASSERT_NE(ring, nullptr);
+  ASSERT_EQ(responses.size(), 1);
+  ASSERT_EQ(responses[0].entries_size(), 1);
+  const auto& entry = responses[0].entries(0);
+  EXPECT_EQ(entry.data_size(), 0);
+  ASSERT_EQ(entry.shared_memory_data_size(), 2);
+  for (int i = 0; i < 2; i++) {
+    const auto& block = entry.shared_memory_data(i);
+    auto bytes_or = ring->Get(block.offset(), block.length());
+    REVERB_ASSERT_OK(bytes_or.status());
+    ChunkData chunk;
+    ASSERT_TRUE(
+        chunk.ParseFromArray(bytes_or.value().data(), bytes_or.value().size()));
+    EXPECT_EQ(chunk.chunk_key(), i + 1);
+  }
+}
+
+TEST(ReverbServiceImplTest, SlicedSampleMatchesUnslicedSample) {
+  const std::vector<ChunkData> chunks = {
+      MakeRandomChunk(/*key=*/1, /*start=*/0, /*rows=*/100, /*row_size=*/8,
+                      /*num_columns=*/2),
+      MakeRandomChunk(/*key=*/2, /*start=*/100, /*rows=*/100, /*row_size=*/8,
+                      /*num_columns=*/2)};
+
+  // Steps [70, 110) in the first column and [80, 105) in the second. Rows
+  // [70, 100) of the first chunk and [0, 10) of the second chunk are needed.
+  FlatTrajectory trajectory;
+  auto* first = trajectory.add_columns();
+  AddSlice(first, /*chunk_key=*/1, /*index=*/0, /*offset=*/70, /*length=*/30);
+  AddSlice(first, /*chunk_key=*/2, /*index=*/0, /*offset=*/0, /*length=*/10);
+  auto* second = trajectory.add_columns();
+  AddSlice(second, /*chunk_key=*/1, /*index=*/1, /*offset=*/80, /*length=*/20);
+  AddSlice(second, /*chunk_key=*/2, /*index=*/1, /*offset=*/0, /*length=*/5);
+
+  DecodedSample samples[2];
+  for (bool slice_chunks : {false, true}) {
+    std::unique_ptr<ReverbServiceImpl> service =
+        MakeSlicingService(slice_chunks);
+    std::unique_ptr<grpc::Server> server(
+        grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+    /* grpc_gen:: */ReverbService::Stub stub(
+        server->InProcessChannel(grpc::ChannelArguments()));
+    InsertItem(&stub, chunks, trajectory);
+    samples[slice_chunks] =
+        DecodeSample(SampleItem(&stub, SampleRequest("dist", 1)));
+  }
+  const DecodedSample& unsliced = samples[0];
+  const DecodedSample& sliced = samples[1];
+
+  EXPECT_THAT(unsliced.trajectory, testing::EqualsProto(trajectory));
+  ASSERT_EQ(sliced.slices.size(), unsliced.slices.size());
+  for (int i = 0; i < sliced.slices.size(); i++) {
+    test::ExpectTensorEqual<int32_t>(sliced.slices[i], unsliced.slices[i]);
+  }
+
+  // The slices reference the sliced chunks with their offsets rebased.
+  const uint64_t first_key = internal::SlicedChunkKey(1, 70, 100);
+  const uint64_t second_key = internal::SlicedChunkKey(2, 0, 10);
+  FlatTrajectory expected;
+  auto* expected_first = expected.add_columns();
+  AddSlice(expected_first, first_key, /*index=*/0, /*offset=*/0,
+           /*length=*/30);
+  AddSlice(expected_first, second_key, /*index=*/0, /*offset=*/0,
+           /*length=*/10);
+  auto* expected_second = expected.add_columns();
+  AddSlice(expected_second, first_key, /*index=*/1, /*offset=*/10,
+           /*length=*/20);
+  AddSlice(expected_second, second_key, /*index=*/1, /*offset=*/0,
+           /*length=*/5);
+  EXPECT_THAT(sliced.trajectory, testing::EqualsProto(expected));
+  ASSERT_EQ(sliced.chunks.size(), 2);
+  const ChunkData& first_chunk = sliced.chunks.at(first_key);
+  EXPECT_EQ(first_chunk.sequence_range().start(), 70);
+  EXPECT_EQ(first_chunk.sequence_range().end(), 99);
+  EXPECT_LT(first_chunk.ByteSizeLong(), chunks[0].ByteSizeLong());
+  const ChunkData& second_chunk = sliced.chunks.at(second_key);
+  EXPECT_EQ(second_chunk.sequence_range().start(), 100);
+  EXPECT_EQ(second_chunk.sequence_range().end(), 109);
+  EXPECT_LT(second_chunk.ByteSizeLong(), chunks[1].ByteSizeLong());
+}
+
+TEST(ReverbServiceImplTest, SlicedSampleIsSplitAcrossResponses) {
+  std::unique_ptr<ReverbServiceImpl> service =
+      MakeSlicingService(/*slice_chunks=*/true);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+
+  // Each chunk is ~2.4MB and each slice ~1.2MB so the response is full after
+  // the second chunk and the third one is sent in a second response.
+  std::vector<ChunkData> chunks;
+  FlatTrajectory trajectory;
+  auto* column = trajectory.add_columns();
+  for (int i = 0; i < 3; i++) {
+    chunks.push_back(MakeRandomChunk(/*key=*/i + 1, /*start=*/i * 100,
+                                     /*rows=*/100, /*row_size=*/6 << 10,
+                                     /*num_columns=*/1));
+    AddSlice(column, /*chunk_key=*/i + 1, /*index=*/0, /*offset=*/0,
+             /*length=*/48);
+  }
+  InsertItem(&stub, chunks, trajectory);
+
+  std::vector<SampleStreamResponse> responses =
+      SampleItem(&stub, SampleRequest("dist", 1));
+  ASSERT_EQ(responses.size(), 2);
+  EXPECT_EQ(responses[0].entries(0).data_size(), 2);
+  EXPECT_FALSE(responses[0].entries(0).end_of_sequence());
+  EXPECT_FALSE(responses[1].entries(0).has_info());
+  EXPECT_EQ(responses[1].entries(0).data_size(), 1);
+  EXPECT_TRUE(responses[1].entries(0).end_of_sequence());
+
+  DecodedSample sample = DecodeSample(responses);
+  ASSERT_EQ(sample.slices.size(), 3);
+  for (int i = 0; i < 3; i++) {
+    tensorflow::Tensor expected;
+    REVERB_ASSERT_OK(internal::UnpackChunkColumnAndSlice(
+        chunks[i], trajectory.columns(0).chunk_slices(i), &expected));
+    test::ExpectTensorEqual<int32_t>(sample.slices[i], expected);
+  }
+
+  // The bytes saved by slicing are credited to the response which the chunk
+  // was sent in.
+  const Histogram saved = service->TableByName("dist")
+                              ->info()
+                              .histograms()
+                              .sample_response_bytes_saved();
+  EXPECT_EQ(saved.count(), 2);
+  EXPECT_GT(saved.min(), 0);
+  EXPECT_GT(saved.max(), saved.min());
+}
+
+TEST(ReverbServiceImplTest, SlicedChunksAreWrittenToSharedMemoryRing) {
+  std::unique_ptr<ReverbServiceImpl> service =
+      MakeSlicingService(/*slice_chunks=*/true);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+
+  const std::vector<ChunkData> chunks = {
+      MakeRandomChunk(/*key=*/1, /*start=*/0, /*rows=*/100, /*row_size=*/8,
+                      /*num_columns=*/1)};
+  FlatTrajectory trajectory;
+  AddSlice(trajectory.add_columns(), /*chunk_key=*/1, /*index=*/0,
+           /*offset=*/10, /*length=*/20);
+  InsertItem(&stub, chunks, trajectory);
+
+  std::unique_ptr<internal::SharedMemoryRing> ring;
+  std::vector<SampleStreamResponse> responses =
+      SampleThroughSharedMemoryRing(&stub, &ring);
+  ASSERT_NE(ring, nullptr);
+  ASSERT_EQ(responses.size(), 1);
+  ASSERT_EQ(responses[0].entries_size(), 1);
+  EXPECT_EQ(responses[0].entries(0).data_size(), 0);
+  EXPECT_EQ(responses[0].entries(0).shared_memory_data_size(), 1);
+
+  DecodedSample sample = DecodeSample(responses, ring.get());
+  ASSERT_EQ(sample.chunks.size(), 1);
+  EXPECT_TRUE(sample.chunks.contains(internal::SlicedChunkKey(1, 10, 30)));
+  ASSERT_EQ(sample.slices.size(), 1);
+  tensorflow::Tensor expected;
+  REVERB_ASSERT_OK(internal::UnpackChunkColumnAndSlice(
+      chunks[0], trajectory.columns(0).chunk_slices(0), &expected));
+  test::ExpectTensorEqual<int32_t>(sample.slices[0], expected);
+}
+
 TEST(ReverbServiceImplTest, InsertChunksWithoutItemWorks) {
   std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
   std::unique_ptr<grpc::Server> server(
@@ -276,6 +650,39 @@ TEST(ReverbServiceImplTest, InsertChunksWithoutItemWorks) {
   REVERB_EXPECT_OK(stream->Finish());
 }
 
+TEST(ReverbServiceImplTest, InsertedDataDoesNotReferenceRequestArena) {
+  const bool reactor_arenas = absl::GetFlag(FLAGS_reverb_use_reactor_arenas);
+  absl::SetFlag(&FLAGS_reverb_use_reactor_arenas, true);
+  auto restore_flag = internal::MakeCleanup([reactor_arenas] {
+    absl::SetFlag(&FLAGS_reverb_use_reactor_arenas, reactor_arenas);
+  });
+
+  std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
+  std::unique_ptr<grpc::Server> server(
+      grpc::ServerBuilder().RegisterService(service.get()).BuildAndStart());
+  /* grpc_gen:: */ReverbService::Stub stub(
+      server->InProcessChannel(grpc::ChannelArguments()));
+
+  grpc::ClientContext context;
+  auto stream = stub.InsertStream(&context);
+  ASSERT_TRUE(stream->Write(InsertMultiChunkRequest({1, 2})));
+  ASSERT_TRUE(stream->Write(InsertItemRequest("dist", {1, 2})));
+  InsertStreamResponse response;
+  ASSERT_TRUE(stream->Read(&response));
+  ASSERT_TRUE(stream->WritesDone());
+  REVERB_EXPECT_OK(stream->Finish());
+
+  // Stored data living on the arena of the request would keep the arena (and
+  // with it the whole request) alive for as long as the item is in the table.
+  std::vector<Table::Item> items = service->TableByName("dist")->Copy();
+  ASSERT_EQ(items.size(), 1);
+  EXPECT_EQ(items[0].flat_trajectory().GetArena(), nullptr);
+  ASSERT_EQ(items[0].chunks().size(), 2);
+  for (const auto& chunk : items[0].chunks()) {
+    EXPECT_EQ(chunk->Pin().value()->GetArena(), nullptr);
+  }
+}
+
 TEST(ReverbServiceImplTest, InsertSameChunkTwiceWorks) {
   std::unique_ptr<ReverbServiceImpl> service = MakeService(10);
   std::unique_ptr<grpc::Server> server(
@@ -564,6 +971,7 @@ TEST(ReverbServiceImplTest, ServerInfoWorks) {
   rate_limiter->mutable_insert_stats();
   rate_limiter->mutable_sample_stats();
   table_info.clear_table_worker_time();
+  table_info.clear_histograms();
   *expected_table_info.mutable_signature() = MakeSignature();
 
   EXPECT_THAT(table_info, testing::EqualsProto(expected_table_info));
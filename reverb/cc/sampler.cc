@@ -18,6 +18,7 @@
 #include <deque>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "grpcpp/impl/codegen/client_context.h"
@@ -39,6 +40,7 @@
 #include "reverb/cc/reverb_service.pb.h"
 #include "reverb/cc/schema.pb.h"
 #include "reverb/cc/support/grpc_util.h"
+#include "reverb/cc/support/shared_memory_ring.h"
 #include "reverb/cc/support/tf_util.h"
 #include "reverb/cc/support/trajectory_util.h"
 #include "reverb/cc/table.h"
@@ -70,7 +72,19 @@ tensorflow::Tensor ScalarTensor(T value) {
   return tensor;
 }
 
+// Unpacks the slice through `cache` unless it is null.
+absl::Status UnpackChunkColumnAndSlice(const ChunkData& chunk_data,
+                                       const FlatTrajectory::ChunkSlice& slice,
+                                       internal::ChunkColumnCache* cache,
+                                       tensorflow::Tensor* out) {
+  if (cache != nullptr) {
+    return cache->UnpackChunkColumnAndSlice(chunk_data, slice, out);
+  }
+  return internal::UnpackChunkColumnAndSlice(chunk_data, slice, out);
+}
+
 absl::Status AsSample(std::vector<SampleStreamResponse::SampleEntry> responses,
+                      internal::ChunkColumnCache* cache,
                       std::unique_ptr<Sample>* sample) {
   const auto& info = responses.front().info();
   internal::flat_hash_map<uint64_t, std::unique_ptr<ChunkData>> chunks;
@@ -110,8 +124,8 @@ absl::Status AsSample(std::vector<SampleStreamResponse::SampleEntry> responses,
       }
 
       column_chunks[i].emplace_back();
-      REVERB_RETURN_IF_ERROR(internal::UnpackChunkColumnAndSlice(
-          *it->second, slice, &column_chunks[i].back()));
+      REVERB_RETURN_IF_ERROR(UnpackChunkColumnAndSlice(
+          *it->second, slice, cache, &column_chunks[i].back()));
 
       // If this was the last time the chunk is referenced the we can release
       // its memory.
@@ -128,12 +142,49 @@ absl::Status AsSample(std::vector<SampleStreamResponse::SampleEntry> responses,
   return absl::OkStatus();
 }
 
+// Decompressed chunk columns referenced by the items of a locally sampled
+// batch. Every column is decompressed (or looked up in `cache`) at most once
+// and the returned slices alias the decompressed buffer instead of owning a
+// copy of the rows.
+class ChunkColumnViews {
+ public:
+  explicit ChunkColumnViews(internal::ChunkColumnCache* cache)
+      : cache_(cache) {}
+
+  absl::Status Slice(const ChunkData& chunk_data,
+                     const FlatTrajectory::ChunkSlice& slice,
+                     tensorflow::Tensor* out) {
+    const auto key = std::make_pair(chunk_data.chunk_key(), slice.index());
+    auto it = columns_.find(key);
+    if (it == columns_.end()) {
+      tensorflow::Tensor column;
+      if (cache_ != nullptr) {
+        REVERB_RETURN_IF_ERROR(
+            cache_->UnpackChunkColumn(chunk_data, slice.index(), &column));
+      } else {
+        REVERB_RETURN_IF_ERROR(
+            internal::UnpackChunkColumn(chunk_data, slice.index(), &column));
+      }
+      it = columns_.emplace(key, std::move(column)).first;
+    }
+    return internal::SliceChunkColumn(it->second, slice.offset(),
+                                      slice.length(), out);
+  }
+
+ private:
+  internal::ChunkColumnCache* const cache_;
+  internal::flat_hash_map<std::pair<uint64_t, int>, tensorflow::Tensor>
+      columns_;
+};
+
 absl::Status AsSample(const Table::SampledItem& sampled_item,
+                      ChunkColumnViews* views,
                       std::unique_ptr<Sample>* sample) {
-  internal::flat_hash_map<uint64_t, std::shared_ptr<ChunkStore::Chunk>> chunks(
+  // The data is pinned so that it can't be spilled while it is unpacked.
+  internal::flat_hash_map<uint64_t, std::shared_ptr<const ChunkData>> chunks(
       sampled_item.ref->chunks().size());
   for (auto& chunk : sampled_item.ref->chunks()) {
-    chunks[chunk->key()] = chunk;
+    REVERB_ASSIGN_OR_RETURN(chunks[chunk->key()], chunk->Pin());
   }
 
   std::vector<std::vector<tensorflow::Tensor>> column_chunks;
@@ -144,8 +195,8 @@ absl::Status AsSample(const Table::SampledItem& sampled_item,
 
     for (const auto& slice : column.chunk_slices()) {
       unpacked_chunks.emplace_back();
-      REVERB_RETURN_IF_ERROR(internal::UnpackChunkColumnAndSlice(
-          chunks[slice.chunk_key()]->data(), slice, &unpacked_chunks.back()));
+      REVERB_RETURN_IF_ERROR(views->Slice(*chunks[slice.chunk_key()], slice,
+                                          &unpacked_chunks.back()));
     }
 
     column_chunks.push_back(std::move(unpacked_chunks));
@@ -172,12 +223,24 @@ absl::Status AsSample(const Table::SampledItem& sampled_item,
 class GrpcSamplerWorker : public SamplerWorker {
  public:
   // Constructs a new worker without creating a stream to a server.
+  //
+  // If `shared_memory_ring_bytes` is positive then each stream asks the
+  // server for a shared memory ring of that size to receive chunk payloads
+  // through. The server only creates it when it runs on the same host as the
+  // worker.
+  //
+  // If `chunk_column_cache` is set then decompressed columns are looked up in
+  // (and added to) the cache.
   GrpcSamplerWorker(
       std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface> stub,
-      std::string table_name, int64_t samples_per_request)
+      std::string table_name, int64_t samples_per_request,
+      int64_t shared_memory_ring_bytes,
+      std::shared_ptr<internal::ChunkColumnCache> chunk_column_cache)
       : stub_(std::move(stub)),
         table_name_(std::move(table_name)),
         samples_per_request_(samples_per_request),
+        shared_memory_ring_bytes_(shared_memory_ring_bytes),
+        chunk_column_cache_(std::move(chunk_column_cache)),
         reserved_slots_(0) {}
 
   // Cancels the stream and marks the worker as closed. Active and future
@@ -196,7 +259,7 @@ class GrpcSamplerWorker : public SamplerWorker {
   // with the status of the stream.  A timeout will cause the Status type
   // DeadlineExceeded to be returned.
   std::pair<int64_t, absl::Status> FetchSamples(
-      internal::Queue<std::unique_ptr<Sample>>* queue, int64_t num_samples,
+      internal::SampleQueue* queue, int64_t num_samples,
       absl::Duration rate_limiter_timeout) override {
     std::unique_ptr<grpc::ClientReaderWriterInterface<SampleStreamRequest,
                                                       SampleStreamResponse>>
@@ -211,6 +274,13 @@ class GrpcSamplerWorker : public SamplerWorker {
       stream = stub_->SampleStream(context_.get());
     }
 
+    // The server creates a new ring for every stream and announces it in its
+    // first response. The ring is mapped as soon as it is announced and the
+    // server is told so in the next request, after which it starts writing to
+    // the ring.
+    std::unique_ptr<internal::SharedMemoryRing> ring;
+    bool confirm_ring = false;
+
     int64_t num_samples_returned = 0;
     SampleStreamResponse response;
     // Vector of samples allocated in the first iteration and then reused.
@@ -223,6 +293,13 @@ class GrpcSamplerWorker : public SamplerWorker {
           std::min(samples_per_request_, num_samples - num_samples_returned));
       request.mutable_rate_limiter_timeout()->set_milliseconds(
           NonnegativeDurationToInt64Millis(rate_limiter_timeout));
+      if (shared_memory_ring_bytes_ > 0 && num_samples_returned == 0) {
+        request.set_shared_memory_ring_bytes(shared_memory_ring_bytes_);
+      }
+      if (confirm_ring) {
+        request.set_shared_memory_ring_mapped(true);
+        confirm_ring = false;
+      }
       // Reservation can be negative if previously reserved slots are being
       // returned.
       if (!queue->Reserve(request.num_samples() - reserved_slots_)) {
@@ -249,7 +326,24 @@ class GrpcSamplerWorker : public SamplerWorker {
             return {num_samples_returned, status};
           }
         }
-        for (auto& entry : response.entries()) {
+        if (!response.shared_memory_ring().empty() && ring == nullptr) {
+          auto ring_or =
+              internal::SharedMemoryRing::Open(response.shared_memory_ring());
+          if (ring_or.ok()) {
+            ring = std::move(ring_or).value();
+            confirm_ring = true;
+          } else {
+            REVERB_LOG(REVERB_WARNING)
+                << "Failed to map shared memory ring, samples will be "
+                   "streamed over gRPC: "
+                << ring_or.status();
+          }
+        }
+        for (auto& entry : *response.mutable_entries()) {
+          auto read_status = ReadSharedMemoryData(ring.get(), &entry);
+          if (!read_status.ok()) {
+            return {num_samples_returned, read_status};
+          }
           parts_of_next_sample.push_back(std::move(entry));
           // Continue grabbing entries until the current sample is complete.
           if (!parts_of_next_sample.back().end_of_sequence()) {
@@ -260,7 +354,8 @@ class GrpcSamplerWorker : public SamplerWorker {
           // let's push it to the queue. We don't expect AsSample to ever fail
           // but it will be closed if the Sampler has been closed.
           std::unique_ptr<Sample> sample;
-          auto status = AsSample(std::move(parts_of_next_sample), &sample);
+          auto status = AsSample(std::move(parts_of_next_sample),
+                                 chunk_column_cache_.get(), &sample);
           parts_of_next_sample.clear();
           if (!status.ok()) {
             return {num_samples_returned, status};
@@ -301,6 +396,30 @@ class GrpcSamplerWorker : public SamplerWorker {
   }
 
  private:
+  // Parses the chunks which the server wrote to `ring` into `entry.data` and
+  // releases the blocks so the server can reuse the memory.
+  static absl::Status ReadSharedMemoryData(
+      internal::SharedMemoryRing* ring,
+      SampleStreamResponse::SampleEntry* entry) {
+    if (entry->shared_memory_data().empty()) return absl::OkStatus();
+    if (ring == nullptr) {
+      return absl::InternalError(
+          "Received shared memory data on a stream without a shared memory "
+          "ring.");
+    }
+    for (const auto& block : entry->shared_memory_data()) {
+      REVERB_ASSIGN_OR_RETURN(absl::string_view bytes,
+                              ring->Get(block.offset(), block.length()));
+      if (!entry->add_data()->ParseFromArray(bytes.data(), bytes.size())) {
+        return absl::InternalError(
+            "Failed to parse ChunkData from shared memory.");
+      }
+      ring->Release(block.offset(), block.length());
+    }
+    entry->clear_shared_memory_data();
+    return absl::OkStatus();
+  }
+
   // Stub used to open `SampleStream`-streams to a server.
   std::shared_ptr</* grpc_gen:: */ReverbService::StubInterface> stub_;
 
@@ -310,6 +429,12 @@ class GrpcSamplerWorker : public SamplerWorker {
   // The maximum number of samples to request in a "batch".
   const int64_t samples_per_request_;
 
+  // Size of the shared memory ring offered to the server. Disabled if <= 0.
+  const int64_t shared_memory_ring_bytes_;
+
+  // Cache of decompressed columns. May be null.
+  const std::shared_ptr<internal::ChunkColumnCache> chunk_column_cache_;
+
   // Number of reserved slots in the queue;
   int64_t reserved_slots_;
 
@@ -325,10 +450,21 @@ class GrpcSamplerWorker : public SamplerWorker {
 class LocalSamplerWorker : public SamplerWorker {
  public:
   // Constructs a new worker without creating a stream to a server.
-  LocalSamplerWorker(std::shared_ptr<Table> table,
-                     int max_in_flight_samples)
+  //
+  // If `chunk_column_cache` is set then decompressed columns are looked up in
+  // (and added to) the cache.
+  //
+  // If `tensor_views` is true then all samples of a batch share the
+  // decompressed columns of the chunks they reference. Otherwise every sample
+  // decompresses the columns it needs on its own.
+  LocalSamplerWorker(
+      std::shared_ptr<Table> table, int max_in_flight_samples,
+      std::shared_ptr<internal::ChunkColumnCache> chunk_column_cache,
+      bool tensor_views)
       : table_(table),
         max_in_flight_samples_(max_in_flight_samples),
+        chunk_column_cache_(std::move(chunk_column_cache)),
+        tensor_views_(tensor_views),
         reserved_slots_(0) {
     REVERB_CHECK_GE(max_in_flight_samples_, 1);
   }
@@ -339,7 +475,7 @@ class LocalSamplerWorker : public SamplerWorker {
   }
 
   std::pair<int64_t, absl::Status> FetchSamples(
-      internal::Queue<std::unique_ptr<Sample>>* queue, int64_t num_samples,
+      internal::SampleQueue* queue, int64_t num_samples,
       absl::Duration rate_limiter_timeout) override {
     static const auto kWakeupTimeout = absl::Seconds(3);
     auto final_deadline = absl::Now() + rate_limiter_timeout;
@@ -404,9 +540,13 @@ class LocalSamplerWorker : public SamplerWorker {
       final_deadline = absl::Now() + rate_limiter_timeout;
 
       // Push sampled items to queue.
+      ChunkColumnViews batch_views(chunk_column_cache_.get());
       for (const auto& item : items) {
+        ChunkColumnViews item_views(chunk_column_cache_.get());
         std::unique_ptr<Sample> sample;
-        if (status = AsSample(item, &sample); !status.ok()) {
+        if (status = AsSample(item, tensor_views_ ? &batch_views : &item_views,
+                              &sample);
+            !status.ok()) {
           return {num_samples_returned, status};
         }
         samples.push_back(std::move(sample));
@@ -436,6 +576,9 @@ class LocalSamplerWorker : public SamplerWorker {
  private:
   std::shared_ptr<Table> table_;
   const int64_t max_in_flight_samples_;
+  // Cache of decompressed columns. May be null.
+  const std::shared_ptr<internal::ChunkColumnCache> chunk_column_cache_;
+  const bool tensor_views_;
   int64_t reserved_slots_;
   bool closed_ ABSL_GUARDED_BY(mu_) = false;
   absl::Mutex mu_;
@@ -466,7 +609,8 @@ std::vector<std::unique_ptr<SamplerWorker>> MakeGrpcWorkers(
   workers.reserve(num_workers);
   for (int i = 0; i < num_workers; i++) {
     workers.push_back(std::make_unique<GrpcSamplerWorker>(
-        stub, table_name, options.max_in_flight_samples_per_worker));
+        stub, table_name, options.max_in_flight_samples_per_worker,
+        options.shared_memory_ring_bytes, options.chunk_column_cache));
   }
 
   return workers;
@@ -481,7 +625,8 @@ std::vector<std::unique_ptr<SamplerWorker>> MakeLocalWorkers(
   workers.reserve(num_workers);
   for (int i = 0; i < num_workers; ++i) {
     workers.push_back(std::make_unique<LocalSamplerWorker>(
-        table, options.max_in_flight_samples_per_worker));
+        table, options.max_in_flight_samples_per_worker,
+        options.chunk_column_cache, options.local_tensor_views));
   }
   return workers;
 }
@@ -508,7 +653,8 @@ Sampler::Sampler(std::vector<std::unique_ptr<SamplerWorker>> workers,
       workers_(std::move(workers)),
       active_sample_(nullptr),
       samples_(options.max_in_flight_samples_per_worker *
-               GetNumWorkers(options)),
+                   GetNumWorkers(options),
+               options.lock_free_queue),
       dtypes_and_shapes_(std::move(dtypes_and_shapes)) {
   REVERB_CHECK_GT(max_samples_, 0);
   REVERB_CHECK_GT(options.max_in_flight_samples_per_worker, 0);
@@ -854,6 +1000,11 @@ absl::Status Sampler::Options::Validate() const {
         "rate_limiter_timeout (", absl::FormatDuration(rate_limiter_timeout),
         ") must not be negative."));
   }
+  if (shared_memory_ring_bytes < 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("shared_memory_ring_bytes (", shared_memory_ring_bytes,
+                     ") must not be negative."));
+  }
   return absl::OkStatus();
 }
 
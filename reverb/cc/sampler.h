@@ -28,6 +28,8 @@
 #include "reverb/cc/platform/thread.h"
 #include "reverb/cc/reverb_service.grpc.pb.h"
 #include "reverb/cc/schema.pb.h"
+#include "reverb/cc/support/chunk_column_cache.h"
+#include "reverb/cc/support/lock_free_queue.h"
 #include "reverb/cc/support/queue.h"
 #include "reverb/cc/support/signature.h"
 #include "reverb/cc/table.h"
@@ -113,6 +115,50 @@ class Sample {
   bool next_timestep_called_;
 };
 
+namespace internal {
+
+// Queue of the samples passed from the `SamplerWorker`s to the `Sampler`.
+// Backed by either a `Queue` or, when `lock_free` is set, a `LockFreeQueue`.
+class SampleQueue {
+ public:
+  SampleQueue(int capacity, bool lock_free) {
+    if (lock_free) {
+      lock_free_queue_ =
+          std::make_unique<LockFreeQueue<std::unique_ptr<Sample>>>(capacity);
+    } else {
+      queue_ = std::make_unique<Queue<std::unique_ptr<Sample>>>(capacity);
+    }
+  }
+
+  void Close() {
+    queue_ ? queue_->Close() : lock_free_queue_->Close();
+  }
+
+  bool Reserve(int count) {
+    return queue_ ? queue_->Reserve(count) : lock_free_queue_->Reserve(count);
+  }
+
+  void PushBatch(std::vector<std::unique_ptr<Sample>>* x) {
+    queue_ ? queue_->PushBatch(x) : lock_free_queue_->PushBatch(x);
+  }
+
+  bool Pop(std::unique_ptr<Sample>* item) {
+    return queue_ ? queue_->Pop(item) : lock_free_queue_->Pop(item);
+  }
+
+  int num_waiting_to_pop() const {
+    return queue_ ? queue_->num_waiting_to_pop()
+                  : lock_free_queue_->num_waiting_to_pop();
+  }
+
+ private:
+  // Exactly one of the queues is set.
+  std::unique_ptr<Queue<std::unique_ptr<Sample>>> queue_;
+  std::unique_ptr<LockFreeQueue<std::unique_ptr<Sample>>> lock_free_queue_;
+};
+
+}  // namespace internal
+
 // SamplerWorker implements strategy for fetching samples from table.
 class SamplerWorker {
  public:
@@ -124,7 +170,7 @@ class SamplerWorker {
   // Attempt to sample up to `num_samples` and push results to `queue`. Returns
   // when `num_samples` pushed to `queue` or error encountered.
   virtual std::pair<int64_t, absl::Status> FetchSamples(
-      internal::Queue<std::unique_ptr<Sample>>* queue, int64_t num_samples,
+      internal::SampleQueue* queue, int64_t num_samples,
       absl::Duration rate_limiter_timeout) = 0;
 };
 
@@ -241,6 +287,48 @@ class Sampler {
     // `Close` is called, whichever comes first.
     absl::Duration rate_limiter_timeout = absl::InfiniteDuration();
 
+    // `shared_memory_ring_bytes` is the size of the shared memory ring that
+    // each gRPC worker asks the server to create. When the server runs on the
+    // same host it writes sampled chunks to the ring instead of serializing
+    // them into the gRPC responses, falling back to gRPC for chunks which do
+    // not fit and for remote clients. The worker still parses the chunks out
+    // of the ring, i.e this saves the gRPC transport but not a copy. The ring
+    // should be a few times larger than the largest chunk. Only used by
+    // samplers constructed from a stub.
+    //
+    // The default, 0, disables the shared memory transport.
+    int64_t shared_memory_ring_bytes = 0;
+
+    // `chunk_column_cache` holds decompressed chunk columns so that chunks
+    // which are sampled repeatedly (e.g from prioritized tables with a high
+    // samples per insert ratio) are only decompressed once. The cache is
+    // shared by all workers of the sampler and can also be shared by multiple
+    // samplers in the same process. Use `ChunkColumnCache::stats` to monitor
+    // its hit rate.
+    //
+    // The default, nullptr, disables caching.
+    std::shared_ptr<internal::ChunkColumnCache> chunk_column_cache;
+
+    // `local_tensor_views` makes the samples of a batch share the decompressed
+    // columns of the chunks they reference. Every chunk column is then only
+    // decompressed once per batch and the returned trajectories are views into
+    // the decompressed buffer, which saves a lot of memory bandwidth when the
+    // chunk length is much larger than the sequence length. Since trajectories
+    // may alias each other they must not be modified in place. Only used by
+    // samplers constructed from a `Table`.
+    //
+    // The default, false, decompresses the chunks of every sample separately.
+    bool local_tensor_views = false;
+
+    // `lock_free_queue` passes samples from the workers to the consumer
+    // through a `LockFreeQueue` rather than a mutex protected `Queue`. This
+    // can help when many workers contend for the queue on hosts with many
+    // cores, but is slower when there is little contention. Benchmark both
+    // before enabling it.
+    //
+    // The default, false, uses the mutex protected queue.
+    bool lock_free_queue = false;
+
     // Checks that field values are valid and returns `InvalidArgument` if any
     // field value invalid.
     absl::Status Validate() const;
@@ -369,7 +457,7 @@ class Sampler {
   std::unique_ptr<Sample> active_sample_;
 
   // Queue of complete samples (timesteps batched up by into sequence).
-  internal::Queue<std::unique_ptr<Sample>> samples_;
+  internal::SampleQueue samples_;
 
   // The dtypes and shapes users expect from either `GetNextTimestep` or
   // `GetNextTrajectory` (whichever they plan to call).  May be absl::nullopt,
@@ -14,6 +14,8 @@
 
 #include "reverb/cc/sampler.h"
 
+#include <cfloat>
+#include <cstring>
 #include <list>
 #include <memory>
 #include <vector>
@@ -33,6 +35,8 @@
 #include "reverb/cc/reverb_service.pb.h"
 #include "reverb/cc/reverb_service_mock.grpc.pb.h"
 #include "reverb/cc/selectors/fifo.h"
+#include "reverb/cc/support/chunk_column_cache.h"
+#include "reverb/cc/support/shared_memory_ring.h"
 #include "reverb/cc/support/tf_util.h"
 #include "reverb/cc/tensor_compression.h"
 #include "reverb/cc/testing/proto_test_util.h"
@@ -308,6 +312,72 @@ TEST(GrpcSamplerTest, SendsFirstRequest) {
   EXPECT_THAT(stub->requests(), SizeIs(1));
 }
 
+TEST(GrpcSamplerTest, RequestsSharedMemoryRingInFirstRequest) {
+  auto stub = MakeGoodStub({MakeResponse(1), MakeResponse(1)});
+  Sampler::Options options;
+  options.max_samples = 2;
+  options.max_in_flight_samples_per_worker = 1;
+  options.num_workers = 1;
+  options.shared_memory_ring_bytes = 1 << 16;
+  Sampler sampler(stub, "table", options);
+  std::vector<tensorflow::Tensor> sample;
+  bool end_of_sequence;
+  REVERB_EXPECT_OK(sampler.GetNextTimestep(&sample, &end_of_sequence));
+  REVERB_EXPECT_OK(sampler.GetNextTimestep(&sample, &end_of_sequence));
+  auto requests = stub->requests();
+  ASSERT_THAT(requests, SizeIs(2));
+  EXPECT_EQ(requests[0].shared_memory_ring_bytes(), 1 << 16);
+  EXPECT_EQ(requests[1].shared_memory_ring_bytes(), 0);
+  // The server never announced a ring.
+  EXPECT_FALSE(requests[1].shared_memory_ring_mapped());
+}
+
+TEST(GrpcSamplerTest, ReadsChunksFromSharedMemoryRingAnnouncedByServer) {
+  // The test plays the part of the server which creates the ring.
+  auto ring_or = internal::SharedMemoryRing::Create(1 << 16);
+  REVERB_ASSERT_OK(ring_or.status());
+  auto ring = std::move(ring_or).value();
+
+  SampleStreamResponse first = MakeResponse(1);
+  first.set_shared_memory_ring(ring->name());
+
+  SampleStreamResponse second = MakeResponse(1);
+  auto* entry = second.mutable_entries(0);
+  const std::string bytes = entry->data(0).SerializeAsString();
+  uint64_t offset;
+  char* data;
+  ASSERT_TRUE(ring->Allocate(bytes.size(), &offset, &data));
+  std::memcpy(data, bytes.data(), bytes.size());
+  ring->Commit(offset, bytes.size());
+  entry->clear_data();
+  auto* block = entry->add_shared_memory_data();
+  block->set_offset(offset);
+  block->set_length(bytes.size());
+
+  auto stub = MakeGoodStub({first, second});
+  Sampler::Options options;
+  options.max_samples = 2;
+  options.max_in_flight_samples_per_worker = 1;
+  options.num_workers = 1;
+  options.shared_memory_ring_bytes = 1 << 16;
+  Sampler sampler(stub, "table", options);
+  for (int i = 0; i < 2; i++) {
+    std::vector<tensorflow::Tensor> sample;
+    bool end_of_sequence;
+    REVERB_ASSERT_OK(sampler.GetNextTimestep(&sample, &end_of_sequence));
+    ExpectTensorEqual<tensorflow::uint64>(
+        sample[0], tensorflow::tensor::DeepCopy(MakeTensor(1).SubSlice(0)));
+  }
+
+  auto requests = stub->requests();
+  ASSERT_THAT(requests, SizeIs(2));
+  EXPECT_FALSE(requests[0].shared_memory_ring_mapped());
+  EXPECT_TRUE(requests[1].shared_memory_ring_mapped());
+
+  // The block was released by the sampler so the whole ring can be reused.
+  EXPECT_TRUE(ring->Allocate(1 << 16, &offset, &data));
+}
+
 TEST(GrpcSamplerTest, SetsEndOfSequence) {
   auto stub = MakeGoodStub({MakeResponse(2), MakeResponse(1)});
   Sampler sampler(stub, "table", {2, 1});
@@ -421,6 +491,96 @@ TEST(LocalSamplerTest, GetNextTrajectorySqueezesColumnsIfSet) {
       not_squeezed[0], tensorflow::tensor::DeepCopy(MakeTensor(4).Slice(2, 3)));
 }
 
+TEST(LocalSamplerTest, UsesChunkColumnCache) {
+  auto table = std::make_shared<Table>(
+      /*name=*/"dist",
+      /*sampler=*/std::make_shared<FifoSelector>(),
+      /*remover=*/std::make_shared<FifoSelector>(),
+      /*max_size=*/100,
+      /*max_times_sampled=*/0,
+      /*rate_limiter=*/
+      std::make_shared<RateLimiter>(1, 1, -DBL_MAX, DBL_MAX));
+  InsertItem(table.get(), 1, 1.0, {5}, /*offset=*/1, /*length=*/3);
+
+  Sampler::Options options;
+  options.max_samples = 3;
+  options.num_workers = 1;
+  options.max_in_flight_samples_per_worker = 1;
+  options.chunk_column_cache =
+      std::make_shared<internal::ChunkColumnCache>(1 << 20);
+  Sampler sampler(table, options);
+
+  for (int i = 0; i < 3; i++) {
+    std::vector<tensorflow::Tensor> sample;
+    REVERB_ASSERT_OK(sampler.GetNextTrajectory(&sample));
+    ASSERT_THAT(sample, SizeIs(1));
+    ExpectTensorEqual<tensorflow::uint64>(
+        sample[0], tensorflow::tensor::DeepCopy(MakeTensor(5).Slice(1, 4)));
+  }
+
+  auto stats = options.chunk_column_cache->stats();
+  EXPECT_EQ(stats.misses, 1);
+  EXPECT_EQ(stats.hits, 2);
+  EXPECT_EQ(stats.entries, 1);
+}
+
+TEST(LocalSamplerTest, TensorViewsShareDecompressedChunks) {
+  auto table = std::make_shared<Table>(
+      /*name=*/"dist",
+      /*sampler=*/std::make_shared<FifoSelector>(),
+      /*remover=*/std::make_shared<FifoSelector>(),
+      /*max_size=*/100,
+      /*max_times_sampled=*/0,
+      /*rate_limiter=*/
+      std::make_shared<RateLimiter>(1, 1, -DBL_MAX, DBL_MAX));
+  InsertItem(table.get(), 1, 1.0, {10}, /*offset=*/2, /*length=*/4);
+
+  // All three samples are fetched in a single batch.
+  Sampler::Options options;
+  options.max_samples = 3;
+  options.num_workers = 1;
+  options.max_in_flight_samples_per_worker = 3;
+  options.local_tensor_views = true;
+  Sampler sampler(table, options);
+
+  std::vector<std::vector<tensorflow::Tensor>> samples(3);
+  for (auto& sample : samples) {
+    REVERB_ASSERT_OK(sampler.GetNextTrajectory(&sample));
+    ASSERT_THAT(sample, SizeIs(1));
+    ExpectTensorEqual<tensorflow::uint64>(
+        sample[0], tensorflow::tensor::DeepCopy(MakeTensor(10).Slice(2, 6)));
+  }
+
+  // The trajectories are views into the same decompressed chunk.
+  EXPECT_EQ(samples[0][0].tensor_data().data(),
+            samples[1][0].tensor_data().data());
+  EXPECT_EQ(samples[0][0].tensor_data().data(),
+            samples[2][0].tensor_data().data());
+}
+
+TEST(LocalSamplerTest, LockFreeQueue) {
+  auto table = MakeTable(100);
+  for (int i = 0; i < 100; i++) {
+    InsertItem(table.get(), i + 1, 1.0, {1});
+  }
+
+  Sampler::Options options;
+  options.max_samples = 100;
+  options.num_workers = 4;
+  options.max_in_flight_samples_per_worker = 3;
+  options.lock_free_queue = true;
+  Sampler sampler(table, options);
+
+  for (int i = 0; i < options.max_samples; i++) {
+    std::vector<tensorflow::Tensor> sample;
+    REVERB_ASSERT_OK(sampler.GetNextTrajectory(&sample));
+    ASSERT_THAT(sample, SizeIs(1));
+  }
+  std::vector<tensorflow::Tensor> sample;
+  EXPECT_EQ(sampler.GetNextTrajectory(&sample).code(),
+            absl::StatusCode::kOutOfRange);
+}
+
 TEST(LocalSamplerTest, RespectsMaxInFlightItems) {
   auto table = MakeTable(100);
   for (int i = 0; i < 100; i++) {
@@ -920,6 +1080,14 @@ TEST(SamplerOptionsTest, ValidateChecksRateLimiterTimeout) {
   REVERB_EXPECT_OK(options.Validate());
 }
 
+TEST(SamplerOptionsTest, ValidateChecksSharedMemoryRingBytes) {
+  Sampler::Options options;
+  options.shared_memory_ring_bytes = -1;
+  EXPECT_EQ(options.Validate().code(), absl::StatusCode::kInvalidArgument);
+  options.shared_memory_ring_bytes = 1 << 20;
+  REVERB_EXPECT_OK(options.Validate());
+}
+
 }  // namespace
 }  // namespace reverb
 }  // namespace deepmind
@@ -24,25 +24,21 @@ namespace deepmind {
 namespace reverb {
 
 absl::Status FifoSelector::Delete(ItemSelector::Key key) {
-  auto it = key_to_iterator_.find(key);
-  if (it == key_to_iterator_.end())
+  if (!keys_.Erase(key))
     return absl::InvalidArgumentError(absl::StrCat("Key ", key, " not found."));
-  keys_.erase(it->second);
-  key_to_iterator_.erase(it);
   return absl::OkStatus();
 }
 
 absl::Status FifoSelector::Insert(ItemSelector::Key key, double priority) {
-  if (key_to_iterator_.find(key) != key_to_iterator_.end()) {
+  if (!keys_.PushBack(key)) {
     return absl::InvalidArgumentError(
         absl::StrCat("Key ", key, " already inserted."));
   }
-  key_to_iterator_.emplace(key, keys_.emplace(keys_.end(), key));
   return absl::OkStatus();
 }
 
 absl::Status FifoSelector::Update(ItemSelector::Key key, double priority) {
-  if (key_to_iterator_.find(key) == key_to_iterator_.end()) {
+  if (!keys_.Contains(key)) {
     return absl::InvalidArgumentError(absl::StrCat("Key ", key, " not found."));
   }
   return absl::OkStatus();
@@ -50,13 +46,12 @@ absl::Status FifoSelector::Update(ItemSelector::Key key, double priority) {
 
 ItemSelector::KeyWithProbability FifoSelector::Sample() {
   REVERB_CHECK(!keys_.empty());
-  return {keys_.front(), 1.};
+  return {keys_.Front(), 1.};
 }
 
-void FifoSelector::Clear() {
-  keys_.clear();
-  key_to_iterator_.clear();
-}
+void FifoSelector::Clear() { keys_.Clear(); }
+
+double FifoSelector::TotalWeight() const { return keys_.size(); }
 
 KeyDistributionOptions FifoSelector::options() const {
   KeyDistributionOptions options;
@@ -68,6 +68,8 @@ void HeapSelector::Clear() {
   heap_.Clear();
 }
 
+double HeapSelector::TotalWeight() const { return nodes_.size(); }
+
 
 KeyDistributionOptions HeapSelector::options() const {
   KeyDistributionOptions options;
@@ -44,6 +44,8 @@ class HeapSelector : public ItemSelector {
   // O(n) time.
   void Clear() override;
 
+  double TotalWeight() const override;
+
   KeyDistributionOptions options() const override;
 
   std::string DebugString() const override;
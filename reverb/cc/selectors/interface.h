@@ -16,6 +16,7 @@
 #define REVERB_CC_SELECTORS_INTERFACE_H_
 
 #include <cstdint>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "reverb/cc/checkpointing/checkpoint.pb.h"
@@ -55,9 +56,29 @@ class ItemSelector {
   // Samples a key. Must contain keys when this is called.
   virtual KeyWithProbability Sample() = 0;
 
+  // Appends `num_samples` samples to `samples`. Each sample is distributed as
+  // if drawn by `Sample` but the samples are not necessarily independent;
+  // implementations may for example stratify them to reduce variance and
+  // amortize the cost of walking their data structures. The order of the
+  // samples is random so any prefix of them is also a valid batch. Must contain
+  // keys when this is called.
+  virtual void SampleBatch(int num_samples,
+                           std::vector<KeyWithProbability>* samples) {
+    samples->reserve(samples->size() + num_samples);
+    for (int i = 0; i < num_samples; i++) {
+      samples->push_back(Sample());
+    }
+  }
+
   // Clear the distribution of all data.
   virtual void Clear() = 0;
 
+  // Total (unnormalized) sampling mass of the keys currently held. The
+  // probability returned by `Sample` is the weight of the selected key divided
+  // by this value. Selectors whose choice does not depend on a weight return
+  // the number of keys.
+  virtual double TotalWeight() const = 0;
+
   // Options for dynamically constructing the distribution. Required when
   // reconstructing class from checkpoint.  Also used to query table metadata.
   virtual KeyDistributionOptions options() const = 0;
@@ -23,25 +23,21 @@ namespace deepmind {
 namespace reverb {
 
 absl::Status LifoSelector::Delete(ItemSelector::Key key) {
-  auto it = key_to_iterator_.find(key);
-  if (it == key_to_iterator_.end())
+  if (!keys_.Erase(key))
     return absl::InvalidArgumentError(absl::StrCat("Key ", key, " not found."));
-  keys_.erase(it->second);
-  key_to_iterator_.erase(it);
   return absl::OkStatus();
 }
 
 absl::Status LifoSelector::Insert(ItemSelector::Key key, double priority) {
-  if (key_to_iterator_.find(key) != key_to_iterator_.end()) {
+  if (!keys_.PushBack(key)) {
     return absl::InvalidArgumentError(
         absl::StrCat("Key ", key, " already inserted."));
   }
-  key_to_iterator_.emplace(key, keys_.emplace(keys_.begin(), key));
   return absl::OkStatus();
 }
 
 absl::Status LifoSelector::Update(ItemSelector::Key key, double priority) {
-  if (key_to_iterator_.find(key) == key_to_iterator_.end()) {
+  if (!keys_.Contains(key)) {
     return absl::InvalidArgumentError(absl::StrCat("Key ", key, " not found."));
   }
   return absl::OkStatus();
@@ -49,13 +45,12 @@ absl::Status LifoSelector::Update(ItemSelector::Key key, double priority) {
 
 ItemSelector::KeyWithProbability LifoSelector::Sample() {
   REVERB_CHECK(!keys_.empty());
-  return {keys_.front(), 1.};
+  return {keys_.Back(), 1.};
 }
 
-void LifoSelector::Clear() {
-  keys_.clear();
-  key_to_iterator_.clear();
-}
+void LifoSelector::Clear() { keys_.Clear(); }
+
+double LifoSelector::TotalWeight() const { return keys_.size(); }
 
 KeyDistributionOptions LifoSelector::options() const {
   KeyDistributionOptions options;
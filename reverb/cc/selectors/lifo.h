@@ -15,19 +15,17 @@
 #ifndef REVERB_CC_SELECTORS_LIFO_H_
 #define REVERB_CC_SELECTORS_LIFO_H_
 
-#include <list>
-
 #include "absl/status/status.h"
 #include "reverb/cc/checkpointing/checkpoint.pb.h"
-#include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/selectors/interface.h"
+#include "reverb/cc/support/key_ring.h"
 
 namespace deepmind {
 namespace reverb {
 
 // Lifo sampling. We ignore all priority values in the calls. Sample() always
 // returns the key that was inserted last until this key is deleted. All
-// operations take O(1) time. See ItemSelector for documentation
+// operations take amortized O(1) time. See ItemSelector for documentation
 // about the methods.
 class LifoSelector : public ItemSelector {
  public:
@@ -43,13 +41,14 @@ class LifoSelector : public ItemSelector {
 
   void Clear() override;
 
+  double TotalWeight() const override;
+
   KeyDistributionOptions options() const override;
 
   std::string DebugString() const override;
 
  private:
-  std::list<Key> keys_;
-  internal::flat_hash_map<Key, std::list<Key>::iterator> key_to_iterator_;
+  internal::KeyRing keys_;
 };
 
 }  // namespace reverb
@@ -14,8 +14,10 @@
 
 #include "reverb/cc/selectors/prioritized.h"
 
+#include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
@@ -27,9 +29,9 @@ namespace deepmind {
 namespace reverb {
 namespace {
 
-// If the approximation error at a node exceeds this threshold, the sum tree is
-// reinitialized.
-constexpr double kMaxApproximationError = 1e-4;
+// Number of leaves allocated by a new selector. The tree doubles in size
+// whenever it runs out of leaves.
+constexpr size_t kInitialCapacity = 4096;
 
 // A priority of zero should correspond to zero probability, even if the
 // priority exponent is zero. So this modified version of std::pow is used to
@@ -47,50 +49,83 @@ absl::Status CheckValidPriority(double priority) {
   return absl::OkStatus();
 }
 
+// Sums `kSize` weights pairwise. This is more accurate than a sequential sum
+// and the independent additions can be executed in parallel.
+template <int kSize>
+double PairwiseSum(const double* weights) {
+  static_assert((kSize & (kSize - 1)) == 0, "kSize must be a power of 2.");
+  if constexpr (kSize == 1) {
+    return weights[0];
+  } else {
+    return PairwiseSum<kSize / 2>(weights) +
+           PairwiseSum<kSize / 2>(weights + kSize / 2);
+  }
+}
+
+// Returns the index of the child (among `weights[0, kSize)`) whose slice of
+// the cumulative weight contains `target` and subtracts the weight of the
+// preceding children from `target`. The children are bisected using the same
+// pairwise sums that make up the value of their parent so a target below that
+// value always ends up at a child with a non-zero weight.
+template <int kSize>
+int ChildContaining(const double* weights, double* target) {
+  if constexpr (kSize == 1) {
+    return 0;
+  } else {
+    const double left = PairwiseSum<kSize / 2>(weights);
+    const double right = PairwiseSum<kSize / 2>(weights + kSize / 2);
+    // Never descend into an empty half. Rounding errors in the levels above can
+    // otherwise push a target which is close to the total past the last child
+    // with a non-zero weight.
+    const bool go_right = *target >= left && right > 0;
+    *target -= go_right ? left : 0;
+    const int offset = go_right ? kSize / 2 : 0;
+    return offset + ChildContaining<kSize / 2>(weights + offset, target);
+  }
+}
+
 }  // namespace
 
 PrioritizedSelector::PrioritizedSelector(double priority_exponent,
                                          uint64_t seed)
-    : priority_exponent_(priority_exponent),
-      capacity_(std::pow(2, 17)),
-      sum_tree_(capacity_),
-      rng_(seed) {}
+    : priority_exponent_(priority_exponent), rng_(seed) {
+  Resize(kInitialCapacity);
+}
 
 absl::Status PrioritizedSelector::Delete(Key key) {
-  const size_t last_index = key_to_index_.size() - 1;
   const auto it = key_to_index_.find(key);
   if (it == key_to_index_.end())
     return absl::InvalidArgumentError(absl::StrCat("Key ", key, " not found."));
   const size_t index = it->second;
+  const size_t last_index = keys_.size() - 1;
 
   if (index != last_index) {
     // Replace the element that we want to remove with the last element.
-    SetNode(index, NodeValue(last_index));
-    const Key last_key = sum_tree_[last_index].key;
-    sum_tree_[index].key = last_key;
+    SetWeight(index, Weight(last_index));
+    const Key last_key = keys_[last_index];
+    keys_[index] = last_key;
     key_to_index_[last_key] = index;
   }
 
-  SetNode(last_index, 0);
-  key_to_index_.erase(it);  // Note that this must occur after SetNode.
+  SetWeight(last_index, 0);
+  keys_.pop_back();
+  key_to_index_.erase(it);
 
   return absl::OkStatus();
 }
 
 absl::Status PrioritizedSelector::Insert(Key key, double priority) {
   REVERB_RETURN_IF_ERROR(CheckValidPriority(priority));
-  const size_t index = key_to_index_.size();
-  if (index == capacity_) {
-    capacity_ *= 2;
-    sum_tree_.resize(capacity_);
-  }
+  const size_t index = keys_.size();
   if (!key_to_index_.try_emplace(key, index).second) {
     return absl::InvalidArgumentError(
         absl::StrCat("Key ", key, " already inserted."));
   }
-  sum_tree_[index].key = key;
-
-  SetNode(index, power(priority, priority_exponent_));
+  if (index == levels_[0].size() * kFanOut) {
+    Resize(2 * index);
+  }
+  keys_.push_back(key);
+  SetWeight(index, power(priority, priority_exponent_));
   return absl::OkStatus();
 }
 
@@ -100,64 +135,76 @@ absl::Status PrioritizedSelector::Update(Key key, double priority) {
   if (it == key_to_index_.end()) {
     return absl::InvalidArgumentError(absl::StrCat("Key ", key, " not found."));
   }
-  SetNode(it->second, power(priority, priority_exponent_));
+  SetWeight(it->second, power(priority, priority_exponent_));
   return absl::OkStatus();
 }
 
 ItemSelector::KeyWithProbability PrioritizedSelector::Sample() {
-  const size_t size = key_to_index_.size();
+  const size_t size = keys_.size();
   REVERB_CHECK_NE(size, 0);
 
   // This should never be called concurrently from multiple threads.
   const double target = uniform_distr_(rng_);  // [0.0, 1.0)
-  const double total_weight = sum_tree_[0].sum;
 
   // All keys have zero priority so treat as if uniformly sampling.
-  if (total_weight == 0) {
+  if (total_weight_ == 0) {
     const size_t pos = static_cast<size_t>(target * size);
-    return {sum_tree_[pos].key, 1. / size};
+    return {keys_[pos], 1. / size};
   }
 
-  // We begin traversing the `sum_tree_` from the root to the children in order
-  // to find the `index` corresponding to the sampled `target_weight`.
-  size_t index = 0;
-  double target_weight = target * total_weight;
-  while (true) {
-    // Go to the left sub tree if it contains our sampled `target_weight`.
-    const size_t left_index = 2 * index + 1;
-    const double left_sum = NodeSum(left_index);
-    if (target_weight < left_sum) {
-      index = left_index;
-      continue;
-    }
-    target_weight -= left_sum;
-    // Go to the right sub tree if it contains our sampled `target_weight`.
-    const size_t right_index = 2 * index + 2;
-    const double right_sum = NodeSum(right_index);
-    if (target_weight < right_sum) {
-      index = right_index;
-      continue;
+  const size_t index = FindLeaf(target * total_weight_);
+  REVERB_CHECK_LT(index, size);
+  return {keys_[index], Weight(index) / total_weight_};
+}
+
+void PrioritizedSelector::SampleBatch(
+    int num_samples, std::vector<KeyWithProbability>* samples) {
+  const size_t size = keys_.size();
+  REVERB_CHECK_NE(size, 0);
+  if (num_samples <= 0) return;
+  samples->reserve(samples->size() + num_samples);
+
+  // All keys have zero priority so treat as if uniformly sampling.
+  if (total_weight_ == 0) {
+    for (int i = 0; i < num_samples; i++) {
+      const size_t pos = static_cast<size_t>(uniform_distr_(rng_) * size);
+      samples->push_back({keys_[pos], 1. / size});
     }
-    target_weight -= right_sum;
-    // Otherwise it is the current index.
-    break;
+    return;
   }
-  REVERB_CHECK_LT(index, size);
-  const double picked_weight = NodeValue(index);
-  REVERB_LOG_IF(REVERB_ERROR, target_weight >= picked_weight)
-      << "Target weight should be smaller than picked weight (target_weight: "
-      << target_weight << " >= picked_weight:" << picked_weight << ").";
-  return {sum_tree_[index].key, picked_weight / total_weight};
+
+  // Draw one target from each stratum.
+  std::vector<double> targets(num_samples);
+  const double stratum_weight = total_weight_ / num_samples;
+  for (int i = 0; i < num_samples; i++) {
+    targets[i] = (i + uniform_distr_(rng_)) * stratum_weight;
+  }
+
+  std::vector<size_t> indices;
+  FindLeaves(&targets, &indices);
+  for (size_t index : indices) {
+    REVERB_CHECK_LT(index, size);
+    samples->push_back({keys_[index], Weight(index) / total_weight_});
+  }
+
+  // The strata are visited in order so a prefix of the batch would be biased
+  // towards the keys with the lowest indices.
+  std::shuffle(samples->end() - num_samples, samples->end(), rng_);
 }
 
 void PrioritizedSelector::Clear() {
-  for (size_t i = 0; i < key_to_index_.size(); ++i) {
-    sum_tree_[i].sum = 0;
-    sum_tree_[i].value = 0;
+  for (auto& level : levels_) {
+    std::fill(level.begin(), level.end(), Block());
   }
+  total_weight_ = 0;
+  keys_.clear();
   key_to_index_.clear();
 }
 
+double PrioritizedSelector::TotalWeight() const {
+  return keys_.empty() ? 0 : total_weight_;
+}
+
 KeyDistributionOptions PrioritizedSelector::options() const {
   KeyDistributionOptions options;
   options.mutable_prioritized()->set_priority_exponent(priority_exponent_);
@@ -170,60 +217,81 @@ std::string PrioritizedSelector::DebugString() const {
       "PrioritizedSelector(priority_exponent=", priority_exponent_, ")");
 }
 
-double PrioritizedSelector::NodeValue(size_t index) const {
-  return sum_tree_[index].value;
+double PrioritizedSelector::NodeSumTestingOnly(size_t index) const {
+  if (index == 0) return total_weight_;
+  index--;
+  for (int level = levels_.size() - 1; level >= 0; --level) {
+    const size_t level_size = levels_[level].size() * kFanOut;
+    if (index < level_size) {
+      return levels_[level][index / kFanOut].weights[index % kFanOut];
+    }
+    index -= level_size;
+  }
+  return 0;
 }
 
-double PrioritizedSelector::NodeSum(size_t index) const {
-  return index < key_to_index_.size() ? sum_tree_[index].sum : 0;
+double PrioritizedSelector::Weight(size_t index) const {
+  return levels_[0][index / kFanOut].weights[index % kFanOut];
 }
 
-double PrioritizedSelector::NodeSumTestingOnly(size_t index) const {
-  return NodeSum(index);
+void PrioritizedSelector::SetWeight(size_t index, double weight) {
+  levels_[0][index / kFanOut].weights[index % kFanOut] = weight;
+  // Recompute the sums of the ancestors rather than applying the difference so
+  // that rounding errors cannot build up over time.
+  size_t block = index / kFanOut;
+  for (size_t level = 1; level < levels_.size(); level++) {
+    levels_[level][block / kFanOut].weights[block % kFanOut] =
+        PairwiseSum<kFanOut>(levels_[level - 1][block].weights);
+    block /= kFanOut;
+  }
+  total_weight_ = PairwiseSum<kFanOut>(levels_.back()[0].weights);
 }
 
-// Updates the sum stored in a node and tracks if the tree needs to be
-// re-initialized.
-// Ensure the sum never becomes negative (it may happen because of rounding
-// errors).
-#define UPDATE_SUM(i)                                          \
-  sum_tree_[(i)].sum += difference;                            \
-  if (sum_tree_[(i)].sum < 0) sum_tree_[(i)].sum = 0.0;        \
-  error = std::abs(sum_tree_[(i)].sum - NodeSum(2 * (i) + 1) - \
-                   NodeSum(2 * (i) + 2) - sum_tree_[(i)].value);
-
-void PrioritizedSelector::SetNode(size_t index, double value) {
-  const double difference = value - NodeValue(index);
-
-  // The floating point approximation error of the last node update.
-  double error = 0.0;
-
-  // Update the subject node.
-  sum_tree_[index].value = value;
-  UPDATE_SUM(index);
-
-  // Update all parents until we find the root node.
-  while (index != 0 && error <= kMaxApproximationError) {
-    index = (index - 1) / 2;
-    UPDATE_SUM(index);
+void PrioritizedSelector::Resize(size_t capacity) {
+  std::vector<std::vector<Block>> levels;
+  size_t num_blocks = (capacity + kFanOut - 1) / kFanOut;
+  while (true) {
+    levels.emplace_back(num_blocks);
+    if (num_blocks == 1) break;
+    num_blocks = (num_blocks + kFanOut - 1) / kFanOut;
+  }
+  for (size_t i = 0; i < keys_.size(); i++) {
+    levels[0][i / kFanOut].weights[i % kFanOut] = Weight(i);
   }
+  levels_ = std::move(levels);
 
-  // If floating-point errors have built up, re-initialize the tree.
-  if (error > kMaxApproximationError) {
-    REVERB_LOG(REVERB_WARNING)
-        << "Tree needs to be initialized because node with index " << index
-        << " has approximation error " << error
-        << ", which exceeds the threshold of " << kMaxApproximationError;
-    ReinitializeSumTree();
+  for (size_t level = 1; level < levels_.size(); level++) {
+    for (size_t block = 0; block < levels_[level - 1].size(); block++) {
+      levels_[level][block / kFanOut].weights[block % kFanOut] =
+          PairwiseSum<kFanOut>(levels_[level - 1][block].weights);
+    }
   }
+  total_weight_ = PairwiseSum<kFanOut>(levels_.back()[0].weights);
 }
 
-#undef UPDATE_SUM
+size_t PrioritizedSelector::FindLeaf(double target) const {
+  // Descend from the root, visiting one block (i.e one cache line) per level.
+  size_t index = 0;
+  for (int level = levels_.size() - 1; level >= 0; --level) {
+    index = index * kFanOut +
+            ChildContaining<kFanOut>(levels_[level][index].weights, &target);
+  }
+  return index;
+}
 
-void PrioritizedSelector::ReinitializeSumTree() {
-  // Re-initialize the sums from the leaves to the root node.
-  for (int64_t i = sum_tree_.size() - 1; i >= 0; --i) {
-    sum_tree_[i].sum = NodeValue(i) + NodeSum(2 * i + 1) + NodeSum(2 * i + 2);
+void PrioritizedSelector::FindLeaves(
+    std::vector<double>* targets, std::vector<size_t>* indices) const {
+  // All targets descend one level at a time. The lookups of the different
+  // targets are independent so the CPU can have many of the cache misses in
+  // flight at once, rather than paying for them one after the other.
+  indices->assign(targets->size(), 0);
+  for (int level = levels_.size() - 1; level >= 0; --level) {
+    const std::vector<Block>& blocks = levels_[level];
+    for (size_t i = 0; i < targets->size(); i++) {
+      size_t& index = (*indices)[i];
+      index = index * kFanOut +
+              ChildContaining<kFanOut>(blocks[index].weights, &(*targets)[i]);
+    }
   }
 }
 
@@ -32,14 +32,25 @@ namespace reverb {
 // sampling a key is proportional to its priority raised to a configurable
 // exponent.
 //
+// The weights are stored in an implicit sum tree with a fan-out of `kFanOut`.
+// The leaves hold the exponentiated priorities of the keys and every inner
+// node holds the sum of its children. The children of a node are stored
+// contiguously in a block that fills exactly one cache line so a lookup
+// touches a single cache line per level, i.e ~8 cache lines for 10M keys
+// rather than ~24 for a binary tree.
+//
 // Since the priorities and probabilities are stored as doubles, numerical
 // rounding errors may be introduced especially when the relative size of
 // probabilities for keys is large. Ideally when using this class priorities are
 // roughly the same scale and the priority exponent is not large, e.g. less than
-// 2.
+// 2. Inner nodes are recomputed from their children on every update so rounding
+// errors do not accumulate over time.
 //
 class PrioritizedSelector : public ItemSelector {
  public:
+  // Number of children of each inner node of the sum tree.
+  static constexpr int kFanOut = 8;
+
   PrioritizedSelector(double priority_exponent,
                       uint64_t seed = std::random_device()());
 
@@ -55,14 +66,25 @@ class PrioritizedSelector : public ItemSelector {
   // O(log n) time.
   KeyWithProbability Sample() override;
 
+  // Draws stratified samples, i.e one sample from each of `num_samples` equally
+  // sized slices of the cumulative weight. All samples walk down the tree
+  // together, one level at a time, which lets the memory accesses of different
+  // samples overlap. The samples are returned in random order.
+  // O(num_samples * log n) time.
+  void SampleBatch(int num_samples,
+                   std::vector<KeyWithProbability>* samples) override;
+
   // O(n) time.
   void Clear() override;
 
+  double TotalWeight() const override;
+
   KeyDistributionOptions options() const override;
 
   std::string DebugString() const override;
 
-  // Returns the sum stored at a node for testing purposes only.
+  // Returns the sum stored at a node for testing purposes only. Nodes are
+  // numbered in breadth first order starting with 0 for the root.
   double NodeSumTestingOnly(size_t index) const;
 
   // Returns a copy of the random numbers generator.
@@ -70,39 +92,30 @@ class PrioritizedSelector : public ItemSelector {
   void SetRng(const std::mt19937_64& rng) { rng_ = rng; }
 
  private:
-  struct Node {
-    Key key;
-    // Sum of the exponentiated priority of this node and all its descendants.
-    // This includes the entire sub tree with inner and leaf nodes.
-    // `NodeValue()` can be used to get the exponentiated priority of a node
-    // without its children.
-    double sum = 0;
-    // The exponentiated priority of this node. This can be computed from `sum`,
-    // however, this calculation becomes less accurate over time as rounding
-    // errors accumulate.
-    double value = 0;
+  // The children of an inner node.
+  struct alignas(64) Block {
+    double weights[kFanOut] = {};
   };
 
-  // Gets the individual value of a node in `sum_tree_` without the summed up
-  // value of all its descendants.
-  double NodeValue(size_t index) const;
+  // Sets the weight of the leaf at `index` and updates its ancestors.
+  // O(log n) time.
+  void SetWeight(size_t index, double weight);
+
+  // Returns the weight of the leaf at `index`.
+  double Weight(size_t index) const;
 
-  // Sum of the exponentiated priority of this node and all its descendants.
-  // If the index is out of bounds, then 0 is returned.
-  double NodeSum(size_t index) const;
+  // Reallocates the tree so it holds at least `capacity` leaves and recomputes
+  // all inner nodes. O(capacity) time.
+  void Resize(size_t capacity);
 
-  // Sets the individual value of a node in the `sum_tree_`. This does not
-  // include the value of the descendants. Usually, this operation's runtime is
-  // in O(log n). However, if floating point rounding errors have accumulated to
-  // a point where the intermediate sums deviate from their true values more
-  // than 1e-4, the tree is reinitialized, which takes O(n) time.
-  void SetNode(size_t index, double value);
+  // Returns the index of the leaf containing `target`, which must be in
+  // [0, TotalWeight()).
+  size_t FindLeaf(double target) const;
 
-  // Computes the sum tree. This may be necessary if rounding errors have
-  // compounded due to repeated partial tree updates. For example, sums may
-  // become negative due to rounding errors (e.g. x - (x + epsilon) < 0 where
-  // epsilon is a small rounding error).
-  void ReinitializeSumTree();
+  // Same as `FindLeaf` for each of the `targets`. The results are written to
+  // `indices` and `targets` is overwritten.
+  void FindLeaves(std::vector<double>* targets,
+                  std::vector<size_t>* indices) const;
 
   // Controls the degree of prioritization. Priorities are raised to this
   // exponent before adding them to the `SumTree` as weights. A non-negative
@@ -110,14 +123,19 @@ class PrioritizedSelector : public ItemSelector {
   // probability (except for keys with zero priority).
   const double priority_exponent_;
 
-  // Capacity of the summary tree. Starts at ~130000 and grows exponentially.
-  size_t capacity_;
+  // The levels of the sum tree. `levels_[0]` holds the leaves and the weights
+  // in `levels_[l][i]` are the sums of the blocks `levels_[l - 1][i * kFanOut +
+  // j]`. The last level holds a single block with the children of the root.
+  std::vector<std::vector<Block>> levels_;
+
+  // Sum of the weights in the last level, i.e the value of the root.
+  double total_weight_ = 0;
 
-  // A tree stored as a flat vector were each node is the sum of its children
-  // plus its own exponentiated priority.
-  std::vector<Node> sum_tree_;
+  // The keys at the leaves of the tree. Leaves are kept dense so that the keys
+  // are found at the first `keys_.size()` leaves.
+  std::vector<Key> keys_;
 
-  // Maps a key to the index where this key can be found in `sum_tree_`.
+  // Maps a key to the index of the leaf where this key can be found.
   internal::flat_hash_map<Key, size_t> key_to_index_;
 
   // Used for sampling, not thread-safe.
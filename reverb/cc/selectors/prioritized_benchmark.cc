@@ -0,0 +1,76 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/selectors/interface.h"
+#include "reverb/cc/selectors/prioritized.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+constexpr int kBatchSize = 256;
+
+void Fill(int64_t num_keys, PrioritizedSelector* selector) {
+  for (int64_t i = 0; i < num_keys; i++) {
+    REVERB_CHECK_OK(selector->Insert(i, 1 + i % 100));
+  }
+}
+
+void BM_Sample(benchmark::State& state) {
+  PrioritizedSelector selector(/*priority_exponent=*/0.6, /*seed=*/1);
+  Fill(state.range(0), &selector);
+  for (auto _ : state) {
+    for (int i = 0; i < kBatchSize; i++) {
+      benchmark::DoNotOptimize(selector.Sample());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+void BM_SampleBatch(benchmark::State& state) {
+  PrioritizedSelector selector(/*priority_exponent=*/0.6, /*seed=*/1);
+  Fill(state.range(0), &selector);
+  std::vector<ItemSelector::KeyWithProbability> samples;
+  for (auto _ : state) {
+    samples.clear();
+    selector.SampleBatch(kBatchSize, &samples);
+    benchmark::DoNotOptimize(samples.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+void BM_Update(benchmark::State& state) {
+  const int64_t num_keys = state.range(0);
+  PrioritizedSelector selector(/*priority_exponent=*/0.6, /*seed=*/1);
+  Fill(num_keys, &selector);
+  uint64_t key = 0;
+  for (auto _ : state) {
+    key = (key + 7919) % num_keys;
+    REVERB_CHECK_OK(selector.Update(key, 1 + key % 10));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_Sample)->Arg(1000)->Arg(1000000)->Arg(10000000);
+BENCHMARK(BM_SampleBatch)->Arg(1000)->Arg(1000000)->Arg(10000000);
+BENCHMARK(BM_Update)->Arg(1000)->Arg(1000000)->Arg(10000000);
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
@@ -15,6 +15,7 @@
 #include "reverb/cc/selectors/prioritized.h"
 
 #include <cmath>
+#include <numeric>
 #include <vector>
 
 #include "gmock/gmock.h"
@@ -127,6 +128,94 @@ TEST(PrioritizedSelectorTest, SampledDistributionMatchesProbabilities) {
   }
 }
 
+TEST(PrioritizedSelectorTest, SampleBatchDistributionMatchesProbabilities) {
+  const int kItems = 100;
+  const int kBatchSize = 7;
+  const int kBatches = 100000;
+
+  PrioritizedSelector prioritized(kInitialPriorityExponent);
+  double sum = 0;
+  for (int i = 0; i < kItems; i++) {
+    REVERB_EXPECT_OK(prioritized.Insert(i, i));
+    sum += i;
+  }
+  std::vector<int64_t> counts(kItems);
+  std::vector<ItemSelector::KeyWithProbability> samples;
+  for (int i = 0; i < kBatches; i++) {
+    samples.clear();
+    prioritized.SampleBatch(kBatchSize, &samples);
+    ASSERT_EQ(samples.size(), kBatchSize);
+    for (const auto& sample : samples) {
+      EXPECT_DOUBLE_EQ(sample.probability, sample.key / sum);
+      counts[sample.key]++;
+    }
+  }
+  EXPECT_EQ(counts[0], 0);
+  for (int k = 1; k < kItems; k++) {
+    EXPECT_NEAR(static_cast<double>(counts[k]) / (kBatchSize * kBatches),
+                k / sum, 0.001);
+  }
+}
+
+TEST(PrioritizedSelectorTest, SampleBatchIsStratified) {
+  const int kItems = 64;
+  PrioritizedSelector prioritized(kInitialPriorityExponent);
+  for (int i = 0; i < kItems; i++) {
+    REVERB_EXPECT_OK(prioritized.Insert(i, 1));
+  }
+
+  // With equal priorities every stratum covers exactly one key.
+  std::vector<ItemSelector::KeyWithProbability> samples;
+  prioritized.SampleBatch(kItems, &samples);
+  std::vector<ItemSelector::Key> keys;
+  for (const auto& sample : samples) {
+    keys.push_back(sample.key);
+    EXPECT_DOUBLE_EQ(sample.probability, 1. / kItems);
+  }
+  std::vector<ItemSelector::Key> want(kItems);
+  std::iota(want.begin(), want.end(), 0);
+  EXPECT_THAT(keys, ::testing::UnorderedElementsAreArray(want));
+  // The order is shuffled.
+  EXPECT_NE(keys, want);
+}
+
+TEST(PrioritizedSelectorTest, SampleBatchAppendsToOutput) {
+  PrioritizedSelector prioritized(kInitialPriorityExponent);
+  REVERB_EXPECT_OK(prioritized.Insert(1, 0));
+  REVERB_EXPECT_OK(prioritized.Insert(2, 0));
+
+  std::vector<ItemSelector::KeyWithProbability> samples(3);
+  prioritized.SampleBatch(5, &samples);
+  EXPECT_EQ(samples.size(), 8);
+  for (int i = 3; i < samples.size(); i++) {
+    EXPECT_THAT(samples[i].key, ::testing::AnyOf(1, 2));
+    EXPECT_EQ(samples[i].probability, 0.5);
+  }
+}
+
+TEST(PrioritizedSelectorTest, GrowsBeyondInitialCapacity) {
+  const int kItems = 100000;
+  PrioritizedSelector prioritized(kInitialPriorityExponent);
+  for (int i = 0; i < kItems; i++) {
+    REVERB_EXPECT_OK(prioritized.Insert(i, i % 2));
+  }
+  EXPECT_DOUBLE_EQ(prioritized.TotalWeight(), kItems / 2);
+  EXPECT_DOUBLE_EQ(prioritized.NodeSumTestingOnly(0), kItems / 2);
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_EQ(prioritized.Sample().key % 2, 1);
+  }
+
+  // Deleting all the keys with a non-zero priority results in uniform
+  // sampling over the remaining keys.
+  for (int i = 1; i < kItems; i += 2) {
+    REVERB_EXPECT_OK(prioritized.Delete(i));
+  }
+  EXPECT_EQ(prioritized.TotalWeight(), 0);
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_EQ(prioritized.Sample().key % 2, 0);
+  }
+}
+
 TEST(PrioritizedSelectorTest, SetsPriorityExponentInOptions) {
   PrioritizedSelector prioritized_a(0.1);
   PrioritizedSelector prioritized_b(0.5);
@@ -140,6 +229,20 @@ TEST(PrioritizedSelectorTest, SetsPriorityExponentInOptions) {
           "prioritized: { priority_exponent: 0.5 } is_deterministic: false"));
 }
 
+TEST(PrioritizedSelectorTest, TotalWeightIsSumOfExponentiatedPriorities) {
+  PrioritizedSelector prioritized(2.0);
+  EXPECT_EQ(prioritized.TotalWeight(), 0);
+  REVERB_EXPECT_OK(prioritized.Insert(1, 2));
+  REVERB_EXPECT_OK(prioritized.Insert(2, 3));
+  EXPECT_DOUBLE_EQ(prioritized.TotalWeight(), 13);
+  REVERB_EXPECT_OK(prioritized.Update(1, 1));
+  EXPECT_DOUBLE_EQ(prioritized.TotalWeight(), 10);
+  REVERB_EXPECT_OK(prioritized.Delete(2));
+  EXPECT_DOUBLE_EQ(prioritized.TotalWeight(), 1);
+  prioritized.Clear();
+  EXPECT_EQ(prioritized.TotalWeight(), 0);
+}
+
 TEST(PrioritizedSelector, RoundingErrors) {
   PrioritizedSelector prioritized(1.0);
 
@@ -0,0 +1,203 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares `FifoSelector` and `LifoSelector` with the previous implementation
+// which kept the keys in a `std::list` indexed by a hash map.
+
+#include <malloc.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <list>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "absl/strings/str_cat.h"
+#include "reverb/cc/platform/hash_map.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/selectors/fifo.h"
+#include "reverb/cc/selectors/interface.h"
+#include "reverb/cc/selectors/lifo.h"
+
+namespace {
+
+// Bytes currently allocated through the global operator new. Used to report
+// the memory used per item.
+std::atomic<int64_t> allocated_bytes(0);
+
+}  // namespace
+
+void* operator new(size_t size) {
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) throw std::bad_alloc();
+  allocated_bytes.fetch_add(malloc_usable_size(ptr), std::memory_order_relaxed);
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  if (ptr == nullptr) return;
+  allocated_bytes.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+// The `std::list` based selector which `FifoSelector` and `LifoSelector` used
+// to be implemented with.
+template <bool kLifo>
+class ListSelector : public ItemSelector {
+ public:
+  absl::Status Delete(Key key) override {
+    auto it = key_to_iterator_.find(key);
+    if (it == key_to_iterator_.end())
+      return absl::InvalidArgumentError(
+          absl::StrCat("Key ", key, " not found."));
+    keys_.erase(it->second);
+    key_to_iterator_.erase(it);
+    return absl::OkStatus();
+  }
+
+  absl::Status Insert(Key key, double priority) override {
+    if (key_to_iterator_.find(key) != key_to_iterator_.end()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Key ", key, " already inserted."));
+    }
+    key_to_iterator_.emplace(
+        key, keys_.emplace(kLifo ? keys_.begin() : keys_.end(), key));
+    return absl::OkStatus();
+  }
+
+  absl::Status Update(Key key, double priority) override {
+    return absl::OkStatus();
+  }
+
+  KeyWithProbability Sample() override {
+    REVERB_CHECK(!keys_.empty());
+    return {keys_.front(), 1.};
+  }
+
+  void Clear() override {
+    keys_.clear();
+    key_to_iterator_.clear();
+  }
+
+  double TotalWeight() const override { return key_to_iterator_.size(); }
+
+  KeyDistributionOptions options() const override { return {}; }
+
+  std::string DebugString() const override { return "ListSelector"; }
+
+ private:
+  std::list<Key> keys_;
+  internal::flat_hash_map<Key, std::list<Key>::iterator> key_to_iterator_;
+};
+
+using ListFifoSelector = ListSelector</*kLifo=*/false>;
+using ListLifoSelector = ListSelector</*kLifo=*/true>;
+
+void Fill(int64_t num_keys, ItemSelector* selector) {
+  for (int64_t i = 0; i < num_keys; i++) {
+    REVERB_CHECK_OK(selector->Insert(i, 1));
+  }
+}
+
+// The access pattern of a queue-like table: every insert evicts the oldest
+// item once the table is full.
+template <typename Selector>
+void BM_InsertDeleteOldest(benchmark::State& state) {
+  const int64_t num_keys = state.range(0);
+  Selector selector;
+  Fill(num_keys, &selector);
+  uint64_t next_key = num_keys;
+  for (auto _ : state) {
+    REVERB_CHECK_OK(selector.Insert(next_key, 1));
+    REVERB_CHECK_OK(selector.Delete(next_key - num_keys));
+    next_key++;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Selector>
+void BM_Sample(benchmark::State& state) {
+  Selector selector;
+  Fill(state.range(0), &selector);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(selector.Sample());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Deletes every key in a random order, e.g items removed by `MutatePriorities`
+// or by the max times sampled limit of a table.
+template <typename Selector>
+void BM_DeleteRandomOrder(benchmark::State& state) {
+  const int64_t num_keys = state.range(0);
+  std::vector<ItemSelector::Key> keys(num_keys);
+  for (int64_t i = 0; i < num_keys; i++) keys[i] = i;
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(1));
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    Selector selector;
+    Fill(num_keys, &selector);
+    state.ResumeTiming();
+    for (auto key : keys) {
+      REVERB_CHECK_OK(selector.Delete(key));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num_keys);
+}
+
+// Reports the heap memory held by a selector per key.
+template <typename Selector>
+void BM_MemoryPerItem(benchmark::State& state) {
+  const int64_t num_keys = state.range(0);
+  for (auto _ : state) {
+    const int64_t before = allocated_bytes.load();
+    Selector selector;
+    Fill(num_keys, &selector);
+    state.counters["bytes_per_item"] =
+        static_cast<double>(allocated_bytes.load() - before) / num_keys;
+  }
+}
+
+#define REVERB_BENCHMARK_QUEUE_SELECTORS(benchmark_fn, ...)        \
+  BENCHMARK_TEMPLATE(benchmark_fn, FifoSelector)__VA_ARGS__;       \
+  BENCHMARK_TEMPLATE(benchmark_fn, ListFifoSelector)__VA_ARGS__;   \
+  BENCHMARK_TEMPLATE(benchmark_fn, LifoSelector)__VA_ARGS__;       \
+  BENCHMARK_TEMPLATE(benchmark_fn, ListLifoSelector)__VA_ARGS__
+
+REVERB_BENCHMARK_QUEUE_SELECTORS(BM_InsertDeleteOldest,
+                                 ->Arg(1000)->Arg(1000000));
+REVERB_BENCHMARK_QUEUE_SELECTORS(BM_Sample, ->Arg(1000)->Arg(1000000));
+REVERB_BENCHMARK_QUEUE_SELECTORS(BM_DeleteRandomOrder,
+                                 ->Arg(1000)->Arg(100000));
+REVERB_BENCHMARK_QUEUE_SELECTORS(BM_MemoryPerItem,
+                                 ->Arg(1000)->Arg(1000000)->Iterations(1));
+
+#undef REVERB_BENCHMARK_QUEUE_SELECTORS
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
@@ -70,6 +70,8 @@ void UniformSelector::Clear() {
   key_to_index_.clear();
 }
 
+double UniformSelector::TotalWeight() const { return keys_.size(); }
+
 KeyDistributionOptions UniformSelector::options() const {
   KeyDistributionOptions options;
   options.set_uniform(true);
@@ -41,6 +41,8 @@ class UniformSelector : public ItemSelector {
 
   void Clear() override;
 
+  double TotalWeight() const override;
+
   KeyDistributionOptions options() const override;
 
   std::string DebugString() const override;
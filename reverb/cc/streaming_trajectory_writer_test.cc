@@ -510,6 +510,9 @@ TEST(StreamingTrajectoryWriter, ChunkersNotifiedWhenAllChunksDone) {
     int GetNumKeepAliveRefs() const override { return 1; }
     bool GetDeltaEncode() const override { return false; }
     bool GetCompressionDisabled() const override { return false; }
+    CompressionCodec GetCompressionCodec() const override {
+      return CompressionCodec::COMPRESSION_CODEC_SNAPPY;
+    }
 
 
         absl::Status OnItemFinalized(
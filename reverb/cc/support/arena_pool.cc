@@ -0,0 +1,108 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "reverb/cc/support/arena_pool.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "reverb/cc/platform/logging.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+struct ArenaPool::Entry {
+  explicit Entry(size_t initial_block_size)
+      : block(new char[initial_block_size]),
+        arena(block.get(), initial_block_size) {}
+
+  // Owned by the entry rather than by the arena so that it is kept on `Reset`.
+  std::unique_ptr<char[]> block;
+  google::protobuf::Arena arena;
+};
+
+struct ArenaPool::State {
+  State(size_t initial_block_size, size_t max_pooled)
+      : initial_block_size(initial_block_size), max_pooled(max_pooled) {}
+
+  const size_t initial_block_size;
+  const size_t max_pooled;
+
+  std::atomic<int64_t> num_created{0};
+  std::atomic<int64_t> num_reused{0};
+
+  absl::Mutex mu;
+  std::vector<std::unique_ptr<Entry>> idle ABSL_GUARDED_BY(mu);
+};
+
+void ArenaPool::Release(const std::weak_ptr<State>& weak_state,
+                        std::unique_ptr<Entry> entry) {
+  entry->arena.Reset();
+  auto state = weak_state.lock();
+  if (state == nullptr) return;
+  absl::MutexLock lock(&state->mu);
+  if (state->idle.size() < state->max_pooled) {
+    state->idle.push_back(std::move(entry));
+  }
+}
+
+ArenaPool::ArenaPool(size_t initial_block_size, size_t max_pooled)
+    : state_(std::make_shared<State>(initial_block_size, max_pooled)) {
+  REVERB_CHECK_GT(initial_block_size, size_t{0});
+}
+
+ArenaPool::~ArenaPool() = default;
+
+std::shared_ptr<google::protobuf::Arena> ArenaPool::Acquire() {
+  std::unique_ptr<Entry> entry;
+  {
+    absl::MutexLock lock(&state_->mu);
+    if (!state_->idle.empty()) {
+      entry = std::move(state_->idle.back());
+      state_->idle.pop_back();
+    }
+  }
+  if (entry == nullptr) {
+    entry = std::make_unique<Entry>(state_->initial_block_size);
+    state_->num_created.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    state_->num_reused.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  google::protobuf::Arena* arena = &entry->arena;
+  std::weak_ptr<State> weak_state = state_;
+  return std::shared_ptr<google::protobuf::Arena>(
+      arena, [weak_state = std::move(weak_state),
+              entry = entry.release()](google::protobuf::Arena*) {
+        Release(weak_state, std::unique_ptr<Entry>(entry));
+      });
+}
+
+int64_t ArenaPool::num_created() const {
+  return state_->num_created.load(std::memory_order_relaxed);
+}
+
+int64_t ArenaPool::num_reused() const {
+  return state_->num_reused.load(std::memory_order_relaxed);
+}
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,74 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef REVERB_CC_SUPPORT_ARENA_POOL_H_
+#define REVERB_CC_SUPPORT_ARENA_POOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "google/protobuf/arena.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Pool of protobuf arenas which are reset and reused once released rather than
+// destroyed. Each arena owns an initial block of `initial_block_size` bytes
+// which survives `Arena::Reset`, so a message that fits in the block is built
+// without touching the global allocator once the pool is warm.
+//
+// Arenas are handed out as shared pointers so that messages allocated on them
+// can be kept alive (e.g by an aliasing `std::shared_ptr`) after the lease
+// ends. The arena is reset and returned to the pool when the last reference is
+// dropped, which may happen on any thread and after the pool itself has been
+// destroyed, in which case the arena is deleted instead. At most `max_pooled`
+// idle arenas are retained.
+//
+// The object is thread safe.
+class ArenaPool {
+ public:
+  ArenaPool(size_t initial_block_size, size_t max_pooled);
+  ~ArenaPool();
+
+  ArenaPool(const ArenaPool&) = delete;
+  ArenaPool& operator=(const ArenaPool&) = delete;
+
+  // Returns an empty arena, creating a new one if none is pooled.
+  std::shared_ptr<google::protobuf::Arena> Acquire();
+
+  // Number of arenas created and number of `Acquire` calls served by a pooled
+  // arena since the pool was constructed.
+  int64_t num_created() const;
+  int64_t num_reused() const;
+
+ private:
+  struct Entry;
+  struct State;
+
+  // Resets the arena of `entry` and hands it back to the pool if the pool is
+  // still alive and not full.
+  static void Release(const std::weak_ptr<State>& weak_state,
+                      std::unique_ptr<Entry> entry);
+
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_ARENA_POOL_H_
@@ -0,0 +1,121 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "reverb/cc/support/arena_pool.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "google/protobuf/arena.h"
+#include "reverb/cc/platform/thread.h"
+#include "reverb/cc/schema.pb.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+TEST(ArenaPoolTest, ReusesReleasedArena) {
+  ArenaPool pool(/*initial_block_size=*/1024, /*max_pooled=*/1);
+  auto arena = pool.Acquire();
+  google::protobuf::Arena* ptr = arena.get();
+  arena.reset();
+
+  arena = pool.Acquire();
+  EXPECT_EQ(arena.get(), ptr);
+  EXPECT_EQ(pool.num_created(), 1);
+  EXPECT_EQ(pool.num_reused(), 1);
+}
+
+TEST(ArenaPoolTest, LeasedArenasAreDistinct) {
+  ArenaPool pool(/*initial_block_size=*/1024, /*max_pooled=*/2);
+  auto first = pool.Acquire();
+  auto second = pool.Acquire();
+  EXPECT_NE(first.get(), second.get());
+  EXPECT_EQ(pool.num_created(), 2);
+  EXPECT_EQ(pool.num_reused(), 0);
+}
+
+TEST(ArenaPoolTest, RetainsAtMostMaxPooled) {
+  ArenaPool pool(/*initial_block_size=*/1024, /*max_pooled=*/1);
+  auto first = pool.Acquire();
+  auto second = pool.Acquire();
+  first.reset();
+  second.reset();
+
+  auto third = pool.Acquire();
+  auto fourth = pool.Acquire();
+  EXPECT_EQ(pool.num_created(), 3);
+  EXPECT_EQ(pool.num_reused(), 1);
+}
+
+TEST(ArenaPoolTest, ReleasedArenaIsReset) {
+  ArenaPool pool(/*initial_block_size=*/256, /*max_pooled=*/1);
+  auto arena = pool.Acquire();
+  const uint64_t initial_space = arena->SpaceAllocated();
+  auto* chunk = google::protobuf::Arena::CreateMessage<ChunkData>(arena.get());
+  chunk->set_chunk_key(1);
+  chunk->mutable_data()->add_tensors()->set_tensor_content(
+      std::string(64 << 10, 'a'));
+  EXPECT_GT(arena->SpaceAllocated(), initial_space);
+  arena.reset();
+
+  // Only the initial block is kept.
+  arena = pool.Acquire();
+  EXPECT_EQ(arena->SpaceAllocated(), initial_space);
+  EXPECT_EQ(arena->SpaceUsed(), 0);
+}
+
+TEST(ArenaPoolTest, MessageOutlivesPool) {
+  std::shared_ptr<const ChunkData> chunk;
+  {
+    ArenaPool pool(/*initial_block_size=*/1024, /*max_pooled=*/1);
+    auto arena = pool.Acquire();
+    auto* message =
+        google::protobuf::Arena::CreateMessage<ChunkData>(arena.get());
+    message->set_chunk_key(7);
+    chunk = std::shared_ptr<const ChunkData>(arena, message);
+  }
+  EXPECT_EQ(chunk->chunk_key(), 7);
+  chunk.reset();
+}
+
+TEST(ArenaPoolTest, ConcurrentAcquireAndRelease) {
+  ArenaPool pool(/*initial_block_size=*/1024, /*max_pooled=*/4);
+  std::vector<std::unique_ptr<Thread>> threads;
+  for (int i = 0; i < 8; i++) {
+    threads.push_back(StartThread("", [&pool, i] {
+      for (int j = 0; j < 1000; j++) {
+        auto arena = pool.Acquire();
+        auto* chunk =
+            google::protobuf::Arena::CreateMessage<ChunkData>(arena.get());
+        chunk->set_chunk_key(i * 1000 + j);
+        EXPECT_EQ(chunk->chunk_key(), i * 1000 + j);
+      }
+    }));
+  }
+  threads.clear();
+  EXPECT_EQ(pool.num_created() + pool.num_reused(), 8000);
+  EXPECT_LE(pool.num_created(), 8);
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
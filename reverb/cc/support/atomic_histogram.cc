@@ -0,0 +1,124 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/atomic_histogram.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+#include "absl/numeric/bits.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+constexpr int64_t kMaxValue = std::numeric_limits<int64_t>::max();
+
+// Lowers (raises) `target` to `value` if `value` is smaller (larger).
+void AtomicMin(std::atomic<int64_t>* target, int64_t value) {
+  int64_t current = target->load(std::memory_order_relaxed);
+  while (value < current &&
+         !target->compare_exchange_weak(current, value,
+                                        std::memory_order_relaxed)) {
+  }
+}
+
+void AtomicMax(std::atomic<int64_t>* target, int64_t value) {
+  int64_t current = target->load(std::memory_order_relaxed);
+  while (value > current &&
+         !target->compare_exchange_weak(current, value,
+                                        std::memory_order_relaxed)) {
+  }
+}
+
+}  // namespace
+
+AtomicHistogram::AtomicHistogram() : sum_(0), min_(kMaxValue), max_(0) {
+  for (auto& bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+int AtomicHistogram::BucketIndex(int64_t value) {
+  const auto v = static_cast<uint64_t>(value);
+  if (v < kSubBuckets) return v;
+  // Position of the most significant bit, >= kSubBucketBits.
+  const int exponent = 63 - absl::countl_zero(v);
+  const int shift = exponent - kSubBucketBits;
+  const int sub_bucket = (v >> shift) & (kSubBuckets - 1);
+  return (shift + 1) * kSubBuckets + sub_bucket;
+}
+
+int64_t AtomicHistogram::BucketLowerBound(int index) {
+  if (index < kSubBuckets) return index;
+  const int shift = index / kSubBuckets - 1;
+  const uint64_t sub_bucket = index % kSubBuckets;
+  return static_cast<int64_t>((kSubBuckets + sub_bucket) << shift);
+}
+
+int64_t AtomicHistogram::BucketUpperBound(int index) {
+  if (index < kSubBuckets) return index + 1;
+  const int shift = index / kSubBuckets - 1;
+  const uint64_t sub_bucket = index % kSubBuckets;
+  const uint64_t upper = (kSubBuckets + sub_bucket + 1) << shift;
+  return upper > static_cast<uint64_t>(kMaxValue) ? kMaxValue
+                                                  : static_cast<int64_t>(upper);
+}
+
+void AtomicHistogram::Record(int64_t value) {
+  value = std::max<int64_t>(value, 0);
+  buckets_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+  AtomicMin(&min_, value);
+  AtomicMax(&max_, value);
+}
+
+void AtomicHistogram::Merge(const AtomicHistogram& other) {
+  for (int i = 0; i < kNumBuckets; i++) {
+    const int64_t count = other.buckets_[i].load(std::memory_order_relaxed);
+    if (count != 0) {
+      buckets_[i].fetch_add(count, std::memory_order_relaxed);
+    }
+  }
+  sum_.fetch_add(other.sum_.load(std::memory_order_relaxed),
+                 std::memory_order_relaxed);
+  AtomicMin(&min_, other.min_.load(std::memory_order_relaxed));
+  AtomicMax(&max_, other.max_.load(std::memory_order_relaxed));
+}
+
+Histogram AtomicHistogram::ToProto() const {
+  Histogram proto;
+  int64_t count = 0;
+  for (int i = 0; i < kNumBuckets; i++) {
+    const int64_t bucket_count = buckets_[i].load(std::memory_order_relaxed);
+    if (bucket_count == 0) continue;
+    auto* bucket = proto.add_buckets();
+    bucket->set_lower_bound(BucketLowerBound(i));
+    bucket->set_upper_bound(BucketUpperBound(i));
+    bucket->set_count(bucket_count);
+    count += bucket_count;
+  }
+  if (count == 0) return proto;
+  proto.set_count(count);
+  proto.set_sum(sum_.load(std::memory_order_relaxed));
+  proto.set_min(min_.load(std::memory_order_relaxed));
+  proto.set_max(max_.load(std::memory_order_relaxed));
+  return proto;
+}
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
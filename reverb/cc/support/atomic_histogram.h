@@ -0,0 +1,83 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_ATOMIC_HISTOGRAM_H_
+#define REVERB_CC_SUPPORT_ATOMIC_HISTOGRAM_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include "absl/time/time.h"
+#include "reverb/cc/schema.pb.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Lock-free histogram of non-negative integers with log-linear buckets (as in
+// HdrHistogram). Values below 16 have a bucket each and every power of two
+// above that is split into 16 buckets of equal width, so a recorded value is
+// known with a relative error of at most 1/16 across the whole int64 range.
+//
+// `Record` only performs relaxed atomic increments so it is cheap enough to
+// be called on hot paths from any number of threads. Snapshots taken while
+// values are being recorded may be slightly inconsistent (e.g `sum` may
+// include a value which is not yet counted by its bucket).
+class AtomicHistogram {
+ public:
+  static constexpr int kSubBucketBits = 4;
+  static constexpr int kSubBuckets = 1 << kSubBucketBits;
+  static constexpr int kNumBuckets = (64 - kSubBucketBits) * kSubBuckets;
+
+  AtomicHistogram();
+
+  // AtomicHistogram is neither copyable nor movable.
+  AtomicHistogram(const AtomicHistogram&) = delete;
+  AtomicHistogram& operator=(const AtomicHistogram&) = delete;
+
+  // Records `value`. Negative values are recorded as 0.
+  void Record(int64_t value);
+
+  // Records `duration` in microseconds.
+  void RecordMicros(absl::Duration duration) {
+    Record(absl::ToInt64Microseconds(duration));
+  }
+
+  // Adds all values recorded by `other` to this histogram.
+  void Merge(const AtomicHistogram& other);
+
+  // Snapshot of the recorded values.
+  Histogram ToProto() const;
+
+  // Index of the bucket which `value` (>= 0) is counted by.
+  static int BucketIndex(int64_t value);
+
+  // Bounds of the values counted by bucket `index`: [lower, upper). The upper
+  // bound of the last bucket saturates at the largest int64.
+  static int64_t BucketLowerBound(int index);
+  static int64_t BucketUpperBound(int index);
+
+ private:
+  std::array<std::atomic<int64_t>, kNumBuckets> buckets_;
+  std::atomic<int64_t> sum_;
+  std::atomic<int64_t> min_;
+  std::atomic<int64_t> max_;
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_ATOMIC_HISTOGRAM_H_
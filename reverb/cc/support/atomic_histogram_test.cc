@@ -0,0 +1,146 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/atomic_histogram.h"
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+#include "reverb/cc/platform/thread.h"
+#include "reverb/cc/schema.pb.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+TEST(AtomicHistogramTest, EmptyHistogram) {
+  AtomicHistogram histogram;
+  Histogram proto = histogram.ToProto();
+  EXPECT_EQ(proto.count(), 0);
+  EXPECT_EQ(proto.min(), 0);
+  EXPECT_EQ(proto.max(), 0);
+  EXPECT_TRUE(proto.buckets().empty());
+}
+
+TEST(AtomicHistogramTest, SmallValuesHaveExactBuckets) {
+  for (int64_t value = 0; value < AtomicHistogram::kSubBuckets; value++) {
+    const int index = AtomicHistogram::BucketIndex(value);
+    EXPECT_EQ(AtomicHistogram::BucketLowerBound(index), value);
+    EXPECT_EQ(AtomicHistogram::BucketUpperBound(index), value + 1);
+  }
+}
+
+TEST(AtomicHistogramTest, BucketsCoverValuesWithBoundedError) {
+  std::vector<int64_t> values = {16,         17,          31,
+                                 32,         33,          1000,
+                                 123456789,  int64_t{1} << 40,
+                                 (int64_t{1} << 62) + 5,
+                                 std::numeric_limits<int64_t>::max()};
+  for (int64_t value : values) {
+    const int index = AtomicHistogram::BucketIndex(value);
+    ASSERT_LT(index, AtomicHistogram::kNumBuckets);
+    const int64_t lower = AtomicHistogram::BucketLowerBound(index);
+    const int64_t upper = AtomicHistogram::BucketUpperBound(index);
+    EXPECT_LE(lower, value);
+    if (value != std::numeric_limits<int64_t>::max()) {
+      EXPECT_LT(value, upper);
+    }
+    EXPECT_LE(upper - lower, lower / AtomicHistogram::kSubBuckets + 1);
+  }
+}
+
+TEST(AtomicHistogramTest, BucketsAreContiguous) {
+  for (int i = 1; i < AtomicHistogram::kNumBuckets; i++) {
+    EXPECT_EQ(AtomicHistogram::BucketLowerBound(i),
+              AtomicHistogram::BucketUpperBound(i - 1));
+    EXPECT_EQ(
+        AtomicHistogram::BucketIndex(AtomicHistogram::BucketLowerBound(i)), i);
+  }
+}
+
+TEST(AtomicHistogramTest, ToProto) {
+  AtomicHistogram histogram;
+  histogram.Record(3);
+  histogram.Record(3);
+  histogram.Record(100);
+  histogram.Record(-5);
+
+  Histogram proto = histogram.ToProto();
+  EXPECT_EQ(proto.count(), 4);
+  EXPECT_EQ(proto.sum(), 106);
+  EXPECT_EQ(proto.min(), 0);
+  EXPECT_EQ(proto.max(), 100);
+  ASSERT_EQ(proto.buckets_size(), 3);
+  EXPECT_EQ(proto.buckets(0).lower_bound(), 0);
+  EXPECT_EQ(proto.buckets(0).count(), 1);
+  EXPECT_EQ(proto.buckets(1).lower_bound(), 3);
+  EXPECT_EQ(proto.buckets(1).count(), 2);
+  EXPECT_LE(proto.buckets(2).lower_bound(), 100);
+  EXPECT_GT(proto.buckets(2).upper_bound(), 100);
+  EXPECT_EQ(proto.buckets(2).count(), 1);
+}
+
+TEST(AtomicHistogramTest, RecordMicros) {
+  AtomicHistogram histogram;
+  histogram.RecordMicros(absl::Milliseconds(2));
+  EXPECT_EQ(histogram.ToProto().sum(), 2000);
+}
+
+TEST(AtomicHistogramTest, Merge) {
+  AtomicHistogram a;
+  AtomicHistogram b;
+  a.Record(5);
+  b.Record(1);
+  b.Record(500);
+  a.Merge(b);
+
+  Histogram proto = a.ToProto();
+  EXPECT_EQ(proto.count(), 3);
+  EXPECT_EQ(proto.sum(), 506);
+  EXPECT_EQ(proto.min(), 1);
+  EXPECT_EQ(proto.max(), 500);
+}
+
+TEST(AtomicHistogramTest, ConcurrentRecords) {
+  constexpr int kThreads = 8;
+  constexpr int kValuesPerThread = 10000;
+  AtomicHistogram histogram;
+  std::vector<std::unique_ptr<Thread>> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.push_back(StartThread("", [&histogram] {
+      for (int j = 0; j < kValuesPerThread; j++) {
+        histogram.Record(j);
+      }
+    }));
+  }
+  threads.clear();
+
+  Histogram proto = histogram.ToProto();
+  EXPECT_EQ(proto.count(), kThreads * kValuesPerThread);
+  EXPECT_EQ(proto.sum(),
+            int64_t{kThreads} * kValuesPerThread * (kValuesPerThread - 1) / 2);
+  EXPECT_EQ(proto.min(), 0);
+  EXPECT_EQ(proto.max(), kValuesPerThread - 1);
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
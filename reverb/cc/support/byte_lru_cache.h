@@ -0,0 +1,135 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_BYTE_LRU_CACHE_H_
+#define REVERB_CC_SUPPORT_BYTE_LRU_CACHE_H_
+
+#include <cstdint>
+#include <list>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "reverb/cc/platform/hash_map.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Thread safe LRU cache which holds values of type `V` keyed by `K` as long as
+// their total size, as reported by the caller on insertion, is within a byte
+// budget. Values are returned by copy so `V` should be cheap to copy (e.g a
+// reference counted buffer).
+//
+// The cache never computes values itself. Callers look up a key and, on a miss,
+// build the value without holding any lock before inserting it. If multiple
+// threads miss on the same key at the same time then all of them build the
+// value but only the first result is cached.
+template <typename K, typename V>
+class ByteLruCache {
+ public:
+  struct Stats {
+    // Number of lookups which found the value in the cache.
+    int64_t hits = 0;
+
+    // Number of lookups which did not find the value in the cache.
+    int64_t misses = 0;
+
+    // Number of values removed from the cache to make room for new ones.
+    int64_t evictions = 0;
+
+    // Number of values currently held by the cache.
+    int64_t entries = 0;
+
+    // Total size of the values currently held by the cache.
+    int64_t bytes = 0;
+  };
+
+  // Creates a cache holding at most `max_bytes` of values. Values larger than
+  // `max_bytes` are never cached.
+  explicit ByteLruCache(int64_t max_bytes) : max_bytes_(max_bytes) {}
+
+  // Copies the value of `key` to `value` and marks it as the most recently
+  // used one. Returns false if the key is not cached.
+  bool Lookup(const K& key, V* value) ABSL_LOCKS_EXCLUDED(mu_) {
+    absl::MutexLock lock(&mu_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      stats_.misses++;
+      return false;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second);
+    *value = it->second->value;
+    stats_.hits++;
+    return true;
+  }
+
+  // Inserts `value`, which is `bytes` large, unless `key` is already cached,
+  // and evicts the least recently used values until the cache is within its
+  // budget.
+  void Insert(const K& key, V value, int64_t bytes) ABSL_LOCKS_EXCLUDED(mu_) {
+    absl::MutexLock lock(&mu_);
+    if (bytes > max_bytes_ || index_.contains(key)) {
+      return;
+    }
+
+    entries_.push_front({key, std::move(value), bytes});
+    index_[key] = entries_.begin();
+    stats_.entries++;
+    stats_.bytes += bytes;
+
+    while (stats_.bytes > max_bytes_) {
+      const Entry& lru = entries_.back();
+      stats_.entries--;
+      stats_.bytes -= lru.bytes;
+      stats_.evictions++;
+      index_.erase(lru.key);
+      entries_.pop_back();
+    }
+  }
+
+  // Returns the counters and current size of the cache.
+  Stats stats() const ABSL_LOCKS_EXCLUDED(mu_) {
+    absl::MutexLock lock(&mu_);
+    return stats_;
+  }
+
+  int64_t max_bytes() const { return max_bytes_; }
+
+ private:
+  struct Entry {
+    K key;
+    V value;
+    int64_t bytes;
+  };
+
+  const int64_t max_bytes_;
+
+  mutable absl::Mutex mu_;
+
+  // Entries ordered from the most to the least recently used.
+  std::list<Entry> entries_ ABSL_GUARDED_BY(mu_);
+
+  // Position of each entry in `entries_`.
+  flat_hash_map<K, typename std::list<Entry>::iterator> index_
+      ABSL_GUARDED_BY(mu_);
+
+  Stats stats_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_BYTE_LRU_CACHE_H_
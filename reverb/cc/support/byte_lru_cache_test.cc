@@ -0,0 +1,118 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/byte_lru_cache.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+#include "reverb/cc/platform/thread.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+TEST(ByteLruCacheTest, LookupReturnsInsertedValue) {
+  ByteLruCache<int, std::string> cache(100);
+  std::string value;
+  EXPECT_FALSE(cache.Lookup(1, &value));
+
+  cache.Insert(1, "one", 3);
+  ASSERT_TRUE(cache.Lookup(1, &value));
+  EXPECT_EQ(value, "one");
+
+  auto stats = cache.stats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 1);
+  EXPECT_EQ(stats.entries, 1);
+  EXPECT_EQ(stats.bytes, 3);
+}
+
+TEST(ByteLruCacheTest, InsertKeepsFirstValue) {
+  ByteLruCache<int, std::string> cache(100);
+  cache.Insert(1, "first", 5);
+  cache.Insert(1, "second", 6);
+
+  std::string value;
+  ASSERT_TRUE(cache.Lookup(1, &value));
+  EXPECT_EQ(value, "first");
+  EXPECT_EQ(cache.stats().bytes, 5);
+}
+
+TEST(ByteLruCacheTest, EvictsLeastRecentlyUsed) {
+  ByteLruCache<int, int> cache(30);
+  cache.Insert(1, 1, 10);
+  cache.Insert(2, 2, 10);
+  cache.Insert(3, 3, 10);
+
+  // Touch 1 so that 2 is the least recently used value.
+  int value;
+  ASSERT_TRUE(cache.Lookup(1, &value));
+  cache.Insert(4, 4, 10);
+
+  EXPECT_TRUE(cache.Lookup(1, &value));
+  EXPECT_FALSE(cache.Lookup(2, &value));
+  EXPECT_TRUE(cache.Lookup(3, &value));
+  EXPECT_TRUE(cache.Lookup(4, &value));
+
+  auto stats = cache.stats();
+  EXPECT_EQ(stats.evictions, 1);
+  EXPECT_EQ(stats.entries, 3);
+  EXPECT_EQ(stats.bytes, 30);
+}
+
+TEST(ByteLruCacheTest, ValuesLargerThanBudgetAreNotCached) {
+  ByteLruCache<int, int> cache(10);
+  cache.Insert(1, 1, 5);
+  cache.Insert(2, 2, 11);
+
+  int value;
+  EXPECT_TRUE(cache.Lookup(1, &value));
+  EXPECT_FALSE(cache.Lookup(2, &value));
+  EXPECT_EQ(cache.stats().evictions, 0);
+}
+
+TEST(ByteLruCacheTest, ConcurrentLookupAndInsert) {
+  ByteLruCache<int, std::string> cache(1000);
+  std::vector<std::unique_ptr<Thread>> threads;
+  for (int i = 0; i < 8; i++) {
+    threads.push_back(StartThread("", [&cache, i] {
+      for (int j = 0; j < 1000; j++) {
+        const int key = (i * 1000 + j) % 64;
+        std::string value;
+        if (cache.Lookup(key, &value)) {
+          EXPECT_EQ(value, absl::StrCat(key));
+        } else {
+          cache.Insert(key, absl::StrCat(key), 20);
+        }
+      }
+    }));
+  }
+  threads.clear();
+
+  auto stats = cache.stats();
+  EXPECT_EQ(stats.hits + stats.misses, 8000);
+  EXPECT_LE(stats.bytes, 1000);
+  EXPECT_EQ(stats.bytes, stats.entries * 20);
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,50 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/chunk_column_cache.h"
+
+#include "absl/status/status.h"
+#include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/support/trajectory_util.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+ChunkColumnCache::ChunkColumnCache(int64_t max_bytes) : cache_(max_bytes) {}
+
+absl::Status ChunkColumnCache::UnpackChunkColumn(const ChunkData& chunk_data,
+                                                 int column,
+                                                 tensorflow::Tensor* out) {
+  const std::pair<uint64_t, int> key(chunk_data.chunk_key(), column);
+  if (cache_.Lookup(key, out)) {
+    return absl::OkStatus();
+  }
+
+  REVERB_RETURN_IF_ERROR(
+      internal::UnpackChunkColumn(chunk_data, column, out));
+  cache_.Insert(key, *out, out->TotalBytes());
+  return absl::OkStatus();
+}
+
+absl::Status ChunkColumnCache::UnpackChunkColumnAndSlice(
+    const ChunkData& chunk_data, const FlatTrajectory::ChunkSlice& slice,
+    tensorflow::Tensor* out) {
+  REVERB_RETURN_IF_ERROR(UnpackChunkColumn(chunk_data, slice.index(), out));
+  return SliceChunkColumn(*out, slice.offset(), slice.length(), out);
+}
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,74 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_CHUNK_COLUMN_CACHE_H_
+#define REVERB_CC_SUPPORT_CHUNK_COLUMN_CACHE_H_
+
+#include <cstdint>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/support/byte_lru_cache.h"
+#include "tensorflow/core/framework/tensor.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Thread safe LRU cache of decompressed chunk columns keyed by chunk key and
+// column index. Chunks are immutable and their keys unique so an entry never
+// has to be invalidated; it is only evicted when the total size of the cached
+// tensors exceeds the byte budget.
+//
+// Used on the sampling path, where prioritized tables (in particular with a
+// high samples per insert ratio) return the same chunks over and over again, to
+// avoid decompressing them every time they are sampled. Returned tensors share
+// their buffers with the cached ones and must therefore not be mutated.
+class ChunkColumnCache {
+ private:
+  using Cache = ByteLruCache<std::pair<uint64_t, int>, tensorflow::Tensor>;
+
+ public:
+  using Stats = Cache::Stats;
+
+  // Creates a cache holding at most `max_bytes` of decompressed tensors.
+  // Columns larger than `max_bytes` are decompressed but never cached.
+  explicit ChunkColumnCache(int64_t max_bytes);
+
+  // Same as `internal::UnpackChunkColumn` but returns the result of an earlier
+  // call for the same chunk and column if it is still cached.
+  absl::Status UnpackChunkColumn(const ChunkData& chunk_data, int column,
+                                 tensorflow::Tensor* out);
+
+  // Same as `internal::UnpackChunkColumnAndSlice` but the unpacked column is
+  // read from (or added to) the cache before it is sliced.
+  absl::Status UnpackChunkColumnAndSlice(
+      const ChunkData& chunk_data, const FlatTrajectory::ChunkSlice& slice,
+      tensorflow::Tensor* out);
+
+  // Returns the counters and current size of the cache.
+  Stats stats() const { return cache_.stats(); }
+
+  int64_t max_bytes() const { return cache_.max_bytes(); }
+
+ private:
+  Cache cache_;
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_CHUNK_COLUMN_CACHE_H_
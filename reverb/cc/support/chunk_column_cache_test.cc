@@ -0,0 +1,154 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/chunk_column_cache.h"
+
+#include <cstdint>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/tensor_compression.h"
+#include "reverb/cc/testing/tensor_testutil.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+// Returns a float tensor with `rows` rows of 4 values, i.e 16 bytes per row.
+tensorflow::Tensor MakeTensor(int rows, float value) {
+  tensorflow::Tensor tensor(tensorflow::DT_FLOAT,
+                            tensorflow::TensorShape({rows, 4}));
+  for (int i = 0; i < tensor.NumElements(); i++) {
+    tensor.flat<float>()(i) = value + i;
+  }
+  return tensor;
+}
+
+ChunkData MakeChunkData(uint64_t key,
+                        const std::vector<tensorflow::Tensor>& columns) {
+  ChunkData data;
+  data.set_chunk_key(key);
+  for (const auto& column : columns) {
+    CompressTensorAsProto(column, data.mutable_data()->add_tensors());
+  }
+  data.set_data_tensors_len(columns.size());
+  return data;
+}
+
+FlatTrajectory::ChunkSlice MakeSlice(int column, int offset, int length) {
+  FlatTrajectory::ChunkSlice slice;
+  slice.set_index(column);
+  slice.set_offset(offset);
+  slice.set_length(length);
+  return slice;
+}
+
+TEST(ChunkColumnCacheTest, ReturnsCachedColumn) {
+  ChunkColumnCache cache(1 << 10);
+  auto first = MakeTensor(2, 1);
+  auto second = MakeTensor(2, 100);
+  auto data = MakeChunkData(1, {first, second});
+
+  tensorflow::Tensor got;
+  REVERB_ASSERT_OK(cache.UnpackChunkColumn(data, 0, &got));
+  test::ExpectTensorEqual<float>(got, first);
+  REVERB_ASSERT_OK(cache.UnpackChunkColumn(data, 1, &got));
+  test::ExpectTensorEqual<float>(got, second);
+  REVERB_ASSERT_OK(cache.UnpackChunkColumn(data, 0, &got));
+  test::ExpectTensorEqual<float>(got, first);
+
+  auto stats = cache.stats();
+  EXPECT_EQ(stats.misses, 2);
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.evictions, 0);
+  EXPECT_EQ(stats.entries, 2);
+  EXPECT_EQ(stats.bytes, first.TotalBytes() + second.TotalBytes());
+}
+
+TEST(ChunkColumnCacheTest, EvictsLeastRecentlyUsed) {
+  // Room for exactly two columns of 2x4 floats.
+  ChunkColumnCache cache(64);
+  auto first = MakeChunkData(1, {MakeTensor(2, 1)});
+  auto second = MakeChunkData(2, {MakeTensor(2, 2)});
+  auto third = MakeChunkData(3, {MakeTensor(2, 3)});
+
+  tensorflow::Tensor got;
+  REVERB_ASSERT_OK(cache.UnpackChunkColumn(first, 0, &got));
+  REVERB_ASSERT_OK(cache.UnpackChunkColumn(second, 0, &got));
+  // Use `first` so that `second` becomes the least recently used.
+  REVERB_ASSERT_OK(cache.UnpackChunkColumn(first, 0, &got));
+  REVERB_ASSERT_OK(cache.UnpackChunkColumn(third, 0, &got));
+
+  auto stats = cache.stats();
+  EXPECT_EQ(stats.evictions, 1);
+  EXPECT_EQ(stats.entries, 2);
+  EXPECT_EQ(stats.bytes, 64);
+
+  REVERB_ASSERT_OK(cache.UnpackChunkColumn(first, 0, &got));
+  REVERB_ASSERT_OK(cache.UnpackChunkColumn(third, 0, &got));
+  EXPECT_EQ(cache.stats().hits, 3);
+  REVERB_ASSERT_OK(cache.UnpackChunkColumn(second, 0, &got));
+  EXPECT_EQ(cache.stats().misses, 4);
+}
+
+TEST(ChunkColumnCacheTest, DoesNotCacheColumnsLargerThanBudget) {
+  ChunkColumnCache cache(16);
+  auto tensor = MakeTensor(2, 1);
+  auto data = MakeChunkData(1, {tensor});
+
+  tensorflow::Tensor got;
+  REVERB_ASSERT_OK(cache.UnpackChunkColumn(data, 0, &got));
+  test::ExpectTensorEqual<float>(got, tensor);
+  REVERB_ASSERT_OK(cache.UnpackChunkColumn(data, 0, &got));
+
+  auto stats = cache.stats();
+  EXPECT_EQ(stats.misses, 2);
+  EXPECT_EQ(stats.entries, 0);
+  EXPECT_EQ(stats.bytes, 0);
+}
+
+TEST(ChunkColumnCacheTest, SlicesDoNotModifyCachedColumn) {
+  ChunkColumnCache cache(1 << 10);
+  auto tensor = MakeTensor(4, 1);
+  auto data = MakeChunkData(1, {tensor});
+
+  tensorflow::Tensor got;
+  REVERB_ASSERT_OK(
+      cache.UnpackChunkColumnAndSlice(data, MakeSlice(0, 1, 2), &got));
+  test::ExpectTensorEqual<float>(got, tensor.Slice(1, 3));
+  REVERB_ASSERT_OK(
+      cache.UnpackChunkColumnAndSlice(data, MakeSlice(0, 0, 4), &got));
+  test::ExpectTensorEqual<float>(got, tensor);
+  EXPECT_EQ(cache.stats().hits, 1);
+}
+
+TEST(ChunkColumnCacheTest, ReturnsErrorForInvalidColumn) {
+  ChunkColumnCache cache(1 << 10);
+  auto data = MakeChunkData(1, {MakeTensor(2, 1)});
+
+  tensorflow::Tensor got;
+  EXPECT_EQ(cache.UnpackChunkColumn(data, 1, &got).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(cache.stats().entries, 0);
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
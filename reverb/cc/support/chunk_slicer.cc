@@ -0,0 +1,122 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/chunk_slicer.h"
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/support/grpc_util.h"
+#include "reverb/cc/support/trajectory_util.h"
+#include "reverb/cc/tensor_compression.h"
+#include "tensorflow/core/framework/tensor.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+// Finalizer of SplitMix64, used to spread the row range over all the bits of
+// the derived key.
+uint64_t Mix(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+}  // namespace
+
+uint64_t SlicedChunkKey(uint64_t key, int begin, int end) {
+  const uint64_t range = (static_cast<uint64_t>(static_cast<uint32_t>(begin))
+                          << 32) |
+                         static_cast<uint32_t>(end);
+  return Mix(key ^ Mix(range));
+}
+
+absl::Status SliceChunkRows(const ChunkData& chunk, int begin, int end,
+                            ChunkData* out) {
+  if (begin < 0 || begin >= end) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Cannot slice rows [", begin, ", ", end, ") of chunk ",
+                     chunk.chunk_key(), "."));
+  }
+  if (chunk.sequence_range().sparse()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Cannot slice chunk ", chunk.chunk_key(),
+                     " as its sequence range is sparse."));
+  }
+
+  out->Clear();
+  out->set_chunk_key(SlicedChunkKey(chunk.chunk_key(), begin, end));
+  out->set_delta_encoded(chunk.delta_encoded());
+  out->set_compression_codec(chunk.compression_codec());
+
+  int64_t uncompressed_size = 0;
+  for (int i = 0; i < chunk.data().tensors_size(); i++) {
+    tensorflow::Tensor column;
+    REVERB_RETURN_IF_ERROR(UnpackChunkColumn(chunk, i, &column));
+
+    tensorflow::Tensor sliced;
+    REVERB_RETURN_IF_ERROR(
+        SliceChunkColumn(column, begin, end - begin, &sliced));
+    uncompressed_size += sliced.TotalBytes();
+
+    if (chunk.delta_encoded()) {
+      DeltaEncodeInPlace(&sliced, /*encode=*/true);
+    }
+    // All columns share the codec of the chunk so a fallback (which the
+    // original, larger, column did not need) cannot be represented.
+    if (CompressTensorAsProto(sliced, out->mutable_data()->add_tensors(),
+                              chunk.compression_codec()) !=
+        chunk.compression_codec()) {
+      return absl::InternalError(absl::StrCat(
+          "Failed to compress column ", i, " of sliced chunk ",
+          chunk.chunk_key(), " with codec ",
+          CompressionCodec_Name(chunk.compression_codec()), "."));
+    }
+  }
+  out->set_data_tensors_len(out->data().tensors_size());
+  out->set_data_uncompressed_size(uncompressed_size);
+
+  if (chunk.has_sequence_range()) {
+    SequenceRange* range = out->mutable_sequence_range();
+    range->set_episode_id(chunk.sequence_range().episode_id());
+    range->set_start(chunk.sequence_range().start() + begin);
+    range->set_end(chunk.sequence_range().start() + end - 1);
+  }
+
+  return absl::OkStatus();
+}
+
+SlicedChunkCache::SlicedChunkCache(int64_t max_bytes) : cache_(max_bytes) {}
+
+absl::StatusOr<grpc::Slice> SlicedChunkCache::GetOrSlice(
+    const ChunkData& chunk, int begin, int end) {
+  const std::tuple<uint64_t, int, int> key(chunk.chunk_key(), begin, end);
+  grpc::Slice bytes;
+  if (cache_.Lookup(key, &bytes)) {
+    return bytes;
+  }
+
+  ChunkData sliced;
+  REVERB_RETURN_IF_ERROR(SliceChunkRows(chunk, begin, end, &sliced));
+  bytes = SerializeToSlice(sliced);
+  cache_.Insert(key, bytes, bytes.size());
+  return bytes;
+}
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,82 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_CHUNK_SLICER_H_
+#define REVERB_CC_SUPPORT_CHUNK_SLICER_H_
+
+#include <cstdint>
+#include <tuple>
+
+#include "grpcpp/support/slice.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/support/byte_lru_cache.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Returns the key of the chunk which holds rows [begin, end) of chunk `key`.
+// The key is derived deterministically so that clients which cache columns by
+// chunk key (see `ChunkColumnCache`) also hit their cache for sliced chunks.
+uint64_t SlicedChunkKey(uint64_t key, int begin, int end);
+
+// Builds a chunk holding rows [begin, end) of every column of `chunk`. The
+// columns are decompressed, sliced and then delta encoded (if `chunk` was) and
+// compressed with the codec of `chunk` again. The key of the new chunk is
+// `SlicedChunkKey(chunk.chunk_key(), begin, end)`.
+//
+// Returns `InvalidArgumentError` if the range is out of bounds or if the
+// sequence range of `chunk` is sparse, in which case the episode steps of the
+// sliced rows are unknown.
+absl::Status SliceChunkRows(const ChunkData& chunk, int begin, int end,
+                            ChunkData* out);
+
+// Thread safe LRU cache of serialized chunks built by `SliceChunkRows`, keyed
+// by the key of the original chunk and the row range.
+//
+// Used on the sampling path of the server where items of a prioritized table
+// are sampled repeatedly and would otherwise have their chunks decoded and
+// re-encoded every time.
+class SlicedChunkCache {
+ private:
+  using Cache = ByteLruCache<std::tuple<uint64_t, int, int>, grpc::Slice>;
+
+ public:
+  using Stats = Cache::Stats;
+
+  // Creates a cache holding at most `max_bytes` of serialized slices. Slices
+  // larger than `max_bytes` are built but never cached.
+  explicit SlicedChunkCache(int64_t max_bytes);
+
+  // Returns the serialized result of `SliceChunkRows(chunk, begin, end)`,
+  // reusing the result of an earlier call if it is still cached.
+  absl::StatusOr<grpc::Slice> GetOrSlice(const ChunkData& chunk, int begin,
+                                         int end);
+
+  // Returns the counters and current size of the cache.
+  Stats stats() const { return cache_.stats(); }
+
+  int64_t max_bytes() const { return cache_.max_bytes(); }
+
+ private:
+  Cache cache_;
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_CHUNK_SLICER_H_
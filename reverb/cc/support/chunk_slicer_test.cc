@@ -0,0 +1,220 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/chunk_slicer.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/status_macros.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/support/trajectory_util.h"
+#include "reverb/cc/tensor_compression.h"
+#include "reverb/cc/testing/tensor_testutil.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+// Returns a tensor with `rows` rows of 4 values, i.e 16 bytes per row.
+template <typename T>
+tensorflow::Tensor MakeTensor(int rows, T value) {
+  tensorflow::Tensor tensor(tensorflow::DataTypeToEnum<T>::value,
+                            tensorflow::TensorShape({rows, 4}));
+  for (int i = 0; i < tensor.NumElements(); i++) {
+    tensor.flat<T>()(i) = value + i;
+  }
+  return tensor;
+}
+
+ChunkData MakeChunkData(uint64_t key,
+                        const std::vector<tensorflow::Tensor>& columns,
+                        bool delta_encode = false) {
+  ChunkData data;
+  data.set_chunk_key(key);
+  data.set_delta_encoded(delta_encode);
+  data.set_compression_codec(CompressionCodec::COMPRESSION_CODEC_SNAPPY);
+  int64_t uncompressed_size = 0;
+  for (const auto& column : columns) {
+    uncompressed_size += column.TotalBytes();
+    CompressTensorAsProto(delta_encode ? DeltaEncode(column, true) : column,
+                          data.mutable_data()->add_tensors(),
+                          data.compression_codec());
+  }
+  data.set_data_tensors_len(columns.size());
+  data.set_data_uncompressed_size(uncompressed_size);
+  data.mutable_sequence_range()->set_episode_id(7);
+  data.mutable_sequence_range()->set_start(100);
+  data.mutable_sequence_range()->set_end(
+      100 + columns.front().dim_size(0) - 1);
+  return data;
+}
+
+tensorflow::Tensor Unpack(const ChunkData& data, int column) {
+  tensorflow::Tensor tensor;
+  REVERB_CHECK_OK(UnpackChunkColumn(data, column, &tensor));
+  return tensor;
+}
+
+ChunkData Parse(const grpc::Slice& bytes) {
+  ChunkData data;
+  REVERB_CHECK(data.ParseFromArray(bytes.begin(), bytes.size()));
+  return data;
+}
+
+TEST(SlicedChunkKeyTest, IsDeterministicAndDependsOnRange) {
+  EXPECT_EQ(SlicedChunkKey(1, 2, 5), SlicedChunkKey(1, 2, 5));
+  EXPECT_NE(SlicedChunkKey(1, 2, 5), SlicedChunkKey(2, 2, 5));
+  EXPECT_NE(SlicedChunkKey(1, 2, 5), SlicedChunkKey(1, 3, 5));
+  EXPECT_NE(SlicedChunkKey(1, 2, 5), SlicedChunkKey(1, 2, 6));
+  EXPECT_NE(SlicedChunkKey(1, 2, 5), uint64_t{1});
+}
+
+TEST(SliceChunkRowsTest, SlicesAllColumns) {
+  auto first = MakeTensor<float>(10, 1);
+  auto second = MakeTensor<float>(10, 100);
+  auto data = MakeChunkData(1, {first, second});
+
+  ChunkData sliced;
+  REVERB_ASSERT_OK(SliceChunkRows(data, 2, 5, &sliced));
+
+  EXPECT_EQ(sliced.chunk_key(), SlicedChunkKey(1, 2, 5));
+  EXPECT_EQ(sliced.data_tensors_len(), 2);
+  EXPECT_EQ(sliced.data_uncompressed_size(), 2 * 3 * 16);
+  EXPECT_EQ(sliced.compression_codec(), data.compression_codec());
+  EXPECT_FALSE(sliced.delta_encoded());
+  EXPECT_EQ(sliced.sequence_range().episode_id(), 7);
+  EXPECT_EQ(sliced.sequence_range().start(), 102);
+  EXPECT_EQ(sliced.sequence_range().end(), 104);
+
+  test::ExpectTensorEqual<float>(Unpack(sliced, 0), first.Slice(2, 5));
+  test::ExpectTensorEqual<float>(Unpack(sliced, 1), second.Slice(2, 5));
+  EXPECT_LT(sliced.ByteSizeLong(), data.ByteSizeLong());
+}
+
+TEST(SliceChunkRowsTest, ReencodesDeltaEncodedColumns) {
+  auto column = MakeTensor<int32_t>(10, 1000);
+  auto data = MakeChunkData(1, {column}, /*delta_encode=*/true);
+
+  ChunkData sliced;
+  REVERB_ASSERT_OK(SliceChunkRows(data, 4, 10, &sliced));
+
+  EXPECT_TRUE(sliced.delta_encoded());
+  test::ExpectTensorEqual<int32_t>(Unpack(sliced, 0), column.Slice(4, 10));
+}
+
+TEST(SliceChunkRowsTest, RejectsInvalidRange) {
+  auto data = MakeChunkData(1, {MakeTensor<float>(10, 1)});
+  ChunkData sliced;
+  EXPECT_EQ(SliceChunkRows(data, -1, 5, &sliced).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(SliceChunkRows(data, 5, 5, &sliced).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(SliceChunkRows(data, 5, 11, &sliced).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(SliceChunkRowsTest, RejectsSparseChunk) {
+  auto data = MakeChunkData(1, {MakeTensor<float>(10, 1)});
+  data.mutable_sequence_range()->set_sparse(true);
+  ChunkData sliced;
+  EXPECT_EQ(SliceChunkRows(data, 2, 5, &sliced).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(SlicedChunkCacheTest, ReturnsCachedSlice) {
+  SlicedChunkCache cache(1 << 20);
+  auto column = MakeTensor<float>(10, 1);
+  auto data = MakeChunkData(1, {column});
+
+  auto first_or = cache.GetOrSlice(data, 2, 5);
+  REVERB_ASSERT_OK(first_or.status());
+  auto second_or = cache.GetOrSlice(data, 2, 5);
+  REVERB_ASSERT_OK(second_or.status());
+  auto other_or = cache.GetOrSlice(data, 3, 5);
+  REVERB_ASSERT_OK(other_or.status());
+
+  // The cached bytes are shared rather than copied.
+  EXPECT_EQ(first_or->begin(), second_or->begin());
+  test::ExpectTensorEqual<float>(Unpack(Parse(*first_or), 0),
+                                 column.Slice(2, 5));
+  test::ExpectTensorEqual<float>(Unpack(Parse(*other_or), 0),
+                                 column.Slice(3, 5));
+
+  auto stats = cache.stats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 2);
+  EXPECT_EQ(stats.evictions, 0);
+  EXPECT_EQ(stats.entries, 2);
+  EXPECT_EQ(stats.bytes, first_or->size() + other_or->size());
+}
+
+TEST(SlicedChunkCacheTest, EvictsLeastRecentlyUsed) {
+  auto first = MakeChunkData(1, {MakeTensor<float>(10, 1)});
+  auto second = MakeChunkData(2, {MakeTensor<float>(10, 1)});
+  auto third = MakeChunkData(3, {MakeTensor<float>(10, 1)});
+
+  // Figure out the size of a single slice so the cache fits two but not three.
+  // The slices only differ in their (varint encoded) keys.
+  SlicedChunkCache probe(1 << 20);
+  REVERB_ASSERT_OK(probe.GetOrSlice(first, 0, 5).status());
+  SlicedChunkCache cache(5 * probe.stats().bytes / 2);
+
+  REVERB_ASSERT_OK(cache.GetOrSlice(first, 0, 5).status());
+  REVERB_ASSERT_OK(cache.GetOrSlice(second, 0, 5).status());
+  REVERB_ASSERT_OK(cache.GetOrSlice(first, 0, 5).status());
+  REVERB_ASSERT_OK(cache.GetOrSlice(third, 0, 5).status());
+  EXPECT_EQ(cache.stats().evictions, 1);
+  EXPECT_EQ(cache.stats().entries, 2);
+
+  // `second` was the least recently used so it must be sliced again.
+  REVERB_ASSERT_OK(cache.GetOrSlice(first, 0, 5).status());
+  EXPECT_EQ(cache.stats().hits, 2);
+  REVERB_ASSERT_OK(cache.GetOrSlice(second, 0, 5).status());
+  EXPECT_EQ(cache.stats().hits, 2);
+}
+
+TEST(SlicedChunkCacheTest, DoesNotCacheSlicesLargerThanBudget) {
+  SlicedChunkCache cache(1);
+  auto data = MakeChunkData(1, {MakeTensor<float>(10, 1)});
+
+  REVERB_ASSERT_OK(cache.GetOrSlice(data, 2, 5).status());
+  REVERB_ASSERT_OK(cache.GetOrSlice(data, 2, 5).status());
+
+  auto stats = cache.stats();
+  EXPECT_EQ(stats.hits, 0);
+  EXPECT_EQ(stats.misses, 2);
+  EXPECT_EQ(stats.entries, 0);
+}
+
+TEST(SlicedChunkCacheTest, PropagatesErrors) {
+  SlicedChunkCache cache(1 << 20);
+  auto data = MakeChunkData(1, {MakeTensor<float>(10, 1)});
+  EXPECT_EQ(cache.GetOrSlice(data, 5, 20).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(cache.stats().entries, 0);
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,226 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/delta_kernels.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define REVERB_DELTA_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+// Signature of a kernel applied to a single row: out = a - b or out = a + b.
+template <typename T>
+using RowFn = void (*)(const T* a, const T* b, T* out, int64_t n);
+
+template <typename T>
+void SubRowScalar(const T* a, const T* b, T* out, int64_t n) {
+  for (int64_t j = 0; j < n; j++) {
+    out[j] = static_cast<T>(a[j] - b[j]);
+  }
+}
+
+template <typename T>
+void AddRowScalar(const T* a, const T* b, T* out, int64_t n) {
+  for (int64_t j = 0; j < n; j++) {
+    out[j] = static_cast<T>(a[j] + b[j]);
+  }
+}
+
+#ifdef REVERB_DELTA_KERNELS_X86
+
+#define REVERB_TARGET_AVX2 __attribute__((target("avx2")))
+
+// Lane-wise integer arithmetic for each element width. SSE2 is part of the
+// x86-64 baseline so it needs no target attribute.
+template <typename T>
+struct SimdOps;
+
+#define REVERB_DEFINE_SIMD_OPS(T, BITS)                               \
+  template <>                                                         \
+  struct SimdOps<T> {                                                 \
+    static __m128i Sub(__m128i a, __m128i b) {                        \
+      return _mm_sub_epi##BITS(a, b);                                 \
+    }                                                                 \
+    static __m128i Add(__m128i a, __m128i b) {                        \
+      return _mm_add_epi##BITS(a, b);                                 \
+    }                                                                 \
+    REVERB_TARGET_AVX2 static __m256i Sub(__m256i a, __m256i b) {     \
+      return _mm256_sub_epi##BITS(a, b);                              \
+    }                                                                 \
+    REVERB_TARGET_AVX2 static __m256i Add(__m256i a, __m256i b) {     \
+      return _mm256_add_epi##BITS(a, b);                              \
+    }                                                                 \
+  };
+
+REVERB_DEFINE_SIMD_OPS(uint8_t, 8)
+REVERB_DEFINE_SIMD_OPS(uint16_t, 16)
+REVERB_DEFINE_SIMD_OPS(uint32_t, 32)
+REVERB_DEFINE_SIMD_OPS(uint64_t, 64)
+
+#undef REVERB_DEFINE_SIMD_OPS
+
+template <typename T, bool kSubtract>
+void RowSse2(const T* a, const T* b, T* out, int64_t n) {
+  constexpr int64_t kLanes = sizeof(__m128i) / sizeof(T);
+  int64_t j = 0;
+  for (; j + kLanes <= n; j += kLanes) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + j));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+    __m128i vo = kSubtract ? SimdOps<T>::Sub(va, vb) : SimdOps<T>::Add(va, vb);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j), vo);
+  }
+  if (kSubtract) {
+    SubRowScalar(a + j, b + j, out + j, n - j);
+  } else {
+    AddRowScalar(a + j, b + j, out + j, n - j);
+  }
+}
+
+template <typename T, bool kSubtract>
+REVERB_TARGET_AVX2 void RowAvx2(const T* a, const T* b, T* out, int64_t n) {
+  constexpr int64_t kLanes = sizeof(__m256i) / sizeof(T);
+  int64_t j = 0;
+  // Two vectors per iteration to hide the latency of the loads.
+  for (; j + 2 * kLanes <= n; j += 2 * kLanes) {
+    const auto* pa = reinterpret_cast<const __m256i*>(a + j);
+    const auto* pb = reinterpret_cast<const __m256i*>(b + j);
+    auto* po = reinterpret_cast<__m256i*>(out + j);
+    __m256i va0 = _mm256_loadu_si256(pa);
+    __m256i va1 = _mm256_loadu_si256(pa + 1);
+    __m256i vb0 = _mm256_loadu_si256(pb);
+    __m256i vb1 = _mm256_loadu_si256(pb + 1);
+    if (kSubtract) {
+      _mm256_storeu_si256(po, SimdOps<T>::Sub(va0, vb0));
+      _mm256_storeu_si256(po + 1, SimdOps<T>::Sub(va1, vb1));
+    } else {
+      _mm256_storeu_si256(po, SimdOps<T>::Add(va0, vb0));
+      _mm256_storeu_si256(po + 1, SimdOps<T>::Add(va1, vb1));
+    }
+  }
+  for (; j + kLanes <= n; j += kLanes) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + j));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+    __m256i vo = kSubtract ? SimdOps<T>::Sub(va, vb) : SimdOps<T>::Add(va, vb);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j), vo);
+  }
+  if (kSubtract) {
+    SubRowScalar(a + j, b + j, out + j, n - j);
+  } else {
+    AddRowScalar(a + j, b + j, out + j, n - j);
+  }
+}
+
+bool CpuSupportsAvx2() {
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+}
+
+template <typename T>
+RowFn<T> SubRowFn() {
+  return CpuSupportsAvx2() ? &RowAvx2<T, true> : &RowSse2<T, true>;
+}
+
+template <typename T>
+RowFn<T> AddRowFn() {
+  return CpuSupportsAvx2() ? &RowAvx2<T, false> : &RowSse2<T, false>;
+}
+
+#else  // REVERB_DELTA_KERNELS_X86
+
+template <typename T>
+RowFn<T> SubRowFn() {
+  return &SubRowScalar<T>;
+}
+
+template <typename T>
+RowFn<T> AddRowFn() {
+  return &AddRowScalar<T>;
+}
+
+#endif  // REVERB_DELTA_KERNELS_X86
+
+template <typename T>
+void EncodeRows(RowFn<T> sub, const T* src, T* dst, int64_t rows,
+                int64_t cols) {
+  if (rows <= 0 || cols <= 0) return;
+  // Iterate backwards so that `src[i - 1]` is still unmodified when `src` and
+  // `dst` are the same buffer.
+  for (int64_t i = rows - 1; i > 0; i--) {
+    sub(src + i * cols, src + (i - 1) * cols, dst + i * cols, cols);
+  }
+  if (src != dst) {
+    std::memcpy(dst, src, cols * sizeof(T));
+  }
+}
+
+template <typename T>
+void DecodeRows(RowFn<T> add, const T* src, T* dst, int64_t rows,
+                int64_t cols) {
+  if (rows <= 0 || cols <= 0) return;
+  if (src != dst) {
+    std::memcpy(dst, src, cols * sizeof(T));
+  }
+  for (int64_t i = 1; i < rows; i++) {
+    add(src + i * cols, dst + (i - 1) * cols, dst + i * cols, cols);
+  }
+}
+
+}  // namespace
+
+template <typename T>
+void DeltaEncodeRows(const T* src, T* dst, int64_t rows, int64_t cols) {
+  static const RowFn<T> sub = SubRowFn<T>();
+  EncodeRows(sub, src, dst, rows, cols);
+}
+
+template <typename T>
+void DeltaDecodeRows(const T* src, T* dst, int64_t rows, int64_t cols) {
+  static const RowFn<T> add = AddRowFn<T>();
+  DecodeRows(add, src, dst, rows, cols);
+}
+
+template <typename T>
+void DeltaEncodeRowsScalar(const T* src, T* dst, int64_t rows, int64_t cols) {
+  EncodeRows(&SubRowScalar<T>, src, dst, rows, cols);
+}
+
+template <typename T>
+void DeltaDecodeRowsScalar(const T* src, T* dst, int64_t rows, int64_t cols) {
+  DecodeRows(&AddRowScalar<T>, src, dst, rows, cols);
+}
+
+#define REVERB_INSTANTIATE_DELTA_KERNELS(T)                                    \
+  template void DeltaEncodeRows<T>(const T*, T*, int64_t, int64_t);            \
+  template void DeltaDecodeRows<T>(const T*, T*, int64_t, int64_t);            \
+  template void DeltaEncodeRowsScalar<T>(const T*, T*, int64_t, int64_t);      \
+  template void DeltaDecodeRowsScalar<T>(const T*, T*, int64_t, int64_t);
+
+REVERB_INSTANTIATE_DELTA_KERNELS(uint8_t)
+REVERB_INSTANTIATE_DELTA_KERNELS(uint16_t)
+REVERB_INSTANTIATE_DELTA_KERNELS(uint32_t)
+REVERB_INSTANTIATE_DELTA_KERNELS(uint64_t)
+
+#undef REVERB_INSTANTIATE_DELTA_KERNELS
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,55 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_DELTA_KERNELS_H_
+#define REVERB_CC_SUPPORT_DELTA_KERNELS_H_
+
+#include <cstdint>
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Kernels used by `DeltaEncode` (see tensor_compression.h). They operate on a
+// row-major matrix of `rows` x `cols` unsigned integers where each row holds
+// one timestep:
+//
+//   Encode: dst[i] = src[i] - src[i - 1]
+//   Decode: dst[i] = src[i] + dst[i - 1]
+//
+// with the first row copied as is. Arithmetic wraps around. `src` and `dst` may
+// either be the same buffer (in-place) or not overlap at all.
+//
+// The kernels are instantiated for uint8_t, uint16_t, uint32_t and uint64_t.
+// On x86-64 the AVX2 or SSE2 implementation is selected at runtime based on
+// the capabilities of the CPU.
+template <typename T>
+void DeltaEncodeRows(const T* src, T* dst, int64_t rows, int64_t cols);
+
+template <typename T>
+void DeltaDecodeRows(const T* src, T* dst, int64_t rows, int64_t cols);
+
+// Portable implementations of the kernels above. Exposed for testing and
+// benchmarking.
+template <typename T>
+void DeltaEncodeRowsScalar(const T* src, T* dst, int64_t rows, int64_t cols);
+
+template <typename T>
+void DeltaDecodeRowsScalar(const T* src, T* dst, int64_t rows, int64_t cols);
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_DELTA_KERNELS_H_
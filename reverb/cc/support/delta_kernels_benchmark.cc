@@ -0,0 +1,89 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "reverb/cc/support/delta_kernels.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+// Each row is one timestep of a stack of four 84x84 uint8 frames (i.e the
+// observation of an Atari agent). The batch size is the number of timesteps.
+constexpr int64_t kFrameStackBytes = 4 * 84 * 84;
+
+template <typename T>
+std::vector<T> MakeRows(int64_t rows, int64_t cols) {
+  std::vector<T> values(rows * cols);
+  for (int64_t i = 0; i < values.size(); i++) {
+    values[i] = static_cast<T>(i * 2654435761u);
+  }
+  return values;
+}
+
+template <typename T, void (*Kernel)(const T*, T*, int64_t, int64_t)>
+void BM_DeltaKernel(benchmark::State& state) {
+  const int64_t rows = state.range(0);
+  const int64_t cols = kFrameStackBytes / sizeof(T);
+  auto src = MakeRows<T>(rows, cols);
+  std::vector<T> dst(src.size());
+  for (auto _ : state) {
+    Kernel(src.data(), dst.data(), rows, cols);
+    benchmark::DoNotOptimize(dst.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * src.size() * sizeof(T));
+}
+
+template <typename T, void (*Kernel)(const T*, T*, int64_t, int64_t)>
+void BM_DeltaKernelInPlace(benchmark::State& state) {
+  const int64_t rows = state.range(0);
+  const int64_t cols = kFrameStackBytes / sizeof(T);
+  auto data = MakeRows<T>(rows, cols);
+  for (auto _ : state) {
+    Kernel(data.data(), data.data(), rows, cols);
+    benchmark::DoNotOptimize(data.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * data.size() * sizeof(T));
+}
+
+#define REVERB_DELTA_BENCHMARKS(T)                                          \
+  BENCHMARK_TEMPLATE(BM_DeltaKernel, T, DeltaEncodeRowsScalar<T>)           \
+      ->Arg(1)->Arg(16)->Arg(64);                                           \
+  BENCHMARK_TEMPLATE(BM_DeltaKernel, T, DeltaEncodeRows<T>)                 \
+      ->Arg(1)->Arg(16)->Arg(64);                                           \
+  BENCHMARK_TEMPLATE(BM_DeltaKernel, T, DeltaDecodeRowsScalar<T>)           \
+      ->Arg(1)->Arg(16)->Arg(64);                                           \
+  BENCHMARK_TEMPLATE(BM_DeltaKernel, T, DeltaDecodeRows<T>)                 \
+      ->Arg(1)->Arg(16)->Arg(64);                                           \
+  BENCHMARK_TEMPLATE(BM_DeltaKernelInPlace, T, DeltaEncodeRowsScalar<T>)    \
+      ->Arg(16);                                                            \
+  BENCHMARK_TEMPLATE(BM_DeltaKernelInPlace, T, DeltaEncodeRows<T>)->Arg(16);
+
+REVERB_DELTA_BENCHMARKS(uint8_t)
+REVERB_DELTA_BENCHMARKS(uint16_t)
+REVERB_DELTA_BENCHMARKS(uint32_t)
+REVERB_DELTA_BENCHMARKS(uint64_t)
+
+#undef REVERB_DELTA_BENCHMARKS
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,97 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/delta_kernels.h"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/random/random.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+using ::testing::ElementsAreArray;
+
+template <typename T>
+class DeltaKernelsTest : public ::testing::Test {};
+
+using UnsignedTypes = ::testing::Types<uint8_t, uint16_t, uint32_t, uint64_t>;
+TYPED_TEST_SUITE(DeltaKernelsTest, UnsignedTypes);
+
+template <typename T>
+std::vector<T> RandomValues(int64_t size) {
+  absl::BitGen gen;
+  std::vector<T> values(size);
+  for (auto& value : values) {
+    value = absl::Uniform<T>(absl::IntervalClosed, gen, 0,
+                             std::numeric_limits<T>::max());
+  }
+  return values;
+}
+
+TYPED_TEST(DeltaKernelsTest, MatchesScalarForAllShapes) {
+  using T = TypeParam;
+  // Column counts chosen to exercise full vectors as well as the scalar tail.
+  for (int64_t rows : {1, 2, 7}) {
+    for (int64_t cols : {1, 3, 16, 33, 64, 100}) {
+      auto src = RandomValues<T>(rows * cols);
+      std::vector<T> expected(src.size());
+      std::vector<T> actual(src.size());
+
+      DeltaEncodeRowsScalar(src.data(), expected.data(), rows, cols);
+      DeltaEncodeRows(src.data(), actual.data(), rows, cols);
+      EXPECT_THAT(actual, ElementsAreArray(expected));
+
+      DeltaDecodeRowsScalar(expected.data(), expected.data(), rows, cols);
+      DeltaDecodeRows(actual.data(), actual.data(), rows, cols);
+      EXPECT_THAT(actual, ElementsAreArray(expected));
+      EXPECT_THAT(actual, ElementsAreArray(src));
+    }
+  }
+}
+
+TYPED_TEST(DeltaKernelsTest, InPlaceMatchesOutOfPlace) {
+  using T = TypeParam;
+  const int64_t rows = 5;
+  const int64_t cols = 37;
+  auto src = RandomValues<T>(rows * cols);
+
+  std::vector<T> out_of_place(src.size());
+  DeltaEncodeRows(src.data(), out_of_place.data(), rows, cols);
+
+  std::vector<T> in_place = src;
+  DeltaEncodeRows(in_place.data(), in_place.data(), rows, cols);
+  EXPECT_THAT(in_place, ElementsAreArray(out_of_place));
+
+  DeltaDecodeRows(in_place.data(), in_place.data(), rows, cols);
+  EXPECT_THAT(in_place, ElementsAreArray(src));
+}
+
+TEST(DeltaKernelsTest, EncodingWrapsAround) {
+  std::vector<uint8_t> src = {200, 10, 5, 255};
+  std::vector<uint8_t> encoded(src.size());
+  DeltaEncodeRows(src.data(), encoded.data(), /*rows=*/4, /*cols=*/1);
+  EXPECT_THAT(encoded, ElementsAreArray({200, 66, 251, 250}));
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
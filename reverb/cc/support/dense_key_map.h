@@ -0,0 +1,214 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef REVERB_CC_SUPPORT_DENSE_KEY_MAP_H_
+#define REVERB_CC_SUPPORT_DENSE_KEY_MAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "reverb/cc/platform/hash_map.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Map from (mostly) monotonically increasing keys to values. Recent keys are
+// stored in a ring buffer indexed by `key & mask` so lookups, inserts and
+// erases are array operations with good locality when keys are inserted in
+// increasing order and erased roughly in the same order (e.g a FIFO queue).
+//
+// The ring covers the window [head, tail) of keys where `head` is the oldest
+// key held by the ring. When a new key does not fit the window the ring is
+// doubled if it is at least half full, otherwise the oldest key is moved to a
+// hash map of stragglers. Keys older than the window, or too far ahead of it,
+// are stored with the stragglers directly. The ring thus never grows beyond
+// twice the number of keys it holds, keys which are erased out of order don't
+// pin memory, and arbitrary (e.g random) keys are supported at the cost of a
+// hash map lookup.
+//
+// The object is not thread safe.
+template <typename T>
+class DenseKeyMap {
+ public:
+  using Key = uint64_t;
+
+  DenseKeyMap() { Reserve(kMinCapacity); }
+
+  // Returns nullptr if `key` is not present. The pointer is invalidated by
+  // subsequent calls to `Insert` and `Clear`.
+  const T* Find(Key key) const {
+    if (InRing(key)) return &slots_[key & mask_];
+    if (stragglers_.empty()) return nullptr;
+    auto it = stragglers_.find(key);
+    return it == stragglers_.end() ? nullptr : &it->second;
+  }
+
+  T* Find(Key key) {
+    return const_cast<T*>(std::as_const(*this).Find(key));
+  }
+
+  bool Contains(Key key) const { return Find(key) != nullptr; }
+
+  // Returns false without modifying the map if `key` is already present.
+  bool Insert(Key key, T value) {
+    if (Contains(key)) return false;
+    if (ring_size_ == 0) {
+      head_ = key;
+      tail_ = key;
+    }
+    // Keys far ahead of the window are stragglers too as moving the window
+    // would spill every key which it currently holds. Keys within the window
+    // (e.g re-inserted after being erased) are put back into their slot.
+    if (key < head_ || (key >= tail_ && key - tail_ >= slots_.size())) {
+      stragglers_.emplace(key, std::move(value));
+      return true;
+    }
+    while (key - head_ >= slots_.size()) {
+      if (2 * (ring_size_ + 1) > slots_.size()) {
+        Reserve(2 * slots_.size());
+      } else {
+        SpillHead();
+        if (ring_size_ == 0) {
+          head_ = key;
+          tail_ = key;
+        }
+      }
+    }
+    slots_[key & mask_] = std::move(value);
+    SetOccupied(key, true);
+    ring_size_++;
+    if (key >= tail_) tail_ = key + 1;
+    return true;
+  }
+
+  // Returns false if `key` is not present.
+  bool Erase(Key key) {
+    if (!InRing(key)) return stragglers_.erase(key) > 0;
+    slots_[key & mask_] = T();
+    SetOccupied(key, false);
+    ring_size_--;
+    if (key == head_) AdvanceHead();
+    return true;
+  }
+
+  // Calls `fn(key, value)` for every entry. Keys held by the ring are visited
+  // in increasing order after the stragglers (which are visited in no
+  // particular order).
+  template <typename F>
+  void ForEach(F fn) const {
+    for (const auto& entry : stragglers_) {
+      fn(entry.first, entry.second);
+    }
+    for (Key key = head_; key < tail_; key++) {
+      if (IsOccupied(key)) fn(key, slots_[key & mask_]);
+    }
+  }
+
+  size_t size() const { return ring_size_ + stragglers_.size(); }
+  bool empty() const { return size() == 0; }
+
+  void Clear() {
+    slots_.clear();
+    occupied_.clear();
+    stragglers_.clear();
+    ring_size_ = 0;
+    head_ = 0;
+    tail_ = 0;
+    Reserve(kMinCapacity);
+  }
+
+  // Number of slots in the ring and number of keys held outside of it. Exposed
+  // for testing.
+  size_t capacity() const { return slots_.size(); }
+  size_t num_stragglers() const { return stragglers_.size(); }
+
+ private:
+  static constexpr size_t kMinCapacity = 64;
+
+  bool InRing(Key key) const {
+    return key >= head_ && key < tail_ && IsOccupied(key);
+  }
+
+  bool IsOccupied(Key key) const {
+    const Key slot = key & mask_;
+    return (occupied_[slot / 64] >> (slot % 64)) & 1;
+  }
+
+  void SetOccupied(Key key, bool value) {
+    const Key slot = key & mask_;
+    if (value) {
+      occupied_[slot / 64] |= uint64_t{1} << (slot % 64);
+    } else {
+      occupied_[slot / 64] &= ~(uint64_t{1} << (slot % 64));
+    }
+  }
+
+  // Moves the keys of the ring into a buffer with `capacity` slots, which must
+  // be a power of two no smaller than the window.
+  void Reserve(size_t capacity) {
+    std::vector<T> slots(capacity);
+    std::vector<uint64_t> occupied((capacity + 63) / 64, 0);
+    const Key mask = capacity - 1;
+    for (Key key = head_; key < tail_ && ring_size_ > 0; key++) {
+      if (!IsOccupied(key)) continue;
+      slots[key & mask] = std::move(slots_[key & mask_]);
+      occupied[(key & mask) / 64] |= uint64_t{1} << ((key & mask) % 64);
+    }
+    slots_ = std::move(slots);
+    occupied_ = std::move(occupied);
+    mask_ = mask;
+  }
+
+  // Moves the oldest key of the ring to the stragglers.
+  void SpillHead() {
+    stragglers_.emplace(head_, std::move(slots_[head_ & mask_]));
+    slots_[head_ & mask_] = T();
+    SetOccupied(head_, false);
+    ring_size_--;
+    AdvanceHead();
+  }
+
+  // Moves `head_` forward to the oldest key still held by the ring.
+  void AdvanceHead() {
+    if (ring_size_ == 0) {
+      head_ = tail_;
+      return;
+    }
+    while (!IsOccupied(head_)) head_++;
+  }
+
+  // Keys in [head_, tail_) which are held by the ring are stored in
+  // `slots_[key & mask_]` and have their bit in `occupied_` set. `head_` is
+  // always occupied unless the ring is empty.
+  std::vector<T> slots_;
+  std::vector<uint64_t> occupied_;
+  Key mask_ = 0;
+  Key head_ = 0;
+  Key tail_ = 0;
+  size_t ring_size_ = 0;
+
+  // Keys which are not held by the ring, either because they were older than
+  // `head_` when inserted or because they were spilled from the ring.
+  internal::flat_hash_map<Key, T> stragglers_;
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_DENSE_KEY_MAP_H_
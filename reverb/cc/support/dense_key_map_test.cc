@@ -0,0 +1,192 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "reverb/cc/support/dense_key_map.h"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/random/random.h"
+#include "reverb/cc/platform/hash_map.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::UnorderedElementsAreArray;
+
+std::vector<uint64_t> Keys(const DenseKeyMap<int>& map) {
+  std::vector<uint64_t> keys;
+  map.ForEach([&keys](uint64_t key, int) { keys.push_back(key); });
+  return keys;
+}
+
+TEST(DenseKeyMapTest, InsertFindErase) {
+  DenseKeyMap<int> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.Insert(10, 100));
+  EXPECT_TRUE(map.Insert(11, 110));
+  EXPECT_FALSE(map.Insert(10, 0));
+  EXPECT_EQ(map.size(), 2);
+
+  ASSERT_NE(map.Find(10), nullptr);
+  EXPECT_EQ(*map.Find(10), 100);
+  EXPECT_EQ(map.Find(12), nullptr);
+  EXPECT_EQ(map.Find(9), nullptr);
+
+  *map.Find(11) = 111;
+  EXPECT_EQ(*map.Find(11), 111);
+
+  EXPECT_TRUE(map.Erase(10));
+  EXPECT_FALSE(map.Erase(10));
+  EXPECT_FALSE(map.Contains(10));
+  EXPECT_TRUE(map.Contains(11));
+  EXPECT_EQ(map.size(), 1);
+}
+
+TEST(DenseKeyMapTest, FifoDoesNotGrowBeyondWindow) {
+  DenseKeyMap<int> map;
+  const size_t initial_capacity = map.capacity();
+  for (uint64_t key = 0; key < 100000; key++) {
+    ASSERT_TRUE(map.Insert(key, key));
+    if (map.size() > 40) {
+      ASSERT_TRUE(map.Erase(key - 40));
+    }
+  }
+  EXPECT_EQ(map.size(), 40);
+  EXPECT_EQ(map.capacity(), initial_capacity);
+  EXPECT_EQ(map.num_stragglers(), 0);
+}
+
+TEST(DenseKeyMapTest, GrowsWhenDense) {
+  DenseKeyMap<int> map;
+  for (uint64_t key = 0; key < 1000; key++) {
+    ASSERT_TRUE(map.Insert(key, key));
+  }
+  EXPECT_GE(map.capacity(), 1000);
+  EXPECT_EQ(map.num_stragglers(), 0);
+  for (uint64_t key = 0; key < 1000; key++) {
+    ASSERT_NE(map.Find(key), nullptr);
+    EXPECT_EQ(*map.Find(key), key);
+  }
+}
+
+TEST(DenseKeyMapTest, OldKeysAreSpilled) {
+  DenseKeyMap<int> map;
+  // Key 0 is never erased so the window would grow forever unless it is moved
+  // out of the ring.
+  ASSERT_TRUE(map.Insert(0, -1));
+  for (uint64_t key = 1; key < 10000; key++) {
+    ASSERT_TRUE(map.Insert(key, key));
+    if (key > 10) {
+      ASSERT_TRUE(map.Erase(key - 10));
+    }
+  }
+  EXPECT_EQ(map.size(), 11);
+  EXPECT_EQ(map.num_stragglers(), 1);
+  EXPECT_LE(map.capacity(), 64);
+  ASSERT_NE(map.Find(0), nullptr);
+  EXPECT_EQ(*map.Find(0), -1);
+  EXPECT_TRUE(map.Erase(0));
+  EXPECT_EQ(map.num_stragglers(), 0);
+}
+
+TEST(DenseKeyMapTest, ReinsertedKeysWithinWindowStayInRing) {
+  DenseKeyMap<int> map;
+  for (uint64_t key = 0; key < 10; key++) {
+    ASSERT_TRUE(map.Insert(key, key));
+  }
+  ASSERT_TRUE(map.Erase(5));
+  ASSERT_TRUE(map.Insert(5, 50));
+  EXPECT_EQ(map.num_stragglers(), 0);
+  ASSERT_NE(map.Find(5), nullptr);
+  EXPECT_EQ(*map.Find(5), 50);
+  EXPECT_THAT(Keys(map), ElementsAre(0, 1, 2, 3, 4, 5, 6, 7, 8, 9));
+}
+
+TEST(DenseKeyMapTest, ForEachVisitsRingInKeyOrder) {
+  DenseKeyMap<int> map;
+  for (uint64_t key = 5; key < 10; key++) {
+    ASSERT_TRUE(map.Insert(key, key));
+  }
+  ASSERT_TRUE(map.Erase(7));
+  ASSERT_TRUE(map.Insert(3, 3));  // Older than the ring.
+  EXPECT_THAT(Keys(map), ElementsAre(3, 5, 6, 8, 9));
+}
+
+TEST(DenseKeyMapTest, Clear) {
+  DenseKeyMap<int> map;
+  for (uint64_t key = 0; key < 1000; key++) {
+    ASSERT_TRUE(map.Insert(key, key));
+  }
+  map.Clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.Find(1), nullptr);
+  EXPECT_TRUE(Keys(map).empty());
+  EXPECT_TRUE(map.Insert(1, 1));
+  EXPECT_EQ(*map.Find(1), 1);
+}
+
+TEST(DenseKeyMapTest, ReleasesErasedValues) {
+  DenseKeyMap<std::shared_ptr<int>> map;
+  auto value = std::make_shared<int>(1);
+  ASSERT_TRUE(map.Insert(1, value));
+  EXPECT_EQ(value.use_count(), 2);
+  ASSERT_TRUE(map.Erase(1));
+  EXPECT_EQ(value.use_count(), 1);
+}
+
+TEST(DenseKeyMapTest, MatchesHashMapWithRandomOperations) {
+  DenseKeyMap<int> map;
+  internal::flat_hash_map<uint64_t, int> expected;
+  absl::BitGen gen;
+  uint64_t next_key = 0;
+  for (int i = 0; i < 20000; i++) {
+    const int op = absl::Uniform(gen, 0, 10);
+    if (op < 5) {
+      // Mostly sequential keys with an occasional random one.
+      const uint64_t key = absl::Bernoulli(gen, 0.01)
+                               ? absl::Uniform<uint64_t>(gen)
+                               : next_key++;
+      EXPECT_EQ(map.Insert(key, i), expected.emplace(key, i).second);
+    } else if (!expected.empty()) {
+      // Mostly erase old keys.
+      const uint64_t key = absl::Bernoulli(gen, 0.8)
+                               ? next_key - absl::Uniform(gen, 0u, 200u)
+                               : absl::Uniform<uint64_t>(gen, 0, next_key + 1);
+      EXPECT_EQ(map.Erase(key), expected.erase(key) > 0);
+    }
+    ASSERT_EQ(map.size(), expected.size());
+  }
+  for (const auto& [key, value] : expected) {
+    ASSERT_NE(map.Find(key), nullptr);
+    EXPECT_EQ(*map.Find(key), value);
+  }
+  std::vector<uint64_t> expected_keys;
+  for (const auto& entry : expected) expected_keys.push_back(entry.first);
+  EXPECT_THAT(Keys(map), UnorderedElementsAreArray(expected_keys));
+  EXPECT_LE(map.capacity(), std::max<size_t>(64, 4 * map.size()));
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
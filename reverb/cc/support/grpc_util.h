@@ -17,12 +17,15 @@
 
 #include <string>
 
+#include "google/protobuf/message_lite.h"
 #include "grpcpp/grpcpp.h"
 #include "grpcpp/impl/codegen/proto_utils.h"
+#include "grpcpp/support/slice.h"
 #include "grpcpp/support/status.h"
 #include "absl/status/status.h"
 #include "absl/strings/match.h"
 #include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
 #include "absl/strings/substitute.h"
 
 namespace deepmind {
@@ -66,6 +69,18 @@ inline std::string FormatGrpcStatus(const grpc::Status& s) {
   return absl::Substitute("[$0] $1", s.error_code(), s.error_message());
 }
 
+// Serializes `message` into a new slice which takes ownership of the
+// serialized bytes (i.e they are not copied into gRPC owned memory).
+inline grpc::Slice SerializeToSlice(
+    const google::protobuf::MessageLite& message) {
+  auto* bytes = new std::string();
+  message.SerializeToString(bytes);
+  return grpc::Slice(
+      bytes->data(), bytes->size(),
+      [](void* user_data) { delete static_cast<std::string*>(user_data); },
+      bytes);
+}
+
 // The hostname from gRPC is URL encoded.
 inline bool IsLocalhostOrInProcess(absl::string_view hostname) {
   return absl::StrContains(hostname, ":127.0.0.1:") ||
@@ -73,6 +88,28 @@ inline bool IsLocalhostOrInProcess(absl::string_view hostname) {
          hostname.empty();
 }
 
+// Returns true if `peer`, as returned by `grpc::ServerContext::peer`, is a
+// loopback address, a unix domain socket or an in-process channel. Unlike
+// `IsLocalhostOrInProcess`, only the address of IP peers is inspected so e.g
+// "ipv6:[2001:db8::1]:1234" is not considered to be local.
+inline bool IsLoopbackOrInProcess(absl::string_view peer) {
+  if (peer.empty() || peer == "unknown" || absl::StartsWith(peer, "inproc") ||
+      absl::StartsWith(peer, "unix:") ||
+      absl::StartsWith(peer, "unix-abstract:")) {
+    return true;
+  }
+  if (absl::ConsumePrefix(&peer, "ipv4:")) {
+    return absl::StartsWith(peer, "127.");
+  }
+  if (absl::ConsumePrefix(&peer, "ipv6:")) {
+    // The brackets around the address may be URL encoded.
+    if (!absl::ConsumePrefix(&peer, "[")) absl::ConsumePrefix(&peer, "%5B");
+    return absl::StartsWith(peer, "::1]") || absl::StartsWith(peer, "::1%5D") ||
+           absl::StartsWith(peer, "::ffff:127.");
+  }
+  return false;
+}
+
 }  // namespace reverb
 }  // namespace deepmind
 
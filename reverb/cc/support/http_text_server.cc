@@ -0,0 +1,176 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/http_text_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "reverb/cc/platform/logging.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+// How often the serving thread checks whether it should stop.
+constexpr int kPollIntervalMs = 100;
+
+// Requests are small so anything larger is rejected.
+constexpr size_t kMaxRequestSize = 8192;
+
+// Clients which are slower than this are disconnected.
+constexpr int kIoTimeoutSeconds = 5;
+
+absl::Status ErrnoToStatus(absl::string_view what) {
+  return absl::InternalError(
+      absl::StrCat(what, " failed: ", std::strerror(errno)));
+}
+
+void WriteAll(int fd, absl::string_view data) {
+  while (!data.empty()) {
+    const ssize_t written = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    data.remove_prefix(written);
+  }
+}
+
+std::string MakeResponse(absl::string_view status, absl::string_view body) {
+  return absl::StrCat("HTTP/1.0 ", status,
+                      "\r\nContent-Type: text/plain; version=0.0.4; "
+                      "charset=utf-8\r\nContent-Length: ",
+                      body.size(), "\r\nConnection: close\r\n\r\n", body);
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<HttpTextServer>> HttpTextServer::Start(
+    int port, Handler handler) {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return ErrnoToStatus("socket");
+
+  const int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+    auto status = ErrnoToStatus(absl::StrCat("bind to port ", port));
+    close(fd);
+    return status;
+  }
+  if (listen(fd, /*backlog=*/16) != 0) {
+    auto status = ErrnoToStatus("listen");
+    close(fd);
+    return status;
+  }
+  socklen_t length = sizeof(address);
+  if (getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+    auto status = ErrnoToStatus("getsockname");
+    close(fd);
+    return status;
+  }
+  return absl::WrapUnique(
+      new HttpTextServer(fd, ntohs(address.sin_port), std::move(handler)));
+}
+
+HttpTextServer::HttpTextServer(int listen_fd, int port, Handler handler)
+    : listen_fd_(listen_fd),
+      port_(port),
+      handler_(std::move(handler)),
+      stop_(false) {
+  thread_ = StartThread("HttpTextServer", [this] { Serve(); });
+}
+
+HttpTextServer::~HttpTextServer() {
+  stop_ = true;
+  thread_ = nullptr;
+  close(listen_fd_);
+}
+
+void HttpTextServer::Serve() {
+  while (!stop_) {
+    pollfd listen_poll = {listen_fd_, POLLIN, 0};
+    const int ready = poll(&listen_poll, 1, kPollIntervalMs);
+    if (ready <= 0) continue;
+    const int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno != EINTR && errno != EAGAIN) {
+        REVERB_LOG(REVERB_WARNING)
+            << "HttpTextServer failed to accept connection: "
+            << std::strerror(errno);
+      }
+      continue;
+    }
+    HandleConnection(fd);
+    close(fd);
+  }
+}
+
+void HttpTextServer::HandleConnection(int fd) {
+  timeval timeout = {kIoTimeoutSeconds, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  // Only the request line is used but the headers are read to the end so the
+  // client doesn't see a reset connection.
+  std::string request;
+  char buffer[1024];
+  while (request.find("\r\n\r\n") == std::string::npos) {
+    if (request.size() > kMaxRequestSize) {
+      WriteAll(fd, MakeResponse("413 Payload Too Large", ""));
+      return;
+    }
+    const ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+    if (received < 0 && errno == EINTR) continue;
+    if (received <= 0) return;
+    request.append(buffer, received);
+  }
+
+  const absl::string_view line =
+      absl::string_view(request).substr(0, request.find("\r\n"));
+  if (!absl::StartsWith(line, "GET ")) {
+    WriteAll(fd, MakeResponse("405 Method Not Allowed", ""));
+    return;
+  }
+  absl::string_view path = line.substr(4, line.find(' ', 4) - 4);
+  path = path.substr(0, path.find('?'));
+  if (path != "/" && path != "/metrics") {
+    WriteAll(fd, MakeResponse("404 Not Found", ""));
+    return;
+  }
+  WriteAll(fd, MakeResponse("200 OK", handler_()));
+}
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
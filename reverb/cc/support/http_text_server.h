@@ -0,0 +1,76 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_HTTP_TEXT_SERVER_H_
+#define REVERB_CC_SUPPORT_HTTP_TEXT_SERVER_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "reverb/cc/platform/thread.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Minimal HTTP/1.0 server which responds to `GET /metrics` (and `GET /`) with
+// the plain text returned by a handler. It is used to expose the metrics of a
+// replay server to local scrapers (e.g Prometheus) without pulling in an HTTP
+// library.
+//
+// The server only listens on the loopback interface and serves one connection
+// at a time from a single thread, so the handler is never called concurrently.
+class HttpTextServer {
+ public:
+  using Handler = std::function<std::string()>;
+
+  // Starts serving on `port` of the loopback interface. If `port` is 0 then
+  // an unused port is picked (see `port()`).
+  static absl::StatusOr<std::unique_ptr<HttpTextServer>> Start(
+      int port, Handler handler);
+
+  // HttpTextServer is neither copyable nor movable.
+  HttpTextServer(const HttpTextServer&) = delete;
+  HttpTextServer& operator=(const HttpTextServer&) = delete;
+
+  // Stops serving and blocks until the serving thread has been joined.
+  ~HttpTextServer();
+
+  // Port the server is listening on.
+  int port() const { return port_; }
+
+ private:
+  HttpTextServer(int listen_fd, int port, Handler handler);
+
+  // Accepts and handles connections until `stop_` is set.
+  void Serve();
+
+  // Reads the request from `fd` and writes the response.
+  void HandleConnection(int fd);
+
+  const int listen_fd_;
+  const int port_;
+  const Handler handler_;
+  std::atomic<bool> stop_;
+  std::unique_ptr<Thread> thread_;
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_HTTP_TEXT_SERVER_H_
@@ -0,0 +1,104 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/http_text_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <utility>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/strings/string_view.h"
+#include "reverb/cc/platform/status_matchers.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+using ::testing::EndsWith;
+using ::testing::HasSubstr;
+using ::testing::StartsWith;
+
+// Sends `request` to the server on `port` and returns the full response.
+std::string Fetch(int port, absl::string_view request) {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  EXPECT_GE(fd, 0);
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  EXPECT_EQ(
+      connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+  EXPECT_EQ(send(fd, request.data(), request.size(), 0), request.size());
+  std::string response;
+  char buffer[1024];
+  ssize_t received;
+  while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+    response.append(buffer, received);
+  }
+  close(fd);
+  return response;
+}
+
+TEST(HttpTextServerTest, ServesHandlerOutput) {
+  std::atomic<int> calls(0);
+  auto server_or = HttpTextServer::Start(0, [&calls] {
+    calls++;
+    return std::string("metric 1\n");
+  });
+  REVERB_ASSERT_OK(server_or.status());
+  auto server = std::move(server_or).value();
+  EXPECT_GT(server->port(), 0);
+
+  std::string response =
+      Fetch(server->port(), "GET /metrics HTTP/1.1\r\nHost: x\r\n\r\n");
+  EXPECT_THAT(response, StartsWith("HTTP/1.0 200 OK\r\n"));
+  EXPECT_THAT(response, HasSubstr("Content-Length: 9\r\n"));
+  EXPECT_THAT(response, EndsWith("\r\n\r\nmetric 1\n"));
+
+  EXPECT_THAT(Fetch(server->port(), "GET / HTTP/1.0\r\n\r\n"),
+              EndsWith("metric 1\n"));
+  EXPECT_EQ(calls, 2);
+}
+
+TEST(HttpTextServerTest, RejectsUnknownRequests) {
+  auto server_or = HttpTextServer::Start(0, [] { return std::string("x"); });
+  REVERB_ASSERT_OK(server_or.status());
+  auto server = std::move(server_or).value();
+  EXPECT_THAT(Fetch(server->port(), "GET /other HTTP/1.0\r\n\r\n"),
+              StartsWith("HTTP/1.0 404 Not Found\r\n"));
+  EXPECT_THAT(Fetch(server->port(), "POST /metrics HTTP/1.0\r\n\r\n"),
+              StartsWith("HTTP/1.0 405 Method Not Allowed\r\n"));
+}
+
+TEST(HttpTextServerTest, FailsIfPortIsTaken) {
+  auto server_or = HttpTextServer::Start(0, [] { return std::string(); });
+  REVERB_ASSERT_OK(server_or.status());
+  auto server = std::move(server_or).value();
+  EXPECT_FALSE(
+      HttpTextServer::Start(server->port(), [] { return std::string(); })
+          .ok());
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
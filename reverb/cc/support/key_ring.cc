@@ -0,0 +1,129 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/key_ring.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+// Must be a power of two (and a multiple of 64 to simplify the tombstones).
+constexpr size_t kMinCapacity = 64;
+
+// Tombstones are never compacted before there are at least this many of them
+// to avoid rebuilding small rings over and over.
+constexpr size_t kMinTombstonesToCompact = 64;
+
+size_t NextPowerOfTwo(size_t n) {
+  size_t result = kMinCapacity;
+  while (result < n) result <<= 1;
+  return result;
+}
+
+}  // namespace
+
+KeyRing::KeyRing()
+    : slots_(kMinCapacity),
+      tombstones_(kMinCapacity / 64),
+      mask_(kMinCapacity - 1) {}
+
+bool KeyRing::PushBack(Key key) {
+  if (!positions_.emplace(key, tail_).second) return false;
+  if (tail_ - head_ == slots_.size()) {
+    Rebuild(2 * slots_.size());
+    // Positions were reassigned so the new key has to be updated.
+    positions_[key] = tail_;
+  }
+  slots_[tail_ & mask_] = key;
+  SetTombstone(tail_, false);
+  tail_++;
+  return true;
+}
+
+bool KeyRing::Erase(Key key) {
+  auto it = positions_.find(key);
+  if (it == positions_.end()) return false;
+  const uint64_t position = it->second;
+  positions_.erase(it);
+
+  if (position == head_) {
+    head_++;
+    while (head_ != tail_ && IsTombstone(head_)) {
+      SetTombstone(head_++, false);
+      num_tombstones_--;
+    }
+  } else if (position == tail_ - 1) {
+    tail_--;
+    while (head_ != tail_ && IsTombstone(tail_ - 1)) {
+      SetTombstone(--tail_, false);
+      num_tombstones_--;
+    }
+  } else {
+    SetTombstone(position, true);
+    num_tombstones_++;
+    if (num_tombstones_ >= kMinTombstonesToCompact &&
+        num_tombstones_ > positions_.size()) {
+      Rebuild(positions_.size());
+    }
+  }
+  return true;
+}
+
+void KeyRing::Clear() {
+  positions_.clear();
+  slots_.assign(kMinCapacity, 0);
+  tombstones_.assign(kMinCapacity / 64, 0);
+  mask_ = kMinCapacity - 1;
+  head_ = 0;
+  tail_ = 0;
+  num_tombstones_ = 0;
+}
+
+void KeyRing::SetTombstone(uint64_t position, bool value) {
+  const uint64_t slot = position & mask_;
+  const uint64_t bit = uint64_t{1} << (slot % 64);
+  if (value) {
+    tombstones_[slot / 64] |= bit;
+  } else {
+    tombstones_[slot / 64] &= ~bit;
+  }
+}
+
+void KeyRing::Rebuild(size_t min_capacity) {
+  const size_t capacity = NextPowerOfTwo(min_capacity);
+  std::vector<Key> slots(capacity);
+  uint64_t position = 0;
+  for (uint64_t i = head_; i != tail_; i++) {
+    if (IsTombstone(i)) continue;
+    const Key key = slots_[i & mask_];
+    slots[position] = key;
+    positions_[key] = position++;
+  }
+  slots_ = std::move(slots);
+  tombstones_.assign(capacity / 64, 0);
+  mask_ = capacity - 1;
+  head_ = 0;
+  tail_ = position;
+  num_tombstones_ = 0;
+}
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,92 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_KEY_RING_H_
+#define REVERB_CC_SUPPORT_KEY_RING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "reverb/cc/platform/hash_map.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Set of unique keys ordered by insertion time. Keys are stored contiguously in
+// a ring buffer so pushing to the back and erasing from either end are O(1)
+// without allocating (once the buffer has grown to fit the set). Erasing a key
+// from the middle leaves a tombstone behind which is skipped once it reaches
+// either end. The buffer is compacted when tombstones outnumber the keys so
+// erasing is amortized O(1) regardless of the order.
+//
+// Each key is also recorded in a hash map (with its position) to support
+// lookups by key.
+class KeyRing {
+ public:
+  using Key = uint64_t;
+
+  KeyRing();
+
+  // Returns false without modifying the ring if `key` is already present.
+  bool PushBack(Key key);
+
+  // Returns false if `key` is not present.
+  bool Erase(Key key);
+
+  bool Contains(Key key) const { return positions_.contains(key); }
+
+  // The oldest and newest keys. Must not be called when empty.
+  Key Front() const { return slots_[head_ & mask_]; }
+  Key Back() const { return slots_[(tail_ - 1) & mask_]; }
+
+  size_t size() const { return positions_.size(); }
+  bool empty() const { return positions_.empty(); }
+
+  // Number of slots in the ring buffer. Exposed for testing.
+  size_t capacity() const { return slots_.size(); }
+
+  void Clear();
+
+ private:
+  bool IsTombstone(uint64_t position) const {
+    const uint64_t slot = position & mask_;
+    return (tombstones_[slot / 64] >> (slot % 64)) & 1;
+  }
+  void SetTombstone(uint64_t position, bool value);
+
+  // Moves the live keys to the start of a buffer with room for at least
+  // `min_capacity` keys.
+  void Rebuild(size_t min_capacity);
+
+  // Keys are identified by their monotonically increasing position, the slot
+  // holding a key is `position & mask_`. The live keys are in [head_, tail_)
+  // and the keys at `head_` and `tail_ - 1` are never tombstones.
+  std::vector<Key> slots_;
+  // One bit per slot, set if the key in the slot has been erased.
+  std::vector<uint64_t> tombstones_;
+  uint64_t mask_;
+  uint64_t head_ = 0;
+  uint64_t tail_ = 0;
+  size_t num_tombstones_ = 0;
+
+  internal::flat_hash_map<Key, uint64_t> positions_;
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_KEY_RING_H_
@@ -0,0 +1,167 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/key_ring.h"
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/random/random.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+// Erases the front and back of `ring` until it is empty and returns the keys
+// in insertion order.
+std::vector<KeyRing::Key> Drain(KeyRing* ring) {
+  std::vector<KeyRing::Key> front;
+  std::vector<KeyRing::Key> back;
+  while (!ring->empty()) {
+    front.push_back(ring->Front());
+    EXPECT_TRUE(ring->Erase(front.back()));
+    if (ring->empty()) break;
+    back.push_back(ring->Back());
+    EXPECT_TRUE(ring->Erase(back.back()));
+  }
+  front.insert(front.end(), back.rbegin(), back.rend());
+  return front;
+}
+
+TEST(KeyRingTest, PushBackAndErase) {
+  KeyRing ring;
+  EXPECT_TRUE(ring.empty());
+  EXPECT_TRUE(ring.PushBack(1));
+  EXPECT_TRUE(ring.PushBack(2));
+  EXPECT_TRUE(ring.PushBack(3));
+  EXPECT_FALSE(ring.PushBack(2));
+  EXPECT_EQ(ring.size(), 3);
+  EXPECT_EQ(ring.Front(), 1);
+  EXPECT_EQ(ring.Back(), 3);
+  EXPECT_TRUE(ring.Contains(2));
+
+  EXPECT_TRUE(ring.Erase(2));
+  EXPECT_FALSE(ring.Erase(2));
+  EXPECT_FALSE(ring.Contains(2));
+  EXPECT_EQ(ring.size(), 2);
+  EXPECT_EQ(ring.Front(), 1);
+  EXPECT_EQ(ring.Back(), 3);
+
+  // The tombstone of 2 is skipped when 1 is erased.
+  EXPECT_TRUE(ring.Erase(1));
+  EXPECT_EQ(ring.Front(), 3);
+  EXPECT_EQ(ring.Back(), 3);
+}
+
+TEST(KeyRingTest, TombstonesAreSkippedAtBothEnds) {
+  KeyRing ring;
+  for (int i = 0; i < 5; i++) ASSERT_TRUE(ring.PushBack(i));
+  EXPECT_TRUE(ring.Erase(1));
+  EXPECT_TRUE(ring.Erase(3));
+  EXPECT_TRUE(ring.Erase(4));
+  EXPECT_EQ(ring.Back(), 2);
+  EXPECT_TRUE(ring.Erase(0));
+  EXPECT_EQ(ring.Front(), 2);
+  EXPECT_EQ(ring.size(), 1);
+}
+
+TEST(KeyRingTest, GrowsAndPreservesOrder) {
+  KeyRing ring;
+  const size_t initial_capacity = ring.capacity();
+  for (int i = 0; i < 10 * initial_capacity; i++) {
+    ASSERT_TRUE(ring.PushBack(i));
+  }
+  EXPECT_GE(ring.capacity(), 10 * initial_capacity);
+  std::vector<KeyRing::Key> keys = Drain(&ring);
+  ASSERT_EQ(keys.size(), 10 * initial_capacity);
+  for (int i = 0; i < keys.size(); i++) {
+    EXPECT_EQ(keys[i], i);
+  }
+}
+
+TEST(KeyRingTest, WrapsAroundWithoutGrowing) {
+  KeyRing ring;
+  const size_t capacity = ring.capacity();
+  for (int i = 0; i < capacity / 2; i++) ASSERT_TRUE(ring.PushBack(i));
+  for (int i = capacity / 2; i < 100 * capacity; i++) {
+    ASSERT_TRUE(ring.PushBack(i));
+    ASSERT_EQ(ring.Front(), i - capacity / 2);
+    ASSERT_TRUE(ring.Erase(ring.Front()));
+  }
+  EXPECT_EQ(ring.capacity(), capacity);
+}
+
+TEST(KeyRingTest, CompactsTombstones) {
+  KeyRing ring;
+  constexpr int kKeys = 10000;
+  for (int i = 0; i < kKeys; i++) ASSERT_TRUE(ring.PushBack(i));
+  const size_t capacity = ring.capacity();
+
+  // Erase all but the first, last and every 100th key from the middle.
+  for (int i = 1; i < kKeys - 1; i++) {
+    if (i % 100 != 0) ASSERT_TRUE(ring.Erase(i));
+  }
+  EXPECT_LT(ring.capacity(), capacity);
+
+  std::vector<KeyRing::Key> expected = {0};
+  for (int i = 100; i < kKeys - 1; i += 100) expected.push_back(i);
+  expected.push_back(kKeys - 1);
+  EXPECT_THAT(Drain(&ring), ::testing::ElementsAreArray(expected));
+}
+
+TEST(KeyRingTest, MatchesReferenceUnderRandomOperations) {
+  KeyRing ring;
+  std::deque<KeyRing::Key> reference;
+  absl::BitGen gen;
+  KeyRing::Key next_key = 0;
+  for (int i = 0; i < 100000; i++) {
+    const int op = absl::Uniform(gen, 0, 10);
+    if (op < 5 || reference.empty()) {
+      ASSERT_TRUE(ring.PushBack(next_key));
+      reference.push_back(next_key++);
+    } else {
+      // Mostly erase from the ends but sometimes from the middle.
+      size_t index = 0;
+      if (op == 6) index = reference.size() - 1;
+      if (op >= 8) index = absl::Uniform<size_t>(gen, 0, reference.size());
+      ASSERT_TRUE(ring.Erase(reference[index]));
+      reference.erase(reference.begin() + index);
+    }
+    ASSERT_EQ(ring.size(), reference.size());
+    if (!reference.empty()) {
+      ASSERT_EQ(ring.Front(), reference.front());
+      ASSERT_EQ(ring.Back(), reference.back());
+    }
+  }
+  EXPECT_THAT(Drain(&ring), ::testing::ElementsAreArray(reference));
+}
+
+TEST(KeyRingTest, Clear) {
+  KeyRing ring;
+  for (int i = 0; i < 1000; i++) ASSERT_TRUE(ring.PushBack(i));
+  ring.Clear();
+  EXPECT_TRUE(ring.empty());
+  EXPECT_FALSE(ring.Contains(1));
+  EXPECT_TRUE(ring.PushBack(1));
+  EXPECT_EQ(ring.Front(), 1);
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
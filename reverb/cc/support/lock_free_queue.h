@@ -0,0 +1,381 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_LOCK_FREE_QUEUE_H_
+#define REVERB_CC_SUPPORT_LOCK_FREE_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "reverb/cc/platform/logging.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Lock-free alternative to `Queue` (see queue.h) with the same interface and
+// semantics. It is used where many producers push into the queue concurrently
+// with consumers which poll it in a tight loop, in which case the single mutex
+// of `Queue` (and the wakeups of its `Await` conditions) becomes a bottleneck.
+//
+// Items are stored in a ring of slots, each with a sequence number that tells
+// producers and consumers whether the slot is free or holds a published item
+// (Vyukov's bounded MPMC queue). `Reserve` and `PopBatch` claim space and items
+// with a CAS on a counter so the fast paths never take a lock. Threads only
+// block when the queue is full (`Reserve`) or does not hold enough items (`Pop`
+// and `PopBatch`), in which case they wait on a (futex backed) `absl::Mutex`
+// condition. The other side only touches the mutex when there are blocked
+// threads, and only the threads whose condition holds are woken up.
+//
+// Differences to `Queue`:
+//   * Items of batches pushed concurrently by different producers may be
+//     interleaved. Items of a single batch are popped in order.
+//   * Items pushed after `Close` or `SetLastItemPushed` are discarded rather
+//     than added to the queue.
+//
+template <typename T>
+class LockFreeQueue {
+ public:
+  // `capacity` is the maximum number of elements which the queue can hold.
+  explicit LockFreeQueue(int capacity)
+      : capacity_(std::max(0, capacity)),
+        mask_(RingSize(capacity_) - 1),
+        slots_(new Slot[mask_ + 1]) {
+    for (int64_t i = 0; i <= mask_; i++) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  LockFreeQueue(const LockFreeQueue&) = delete;
+  LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+  // Closes the queue. All pending and future calls to `Reserve()` and `Pop()`
+  // are unblocked and return false without performing the operation. Additional
+  // calls of Close after the first one have no effect.
+  void Close() {
+    closed_.store(true);
+    Wake(&pushers_);
+    Wake(&poppers_);
+  }
+
+  // Reserves a given number of slots in the queue. Blocks if there is not
+  // sufficient space in the queue. On success, `true` is returned.
+  // If the queue is closed, `false` is returned.
+  bool Reserve(int count) {
+    while (true) {
+      if (IsClosedForPush()) {
+        // The reservation is still recorded so that a following `PushBatch`
+        // does not fail the reservation check, just like it would for `Queue`.
+        reserved_.fetch_add(count, std::memory_order_relaxed);
+        return false;
+      }
+      int64_t occupied = occupied_.load(std::memory_order_relaxed);
+      while (occupied + count <= capacity_) {
+        if (occupied_.compare_exchange_weak(occupied, occupied + count)) {
+          reserved_.fetch_add(count, std::memory_order_relaxed);
+          return true;
+        }
+      }
+      Wait(&pushers_, absl::InfiniteFuture(), [&] {
+        return IsClosedForPush() || occupied_.load() + count <= capacity_;
+      });
+    }
+  }
+
+  // Pushes a batch of items using std::move and then calls `clear` on the input
+  // vector.
+  // NOTE! Space for all elements of the provided vector must be reserved before
+  // calling this method. Failing to do so will trigger death.
+  void PushBatch(std::vector<T>* x) {
+    const int64_t n = x->size();
+    const int64_t reserved =
+        reserved_.fetch_sub(n, std::memory_order_relaxed);
+    REVERB_CHECK_GE(reserved, n)
+        << "Space has not been reserved in the queue. Please file a bug to the "
+           "Reverb team.";
+    if (n == 0 || IsClosedForPush()) {
+      x->clear();
+      return;
+    }
+
+    const int64_t begin = tail_.fetch_add(n, std::memory_order_relaxed);
+    for (int64_t i = 0; i < n; i++) {
+      Slot& slot = slots_[(begin + i) & mask_];
+      // The reservation guarantees that the slot has been (or is about to be)
+      // released by the consumer of the previous lap.
+      SpinUntil(slot, begin + i);
+      slot.value = std::move((*x)[i]);
+      slot.sequence.store(begin + i + 1, std::memory_order_release);
+    }
+    x->clear();
+
+    pushes_.fetch_add(n, std::memory_order_relaxed);
+    available_.fetch_add(n);
+    Wake(&poppers_);
+  }
+
+  // Exactly the same as the method above, but accepts vector of elements
+  // instead of a pointer.
+  void PushBatch(std::vector<T> x) { PushBatch(&x); }
+
+  // Blocks until queue contains at least `batch_size` items then pops and
+  // pushes `batch_size` from the queue to `out`.
+  //
+  // Returns:
+  //   OK: If `batch_size` items could be popped before `timeout`.
+  //   InvalidArgumentError: if `batch_size` > queue size.
+  //   DeadlineExceededError: if timeout exceeded.
+  //   ResourceExhaustedError: if SetLastItemPushed called before `batch_size`
+  //     items in the queue.
+  //   CancelledError: if queue has been closed or SetLastItemPushed called on
+  //     an already empty queue.
+  //
+  absl::Status PopBatch(int batch_size, absl::Duration timeout,
+                        std::vector<T>* out) {
+    if (batch_size > capacity_) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Batch size (", batch_size,
+                       ") must be <= of queue size (", capacity_, ")."));
+    }
+
+    ScopedIncrement ticket(&num_waiting_to_pop_);
+    const absl::Time deadline = absl::Now() + timeout;
+    while (true) {
+      if (closed_.load()) {
+        return absl::CancelledError("Queue is closed.");
+      }
+      if (last_item_pushed_.load()) {
+        return absl::ResourceExhaustedError(absl::StrCat(
+            "The last item have been pushed to the queue and the current size "
+            "(", size(), ") is less than the batch size (", batch_size, ")."));
+      }
+      if (TryClaim(batch_size)) {
+        Take(batch_size, [out](T&& item) { out->push_back(std::move(item)); });
+        return absl::OkStatus();
+      }
+      if (absl::Now() >= deadline) {
+        return absl::DeadlineExceededError(
+            absl::StrCat("Timeout exceeded before ", batch_size,
+                         " items observed in queue."));
+      }
+      Wait(&poppers_, deadline, [&] {
+        return closed_.load() || last_item_pushed_.load() ||
+               available_.load() >= batch_size;
+      });
+    }
+  }
+
+  absl::Status PopBatch(int batch_size, std::vector<T>* out) {
+    return PopBatch(batch_size, absl::InfiniteDuration(), out);
+  }
+
+  // Marks that no more items will be pushed to the queue.
+  void SetLastItemPushed() {
+    last_item_pushed_.store(true);
+    if (available_.load() == 0) {
+      closed_.store(true);
+    }
+    Wake(&pushers_);
+    Wake(&poppers_);
+  }
+
+  // Removes an element from the queue and move-assigns it to *item. Blocks if
+  // the queue is empty. On success, `true` is returned. If the queue was
+  // closed, `false` is returned.
+  //
+  // If called after `SetLastItemPushed` and the final item of the queue is
+  // returned then queue is closed.
+  bool Pop(T* item) {
+    ScopedIncrement ticket(&num_waiting_to_pop_);
+    while (true) {
+      if (closed_.load()) return false;
+      if (TryClaim(1)) {
+        Take(1, [item](T&& value) { *item = std::move(value); });
+        return true;
+      }
+      Wait(&poppers_, absl::InfiniteFuture(),
+           [&] { return closed_.load() || available_.load() > 0; });
+    }
+  }
+
+  // Current number of elements.
+  int size() const { return available_.load(std::memory_order_relaxed); }
+
+  int num_waiting_to_pop() const {
+    return num_waiting_to_pop_.load(std::memory_order_relaxed);
+  }
+
+  int num_pushes() const { return pushes_.load(std::memory_order_relaxed); }
+
+ private:
+  struct Slot {
+    // Equal to the position of the slot when it is free and to position + 1
+    // when it holds a published item, where positions grow monotonically.
+    std::atomic<int64_t> sequence;
+    T value;
+  };
+
+  // Threads blocked on one side of the queue. `mu` is only held while waiting
+  // for, or signalling, a change of the queue state.
+  struct alignas(ABSL_CACHELINE_SIZE) WaitList {
+    absl::Mutex mu;
+    std::atomic<int32_t> num_waiting{0};
+  };
+
+  // Increments a counter while in scope.
+  class ScopedIncrement {
+   public:
+    explicit ScopedIncrement(std::atomic<int>* value) : value_(value) {
+      value_->fetch_add(1, std::memory_order_relaxed);
+    }
+    ~ScopedIncrement() { value_->fetch_sub(1, std::memory_order_relaxed); }
+
+   private:
+    std::atomic<int>* value_;
+  };
+
+  static int64_t RingSize(int64_t capacity) {
+    int64_t size = 1;
+    while (size < capacity) size <<= 1;
+    return size;
+  }
+
+  static void SpinUntil(const Slot& slot, int64_t sequence) {
+    while (ABSL_PREDICT_FALSE(slot.sequence.load(std::memory_order_acquire) !=
+                              sequence)) {
+      std::this_thread::yield();
+    }
+  }
+
+  bool IsClosedForPush() const {
+    return closed_.load() || last_item_pushed_.load();
+  }
+
+  // Atomically claims `count` published items. Returns false if the queue holds
+  // fewer items.
+  bool TryClaim(int64_t count) {
+    int64_t available = available_.load(std::memory_order_relaxed);
+    while (available >= count) {
+      if (available_.compare_exchange_weak(available, available - count)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Moves `count` previously claimed items out of their slots and into `fn`
+  // and then releases the slots.
+  template <typename F>
+  void Take(int64_t count, F fn) {
+    const int64_t begin = head_.fetch_add(count, std::memory_order_relaxed);
+    for (int64_t i = 0; i < count; i++) {
+      Slot& slot = slots_[(begin + i) & mask_];
+      // The item is counted as available once every item of its batch has been
+      // published but batches of other producers may still be in flight.
+      SpinUntil(slot, begin + i + 1);
+      fn(std::move(slot.value));
+      slot.sequence.store(begin + i + mask_ + 1, std::memory_order_release);
+    }
+    occupied_.fetch_sub(count);
+    Wake(&pushers_);
+
+    if (last_item_pushed_.load() && available_.load() == 0) {
+      closed_.store(true);
+      Wake(&poppers_);
+    }
+  }
+
+  // Blocks until `ready` returns true or `deadline` is reached. `ready` must be
+  // rechecked by the caller as the state may change again before it returns.
+  template <typename F>
+  static void Wait(WaitList* list, absl::Time deadline, const F& ready) {
+    list->num_waiting.fetch_add(1);
+    {
+      absl::MutexLock lock(&list->mu);
+      list->mu.AwaitWithDeadline(absl::Condition(&ready), deadline);
+    }
+    list->num_waiting.fetch_sub(1);
+  }
+
+  // Wakes up the threads blocked in `list` whose condition now holds. The
+  // state change must be made before calling this. Waiters increment
+  // `num_waiting` before evaluating their condition so either they observe the
+  // change or the mutex is released after they started waiting, which makes
+  // `absl::Mutex` reevaluate their conditions.
+  static void Wake(WaitList* list) {
+    if (list->num_waiting.load() > 0) {
+      absl::MutexLock lock(&list->mu);
+    }
+  }
+
+  // Maximum number of elements which the queue can hold.
+  const int64_t capacity_;
+
+  // Size of the ring minus one. The ring size is the smallest power of two
+  // that is >= `capacity_`.
+  const int64_t mask_;
+
+  std::unique_ptr<Slot[]> slots_;
+
+  // Position of the next slot to be filled by a producer.
+  alignas(ABSL_CACHELINE_SIZE) std::atomic<int64_t> tail_{0};
+
+  // Number of slots reserved for future pushes (see `Reserve`).
+  std::atomic<int64_t> reserved_{0};
+
+  // Total number of pushed elements.
+  std::atomic<int64_t> pushes_{0};
+
+  // Position of the next slot to be emptied by a consumer.
+  alignas(ABSL_CACHELINE_SIZE) std::atomic<int64_t> head_{0};
+
+  // Number of published items which have not been claimed by a consumer.
+  alignas(ABSL_CACHELINE_SIZE) std::atomic<int64_t> available_{0};
+
+  // Number of slots which are either reserved, hold an item or are being
+  // emptied by a consumer. Never exceeds `capacity_`.
+  alignas(ABSL_CACHELINE_SIZE) std::atomic<int64_t> occupied_{0};
+
+  // Whether `Close()` was called.
+  std::atomic<bool> closed_{false};
+
+  // Whether `SetLastItemPushed()` has been called. When set then push calls are
+  // treated the same as if `Closed()` had been called. If set and the queue is
+  // empty after a pop call then `closed_` is set.
+  std::atomic<bool> last_item_pushed_{false};
+
+  // The number of threads which are currently in `Pop` or `PopBatch`.
+  std::atomic<int> num_waiting_to_pop_{0};
+
+  // Producers blocked in `Reserve` and consumers blocked in `Pop`/`PopBatch`.
+  WaitList pushers_;
+  WaitList poppers_;
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_LOCK_FREE_QUEUE_H_
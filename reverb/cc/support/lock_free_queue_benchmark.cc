@@ -0,0 +1,85 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/thread.h"
+#include "reverb/cc/support/lock_free_queue.h"
+#include "reverb/cc/support/queue.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+constexpr int kItemsPerProducer = 20000;
+
+// Mimics the way `Sampler` uses its queue: each of `state.range(0)` producers
+// (the `SamplerWorker`s) reserves room for a batch of `state.range(1)` samples,
+// pushes it and repeats, while a single consumer pops the samples one at a
+// time. `kItemsPerProducer` must be divisible by the batch size.
+template <typename QueueType>
+void BM_SamplerFanIn(benchmark::State& state) {
+  const int num_producers = state.range(0);
+  const int batch_size = state.range(1);
+
+  for (auto _ : state) {
+    QueueType queue(/*capacity=*/num_producers * batch_size);
+    std::vector<std::unique_ptr<internal::Thread>> producers;
+    for (int p = 0; p < num_producers; p++) {
+      producers.push_back(internal::StartThread("producer", [&] {
+        std::vector<std::unique_ptr<int64_t>> batch;
+        for (int i = 0; i < kItemsPerProducer; i += batch_size) {
+          REVERB_CHECK(queue.Reserve(batch_size));
+          for (int j = 0; j < batch_size; j++) {
+            batch.push_back(std::make_unique<int64_t>(i + j));
+          }
+          queue.PushBatch(&batch);
+        }
+      }));
+    }
+
+    std::unique_ptr<int64_t> item;
+    for (int64_t i = 0; i < int64_t{num_producers} * kItemsPerProducer; i++) {
+      REVERB_CHECK(queue.Pop(&item));
+      benchmark::DoNotOptimize(*item);
+    }
+    producers.clear();
+  }
+  state.SetItemsProcessed(state.iterations() * num_producers *
+                          kItemsPerProducer);
+}
+
+void FanInArgs(benchmark::internal::Benchmark* b) {
+  for (int producers : {1, 4, 16}) {
+    for (int batch_size : {1, 16}) {
+      b->Args({producers, batch_size});
+    }
+  }
+}
+
+BENCHMARK_TEMPLATE(BM_SamplerFanIn, internal::Queue<std::unique_ptr<int64_t>>)
+    ->Apply(FanInArgs)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_SamplerFanIn,
+                   internal::LockFreeQueue<std::unique_ptr<int64_t>>)
+    ->Apply(FanInArgs)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
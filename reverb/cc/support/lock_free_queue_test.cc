@@ -0,0 +1,334 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/lock_free_queue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/platform/thread.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+TEST(LockFreeQueueTest, PushAndPopAreConsistent) {
+  LockFreeQueue<int> q(10);
+  int output;
+  for (int i = 0; i < 100; i++) {
+    q.Reserve(1);
+    q.PushBatch({i});
+    q.Pop(&output);
+    EXPECT_EQ(output, i);
+  }
+}
+
+TEST(LockFreeQueueTest, PushBlocksWhenFull) {
+  LockFreeQueue<int> q(2);
+  ASSERT_TRUE(q.Reserve(2));
+  q.PushBatch({1, 2});
+  absl::Notification n;
+  auto t = StartThread("", [&q, &n] {
+    REVERB_CHECK(q.Reserve(1));
+    q.PushBatch({3});
+    n.Notify();
+  });
+  ASSERT_FALSE(n.HasBeenNotified());
+  int output;
+  ASSERT_TRUE(q.Pop(&output));
+  n.WaitForNotification();
+  EXPECT_EQ(output, 1);
+}
+
+TEST(LockFreeQueueTest, PopBlocksWhenEmpty) {
+  LockFreeQueue<int> q(2);
+  absl::Notification n;
+  int output;
+  auto t = StartThread("", [&q, &n, &output] {
+    REVERB_CHECK(q.Pop(&output));
+    n.Notify();
+  });
+  ASSERT_FALSE(n.HasBeenNotified());
+  ASSERT_TRUE(q.Reserve(1));
+  q.PushBatch({1});
+  n.WaitForNotification();
+  EXPECT_EQ(output, 1);
+}
+
+TEST(LockFreeQueueTest, AfterClosePushAndPopReturnFalse) {
+  LockFreeQueue<int> q(2);
+  q.Close();
+  ASSERT_FALSE(q.Reserve(1));
+  EXPECT_FALSE(q.Pop(nullptr));
+}
+
+TEST(LockFreeQueueTest, CloseUnblocksPush) {
+  LockFreeQueue<int> q(2);
+  ASSERT_TRUE(q.Reserve(2));
+  q.PushBatch({1, 2});
+  absl::Notification n;
+  bool ok;
+  auto t = StartThread("", [&q, &n, &ok] {
+    ok = q.Reserve(1);
+    q.PushBatch({3});
+    n.Notify();
+  });
+  ASSERT_FALSE(n.HasBeenNotified());
+  q.Close();
+  n.WaitForNotification();
+  EXPECT_FALSE(ok);
+}
+
+TEST(LockFreeQueueTest, CloseUnblocksPop) {
+  LockFreeQueue<int> q(2);
+  absl::Notification n;
+  bool ok;
+  auto t = StartThread("", [&q, &n, &ok] {
+    int output;
+    ok = q.Pop(&output);
+    n.Notify();
+  });
+  ASSERT_FALSE(n.HasBeenNotified());
+  q.Close();
+  n.WaitForNotification();
+  EXPECT_FALSE(ok);
+}
+
+TEST(LockFreeQueueTest, SizeReturnsNumberOfElements) {
+  LockFreeQueue<int> q(3);
+  EXPECT_EQ(q.size(), 0);
+
+  q.Reserve(2);
+  q.PushBatch({20, 30});
+  EXPECT_EQ(q.size(), 2);
+
+  int v;
+  ASSERT_TRUE(q.Pop(&v));
+  EXPECT_EQ(q.size(), 1);
+}
+
+TEST(LockFreeQueueTest, PushFailsAfterSetLastItemPushed) {
+  LockFreeQueue<int> q(3);
+  q.SetLastItemPushed();
+  EXPECT_FALSE(q.Reserve(1));
+  q.PushBatch({1});
+  EXPECT_EQ(q.size(), 0);
+}
+
+TEST(LockFreeQueueTest, ExistingItemsCanBePoppedAfterSetLastItemPushed) {
+  LockFreeQueue<int> q(3);
+
+  q.Reserve(2);
+  q.PushBatch({1, 2});
+
+  q.SetLastItemPushed();
+
+  int v;
+  ASSERT_TRUE(q.Pop(&v));
+  EXPECT_EQ(v, 1);
+  ASSERT_TRUE(q.Pop(&v));
+  EXPECT_EQ(v, 2);
+
+  // Queue is now empty and no items can be pushed so it is effectively closed.
+  EXPECT_FALSE(q.Pop(&v));
+}
+
+TEST(LockFreeQueueTest, BlockingPopReturnsIfSetLastItemPushedCalled) {
+  LockFreeQueue<int> q(2);
+  absl::Notification n;
+  bool ok;
+  auto t = StartThread("", [&q, &n, &ok] {
+    int output;
+    ok = q.Pop(&output);
+    n.Notify();
+  });
+  ASSERT_FALSE(n.HasBeenNotified());
+  q.SetLastItemPushed();
+  n.WaitForNotification();
+  EXPECT_FALSE(ok);
+}
+
+TEST(LockFreeQueueTest, PopBatchBlocksUntilBatchFull) {
+  LockFreeQueue<int> q(10);
+
+  std::vector<int> v;
+  for (int i = 0; i < 5; i++) {
+    EXPECT_EQ(q.PopBatch(5, absl::ZeroDuration(), &v).code(),
+              absl::StatusCode::kDeadlineExceeded);
+    EXPECT_TRUE(q.Reserve(1));
+    q.PushBatch({i});
+  }
+
+  REVERB_EXPECT_OK(q.PopBatch(5, &v));
+}
+
+TEST(LockFreeQueueTest, PopBatchEmitsItemsInOrder) {
+  LockFreeQueue<int> q(10);
+
+  EXPECT_TRUE(q.Reserve(5));
+  q.PushBatch({0, 1, 2, 3, 4});
+
+  std::vector<int> v;
+  REVERB_EXPECT_OK(q.PopBatch(5, &v));
+  EXPECT_THAT(v, testing::ElementsAre(0, 1, 2, 3, 4));
+}
+
+TEST(LockFreeQueueTest, PopBatchReturnsIfSetLastItemPushed) {
+  LockFreeQueue<int> q(3);
+  absl::Notification n;
+  absl::Status status;
+
+  auto thread = internal::StartThread("", [&] {
+    std::vector<int> out;
+    status = q.PopBatch(2, &out);
+    n.Notify();
+  });
+
+  // Inserting one item should not unblock it.
+  q.Reserve(1);
+  q.PushBatch({1});
+  EXPECT_FALSE(n.WaitForNotificationWithTimeout(absl::Milliseconds(100)));
+
+  // Calling `SetLastItemPushed` should unblock the call as the batch can never
+  // be filled now.
+  q.SetLastItemPushed();
+  n.WaitForNotification();
+  EXPECT_EQ(status.code(), absl::StatusCode::kResourceExhausted);
+}
+
+TEST(LockFreeQueueTest, PopBatchReturnsInvalidArgumentIfBatchSizeTooBig) {
+  LockFreeQueue<int> q(3);
+  std::vector<int> v;
+  EXPECT_EQ(q.PopBatch(4, &v).code(), absl::StatusCode::kInvalidArgument);
+}
+
+TEST(LockFreeQueueTest, PopBatchReturnsCancelledIfClosedCalled) {
+  LockFreeQueue<int> q(3);
+  absl::Notification n;
+  absl::Status status;
+
+  auto thread = internal::StartThread("", [&] {
+    std::vector<int> out;
+    status = q.PopBatch(2, &out);
+    n.Notify();
+  });
+
+  // Inserting one item should not unblock it.
+  q.Reserve(1);
+  q.PushBatch({1});
+  EXPECT_FALSE(n.WaitForNotificationWithTimeout(absl::Milliseconds(100)));
+
+  // Calling `Close` should unblock the call.
+  q.Close();
+  n.WaitForNotification();
+  EXPECT_EQ(status.code(), absl::StatusCode::kCancelled);
+}
+
+TEST(LockFreeQueueTest, ConcurrentProducersAndConsumers) {
+  constexpr int kProducers = 8;
+  constexpr int kConsumers = 4;
+  constexpr int kBatchesPerProducer = 2000;
+  constexpr int kMaxBatchSize = 5;
+
+  LockFreeQueue<std::unique_ptr<int64_t>> q(16);
+  std::atomic<int64_t> sum(0);
+  std::atomic<int64_t> num_popped(0);
+
+  std::vector<std::unique_ptr<Thread>> consumers;
+  for (int c = 0; c < kConsumers; c++) {
+    consumers.push_back(StartThread("", [&, c] {
+      std::vector<std::unique_ptr<int64_t>> batch;
+      std::unique_ptr<int64_t> item;
+      while (true) {
+        // Mix single pops with batched pops.
+        if (c % 2 == 0) {
+          if (!q.Pop(&item)) return;
+          sum += *item;
+          num_popped++;
+        } else {
+          batch.clear();
+          auto status = q.PopBatch(2, absl::Milliseconds(1), &batch);
+          if (absl::IsDeadlineExceeded(status)) continue;
+          if (!status.ok()) return;
+          for (const auto& value : batch) sum += *value;
+          num_popped += batch.size();
+        }
+      }
+    }));
+  }
+
+  std::vector<std::unique_ptr<Thread>> producers;
+  for (int p = 0; p < kProducers; p++) {
+    producers.push_back(StartThread("", [&, p] {
+      std::vector<std::unique_ptr<int64_t>> batch;
+      for (int i = 0; i < kBatchesPerProducer; i++) {
+        const int batch_size = 1 + (p + i) % kMaxBatchSize;
+        REVERB_CHECK(q.Reserve(batch_size));
+        for (int j = 0; j < batch_size; j++) {
+          batch.push_back(std::make_unique<int64_t>(p * 1000000 + i));
+        }
+        q.PushBatch(&batch);
+      }
+    }));
+  }
+
+  int64_t expected_sum = 0;
+  int64_t expected_count = 0;
+  for (int p = 0; p < kProducers; p++) {
+    for (int i = 0; i < kBatchesPerProducer; i++) {
+      const int batch_size = 1 + (p + i) % kMaxBatchSize;
+      expected_sum += batch_size * static_cast<int64_t>(p * 1000000 + i);
+      expected_count += batch_size;
+    }
+  }
+
+  // Consumers using `Pop` drain the remaining items before the queue closes.
+  producers.clear();
+  q.SetLastItemPushed();
+  consumers.clear();
+
+  EXPECT_EQ(num_popped, expected_count);
+  EXPECT_EQ(sum, expected_sum);
+  EXPECT_EQ(q.num_pushes(), expected_count);
+}
+
+TEST(LockFreeQueueTest, PreservesOrderOfSingleProducer) {
+  LockFreeQueue<int> q(3);
+  auto producer = StartThread("", [&q] {
+    for (int i = 0; i < 10000; i++) {
+      REVERB_CHECK(q.Reserve(1));
+      q.PushBatch({i});
+    }
+  });
+  int v;
+  for (int i = 0; i < 10000; i++) {
+    ASSERT_TRUE(q.Pop(&v));
+    ASSERT_EQ(v, i);
+  }
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
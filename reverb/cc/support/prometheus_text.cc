@@ -0,0 +1,175 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/prometheus_text.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_replace.h"
+#include "absl/strings/string_view.h"
+#include "reverb/cc/schema.pb.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+std::string TableLabel(const TableInfo& table) {
+  return absl::StrCat(
+      "table=\"",
+      absl::StrReplaceAll(table.name(),
+                          {{"\\", "\\\\"}, {"\"", "\\\""}, {"\n", "\\n"}}),
+      "\"");
+}
+
+void AppendHeader(absl::string_view name, absl::string_view type,
+                  absl::string_view help, std::string* out) {
+  absl::StrAppend(out, "# HELP ", name, " ", help, "\n# TYPE ", name, " ",
+                  type, "\n");
+}
+
+// Appends a series per table with the value returned by `value`.
+void AppendScalar(absl::Span<const TableInfo> tables, absl::string_view name,
+                  absl::string_view type, absl::string_view help,
+                  const std::function<int64_t(const TableInfo&)>& value,
+                  std::string* out) {
+  AppendHeader(name, type, help, out);
+  for (const auto& table : tables) {
+    absl::StrAppend(out, name, "{", TableLabel(table), "} ", value(table),
+                    "\n");
+  }
+}
+
+void AppendHistogram(
+    absl::Span<const TableInfo> tables, absl::string_view name,
+    absl::string_view help,
+    const std::function<const Histogram&(const TableHistograms&)>& histogram,
+    std::string* out) {
+  AppendHeader(name, "histogram", help, out);
+  for (const auto& table : tables) {
+    const std::string label = TableLabel(table);
+    const Histogram& h = histogram(table.histograms());
+    int64_t cumulative = 0;
+    for (const auto& bucket : h.buckets()) {
+      cumulative += bucket.count();
+      absl::StrAppend(out, name, "_bucket{", label, ",le=\"",
+                      bucket.upper_bound() - 1, "\"} ", cumulative, "\n");
+    }
+    absl::StrAppend(out, name, "_bucket{", label, ",le=\"+Inf\"} ", h.count(),
+                    "\n", name, "_sum{", label, "} ", h.sum(), "\n", name,
+                    "_count{", label, "} ", h.count(), "\n");
+  }
+}
+
+}  // namespace
+
+std::string TableInfosToPrometheusText(absl::Span<const TableInfo> tables) {
+  std::string out;
+  AppendScalar(
+      tables, "reverb_table_size", "gauge", "Number of items in the table.",
+      [](const TableInfo& t) { return t.current_size(); }, &out);
+  AppendScalar(
+      tables, "reverb_table_max_size", "gauge",
+      "Maximum number of items in the table.",
+      [](const TableInfo& t) { return t.max_size(); }, &out);
+  AppendScalar(
+      tables, "reverb_table_episodes", "gauge",
+      "Number of episodes referenced by the items in the table.",
+      [](const TableInfo& t) { return t.num_episodes(); }, &out);
+  AppendScalar(
+      tables, "reverb_table_inserts_total", "counter",
+      "Number of inserts committed by the rate limiter.",
+      [](const TableInfo& t) {
+        return t.rate_limiter_info().insert_stats().completed();
+      },
+      &out);
+  AppendScalar(
+      tables, "reverb_table_samples_total", "counter",
+      "Number of samples committed by the rate limiter.",
+      [](const TableInfo& t) {
+        return t.rate_limiter_info().sample_stats().completed();
+      },
+      &out);
+
+  const absl::string_view kWorkerTime = "reverb_table_worker_time_ms_total";
+  AppendHeader(kWorkerTime, "counter",
+               "Time spent by the table worker in each of its states.", &out);
+  for (const auto& table : tables) {
+    const std::string label = TableLabel(table);
+    const TableWorkerTime& time = table.table_worker_time();
+    for (const auto& [state, ms] :
+         {std::pair<absl::string_view, int64_t>{"running", time.running_ms()},
+          {"sampling", time.sampling_ms()},
+          {"inserting", time.inserting_ms()},
+          {"sleeping", time.sleeping_ms()},
+          {"waiting_for_sampling", time.waiting_for_sampling_ms()},
+          {"waiting_for_inserts", time.waiting_for_inserts_ms()}}) {
+      absl::StrAppend(&out, kWorkerTime, "{", label, ",state=\"", state,
+                      "\"} ", ms, "\n");
+    }
+  }
+
+  AppendHistogram(
+      tables, "reverb_table_insert_to_commit_us",
+      "Time between an insert being received and committed by the table.",
+      [](const TableHistograms& h) -> const Histogram& {
+        return h.insert_to_commit_us();
+      },
+      &out);
+  AppendHistogram(
+      tables, "reverb_table_sample_wait_us",
+      "Time between a sample request being received and completed.",
+      [](const TableHistograms& h) -> const Histogram& {
+        return h.sample_wait_us();
+      },
+      &out);
+  AppendHistogram(
+      tables, "reverb_table_rate_limiter_blocked_us",
+      "Periods during which all pending requests were blocked by the rate "
+      "limiter.",
+      [](const TableHistograms& h) -> const Histogram& {
+        return h.rate_limiter_blocked_us();
+      },
+      &out);
+  AppendHistogram(
+      tables, "reverb_table_lock_hold_us",
+      "Time the table worker held the table lock per batch of requests.",
+      [](const TableHistograms& h) -> const Histogram& {
+        return h.lock_hold_us();
+      },
+      &out);
+  AppendHistogram(
+      tables, "reverb_table_sample_response_bytes",
+      "Serialized size of the sample responses sent for the table.",
+      [](const TableHistograms& h) -> const Histogram& {
+        return h.sample_response_bytes();
+      },
+      &out);
+  AppendHistogram(
+      tables, "reverb_table_sample_response_bytes_saved",
+      "Bytes saved per sample response by slicing chunks to the sampled rows.",
+      [](const TableHistograms& h) -> const Histogram& {
+        return h.sample_response_bytes_saved();
+      },
+      &out);
+  return out;
+}
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,40 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_PROMETHEUS_TEXT_H_
+#define REVERB_CC_SUPPORT_PROMETHEUS_TEXT_H_
+
+#include <string>
+
+#include "absl/types/span.h"
+#include "reverb/cc/schema.pb.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Renders the counters and histograms of `tables` in the Prometheus text
+// exposition format (version 0.0.4). Every series is labelled with the name of
+// its table.
+//
+// Histograms only include their non-empty buckets (plus `+Inf`), so the set
+// of `le` labels of a series grows as values are recorded. The `le` label of a
+// bucket is its largest value as all recorded values are integers.
+std::string TableInfosToPrometheusText(absl::Span<const TableInfo> tables);
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_PROMETHEUS_TEXT_H_
@@ -0,0 +1,95 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/prometheus_text.h"
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "reverb/cc/schema.pb.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+using ::testing::HasSubstr;
+using ::testing::Not;
+
+TEST(PrometheusTextTest, Scalars) {
+  std::vector<TableInfo> tables(2);
+  tables[0].set_name("first");
+  tables[0].set_current_size(3);
+  tables[0].mutable_rate_limiter_info()->mutable_insert_stats()->set_completed(
+      7);
+  tables[0].mutable_table_worker_time()->set_sleeping_ms(11);
+  tables[1].set_name("second");
+  tables[1].set_current_size(5);
+
+  std::string text = TableInfosToPrometheusText(tables);
+  EXPECT_THAT(text, HasSubstr("# TYPE reverb_table_size gauge\n"
+                              "reverb_table_size{table=\"first\"} 3\n"
+                              "reverb_table_size{table=\"second\"} 5\n"));
+  EXPECT_THAT(text,
+              HasSubstr("reverb_table_inserts_total{table=\"first\"} 7\n"));
+  EXPECT_THAT(text, HasSubstr("reverb_table_worker_time_ms_total{table="
+                              "\"first\",state=\"sleeping\"} 11\n"));
+}
+
+TEST(PrometheusTextTest, HistogramBucketsAreCumulative) {
+  std::vector<TableInfo> tables(1);
+  tables[0].set_name("dist");
+  Histogram* histogram =
+      tables[0].mutable_histograms()->mutable_sample_wait_us();
+  histogram->set_count(3);
+  histogram->set_sum(40);
+  auto* bucket = histogram->add_buckets();
+  bucket->set_lower_bound(3);
+  bucket->set_upper_bound(4);
+  bucket->set_count(1);
+  bucket = histogram->add_buckets();
+  bucket->set_lower_bound(18);
+  bucket->set_upper_bound(19);
+  bucket->set_count(2);
+
+  std::string text = TableInfosToPrometheusText(tables);
+  EXPECT_THAT(text, HasSubstr("# TYPE reverb_table_sample_wait_us histogram\n"
+                              "reverb_table_sample_wait_us_bucket{"
+                              "table=\"dist\",le=\"3\"} 1\n"
+                              "reverb_table_sample_wait_us_bucket{"
+                              "table=\"dist\",le=\"18\"} 3\n"
+                              "reverb_table_sample_wait_us_bucket{"
+                              "table=\"dist\",le=\"+Inf\"} 3\n"
+                              "reverb_table_sample_wait_us_sum{"
+                              "table=\"dist\"} 40\n"
+                              "reverb_table_sample_wait_us_count{"
+                              "table=\"dist\"} 3\n"));
+  EXPECT_THAT(text, HasSubstr("reverb_table_lock_hold_us_count{table=\"dist\"} "
+                              "0\n"));
+}
+
+TEST(PrometheusTextTest, LabelValuesAreEscaped) {
+  std::vector<TableInfo> tables(1);
+  tables[0].set_name("a\"b\\c\nd");
+  std::string text = TableInfosToPrometheusText(tables);
+  EXPECT_THAT(text, HasSubstr("{table=\"a\\\"b\\\\c\\nd\"}"));
+  EXPECT_THAT(text, Not(HasSubstr("a\"b")));
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
@@ -0,0 +1,95 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/sample_stream_response_builder.h"
+
+#include <cstdint>
+#include <string>
+
+#include "google/protobuf/io/coded_stream.h"
+#include "grpcpp/support/byte_buffer.h"
+#include "grpcpp/support/slice.h"
+#include "absl/types/span.h"
+#include "reverb/cc/platform/logging.h"
+#include "reverb/cc/reverb_service.pb.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+using ::google::protobuf::io::CodedOutputStream;
+
+// Tags of the length delimited fields `SampleStreamResponse.entries` and
+// `SampleStreamResponse.SampleEntry.data`.
+constexpr char kEntriesTag = (1 << 3) | 2;
+constexpr char kDataTag = (2 << 3) | 2;
+
+void AppendVarint(uint64_t value, std::string* out) {
+  uint8_t buffer[10];
+  uint8_t* end = CodedOutputStream::WriteVarint64ToArray(value, buffer);
+  out->append(reinterpret_cast<const char*>(buffer), end - buffer);
+}
+
+}  // namespace
+
+void SampleStreamResponseBuilder::AddEntry(
+    const SampleStreamResponse::SampleEntry& entry,
+    absl::Span<const grpc::Slice> chunks) {
+  REVERB_CHECK_EQ(entry.data_size(), 0);
+
+  size_t entry_size = entry.ByteSizeLong();
+  for (const auto& chunk : chunks) {
+    entry_size +=
+        1 + CodedOutputStream::VarintSize64(chunk.size()) + chunk.size();
+  }
+
+  // Fields may appear in any order on the wire so the serialized entry is
+  // followed by its `data`. Everything except the chunks themselves is copied
+  // into small slices in between them.
+  std::string header;
+  header.push_back(kEntriesTag);
+  AppendVarint(entry_size, &header);
+  entry.AppendToString(&header);
+  for (const auto& chunk : chunks) {
+    header.push_back(kDataTag);
+    AppendVarint(chunk.size(), &header);
+    slices_.emplace_back(header);
+    slices_.push_back(chunk);
+    header.clear();
+  }
+  if (!header.empty()) {
+    slices_.emplace_back(header);
+  }
+  size_ += 1 + CodedOutputStream::VarintSize64(entry_size) + entry_size;
+}
+
+void SampleStreamResponseBuilder::AddFields(
+    const SampleStreamResponse& fields) {
+  REVERB_CHECK_EQ(fields.entries_size(), 0);
+  std::string bytes = fields.SerializeAsString();
+  size_ += bytes.size();
+  slices_.emplace_back(bytes);
+}
+
+grpc::ByteBuffer SampleStreamResponseBuilder::Build() {
+  grpc::ByteBuffer buffer(slices_.data(), slices_.size());
+  slices_.clear();
+  size_ = 0;
+  return buffer;
+}
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
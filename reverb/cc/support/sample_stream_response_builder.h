@@ -0,0 +1,64 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_SAMPLE_STREAM_RESPONSE_BUILDER_H_
+#define REVERB_CC_SUPPORT_SAMPLE_STREAM_RESPONSE_BUILDER_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "grpcpp/support/byte_buffer.h"
+#include "grpcpp/support/slice.h"
+#include "absl/types/span.h"
+#include "reverb/cc/reverb_service.pb.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Builds the wire format of a `SampleStreamResponse` as a sequence of slices.
+// The serialized chunks of an entry are referenced rather than copied, so a
+// chunk which is sampled many times only has to be serialized once (see
+// `ChunkStore::Chunk::WireBytes`). Only the (small) remainder of each entry is
+// serialized when it is added.
+class SampleStreamResponseBuilder {
+ public:
+  // Appends `entry` to the response with `chunks`, each a serialized
+  // `ChunkData`, as its `data`. `entry` must not have any `data` of its own.
+  void AddEntry(const SampleStreamResponse::SampleEntry& entry,
+                absl::Span<const grpc::Slice> chunks);
+
+  // Appends the fields of `fields` to the response. `fields` must not have any
+  // `entries`.
+  void AddFields(const SampleStreamResponse& fields);
+
+  // Whether no entries have been added since the last call to `Build`.
+  bool empty() const { return slices_.empty(); }
+
+  // Size of the serialized response built so far.
+  size_t ByteSizeLong() const { return size_; }
+
+  // Returns the response built so far and resets the builder.
+  grpc::ByteBuffer Build();
+
+ private:
+  std::vector<grpc::Slice> slices_;
+  size_t size_ = 0;
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_SAMPLE_STREAM_RESPONSE_BUILDER_H_
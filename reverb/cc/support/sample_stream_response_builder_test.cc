@@ -0,0 +1,132 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/sample_stream_response_builder.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "grpcpp/impl/codegen/proto_utils.h"
+#include "grpcpp/support/slice.h"
+#include "reverb/cc/reverb_service.pb.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/support/grpc_util.h"
+#include "reverb/cc/testing/proto_test_util.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+using ::deepmind::reverb::testing::EqualsProto;
+
+ChunkData MakeChunk(uint64_t key, int payload_size) {
+  ChunkData chunk;
+  chunk.set_chunk_key(key);
+  chunk.mutable_sequence_range()->set_episode_id(key);
+  chunk.mutable_sequence_range()->set_end(1);
+  chunk.mutable_data()->add_tensors()->set_tensor_content(
+      std::string(payload_size, 'x'));
+  return chunk;
+}
+
+SampleStreamResponse Parse(grpc::ByteBuffer* buffer) {
+  SampleStreamResponse response;
+  EXPECT_TRUE(grpc::SerializationTraits<SampleStreamResponse>::Deserialize(
+                  buffer, &response)
+                  .ok());
+  return response;
+}
+
+TEST(SampleStreamResponseBuilderTest, MatchesSerializedProto) {
+  // Large enough for the length prefixes to take more than one byte.
+  std::vector<ChunkData> chunks = {MakeChunk(1, 10), MakeChunk(2, 300),
+                                   MakeChunk(3, 100000)};
+
+  SampleStreamResponse expected;
+  SampleStreamResponseBuilder builder;
+
+  SampleStreamResponse::SampleEntry first;
+  first.mutable_info()->mutable_item()->set_key(7);
+  first.mutable_info()->mutable_item()->set_table("table");
+  first.mutable_info()->set_probability(0.5);
+  *expected.add_entries() = first;
+  *expected.mutable_entries(0)->add_data() = chunks[0];
+  *expected.mutable_entries(0)->add_data() = chunks[1];
+  builder.AddEntry(first, {SerializeToSlice(chunks[0]),
+                           SerializeToSlice(chunks[1])});
+
+  SampleStreamResponse::SampleEntry second;
+  second.set_end_of_sequence(true);
+  second.add_shared_memory_data()->set_length(3);
+  *expected.add_entries() = second;
+  *expected.mutable_entries(1)->add_data() = chunks[2];
+  builder.AddEntry(second, {SerializeToSlice(chunks[2])});
+
+  SampleStreamResponse::SampleEntry without_data;
+  without_data.set_end_of_sequence(true);
+  *expected.add_entries() = without_data;
+  builder.AddEntry(without_data, {});
+
+  SampleStreamResponse fields;
+  fields.set_shared_memory_ring("/reverb_shm_1");
+  expected.set_shared_memory_ring(fields.shared_memory_ring());
+  builder.AddFields(fields);
+
+  EXPECT_EQ(builder.ByteSizeLong(), expected.ByteSizeLong());
+  grpc::ByteBuffer buffer = builder.Build();
+  EXPECT_EQ(buffer.Length(), expected.ByteSizeLong());
+  EXPECT_THAT(Parse(&buffer), EqualsProto(expected));
+}
+
+TEST(SampleStreamResponseBuilderTest, BuildResetsBuilder) {
+  SampleStreamResponseBuilder builder;
+  EXPECT_TRUE(builder.empty());
+
+  SampleStreamResponse::SampleEntry entry;
+  entry.set_end_of_sequence(true);
+  builder.AddEntry(entry, {SerializeToSlice(MakeChunk(1, 10))});
+  EXPECT_FALSE(builder.empty());
+  grpc::ByteBuffer first = builder.Build();
+  EXPECT_TRUE(builder.empty());
+  EXPECT_EQ(builder.ByteSizeLong(), 0);
+
+  builder.AddEntry(entry, {});
+  grpc::ByteBuffer second = builder.Build();
+  EXPECT_EQ(Parse(&first).entries(0).data_size(), 1);
+  EXPECT_EQ(Parse(&second).entries(0).data_size(), 0);
+}
+
+TEST(SampleStreamResponseBuilderTest, SharesChunkSlices) {
+  grpc::Slice chunk = SerializeToSlice(MakeChunk(1, 1000));
+  SampleStreamResponseBuilder builder;
+  SampleStreamResponse::SampleEntry entry;
+  builder.AddEntry(entry, {chunk});
+  builder.AddEntry(entry, {chunk});
+  grpc::ByteBuffer buffer = builder.Build();
+
+  std::vector<grpc::Slice> slices;
+  ASSERT_TRUE(buffer.Dump(&slices).ok());
+  int references = 0;
+  for (const auto& slice : slices) {
+    if (slice.begin() == chunk.begin()) references++;
+  }
+  EXPECT_EQ(references, 2);
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
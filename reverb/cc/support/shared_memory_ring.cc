@@ -0,0 +1,240 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/shared_memory_ring.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include "absl/memory/memory.h"
+#include "absl/random/random.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/strip.h"
+#include "reverb/cc/platform/logging.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+constexpr uint64_t kMagic = 0x5245564552425348;  // "REVERBSH".
+
+// Payload starts at a cache line boundary after the header.
+constexpr size_t kHeaderSize = 256;
+
+// Prefix of the names generated by `Create`.
+constexpr absl::string_view kNamePrefix = "/reverb_shm_";
+
+absl::Status ErrnoToStatus(absl::string_view what, absl::string_view name) {
+  return absl::InternalError(
+      absl::StrCat(what, " failed for shared memory object ", name, ": ",
+                   std::strerror(errno)));
+}
+
+// Returns a name which cannot be guessed by other processes.
+std::string UniqueName() {
+  static std::atomic<uint64_t> counter(0);
+  absl::BitGen gen;
+  return absl::StrCat(kNamePrefix, getpid(), "_", counter.fetch_add(1), "_",
+                      absl::Hex(absl::Uniform<uint64_t>(gen)), "_",
+                      absl::Hex(absl::Uniform<uint64_t>(gen)));
+}
+
+// Whether `name` has the form of the names generated by `UniqueName`.
+bool IsValidName(absl::string_view name) {
+  if (!absl::ConsumePrefix(&name, kNamePrefix) || name.empty() ||
+      name.size() > 128) {
+    return false;
+  }
+  for (char c : name) {
+    if (!absl::ascii_isxdigit(c) && c != '_') return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+struct SharedMemoryRing::Header {
+  uint64_t magic;
+  uint64_t capacity;
+  // Offset one past the last byte written by the producer.
+  alignas(64) std::atomic<uint64_t> write_offset;
+  // Offset one past the last byte released by the consumer.
+  alignas(64) std::atomic<uint64_t> read_offset;
+};
+
+absl::StatusOr<std::unique_ptr<SharedMemoryRing>> SharedMemoryRing::Create(
+    size_t capacity) {
+  static_assert(sizeof(Header) <= kHeaderSize,
+                "Header does not fit in the reserved space.");
+  static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                "Shared memory offsets must be lock free.");
+  if (capacity == 0) {
+    return absl::InvalidArgumentError("capacity must be > 0.");
+  }
+  std::string name = UniqueName();
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) return ErrnoToStatus("shm_open", name);
+
+  const size_t mapping_size = kHeaderSize + capacity;
+  if (ftruncate(fd, mapping_size) != 0) {
+    auto status = ErrnoToStatus("ftruncate", name);
+    close(fd);
+    shm_unlink(name.c_str());
+    return status;
+  }
+  void* mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    auto status = ErrnoToStatus("mmap", name);
+    shm_unlink(name.c_str());
+    return status;
+  }
+
+  auto* header = new (mapping) Header;
+  header->magic = kMagic;
+  header->capacity = capacity;
+  header->write_offset.store(0, std::memory_order_relaxed);
+  header->read_offset.store(0, std::memory_order_release);
+
+  return absl::WrapUnique(new SharedMemoryRing(
+      std::move(name), /*owner=*/true, mapping, mapping_size));
+}
+
+absl::StatusOr<std::unique_ptr<SharedMemoryRing>> SharedMemoryRing::Open(
+    absl::string_view name) {
+  if (!IsValidName(name)) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Invalid shared memory ring name \"", absl::CEscape(name), "\"."));
+  }
+  std::string name_str(name);
+  int fd = shm_open(name_str.c_str(), O_RDWR, 0600);
+  if (fd < 0) return ErrnoToStatus("shm_open", name);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    auto status = ErrnoToStatus("fstat", name);
+    close(fd);
+    return status;
+  }
+  const size_t mapping_size = st.st_size;
+  if (mapping_size <= kHeaderSize) {
+    close(fd);
+    return absl::InvalidArgumentError(
+        absl::StrCat("Shared memory object ", name, " is too small (",
+                     mapping_size, " bytes)."));
+  }
+  void* mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) return ErrnoToStatus("mmap", name);
+
+  auto* header = static_cast<Header*>(mapping);
+  if (header->magic != kMagic ||
+      header->capacity != mapping_size - kHeaderSize) {
+    munmap(mapping, mapping_size);
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Shared memory object ", name, " is not a SharedMemoryRing."));
+  }
+  return absl::WrapUnique(new SharedMemoryRing(
+      std::move(name_str), /*owner=*/false, mapping, mapping_size));
+}
+
+SharedMemoryRing::SharedMemoryRing(std::string name, bool owner, void* mapping,
+                                   size_t mapping_size)
+    : name_(std::move(name)),
+      owner_(owner),
+      mapping_(mapping),
+      mapping_size_(mapping_size),
+      header_(static_cast<Header*>(mapping)),
+      data_(static_cast<char*>(mapping) + kHeaderSize),
+      capacity_(mapping_size - kHeaderSize) {}
+
+SharedMemoryRing::~SharedMemoryRing() {
+  if (munmap(mapping_, mapping_size_) != 0) {
+    REVERB_LOG(REVERB_ERROR) << "munmap failed for " << name_ << ": "
+                             << std::strerror(errno);
+  }
+  Unlink();
+}
+
+void SharedMemoryRing::Unlink() {
+  if (owner_ && shm_unlink(name_.c_str()) != 0) {
+    REVERB_LOG(REVERB_ERROR) << "shm_unlink failed for " << name_ << ": "
+                             << std::strerror(errno);
+  }
+  owner_ = false;
+}
+
+bool SharedMemoryRing::Allocate(size_t length, uint64_t* offset, char** data) {
+  if (length == 0 || length > capacity_) return false;
+
+  uint64_t begin = header_->write_offset.load(std::memory_order_relaxed);
+  // Blocks must be contiguous so skip the tail of the buffer if the block
+  // would otherwise wrap around.
+  const uint64_t position = begin % capacity_;
+  if (position + length > capacity_) {
+    begin += capacity_ - position;
+  }
+  const uint64_t end = begin + length;
+  if (end - header_->read_offset.load(std::memory_order_acquire) >
+      capacity_) {
+    return false;
+  }
+
+  *offset = begin;
+  *data = data_ + begin % capacity_;
+  return true;
+}
+
+void SharedMemoryRing::Commit(uint64_t offset, size_t length) {
+  // Release ordering makes the payload visible to the consumer before the new
+  // offset is.
+  header_->write_offset.store(offset + length, std::memory_order_release);
+}
+
+absl::StatusOr<absl::string_view> SharedMemoryRing::Get(uint64_t offset,
+                                                       size_t length) const {
+  const uint64_t read = header_->read_offset.load(std::memory_order_relaxed);
+  const uint64_t write = header_->write_offset.load(std::memory_order_acquire);
+  if (length == 0 || length > capacity_ || offset < read ||
+      offset + length > write || offset % capacity_ + length > capacity_) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Block [", offset, ", ", offset + length,
+        ") is not within the unreleased region [", read, ", ", write,
+        ") of shared memory object ", name_, "."));
+  }
+  return absl::string_view(data_ + offset % capacity_, length);
+}
+
+void SharedMemoryRing::Release(uint64_t offset, size_t length) {
+  const uint64_t end = offset + length;
+  if (end > header_->read_offset.load(std::memory_order_relaxed)) {
+    header_->read_offset.store(end, std::memory_order_release);
+  }
+}
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
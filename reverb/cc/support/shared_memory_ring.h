@@ -0,0 +1,128 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_SUPPORT_SHARED_MEMORY_RING_H_
+#define REVERB_CC_SUPPORT_SHARED_MEMORY_RING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+
+// Single producer, single consumer byte ring buffer backed by a POSIX shared
+// memory object. It is used to pass sampled chunk payloads from a server to a
+// `Sampler` running in a different process on the same host without routing
+// the bytes through gRPC. Note that the consumer parses the payloads out of
+// the ring, so this saves the gRPC serialization and transport but not a copy.
+//
+// The producer (i.e the server) creates the ring with `Create`, which picks a
+// random name, and sends the `name` to the consumer (i.e the client) which maps
+// it using `Open`. Once the consumer has confirmed that the ring is mapped the
+// producer calls `Unlink` so that no other process can open it. Only names
+// generated by `Create` are accepted by `Open`. Blocks
+// are identified by their monotonically increasing `offset` (the physical
+// position is `offset % capacity`) so a block is never split across the end of
+// the buffer. The offsets and lengths of written blocks are communicated
+// out-of-band (over the gRPC stream) and the consumer acknowledges blocks, in
+// the order they were written, by calling `Release`. The producer never
+// overwrites bytes which have not been released so `Allocate` fails instead of
+// blocking when the consumer falls behind.
+//
+// Writing a block is split into `Allocate`, which reserves the memory, and
+// `Commit`, which publishes it to the consumer once the payload has been
+// written.
+//
+// The object is not thread safe; each side is expected to be used by a single
+// thread at a time.
+class SharedMemoryRing {
+ public:
+  // Creates and maps a new shared memory object with room for `capacity` bytes
+  // of payload. The object can only be opened by processes of the same user
+  // and is unlinked when the returned ring is destroyed, unless `Unlink` was
+  // called before that.
+  static absl::StatusOr<std::unique_ptr<SharedMemoryRing>> Create(
+      size_t capacity);
+
+  // Maps an existing ring created (and still owned) by another process. Returns
+  // InvalidArgumentError if `name` could not have been generated by `Create`.
+  static absl::StatusOr<std::unique_ptr<SharedMemoryRing>> Open(
+      absl::string_view name);
+
+  SharedMemoryRing(const SharedMemoryRing&) = delete;
+  SharedMemoryRing& operator=(const SharedMemoryRing&) = delete;
+
+  ~SharedMemoryRing();
+
+  // Name of the shared memory object. Used by the consumer to `Open` the ring.
+  const std::string& name() const { return name_; }
+
+  // Removes the name of the shared memory object so that it can no longer be
+  // opened. Existing mappings, including this one, remain valid. Noop for
+  // rings returned by `Open` and when called more than once.
+  void Unlink();
+
+  // Number of payload bytes that can be held by the ring.
+  size_t capacity() const { return capacity_; }
+
+  // Reserves `length` contiguous bytes for writing. Returns false if `length`
+  // exceeds the capacity or if not enough bytes have been released by the
+  // consumer, in which case the caller should send the payload using a
+  // different transport. On success `offset` identifies the block and `data`
+  // points to the writable memory. The block is not visible to the consumer
+  // until it is committed and a block which is not committed before the next
+  // call to `Allocate` is discarded.
+  bool Allocate(size_t length, uint64_t* offset, char** data);
+
+  // Publishes the block returned by the last call to `Allocate` to the
+  // consumer. Must be called after the payload has been written to the block.
+  void Commit(uint64_t offset, size_t length);
+
+  // Returns a view of a block previously written by the producer. Returns
+  // InvalidArgumentError if the block is not within the unreleased part of the
+  // ring. The view remains valid until the block is released.
+  absl::StatusOr<absl::string_view> Get(uint64_t offset, size_t length) const;
+
+  // Marks all blocks up to and including the one identified by `offset` and
+  // `length` as consumed so that the producer can reuse the memory.
+  void Release(uint64_t offset, size_t length);
+
+ private:
+  struct Header;
+
+  SharedMemoryRing(std::string name, bool owner, void* mapping,
+                   size_t mapping_size);
+
+  const std::string name_;
+  // Whether the name of the object still has to be unlinked by this ring.
+  bool owner_;
+  void* const mapping_;
+  const size_t mapping_size_;
+  Header* const header_;
+  char* const data_;
+  const size_t capacity_;
+};
+
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
+
+#endif  // REVERB_CC_SUPPORT_SHARED_MEMORY_RING_H_
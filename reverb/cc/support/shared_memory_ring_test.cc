@@ -0,0 +1,163 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/shared_memory_ring.h"
+
+#include <cstring>
+#include <memory>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "reverb/cc/platform/status_matchers.h"
+
+namespace deepmind {
+namespace reverb {
+namespace internal {
+namespace {
+
+void WriteBlock(SharedMemoryRing* ring, absl::string_view value,
+                uint64_t* offset) {
+  char* data;
+  ASSERT_TRUE(ring->Allocate(value.size(), offset, &data));
+  std::memcpy(data, value.data(), value.size());
+  ring->Commit(*offset, value.size());
+}
+
+TEST(SharedMemoryRingTest, ProducerWritesAreVisibleToConsumer) {
+  auto producer_or = SharedMemoryRing::Create(64);
+  REVERB_ASSERT_OK(producer_or.status());
+  auto producer = std::move(producer_or).value();
+  auto consumer_or = SharedMemoryRing::Open(producer->name());
+  REVERB_ASSERT_OK(consumer_or.status());
+  auto consumer = std::move(consumer_or).value();
+  EXPECT_EQ(consumer->capacity(), 64);
+
+  uint64_t first, second;
+  WriteBlock(producer.get(), "hello", &first);
+  WriteBlock(producer.get(), "world", &second);
+
+  auto first_or = consumer->Get(first, 5);
+  REVERB_ASSERT_OK(first_or.status());
+  EXPECT_EQ(first_or.value(), "hello");
+  auto second_or = consumer->Get(second, 5);
+  REVERB_ASSERT_OK(second_or.status());
+  EXPECT_EQ(second_or.value(), "world");
+}
+
+TEST(SharedMemoryRingTest, AllocateFailsUntilConsumerReleases) {
+  auto ring_or = SharedMemoryRing::Create(16);
+  REVERB_ASSERT_OK(ring_or.status());
+  auto ring = std::move(ring_or).value();
+
+  uint64_t first, second;
+  char* data;
+  WriteBlock(ring.get(), "0123456789", &first);
+  EXPECT_FALSE(ring->Allocate(10, &second, &data));
+  EXPECT_FALSE(ring->Allocate(17, &second, &data));
+
+  ring->Release(first, 10);
+  // The block does not fit before the end of the buffer so it is placed at the
+  // beginning of the next lap.
+  WriteBlock(ring.get(), "abcdefghij", &second);
+  EXPECT_EQ(second, 16);
+  auto value_or = ring->Get(second, 10);
+  REVERB_ASSERT_OK(value_or.status());
+  EXPECT_EQ(value_or.value(), "abcdefghij");
+}
+
+TEST(SharedMemoryRingTest, BlocksAreNotVisibleUntilCommitted) {
+  auto producer_or = SharedMemoryRing::Create(64);
+  REVERB_ASSERT_OK(producer_or.status());
+  auto producer = std::move(producer_or).value();
+  auto consumer_or = SharedMemoryRing::Open(producer->name());
+  REVERB_ASSERT_OK(consumer_or.status());
+  auto consumer = std::move(consumer_or).value();
+
+  uint64_t offset;
+  char* data;
+  ASSERT_TRUE(producer->Allocate(5, &offset, &data));
+  EXPECT_EQ(consumer->Get(offset, 5).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  std::memcpy(data, "hello", 5);
+  producer->Commit(offset, 5);
+  auto value_or = consumer->Get(offset, 5);
+  REVERB_ASSERT_OK(value_or.status());
+  EXPECT_EQ(value_or.value(), "hello");
+}
+
+TEST(SharedMemoryRingTest, AllocateDiscardsUncommittedBlock) {
+  auto ring_or = SharedMemoryRing::Create(16);
+  REVERB_ASSERT_OK(ring_or.status());
+  auto ring = std::move(ring_or).value();
+
+  uint64_t first, second;
+  char* data;
+  ASSERT_TRUE(ring->Allocate(10, &first, &data));
+  WriteBlock(ring.get(), "0123456789", &second);
+  EXPECT_EQ(first, second);
+}
+
+TEST(SharedMemoryRingTest, GetRejectsBlocksOutsideOfUnreleasedRegion) {
+  auto ring_or = SharedMemoryRing::Create(16);
+  REVERB_ASSERT_OK(ring_or.status());
+  auto ring = std::move(ring_or).value();
+
+  uint64_t offset;
+  WriteBlock(ring.get(), "abcd", &offset);
+  EXPECT_EQ(ring->Get(offset, 5).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  ring->Release(offset, 4);
+  EXPECT_EQ(ring->Get(offset, 4).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(SharedMemoryRingTest, OpenFailsForUnknownName) {
+  EXPECT_EQ(SharedMemoryRing::Open("/reverb_shm_0_0_0_0").status().code(),
+            absl::StatusCode::kInternal);
+}
+
+TEST(SharedMemoryRingTest, OpenRejectsNamesNotGeneratedByCreate) {
+  for (absl::string_view name :
+       {"", "/", "/reverb_shm_", "/dev_shm_object", "reverb_shm_1_2_3_4",
+        "/reverb_shm_1/../../etc", "/reverb_shm_../x", "/reverb_shm_1_2/3"}) {
+    EXPECT_EQ(SharedMemoryRing::Open(name).status().code(),
+              absl::StatusCode::kInvalidArgument)
+        << name;
+  }
+}
+
+TEST(SharedMemoryRingTest, UnlinkKeepsMappingsValid) {
+  auto producer_or = SharedMemoryRing::Create(64);
+  REVERB_ASSERT_OK(producer_or.status());
+  auto producer = std::move(producer_or).value();
+  auto consumer_or = SharedMemoryRing::Open(producer->name());
+  REVERB_ASSERT_OK(consumer_or.status());
+  auto consumer = std::move(consumer_or).value();
+
+  producer->Unlink();
+  EXPECT_FALSE(SharedMemoryRing::Open(producer->name()).ok());
+
+  uint64_t offset;
+  WriteBlock(producer.get(), "hello", &offset);
+  auto value_or = consumer->Get(offset, 5);
+  REVERB_ASSERT_OK(value_or.status());
+  EXPECT_EQ(value_or.value(), "hello");
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace reverb
+}  // namespace deepmind
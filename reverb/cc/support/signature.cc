@@ -14,7 +14,9 @@
 
 #include "reverb/cc/support/signature.h"
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
@@ -220,22 +222,31 @@ absl::Status AddBatchDim(tensorflow::StructuredValue* value, int batch_size) {
   return absl::OkStatus();
 }
 
-tensorflow::StructuredValue StructuredValueFromItem(const TableItem& item) {
+absl::StatusOr<tensorflow::StructuredValue> StructuredValueFromItem(
+    const TableItem& item) {
   tensorflow::StructuredValue value;
 
-  auto get_tensor = [&](const FlatTrajectory::ChunkSlice& slice) {
+  // Keeps the data referenced by the returned tensors from being spilled.
+  std::vector<std::shared_ptr<const ChunkData>> pinned;
+  auto get_tensor = [&](const FlatTrajectory::ChunkSlice& slice)
+      -> absl::StatusOr<const tensorflow::TensorProto*> {
     for (const auto& chunk : item.chunks()) {
       if (chunk->key() == slice.chunk_key()) {
-        return &chunk->data().data().tensors(slice.index());
+        REVERB_ASSIGN_OR_RETURN(auto data, chunk->Pin());
+        pinned.push_back(std::move(data));
+        return &pinned.back()->data().tensors(slice.index());
       }
     }
-    REVERB_CHECK(false) << "Invalid item.";
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid item: chunk ", slice.chunk_key(),
+                     " is not referenced by the item."));
   };
 
   for (int col_idx = 0; col_idx < item.flat_trajectory().columns_size();
        col_idx++) {
     const auto& col = item.flat_trajectory().columns(col_idx);
-    const auto* tensor_proto = get_tensor(col.chunk_slices(0));
+    REVERB_ASSIGN_OR_RETURN(const auto* tensor_proto,
+                            get_tensor(col.chunk_slices(0)));
 
     auto* spec =
         value.mutable_list_value()->add_values()->mutable_tensor_spec_value();
@@ -19,6 +19,7 @@
 #include <vector>
 
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
 #include "reverb/cc/platform/hash_map.h"
@@ -56,8 +57,10 @@ tensorflow::StructuredValue StructuredValueFromChunkData(
     const ChunkData& chunk_data);
 
 // Create a structured value of the trajectory referenced by `item`. Non
-// squeezed columns are assigned a batch dimension of -1.
-tensorflow::StructuredValue StructuredValueFromItem(const TableItem& item);
+// squeezed columns are assigned a batch dimension of -1. Fails if the data of
+// a chunk could not be paged in.
+absl::StatusOr<tensorflow::StructuredValue> StructuredValueFromItem(
+    const TableItem& item);
 
 // Map from table name to optional vector of flattened (dtype, shape) pairs.
 typedef internal::flat_hash_map<std::string, internal::DtypesAndShapes>
@@ -14,16 +14,56 @@
 
 #include "reverb/cc/support/task_executor.h"
 
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "reverb/cc/platform/logging.h"
+
 namespace deepmind {
 namespace reverb {
+namespace {
+
+// Executor and index of the worker running on the current thread, if any.
+thread_local const TaskExecutor* current_executor = nullptr;
+thread_local size_t current_worker = 0;
+
+}  // namespace
+
+struct TaskExecutor::Worker {
+  absl::Mutex mu;
+  std::deque<internal::Task> tasks ABSL_GUARDED_BY(mu);
+  // Number of tasks in `tasks`. Lets thieves skip empty deques without
+  // acquiring `mu`.
+  std::atomic<int64_t> size{0};
+};
 
 TaskExecutor::TaskExecutor(size_t num_threads,
                            const std::string& thread_name_prefix)
-    : queue_() {
-  for (int thread_index = 0; thread_index < num_threads; thread_index++) {
+    : TaskExecutor(num_threads, thread_name_prefix, Options()) {}
+
+TaskExecutor::TaskExecutor(size_t num_threads,
+                           const std::string& thread_name_prefix,
+                           Options options) {
+  // Tasks scheduled on an executor without threads are run by `Close`.
+  for (size_t i = 0; i < std::max<size_t>(num_threads, 1); i++) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  for (size_t thread_index = 0; thread_index < num_threads; thread_index++) {
     threads_.push_back(internal::StartThread(
         absl::StrCat(thread_name_prefix, "_", thread_index),
-        [this] { RunWorker(); }));
+        [this, thread_index, options] {
+          if (options.pin_threads) {
+            REVERB_LOG_IF(REVERB_WARNING,
+                          !internal::PinCurrentThreadToCpu(thread_index))
+                << "Failed to pin executor thread " << thread_index
+                << " to a CPU.";
+          }
+          RunWorker(thread_index);
+        }));
   }
 }
 
@@ -31,25 +71,112 @@ TaskExecutor::~TaskExecutor() {
   Close();
 }
 
-void TaskExecutor::Schedule(const std::function<void()>& callback) {
-  queue_.Push(std::move(callback));
+void TaskExecutor::Schedule(internal::Task task) {
+  size_t index;
+  if (current_executor == this) {
+    index = current_worker;
+  } else {
+    // Threads outside of the pool always feed the same deque so that tasks
+    // scheduled by one thread are picked up in the order they were scheduled
+    // (unless stolen) and distinct threads are unlikely to share a deque.
+    static thread_local const size_t thread_hash =
+        std::hash<std::thread::id>()(std::this_thread::get_id());
+    index = thread_hash % workers_.size();
+  }
+
+  Worker& worker = *workers_[index];
+  {
+    absl::MutexLock lock(&worker.mu);
+    // Checking `closed_` while holding the lock guarantees that `Close` either
+    // sees the task when it drains the deque or that the task is dropped here.
+    if (closed_.load()) return;
+    num_queued_.fetch_add(1);
+    worker.tasks.push_back(std::move(task));
+    worker.size.fetch_add(1, std::memory_order_relaxed);
+  }
+  // A worker increments `num_sleeping_` before it checks `num_queued_` so
+  // either it sees the new task or we see that it has to be woken up.
+  if (num_sleeping_.load() > 0) {
+    absl::MutexLock lock(&idle_mu_);
+    wakeup_.Signal();
+  }
+}
+
+bool TaskExecutor::TryPop(size_t index, internal::Task* task) {
+  for (size_t i = 0; i < workers_.size(); i++) {
+    Worker& worker = *workers_[(index + i) % workers_.size()];
+    if (worker.size.load(std::memory_order_relaxed) == 0) continue;
+    absl::MutexLock lock(&worker.mu);
+    if (worker.tasks.empty()) continue;
+    *task = std::move(worker.tasks.front());
+    worker.tasks.pop_front();
+    worker.size.fetch_sub(1, std::memory_order_relaxed);
+    num_queued_.fetch_sub(1);
+    return true;
+  }
+  return false;
 }
 
 void TaskExecutor::Close() {
-  std::function<void()> callback;
-  // Before closing, we cancel all the pending tasks.
-  queue_.SetLastItemPushed();
-  while (queue_.Pop(&callback)) {
-    callback();
+  {
+    absl::MutexLock lock(&idle_mu_);
+    closed_.store(true);
+    wakeup_.SignalAll();
+  }
+  // Before closing, we run all the pending tasks.
+  internal::Task task;
+  while (TryPop(0, &task)) {
+    task();
+    task.Reset();
   }
   threads_.clear();  // Joins worker threads.
 }
 
-void TaskExecutor::RunWorker() {
-  std::function<void()> callback;
-  while (queue_.Pop(&callback)) {
-    callback();
+void TaskExecutor::RunWorker(size_t index) {
+  current_executor = this;
+  current_worker = index;
+  internal::Task task;
+  while (true) {
+    if (TryPop(index, &task)) {
+      task();
+      // Release whatever the task captured before going to sleep.
+      task.Reset();
+      continue;
+    }
+    absl::MutexLock lock(&idle_mu_);
+    num_sleeping_.fetch_add(1);
+    while (num_queued_.load() == 0 && !closed_.load()) {
+      wakeup_.Wait(&idle_mu_);
+    }
+    num_sleeping_.fetch_sub(1);
+    if (closed_.load() && num_queued_.load() == 0) break;
+  }
+  current_executor = nullptr;
+}
+
+absl::Status ParallelFor(TaskExecutor* executor, int n,
+                         const std::function<absl::Status(int)>& fn) {
+  if (executor == nullptr || n <= 1) {
+    for (int i = 0; i < n; i++) {
+      REVERB_RETURN_IF_ERROR(fn(i));
+    }
+    return absl::OkStatus();
+  }
+
+  std::vector<absl::Status> statuses(n);
+  absl::BlockingCounter counter(n);
+  for (int i = 0; i < n; i++) {
+    executor->Schedule([&fn, &statuses, &counter, i] {
+      statuses[i] = fn(i);
+      counter.DecrementCount();
+    });
+  }
+  counter.Wait();
+
+  for (auto& status : statuses) {
+    REVERB_RETURN_IF_ERROR(status);
   }
+  return absl::OkStatus();
 }
 
 }  // namespace reverb
@@ -15,40 +15,194 @@
 #ifndef REVERB_CC_TASK_EXECUTOR_H_
 #define REVERB_CC_TASK_EXECUTOR_H_
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
 #include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
 #include "reverb/cc/platform/status_macros.h"
 #include "reverb/cc/platform/thread.h"
-#include "reverb/cc/support/unbounded_queue.h"
 
 namespace deepmind {
 namespace reverb {
+namespace internal {
 
-// Class that implements a thread pool that executes tasks from a queue. It is
-// thread-safe.
+// Move-only `void()` callable. Callables of at most `kInlineSize` bytes are
+// stored inline so constructing, moving and running the task does not
+// allocate. Larger callables are moved to the heap.
+class Task {
+ public:
+  static constexpr size_t kInlineSize = 48;
+
+  Task() = default;
+
+  template <typename F, typename = std::enable_if_t<
+                            !std::is_same_v<std::decay_t<F>, Task>>>
+  Task(F&& fn) {  // NOLINT(google-explicit-constructor)
+    using Fn = std::decay_t<F>;
+    if constexpr (sizeof(Fn) <= kInlineSize &&
+                  alignof(Fn) <= alignof(std::max_align_t) &&
+                  std::is_nothrow_move_constructible_v<Fn>) {
+      new (storage_) Fn(std::forward<F>(fn));
+      ops_ = &kInlineOps<Fn>;
+    } else {
+      *reinterpret_cast<Fn**>(storage_) = new Fn(std::forward<F>(fn));
+      ops_ = &kHeapOps<Fn>;
+    }
+  }
+
+  Task(Task&& other) noexcept : ops_(other.ops_) {
+    if (ops_ != nullptr) {
+      ops_->move(other.storage_, storage_);
+      other.ops_ = nullptr;
+    }
+  }
+
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      Reset();
+      ops_ = other.ops_;
+      if (ops_ != nullptr) {
+        ops_->move(other.storage_, storage_);
+        other.ops_ = nullptr;
+      }
+    }
+    return *this;
+  }
+
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  ~Task() { Reset(); }
+
+  explicit operator bool() const { return ops_ != nullptr; }
+
+  // Runs the task. Must not be called on an empty task.
+  void operator()() { ops_->invoke(storage_); }
+
+  // Destroys the callable (and everything it captured) leaving the task empty.
+  void Reset() {
+    if (ops_ != nullptr) {
+      ops_->destroy(storage_);
+      ops_ = nullptr;
+    }
+  }
+
+ private:
+  struct Ops {
+    void (*invoke)(void* storage);
+    // Moves the callable from `from` to `to` and destroys what remains in
+    // `from`.
+    void (*move)(void* from, void* to);
+    void (*destroy)(void* storage);
+  };
+
+  template <typename Fn>
+  static constexpr Ops kInlineOps = {
+      [](void* storage) { (*static_cast<Fn*>(storage))(); },
+      [](void* from, void* to) {
+        new (to) Fn(std::move(*static_cast<Fn*>(from)));
+        static_cast<Fn*>(from)->~Fn();
+      },
+      [](void* storage) { static_cast<Fn*>(storage)->~Fn(); },
+  };
+
+  template <typename Fn>
+  static constexpr Ops kHeapOps = {
+      [](void* storage) { (**static_cast<Fn**>(storage))(); },
+      [](void* from, void* to) {
+        *static_cast<Fn**>(to) = *static_cast<Fn**>(from);
+      },
+      [](void* storage) { delete *static_cast<Fn**>(storage); },
+  };
+
+  alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+  const Ops* ops_ = nullptr;
+};
+
+}  // namespace internal
+
+// Class that implements a thread pool that executes tasks. It is thread-safe.
+//
+// Every worker thread owns a deque of tasks. Tasks scheduled from outside the
+// pool are pushed to a deque picked by the scheduling thread (so a thread
+// keeps feeding the same deque) while tasks scheduled from a worker are pushed
+// to its own deque. Workers run the tasks of their own deque in FIFO order and
+// steal from the other deques when it is empty, so concurrent producers rarely
+// contend on the same mutex. Workers only sleep when all deques are empty.
 class TaskExecutor {
  public:
+  struct Options {
+    // If true then worker `i` is pinned to CPU `i` (modulo the number of CPUs).
+    // Ignored on platforms which do not support thread affinity.
+    bool pin_threads = false;
+  };
+
   // Constructs a TaskExecutor.
   // num_threads: number of threads that will run tasks.
   // thread_name_prefix: is used as a prefix for the name of the threads.
   TaskExecutor(size_t num_threads, const std::string& thread_name_prefix);
+  TaskExecutor(size_t num_threads, const std::string& thread_name_prefix,
+               Options options);
 
   ~TaskExecutor();
 
-  // Schedules `task_cb` to be called as soon as possible.
-  void Schedule(const std::function<void()>& callback);
+  // Schedules `callback` to be called as soon as possible. Callbacks which are
+  // small enough (see `internal::Task`) are scheduled without allocating.
+  template <typename F, typename = std::enable_if_t<!std::is_same_v<
+                            std::decay_t<F>, internal::Task>>>
+  void Schedule(F&& callback) {
+    Schedule(internal::Task(std::forward<F>(callback)));
+  }
+  void Schedule(internal::Task task);
 
-  // Closes the thread pool and the queue. After calling this, no new tasks
-  // will be scheduled and pending tasks will run with a cancelled status.
+  // Closes the thread pool. After calling this, no new tasks will be scheduled
+  // and pending tasks are run before the worker threads are joined.
   void Close();
 
  private:
-  void RunWorker();
+  struct Worker;
 
-  internal::UnboundedQueue<std::function<void()>> queue_;
+  // Pops the oldest task from the deque of worker `index` or, if it is empty,
+  // steals one from another worker.
+  bool TryPop(size_t index, internal::Task* task);
+
+  void RunWorker(size_t index);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
   std::vector<std::unique_ptr<internal::Thread>> threads_;
+
+  std::atomic<bool> closed_{false};
+  // Number of tasks in all the deques. Incremented before a task is pushed and
+  // decremented after it has been popped so it is never less than the actual
+  // number.
+  std::atomic<int64_t> num_queued_{0};
+  // Number of workers which are (about to start) waiting on `wakeup_`.
+  std::atomic<int> num_sleeping_{0};
+
+  absl::Mutex idle_mu_;
+  absl::CondVar wakeup_;
 };
 
+// Calls `fn(i)` for every `i` in [0, n) using the threads of `executor` and
+// blocks until all calls have completed. If `executor` is null then the calls
+// are made sequentially on the calling thread. Returns the error of the lowest
+// `i` that failed, if any.
+//
+// Must not be called from a task running on `executor` as all its threads
+// could then end up waiting for each other.
+absl::Status ParallelFor(TaskExecutor* executor, int n,
+                         const std::function<absl::Status(int)>& fn);
+
 }  // namespace reverb
 }  // namespace deepmind
 
@@ -0,0 +1,114 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "reverb/cc/platform/thread.h"
+#include "reverb/cc/support/task_executor.h"
+#include "reverb/cc/support/unbounded_queue.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+// The executor that `TaskExecutor` replaced: every worker pops
+// `std::function`s from a single mutex protected queue.
+class SingleQueueExecutor {
+ public:
+  SingleQueueExecutor(size_t num_threads, const std::string& name) {
+    for (size_t i = 0; i < num_threads; i++) {
+      threads_.push_back(internal::StartThread(name, [this] {
+        std::function<void()> callback;
+        while (queue_.Pop(&callback)) {
+          callback();
+        }
+      }));
+    }
+  }
+
+  ~SingleQueueExecutor() {
+    queue_.SetLastItemPushed();
+    threads_.clear();
+  }
+
+  void Schedule(const std::function<void()>& callback) {
+    queue_.Push(callback);
+  }
+
+ private:
+  internal::UnboundedQueue<std::function<void()>> queue_;
+  std::vector<std::unique_ptr<internal::Thread>> threads_;
+};
+
+constexpr int kTasksPerProducer = 10000;
+
+// Each of `state.range(0)` producer threads schedules `kTasksPerProducer`
+// callbacks on an executor with `state.range(1)` threads. The callbacks
+// capture about as much state as the insert completion callbacks of a table
+// (a weak pointer and a vector of keys).
+template <typename Executor>
+void BM_ScheduleFanIn(benchmark::State& state) {
+  const int num_producers = state.range(0);
+  Executor executor(state.range(1), "bench");
+  auto target = std::make_shared<int64_t>(0);
+  std::weak_ptr<int64_t> weak_target = target;
+
+  for (auto _ : state) {
+    absl::BlockingCounter done(num_producers * kTasksPerProducer);
+    std::vector<std::unique_ptr<internal::Thread>> producers;
+    for (int p = 0; p < num_producers; p++) {
+      producers.push_back(internal::StartThread("producer", [&, p] {
+        for (int i = 0; i < kTasksPerProducer; i++) {
+          std::vector<uint64_t> keys = {static_cast<uint64_t>(p),
+                                        static_cast<uint64_t>(i)};
+          executor.Schedule(
+              [&done, weak_target, keys = std::move(keys)] {
+                benchmark::DoNotOptimize(weak_target.lock());
+                benchmark::DoNotOptimize(keys.data());
+                done.DecrementCount();
+              });
+        }
+      }));
+    }
+    producers.clear();
+    done.Wait();
+  }
+  state.SetItemsProcessed(state.iterations() * num_producers *
+                          kTasksPerProducer);
+}
+
+void FanInArgs(benchmark::internal::Benchmark* b) {
+  for (int producers : {1, 4, 16}) {
+    for (int threads : {1, 4, 16}) {
+      b->Args({producers, threads});
+    }
+  }
+}
+
+BENCHMARK_TEMPLATE(BM_ScheduleFanIn, SingleQueueExecutor)
+    ->Apply(FanInArgs)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ScheduleFanIn, TaskExecutor)
+    ->Apply(FanInArgs)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
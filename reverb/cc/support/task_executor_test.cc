@@ -0,0 +1,198 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/support/task_executor.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "reverb/cc/platform/status_matchers.h"
+#include "reverb/cc/platform/thread.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+TEST(TaskExecutorTest, RunsScheduledTasks) {
+  std::atomic<int> count(0);
+  {
+    TaskExecutor executor(4, "test");
+    for (int i = 0; i < 100; i++) {
+      executor.Schedule([&count] { count++; });
+    }
+  }
+  EXPECT_EQ(count, 100);
+}
+
+TEST(TaskExecutorTest, RunsTasksOfSingleProducerInOrder) {
+  std::vector<int> order;
+  {
+    TaskExecutor executor(1, "test");
+    for (int i = 0; i < 1000; i++) {
+      executor.Schedule([&order, i] { order.push_back(i); });
+    }
+  }
+  ASSERT_THAT(order, ::testing::SizeIs(1000));
+  for (int i = 0; i < order.size(); i++) {
+    EXPECT_EQ(order[i], i);
+  }
+}
+
+TEST(TaskExecutorTest, IdleWorkersStealTasks) {
+  TaskExecutor executor(4, "test");
+  // All tasks are scheduled from the same thread, and thus pushed to the same
+  // deque, so they can only run concurrently if the other workers steal them.
+  absl::BlockingCounter started(4);
+  absl::Notification release;
+  for (int i = 0; i < 4; i++) {
+    executor.Schedule([&] {
+      started.DecrementCount();
+      release.WaitForNotification();
+    });
+  }
+  started.Wait();
+  release.Notify();
+}
+
+TEST(TaskExecutorTest, TasksCanScheduleTasks) {
+  std::atomic<int> count(0);
+  absl::BlockingCounter done(100);
+  TaskExecutor executor(4, "test");
+  for (int i = 0; i < 10; i++) {
+    executor.Schedule([&] {
+      for (int j = 0; j < 10; j++) {
+        executor.Schedule([&] {
+          count++;
+          done.DecrementCount();
+        });
+      }
+    });
+  }
+  done.Wait();
+  EXPECT_EQ(count, 100);
+}
+
+TEST(TaskExecutorTest, ConcurrentProducers) {
+  std::atomic<int> count(0);
+  {
+    TaskExecutor executor(4, "test");
+    std::vector<std::unique_ptr<internal::Thread>> producers;
+    for (int i = 0; i < 8; i++) {
+      producers.push_back(internal::StartThread("", [&] {
+        for (int j = 0; j < 1000; j++) {
+          executor.Schedule([&count] { count++; });
+        }
+      }));
+    }
+    producers.clear();  // Joins the producers.
+  }
+  EXPECT_EQ(count, 8000);
+}
+
+TEST(TaskExecutorTest, CloseRunsPendingTasksAndDropsNewOnes) {
+  std::atomic<int> count(0);
+  TaskExecutor executor(0, "test");
+  for (int i = 0; i < 10; i++) {
+    executor.Schedule([&count] { count++; });
+  }
+  EXPECT_EQ(count, 0);
+  executor.Close();
+  EXPECT_EQ(count, 10);
+  executor.Schedule([&count] { count++; });
+  EXPECT_EQ(count, 10);
+}
+
+TEST(TaskExecutorTest, PinnedThreadsRunTasks) {
+  std::atomic<int> count(0);
+  {
+    TaskExecutor::Options options;
+    options.pin_threads = true;
+    TaskExecutor executor(2, "test", options);
+    for (int i = 0; i < 100; i++) {
+      executor.Schedule([&count] { count++; });
+    }
+  }
+  EXPECT_EQ(count, 100);
+}
+
+TEST(TaskTest, RunsSmallAndLargeCallables) {
+  int small_calls = 0;
+  internal::Task small([&small_calls] { small_calls++; });
+  small();
+  EXPECT_EQ(small_calls, 1);
+
+  std::vector<int> large_calls;
+  char padding[2 * internal::Task::kInlineSize] = {};
+  internal::Task large([&large_calls, padding] {
+    large_calls.push_back(padding[0]);
+  });
+  internal::Task moved(std::move(large));
+  EXPECT_FALSE(large);
+  moved();
+  EXPECT_THAT(large_calls, ::testing::ElementsAre(0));
+}
+
+TEST(TaskTest, DestroysCapturesOnReset) {
+  auto captured = std::make_shared<int>(1);
+  internal::Task task([captured] {});
+  internal::Task other;
+  other = std::move(task);
+  EXPECT_EQ(captured.use_count(), 2);
+  other.Reset();
+  EXPECT_FALSE(other);
+  EXPECT_EQ(captured.use_count(), 1);
+}
+
+TEST(ParallelForTest, CallsFunctionForEveryIndex) {
+  TaskExecutor executor(4, "test");
+  std::vector<int> calls(100);
+  REVERB_EXPECT_OK(ParallelFor(&executor, calls.size(), [&calls](int i) {
+    calls[i]++;
+    return absl::OkStatus();
+  }));
+  EXPECT_THAT(calls, ::testing::Each(1));
+}
+
+TEST(ParallelForTest, RunsInlineWithoutExecutor) {
+  std::vector<int> calls(10);
+  REVERB_EXPECT_OK(ParallelFor(nullptr, calls.size(), [&calls](int i) {
+    calls[i]++;
+    return absl::OkStatus();
+  }));
+  EXPECT_THAT(calls, ::testing::Each(1));
+}
+
+TEST(ParallelForTest, ReturnsFirstError) {
+  TaskExecutor executor(4, "test");
+  auto status = ParallelFor(&executor, 10, [](int i) {
+    if (i == 3 || i == 7) {
+      return absl::InternalError(absl::StrCat("failed ", i));
+    }
+    return absl::OkStatus();
+  });
+  EXPECT_EQ(status, absl::InternalError("failed 3"));
+}
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
@@ -150,26 +150,25 @@ absl::Status UnpackChunkColumn(const ChunkData& chunk_data, int column,
         " which has ", chunk_data.data().tensors_size(), " columns."));
   }
 
-  *out = DecompressTensorFromProto(chunk_data.data().tensors(column));
+  REVERB_ASSIGN_OR_RETURN(
+      *out, DecompressTensorFromProto(chunk_data.data().tensors(column),
+                                      chunk_data.compression_codec()));
   if (chunk_data.delta_encoded()) {
-    *out = DeltaEncode(*out, /*encode=*/false);
+    DeltaEncodeInPlace(out, /*encode=*/false);
   }
 
   return absl::OkStatus();
 }
 
-absl::Status UnpackChunkColumnAndSlice(const ChunkData& chunk_data, int column,
-                                       int offset, int length,
-                                       tensorflow::Tensor* out) {
-  REVERB_RETURN_IF_ERROR(UnpackChunkColumn(chunk_data, column, out));
-
-  if (offset < 0 || offset + length > out->shape().dim_size(0)) {
+absl::Status SliceChunkColumn(const tensorflow::Tensor& column, int offset,
+                              int length, tensorflow::Tensor* out) {
+  if (offset < 0 || offset + length > column.shape().dim_size(0)) {
     return absl::InvalidArgumentError(absl::StrCat(
         "Cannot slice (", offset, ", ", offset + length,
-        ") out of tensor with shape ", out->shape().DebugString(), "."));
+        ") out of tensor with shape ", column.shape().DebugString(), "."));
   }
 
-  *out = out->Slice(offset, offset + length);
+  *out = column.Slice(offset, offset + length);
   if (!out->IsAligned()) {
     *out = tensorflow::tensor::DeepCopy(*out);
   }
@@ -177,6 +176,13 @@ absl::Status UnpackChunkColumnAndSlice(const ChunkData& chunk_data, int column,
   return absl::OkStatus();
 }
 
+absl::Status UnpackChunkColumnAndSlice(const ChunkData& chunk_data, int column,
+                                       int offset, int length,
+                                       tensorflow::Tensor* out) {
+  REVERB_RETURN_IF_ERROR(UnpackChunkColumn(chunk_data, column, out));
+  return SliceChunkColumn(*out, offset, length, out);
+}
+
 absl::Status UnpackChunkColumnAndSlice(const ChunkData& chunk_data,
                                        const FlatTrajectory::ChunkSlice& slice,
                                        tensorflow::Tensor* out) {
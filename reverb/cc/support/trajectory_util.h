@@ -66,6 +66,12 @@ int ColumnLength(const FlatTrajectory& trajectory, int column);
 absl::Status UnpackChunkColumn(const ChunkData& chunk_data, int column,
                                tensorflow::Tensor* out);
 
+// Returns an aligned tensor holding rows [offset, offset + length) of the
+// unpacked `column`. The slice shares the buffer of `column` unless a copy is
+// needed for alignment.
+absl::Status SliceChunkColumn(const tensorflow::Tensor& column, int offset,
+                              int length, tensorflow::Tensor* out);
+
 // Unpacks content of column (see `UnpackChunkColumn`) and returns an aligned
 // tensor of the desired slice,
 absl::Status UnpackChunkColumnAndSlice(const ChunkData& chunk_data, int column,
@@ -18,12 +18,15 @@
 #include <cstddef>
 #include <initializer_list>
 #include <memory>
+#include <numeric>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "google/protobuf/timestamp.pb.h"
 #include "absl/memory/memory.h"
+#include "absl/random/discrete_distribution.h"
+#include "absl/random/distributions.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
@@ -31,10 +34,12 @@
 #include "absl/synchronization/notification.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "reverb/cc/checkpointing/checkpoint.pb.h"
 #include "reverb/cc/chunk_store.h"
 #include "reverb/cc/errors.h"
+#include "reverb/cc/platform/checkpointing_utils.h"
 #include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/platform/hash_set.h"
 #include "reverb/cc/platform/logging.h"
@@ -51,13 +56,58 @@ namespace {
 
 using Extensions = std::vector<std::shared_ptr<TableExtension>>;
 
+inline bool IsTimestampBefore(const google::protobuf::Timestamp& a,
+                              const google::protobuf::Timestamp& b) {
+  return a.seconds() < b.seconds() ||
+         (a.seconds() == b.seconds() && a.nanos() < b.nanos());
+}
+
 inline bool IsInsertedBefore(const PrioritizedItem& a,
                              const PrioritizedItem& b) {
-  return a.inserted_at().seconds() < b.inserted_at().seconds() ||
-         (a.inserted_at().seconds() == b.inserted_at().seconds() &&
-          a.inserted_at().nanos() < b.inserted_at().nanos());
+  return IsTimestampBefore(a.inserted_at(), b.inserted_at());
+}
+
+// Returns true if a deterministic selector configured with `options` would
+// select `a` (with priority `a_priority`) before `b` (with priority
+// `b_priority`).
+inline bool IsSelectedBefore(const KeyDistributionOptions& options,
+                             const TableItem& a, double a_priority,
+                             const TableItem& b, double b_priority) {
+  switch (options.distribution_case()) {
+    case KeyDistributionOptions::kLifo:
+      return IsTimestampBefore(b.inserted_at(), a.inserted_at());
+    case KeyDistributionOptions::kHeap:
+      return options.heap().min_heap() ? a_priority < b_priority
+                                       : a_priority > b_priority;
+    default:
+      return IsTimestampBefore(a.inserted_at(), b.inserted_at());
+  }
+}
+
+// Returns the share of `total` assigned to the `index`:th of `num_shards`
+// shards when `total` is split as evenly as possible.
+inline int64_t ShareOf(int64_t total, int num_shards, int index) {
+  return total / num_shards + (index < total % num_shards ? 1 : 0);
 }
 
+// Collects the results of the per shard requests that a sample request on a
+// sharded table is split into. The original callback is called once all the
+// shard requests have completed.
+struct ShardedSampleRequest {
+  absl::Mutex mu;
+
+  // Number of shard requests which have not yet completed.
+  int pending ABSL_GUARDED_BY(mu) = 0;
+
+  // Samples from all completed shard requests and the first error (if any).
+  Table::SampleRequest merged ABSL_GUARDED_BY(mu);
+
+  // Callbacks of the shard requests. The shards only hold weak references so
+  // the callbacks must be kept alive until all of them have been called.
+  std::vector<std::shared_ptr<Table::SamplingCallback>> callbacks
+      ABSL_GUARDED_BY(mu);
+};
+
 inline void EncodeAsTimestampProto(absl::Time t,
                                    google::protobuf::Timestamp* proto) {
   const int64_t s = absl::ToUnixSeconds(t);
@@ -101,6 +151,7 @@ void Table::FinalizeSampleRequest(std::unique_ptr<Table::SampleRequest> request,
     return;
   }
   r->status = status;
+  histograms_.sample_wait_us.RecordMicros(absl::Now() - r->created_at);
   callback_executor_->Schedule([r] {
     auto to_notify = r->on_batch_done.lock();
     // Callback might have been destroyed in the meantime.
@@ -143,11 +194,41 @@ void NotifyPendingInserts(const std::vector<Table::InsertRequest>& requests) {
   }
 }
 
+void AddCompletedInsert(std::weak_ptr<Table::InsertCallback> callback,
+                        Table::Key key, Table::CompletedInserts* completed) {
+  // Streams usually have many inserts in flight so the most recent group is the
+  // most likely to match.
+  for (auto it = completed->rbegin(); it != completed->rend(); ++it) {
+    if (!it->first.owner_before(callback) && !callback.owner_before(it->first)) {
+      it->second.push_back(key);
+      return;
+    }
+  }
+  completed->emplace_back(std::move(callback), std::vector<Table::Key>{key});
+}
+
+void Table::NotifyCompletedInserts(CompletedInserts* completed) {
+  for (auto& [callback, keys] : *completed) {
+    callback_executor_->Schedule(
+        [callback = std::move(callback), keys = std::move(keys)] {
+          auto to_notify = callback.lock();
+          // Callback might have been destroyed in the meantime.
+          if (to_notify != nullptr) {
+            for (Table::Key key : keys) {
+              (*to_notify)(key);
+            }
+          }
+        });
+  }
+  completed->clear();
+}
+
 Table::Table(std::string name, std::shared_ptr<ItemSelector> sampler,
              std::shared_ptr<ItemSelector> remover, int64_t max_size,
              int32_t max_times_sampled,
              std::shared_ptr<RateLimiter> rate_limiter, Extensions extensions,
-             absl::optional<tensorflow::StructuredValue> signature)
+             absl::optional<tensorflow::StructuredValue> signature,
+             int num_shards, bool dense_keys)
     : sampler_(std::move(sampler)),
       remover_(std::move(remover)),
       num_deleted_episodes_(0),
@@ -163,8 +244,28 @@ Table::Table(std::string name, std::shared_ptr<ItemSelector> sampler,
       name_(std::move(name)),
       rate_limiter_(std::move(rate_limiter)),
       signature_(std::move(signature)),
-      sync_extensions_(std::move(extensions)) {
+      sync_extensions_(std::move(extensions)),
+      dense_keys_(dense_keys) {
+  REVERB_CHECK_GE(num_shards, 1);
+  REVERB_CHECK(!dense_keys_ || (num_shards == 1 && sync_extensions_.empty()))
+      << "Dense keys are not supported by sharded tables or with extensions.";
   REVERB_CHECK_OK(rate_limiter_->RegisterTable(this));
+  if (num_shards > 1) {
+    REVERB_CHECK(sync_extensions_.empty())
+        << "Extensions are not supported by sharded tables.";
+    CreateShards(num_shards);
+    {
+      // Used for the requests which are parked on the table itself.
+      absl::MutexLock lock(&mu_);
+      callback_executor_ =
+          std::make_shared<TaskExecutor>(1, "TableCallbackExecutor_" + name_);
+    }
+    table_worker_ =
+        internal::StartThread("ShardedSampleWorker_" + name_, [&]() {
+          ShardedSampleWorkerLoop();
+        });
+    return;
+  }
   for (auto& extension : sync_extensions_) {
     REVERB_CHECK_OK(extension->RegisterTable(&mu_, this));
   }
@@ -183,6 +284,8 @@ Table::~Table() {
   }
   // Join the worker thread
   table_worker_ = nullptr;
+  // Join the workers of the shards as they notify this table about inserts.
+  shards_.clear();
   // Join the extension worker thread.
   extension_worker_ = nullptr;
   rate_limiter_->UnregisterTable(&mu_, this);
@@ -200,12 +303,21 @@ absl::Status Table::TableWorkerLoop() {
   std::vector<InsertRequest> current_inserts;
   // Index of the next item in the `pending_inserts` to be processed.
   int insert_idx = 0;
+  // Keys of the inserts committed in the current batch grouped by stream.
+  CompletedInserts completed_inserts;
+  // Maximum number of inserts committed in one go while sample requests are
+  // waiting. Set to the number of samples committed during the last sampling
+  // turn so that inserts and samples take turns of the same size.
+  int insert_budget = 1;
   // Collection of sample requests to be processed.
   std::vector<std::unique_ptr<SampleRequest>> current_sampling;
   // Index of the next request from the `sampling_requests` to be processed.
   int sample_idx = 0;
   // Whether the next sample was rate limited.
   bool rate_limited = false;
+  // Set when the worker goes to sleep as all pending requests are blocked by
+  // the rate limiter and cleared once a request is committed again.
+  absl::optional<absl::Time> blocked_since;
   // Response size of the currently processed sampling request. Used to make
   // sure response doesn't exceed a certain size limit.
   int current_sampling_response_size_bytes = 0;
@@ -219,30 +331,52 @@ absl::Status Table::TableWorkerLoop() {
     worker_stats.Enter(TableWorkerState::kRunning);
   }
   while (true) {
+    // Whether any inserts were committed while holding `mu_` below.
+    bool items_inserted = false;
     {
       absl::MutexLock lock(&mu_);
+      const absl::Time locked_at = absl::Now();
+      const int64_t progress_before_lock = progress;
       // Tracks whether while loop below makes progress.
       int64_t prev_progress = progress - 1;
       while (prev_progress < progress) {
         prev_progress = progress;
-        // Try processing an insert request.
+        // Try processing a batch of insert requests.
         worker_stats.Enter(TableWorkerState::kActivelyInserting);
-        if (insert_idx < current_inserts.size() &&
-            rate_limiter_->CanInsert(&mu_, 1)) {
-          uint64_t id = current_inserts[insert_idx].item->key();
-          REVERB_RETURN_IF_ERROR(InsertOrAssignInternal(
-              std::move(current_inserts[insert_idx].item)));
-          auto callback =
-              std::move(current_inserts[insert_idx].insert_completed);
-          callback_executor_->Schedule([callback, id] {
-            auto to_notify = callback.lock();
-            // Callback might have been destroyed in the meantime.
-            if (to_notify != nullptr) {
-              (*to_notify)(id);
+        if (insert_idx < current_inserts.size()) {
+          const bool samplers_waiting = sample_idx < current_sampling.size();
+          const int batch_end = std::min<int>(
+              current_inserts.size(),
+              insert_idx +
+                  (samplers_waiting ? insert_budget : kMaxInsertsPerBatch));
+          // If the rate limiter allows for the whole batch to be inserted then
+          // it also allows for every prefix of it, so the per-item check can
+          // be skipped.
+          const bool batch_allowed =
+              rate_limiter_->CanInsert(&mu_, batch_end - insert_idx);
+          absl::Status status;
+          const int batch_start = insert_idx;
+          while (insert_idx < batch_end &&
+                 (batch_allowed || rate_limiter_->CanInsert(&mu_, 1))) {
+            auto& request = current_inserts[insert_idx];
+            const Key key = request.item->key();
+            status = InsertOrAssignInternal(std::move(request.item));
+            if (!status.ok()) break;
+            AddCompletedInsert(std::move(request.insert_completed), key,
+                               &completed_inserts);
+            insert_idx++;
+            progress++;
+          }
+          if (insert_idx > batch_start) {
+            const absl::Time committed_at = absl::Now();
+            for (int i = batch_start; i < insert_idx; i++) {
+              histograms_.insert_to_commit_us.RecordMicros(
+                  committed_at - current_inserts[i].created_at);
             }
-          });
-          insert_idx++;
-          progress++;
+          }
+          if (insert_idx > batch_start) items_inserted = true;
+          NotifyCompletedInserts(&completed_inserts);
+          REVERB_RETURN_IF_ERROR(status);
         }
         // Skip sampling requests which timed out already.
         worker_stats.Enter(TableWorkerState::kActivelySampling);
@@ -253,14 +387,19 @@ absl::Status Table::TableWorkerLoop() {
         // Try processing a sample request.
         if (sample_idx < current_sampling.size()) {
           auto& request = current_sampling[sample_idx];
+          int samples_committed = 0;
           while (rate_limiter_->MaybeCommitSample(&mu_)) {
             progress++;
+            samples_committed++;
             if (request->samples.empty()) {
               current_sampling_response_size_bytes = 0;
             }
+            // Number of samples still missing from the request.
+            const int batch_size =
+                request->samples.capacity() - request->samples.size();
             request->samples.emplace_back();
-            REVERB_RETURN_IF_ERROR(
-                SampleInternal(rate_limited, &request->samples.back()));
+            REVERB_RETURN_IF_ERROR(SampleInternal(
+                rate_limited, batch_size, &request->samples.back()));
             // Capacity of the samples collection indicates how many items
             // should be sampled.
             for (const auto& chunk : request->samples.back().ref->chunks()) {
@@ -277,8 +416,22 @@ absl::Status Table::TableWorkerLoop() {
               break;
             }
           }
+          insert_budget =
+              std::clamp(samples_committed, 1, kMaxInsertsPerBatch);
         }
       }
+      // Progress made while holding the lock means that inserts or samples
+      // were committed, i.e that the worker is no longer blocked.
+      const absl::Time unlocked_at = absl::Now();
+      histograms_.lock_hold_us.RecordMicros(unlocked_at - locked_at);
+      if (blocked_since.has_value() && progress != progress_before_lock) {
+        histograms_.rate_limiter_blocked_us.RecordMicros(unlocked_at -
+                                                         *blocked_since);
+        blocked_since.reset();
+      }
+    }
+    if (items_inserted && on_items_inserted_) {
+      on_items_inserted_();
     }
     worker_stats.Enter(TableWorkerState::kRunning);
     // Sampling requests that exceeded deadline and should be terminated.
@@ -334,10 +487,18 @@ absl::Status Table::TableWorkerLoop() {
             }
           }
           worker_stats.Enter(TableWorkerState::kWaitingForInserts);
+          if (!blocked_since.has_value()) blocked_since = deadline;
         } else if (insert_idx < current_inserts.size()) {
           worker_stats.Enter(TableWorkerState::kWaitingForSamples);
+          if (!blocked_since.has_value()) blocked_since = deadline;
         } else {
           worker_stats.Enter(TableWorkerState::kSleeping);
+          // The blocked requests timed out (or were cancelled).
+          if (blocked_since.has_value()) {
+            histograms_.rate_limiter_blocked_us.RecordMicros(deadline -
+                                                             *blocked_since);
+            blocked_since.reset();
+          }
         }
         worker_time_distribution_ = worker_stats;
         rate_limited =
@@ -463,10 +624,121 @@ absl::Status Table::ExtensionsWorkerLoop() {
 }
 
 void Table::SetCallbackExecutor(std::shared_ptr<TaskExecutor> executor) {
+  for (auto& shard : shards_) {
+    shard->SetCallbackExecutor(executor);
+  }
   absl::MutexLock lock(&mu_);
   callback_executor_ = executor;
 }
 
+void Table::CreateShards(int num_shards) {
+  absl::MutexLock lock(&mu_);
+  shard_sampler_options_ = sampler_->options();
+  const auto limiter = rate_limiter_->CheckpointReader(&mu_);
+  const int64_t shard_max_size = (max_size_ + num_shards - 1) / num_shards;
+
+  shards_.reserve(num_shards);
+  for (int i = 0; i < num_shards; i++) {
+    // The constraints of the rate limiter are split evenly across the shards.
+    // When the table is restored from a checkpoint the state of the rate
+    // limiter is spread across the shards in the same way.
+    RateLimiterCheckpoint shard_limiter = limiter;
+    shard_limiter.set_min_size_to_sample(std::max<int64_t>(
+        1, (limiter.min_size_to_sample() + num_shards - 1) / num_shards));
+    shard_limiter.set_min_diff(limiter.min_diff() / num_shards);
+    shard_limiter.set_max_diff(limiter.max_diff() / num_shards);
+    shard_limiter.set_insert_count(
+        ShareOf(limiter.insert_count(), num_shards, i));
+    shard_limiter.set_sample_count(
+        ShareOf(limiter.sample_count(), num_shards, i));
+    shard_limiter.set_delete_count(
+        ShareOf(limiter.delete_count(), num_shards, i));
+
+    shards_.push_back(std::make_unique<Table>(
+        /*name=*/name_,
+        /*sampler=*/MakeSelector(sampler_->options()),
+        /*remover=*/MakeSelector(remover_->options()),
+        /*max_size=*/shard_max_size,
+        /*max_times_sampled=*/max_times_sampled_,
+        /*rate_limiter=*/std::make_shared<RateLimiter>(shard_limiter)));
+    // The shard cannot receive any items before this function returns, so
+    // the callback is in place before the shard's worker could invoke it.
+    shards_.back()->on_items_inserted_ = [this] { OnShardItemsInserted(); };
+  }
+
+  // The state now lives in the shards' rate limiters.
+  rate_limiter_->Reset(&mu_);
+}
+
+void Table::OnShardItemsInserted() {
+  shard_insert_generation_.fetch_add(1, std::memory_order_acq_rel);
+  absl::MutexLock lock(&worker_mu_);
+  if (!pending_sampling_.empty()) {
+    shard_items_inserted_ = true;
+    wakeup_worker_.Signal();
+  }
+}
+
+void Table::ShardedSampleWorkerLoop() {
+  while (true) {
+    // Parked requests which exceeded their deadline.
+    std::vector<std::unique_ptr<SampleRequest>> to_terminate;
+    // Parked requests which are split across the shards again.
+    std::vector<std::unique_ptr<SampleRequest>> to_dispatch;
+    bool stop = false;
+    {
+      absl::MutexLock lock(&worker_mu_);
+      while (!stop_worker_ && !shard_items_inserted_ && to_terminate.empty()) {
+        auto wakeup = absl::InfiniteFuture();
+        GetExpiredRequests(absl::Now(), &pending_sampling_, &to_terminate,
+                           &wakeup);
+        pending_sampling_.erase(
+            std::remove(pending_sampling_.begin(), pending_sampling_.end(),
+                        nullptr),
+            pending_sampling_.end());
+        if (to_terminate.empty()) {
+          wakeup_worker_.WaitWithDeadline(&worker_mu_, wakeup);
+        }
+      }
+      stop = stop_worker_;
+      if (stop || shard_items_inserted_) {
+        shard_items_inserted_ = false;
+        std::swap(to_dispatch, pending_sampling_);
+      }
+    }
+    if (!to_terminate.empty() || stop) {
+      absl::MutexLock lock(&mu_);
+      for (auto& request : to_terminate) {
+        FinalizeSampleRequest(std::move(request),
+                              errors::RateLimiterTimeout());
+      }
+      if (stop) {
+        for (auto& request : to_dispatch) {
+          FinalizeSampleRequest(
+              std::move(request),
+              absl::CancelledError(
+                  "EnqueSampleRequest: RateLimiter has been cancelled"));
+        }
+        return;
+      }
+    }
+    // The requests are parked again if the items were removed before they
+    // could be dispatched.
+    for (auto& request : to_dispatch) {
+      EnqueShardedSampleRequest(request->samples.capacity(),
+                                std::move(request->on_batch_done),
+                                request->deadline - absl::Now());
+    }
+  }
+}
+
+size_t Table::ShardIndex(Key key) const {
+  // Keys are mixed before being partitioned so that keys with regular
+  // patterns (e.g. sequential) are spread evenly across the shards.
+  const uint64_t mixed = (key * 0x9E3779B97F4A7C15ULL) >> 32;
+  return mixed % shards_.size();
+}
+
 void Table::EnableTableWorker(std::shared_ptr<TaskExecutor> executor) {
   SetCallbackExecutor(std::move(executor));
 
@@ -500,12 +772,23 @@ void Table::EnableTableWorker(std::shared_ptr<TaskExecutor> executor) {
 
 std::vector<Table::Item> Table::Copy(size_t count) const {
   std::vector<Item> items;
-  absl::MutexLock lock(&mu_);
-  items.reserve(count == 0 ? data_.size() : count);
-  for (auto it = data_.cbegin();
-       it != data_.cend() && (count == 0 || items.size() < count); it++) {
-    items.push_back(*it->second);
+  if (!shards_.empty()) {
+    for (const auto& shard : shards_) {
+      if (count != 0 && items.size() >= count) break;
+      auto shard_items =
+          shard->Copy(count == 0 ? 0 : count - items.size());
+      items.insert(items.end(), std::make_move_iterator(shard_items.begin()),
+                   std::make_move_iterator(shard_items.end()));
+    }
+    return items;
   }
+  absl::MutexLock lock(&mu_);
+  items.reserve(count == 0 ? NumItems() : count);
+  ForEachItem([&](const std::shared_ptr<Item>& item) {
+    if (count == 0 || items.size() < count) {
+      items.push_back(*item);
+    }
+  });
   return items;
 }
 
@@ -529,9 +812,14 @@ absl::Status Table::InsertOrAssign(Item item, absl::Duration timeout) {
 absl::Status Table::InsertOrAssignAsync(
     Item item, bool* can_insert_more,
     std::weak_ptr<InsertCallback> insert_completed) {
+  if (!shards_.empty()) {
+    const size_t shard = ShardIndex(item.key());
+    return shards_[shard]->InsertOrAssignAsync(
+        std::move(item), can_insert_more, std::move(insert_completed));
+  }
   REVERB_RETURN_IF_ERROR(CheckItemValidity(item));
   InsertRequest request{std::make_shared<Item>(std::move(item)),
-                        std::move(insert_completed)};
+                        std::move(insert_completed), absl::Now()};
   // Table worker doesn't release memory of removed items, clients do that
   // asynchrously.
   std::shared_ptr<Item> to_delete;
@@ -552,9 +840,23 @@ absl::Status Table::InsertOrAssignAsync(
 }
 
 absl::Status Table::InsertOrAssignInternal(std::shared_ptr<Item> item) {
+  if (dense_keys_) {
+    // Writers reusing a key assign to the item they inserted before rather
+    // than adding a new one.
+    const Key writer_key = item->key();
+    auto it = dense_keys_by_writer_key_.find(writer_key);
+    if (it != dense_keys_by_writer_key_.end()) {
+      item->set_key(it->second);
+    } else {
+      const Key dense_key = next_dense_key_++;
+      dense_keys_by_writer_key_.emplace(writer_key, dense_key);
+      writer_keys_.Insert(dense_key, writer_key);
+      item->set_key(dense_key);
+    }
+  }
   const auto key = item->key();
   const auto priority = item->priority();
-  if (data_.contains(key)) {
+  if (FindItem(key) != nullptr) {
     REVERB_RETURN_IF_ERROR(UpdateItem(key, priority));
     ExtensionOperation(ExtensionRequest::CallType::kMemoryRelease, item);
     WaitForBackgroundWork();
@@ -564,24 +866,23 @@ absl::Status Table::InsertOrAssignInternal(std::shared_ptr<Item> item) {
   // Set the insertion timestamp after the lock has been acquired as this
   // represents the order it was inserted into the sampler and remover.
   EncodeAsTimestampProto(absl::Now(), item->unsafe_mutable_inserted_at());
-  data_[key] = std::move(item);
+  StoreItem(item);
 
   REVERB_RETURN_IF_ERROR(sampler_->Insert(key, priority));
+  presampled_.clear();
   REVERB_RETURN_IF_ERROR(remover_->Insert(key, priority));
 
-  auto it = data_.find(key);
-
   // Increment references to the episode/s the item is referencing.
   // We increment before a possible call to DeleteItem since the sampler can
   // return this key.
-  for (const auto& chunk : it->second->chunks()) {
+  for (const auto& chunk : item->chunks()) {
     ++episode_refs_[chunk->episode_id()];
   }
 
-  ExtensionOperation(ExtensionRequest::CallType::kInsert, it->second);
+  ExtensionOperation(ExtensionRequest::CallType::kInsert, item);
 
   // Remove an item if we exceeded `max_size_`.
-  if (data_.size() > max_size_) {
+  if (NumItems() > max_size_) {
     REVERB_RETURN_IF_ERROR(DeleteItem(remover_->Sample().key));
   }
 
@@ -594,6 +895,23 @@ absl::Status Table::InsertOrAssignInternal(std::shared_ptr<Item> item) {
 
 absl::Status Table::MutateItems(absl::Span<const KeyWithPriority> updates,
                                 absl::Span<const Key> deletes) {
+  if (!shards_.empty()) {
+    // Group the operations by shard while preserving their relative order.
+    std::vector<std::vector<KeyWithPriority>> shard_updates(shards_.size());
+    std::vector<std::vector<Key>> shard_deletes(shards_.size());
+    for (const auto& update : updates) {
+      shard_updates[ShardIndex(update.key())].push_back(update);
+    }
+    for (const auto key : deletes) {
+      shard_deletes[ShardIndex(key)].push_back(key);
+    }
+    for (size_t i = 0; i < shards_.size(); i++) {
+      if (shard_updates[i].empty() && shard_deletes[i].empty()) continue;
+      REVERB_RETURN_IF_ERROR(
+          shards_[i]->MutateItems(shard_updates[i], shard_deletes[i]));
+    }
+    return absl::OkStatus();
+  }
   std::vector<std::shared_ptr<Item>> deleted_items(deletes.size());
   {
     absl::MutexLock lock(&mu_);
@@ -621,9 +939,14 @@ absl::Status Table::Sample(SampledItem* sampled_item, absl::Duration timeout) {
 void Table::EnqueSampleRequest(int num_samples,
                                std::weak_ptr<SamplingCallback> callback,
                                absl::Duration timeout) {
+  if (!shards_.empty()) {
+    EnqueShardedSampleRequest(num_samples, std::move(callback), timeout);
+    return;
+  }
   auto request = std::make_unique<SampleRequest>();
   request->on_batch_done = std::move(callback);
-  request->deadline = absl::Now() + timeout;
+  request->created_at = absl::Now();
+  request->deadline = request->created_at + timeout;
   // Reserved size is used to communicate sampling batch size (it eliminates the
   // need of alocating memory inside the table worker).
   request->samples.reserve(num_samples);
@@ -649,6 +972,198 @@ void Table::EnqueSampleRequest(int num_samples,
   }
 }
 
+void Table::EnqueShardedSampleRequest(int num_samples,
+                                      std::weak_ptr<SamplingCallback> callback,
+                                      absl::Duration timeout) {
+  const int num_shards = shards_.size();
+  const bool deterministic = shard_sampler_options_.is_deterministic();
+  // Read before the shards are inspected so that inserts which complete while
+  // the snapshot below is taken are not missed if the request is parked.
+  const int64_t insert_generation =
+      shard_insert_generation_.load(std::memory_order_acquire);
+
+  // Take a snapshot of the state of every shard. The shards are locked one at
+  // a time so the snapshot is not atomic across shards, which means that the
+  // probabilities computed below are only exact in the absence of concurrent
+  // mutations.
+  std::vector<int64_t> sizes(num_shards);
+  std::vector<double> weights(num_shards);
+  std::vector<bool> can_sample(num_shards);
+  std::vector<std::shared_ptr<Item>> heads(num_shards);
+  std::vector<double> head_priorities(num_shards);
+  std::vector<int32_t> head_times_sampled(num_shards);
+  for (int i = 0; i < num_shards; i++) {
+    Table* shard = shards_[i].get();
+    absl::MutexLock lock(&shard->mu_);
+    sizes[i] = shard->NumItems();
+    weights[i] = shard->sampler_->TotalWeight();
+    can_sample[i] = shard->rate_limiter_->CanSample(&shard->mu_, 1);
+    if (deterministic && sizes[i] > 0) {
+      // Deterministic selectors do not change state when sampled so this
+      // simply peeks at the item which the shard would return next. The
+      // fields of the item are mutated by the shard's worker so they are
+      // copied while the lock is held.
+      heads[i] = *shard->FindItem(shard->sampler_->Sample().key);
+      head_priorities[i] = heads[i]->priority();
+      head_times_sampled[i] = heads[i]->times_sampled();
+    }
+  }
+  const int64_t total_size =
+      std::accumulate(sizes.begin(), sizes.end(), int64_t{0});
+
+  if (total_size == 0) {
+    // None of the shards can serve the request yet and there is no telling
+    // which shard the next item will land in. Rather than blocking the
+    // request on an arbitrary shard it is parked on the table until an item
+    // has been inserted into any of the shards.
+    auto request = std::make_unique<SampleRequest>();
+    request->on_batch_done = std::move(callback);
+    request->created_at = absl::Now();
+    request->deadline = request->created_at + timeout;
+    request->samples.reserve(num_samples);
+    {
+      absl::MutexLock lock(&worker_mu_);
+      if (!stop_worker_) {
+        if (insert_generation !=
+            shard_insert_generation_.load(std::memory_order_acquire)) {
+          shard_items_inserted_ = true;
+        }
+        pending_sampling_.push_back(std::move(request));
+        wakeup_worker_.Signal();
+        return;
+      }
+    }
+    absl::MutexLock lock(&mu_);
+    FinalizeSampleRequest(
+        std::move(request),
+        absl::CancelledError(
+            "EnqueSampleRequest: RateLimiter has been cancelled"));
+    return;
+  }
+
+  // Number of samples to request from each shard and the factor which
+  // converts the probabilities returned by the shard into probabilities of
+  // the global distribution.
+  std::vector<int> counts(num_shards, 0);
+  std::vector<double> scales(num_shards, 1.0);
+
+  if (deterministic) {
+    // Only the shard holding the globally first item can be sampled without
+    // breaking the order of the selector. Deterministic selectors keep
+    // returning the same item until it is removed, so the shard can serve as
+    // many samples as the item has left before reaching `max_times_sampled_`.
+    int best = -1;
+    for (int i = 0; i < num_shards; i++) {
+      if (heads[i] != nullptr &&
+          (best == -1 ||
+           IsSelectedBefore(shard_sampler_options_, *heads[i],
+                            head_priorities[i], *heads[best],
+                            head_priorities[best]))) {
+        best = i;
+      }
+    }
+    int64_t remaining = num_samples;
+    if (max_times_sampled_ > 0) {
+      remaining = max_times_sampled_ - head_times_sampled[best];
+    }
+    counts[best] = std::max<int64_t>(
+        1, std::min<int64_t>(num_samples, remaining));
+  } else {
+    // The mass of a shard is the total weight of its items. If all items have
+    // zero weight then the selectors fall back to uniform sampling, so the
+    // mass of the shards becomes the number of items.
+    const double total_weight =
+        std::accumulate(weights.begin(), weights.end(), 0.0);
+    std::vector<double> masses(num_shards);
+    for (int i = 0; i < num_shards; i++) {
+      masses[i] = total_weight > 0 ? weights[i] : sizes[i];
+    }
+
+    // Prefer the shards whose rate limiter currently allows sampling so that
+    // requests are not parked on a blocked shard while others could serve
+    // them. If no shard can sample right now then the request is spread over
+    // all the shards.
+    std::vector<double> selection(num_shards);
+    for (int i = 0; i < num_shards; i++) {
+      selection[i] = can_sample[i] ? masses[i] : 0;
+    }
+    double selection_mass =
+        std::accumulate(selection.begin(), selection.end(), 0.0);
+    if (selection_mass <= 0) {
+      selection = masses;
+      selection_mass = std::accumulate(masses.begin(), masses.end(), 0.0);
+    }
+
+    // The probabilities are relative to the shards which the samples are
+    // actually drawn from, so that they match the observed distribution even
+    // when some of the shards are blocked.
+    for (int i = 0; i < num_shards; i++) {
+      if (selection[i] > 0) {
+        scales[i] = selection[i] / selection_mass;
+      }
+    }
+
+    absl::discrete_distribution<int> distribution(selection.begin(),
+                                                  selection.end());
+    absl::MutexLock lock(&shard_bit_gen_mu_);
+    for (int i = 0; i < num_samples; i++) {
+      counts[distribution(shard_bit_gen_)]++;
+    }
+  }
+
+  auto request = std::make_shared<ShardedSampleRequest>();
+  std::vector<std::pair<int, std::weak_ptr<SamplingCallback>>> to_enqueue;
+  {
+    absl::MutexLock lock(&request->mu);
+    request->merged.on_batch_done = std::move(callback);
+    request->merged.samples.reserve(num_samples);
+    for (int i = 0; i < num_shards; i++) {
+      if (counts[i] == 0) continue;
+      const double scale = scales[i];
+      const int64_t other_shards_size = total_size - sizes[i];
+      auto shard_callback = std::make_shared<SamplingCallback>(
+          [request, scale, other_shards_size](SampleRequest* shard_request) {
+            // Destroyed after the lock has been released.
+            std::vector<std::shared_ptr<SamplingCallback>> callbacks;
+            absl::MutexLock lock(&request->mu);
+            if (!shard_request->status.ok()) {
+              if (request->merged.status.ok()) {
+                request->merged.status = shard_request->status;
+              }
+            } else {
+              for (auto& sample : shard_request->samples) {
+                sample.probability *= scale;
+                sample.table_size += other_shards_size;
+                request->merged.samples.push_back(std::move(sample));
+              }
+            }
+            if (--request->pending > 0) {
+              return;
+            }
+            // Like `SampleFlexibleBatch`, a partially filled batch is a
+            // success even if some of the shard requests failed.
+            if (!request->merged.samples.empty()) {
+              request->merged.status = absl::OkStatus();
+            }
+            auto to_notify = request->merged.on_batch_done.lock();
+            // Callback might have been destroyed in the meantime.
+            if (to_notify != nullptr) {
+              (*to_notify)(&request->merged);
+            }
+            callbacks.swap(request->callbacks);
+          });
+      request->callbacks.push_back(shard_callback);
+      to_enqueue.emplace_back(i, shard_callback);
+      request->pending++;
+    }
+  }
+
+  for (auto& shard_request : to_enqueue) {
+    shards_[shard_request.first]->EnqueSampleRequest(
+        counts[shard_request.first], std::move(shard_request.second), timeout);
+  }
+}
+
 absl::Status Table::SampleFlexibleBatch(std::vector<SampledItem>* items,
                                         int batch_size,
                                         absl::Duration timeout) {
@@ -674,9 +1189,18 @@ absl::Status Table::SampleFlexibleBatch(std::vector<SampledItem>* items,
   return result;
 }
 
-absl::Status Table::SampleInternal(bool rate_limited, SampledItem* result) {
-  auto sample = sampler_->Sample();
-  std::shared_ptr<Item>& item = data_[sample.key];
+absl::Status Table::SampleInternal(bool rate_limited, int batch_size,
+                                   SampledItem* result) {
+  if (presampled_.empty()) {
+    // Deleting an item invalidates the rest of the batch so there is nothing
+    // to gain from drawing more than one key when items are deleted once they
+    // have been sampled `max_times_sampled_` times.
+    sampler_->SampleBatch(max_times_sampled_ > 0 ? 1 : batch_size,
+                          &presampled_);
+  }
+  const auto sample = presampled_.back();
+  presampled_.pop_back();
+  const std::shared_ptr<Item>& item = *FindMutableItem(sample.key);
   // If this is the first time the item was sampled then update unique
   // sampled counter.
   if (item->times_sampled() == 0) {
@@ -689,7 +1213,7 @@ absl::Status Table::SampleInternal(bool rate_limited, SampledItem* result) {
   *result = {
       .ref = item,
       .probability = sample.probability,
-      .table_size = static_cast<int64_t>(data_.size()),
+      .table_size = static_cast<int64_t>(NumItems()),
       .priority = item->priority(),
       .times_sampled = item->times_sampled(),
       .rate_limited = rate_limited,
@@ -709,12 +1233,30 @@ absl::Status Table::SampleInternal(bool rate_limited, SampledItem* result) {
 }
 
 int64_t Table::size() const {
+  if (!shards_.empty()) {
+    int64_t size = 0;
+    for (const auto& shard : shards_) {
+      size += shard->size();
+    }
+    return size;
+  }
   absl::MutexLock lock(&mu_);
-  return data_.size();
+  return NumItems();
 }
 
 const std::string& Table::name() const { return name_; }
 
+int Table::num_shards() const {
+  return shards_.empty() ? 1 : shards_.size();
+}
+
+bool Table::dense_keys() const { return dense_keys_; }
+
+size_t Table::num_dense_key_stragglers() const {
+  absl::MutexLock lock(&mu_);
+  return dense_data_.num_stragglers();
+}
+
 TableInfo Table::info() const {
   TableInfo info;
 
@@ -726,12 +1268,58 @@ TableInfo Table::info() const {
     *info.mutable_signature() = *signature_;
   }
 
+  if (!shards_.empty()) {
+    {
+      absl::MutexLock lock(&mu_);
+      *info.mutable_rate_limiter_info() = rate_limiter_->Info(&mu_);
+      *info.mutable_sampler_options() = sampler_->options();
+      *info.mutable_remover_options() = remover_->options();
+    }
+    // The configuration is reported as passed to the constructor while the
+    // state is aggregated over the shards.
+    auto* limiter_info = info.mutable_rate_limiter_info();
+    auto* worker_time = info.mutable_table_worker_time();
+    for (const auto& shard : shards_) {
+      auto shard_info = shard->info();
+      info.set_current_size(info.current_size() + shard_info.current_size());
+      info.set_num_deleted_episodes(info.num_deleted_episodes() +
+                                    shard_info.num_deleted_episodes());
+      info.set_num_unique_samples(info.num_unique_samples() +
+                                  shard_info.num_unique_samples());
+      limiter_info->mutable_insert_stats()->set_completed(
+          limiter_info->insert_stats().completed() +
+          shard_info.rate_limiter_info().insert_stats().completed());
+      limiter_info->mutable_sample_stats()->set_completed(
+          limiter_info->sample_stats().completed() +
+          shard_info.rate_limiter_info().sample_stats().completed());
+
+      const auto& shard_time = shard_info.table_worker_time();
+      worker_time->set_running_ms(worker_time->running_ms() +
+                                  shard_time.running_ms());
+      worker_time->set_sampling_ms(worker_time->sampling_ms() +
+                                   shard_time.sampling_ms());
+      worker_time->set_inserting_ms(worker_time->inserting_ms() +
+                                    shard_time.inserting_ms());
+      worker_time->set_sleeping_ms(worker_time->sleeping_ms() +
+                                   shard_time.sleeping_ms());
+      worker_time->set_waiting_for_sampling_ms(
+          worker_time->waiting_for_sampling_ms() +
+          shard_time.waiting_for_sampling_ms());
+      worker_time->set_waiting_for_inserts_ms(
+          worker_time->waiting_for_inserts_ms() +
+          shard_time.waiting_for_inserts_ms());
+    }
+    info.set_num_episodes(num_episodes());
+    *info.mutable_histograms() = HistogramsProto();
+    return info;
+  }
+
   {
     absl::MutexLock lock(&mu_);
     *info.mutable_rate_limiter_info() = rate_limiter_->Info(&mu_);
     *info.mutable_sampler_options() = sampler_->options();
     *info.mutable_remover_options() = remover_->options();
-    info.set_current_size(data_.size());
+    info.set_current_size(NumItems());
     info.set_num_episodes(episode_refs_.size());
     info.set_num_deleted_episodes(num_deleted_episodes_);
     info.set_num_unique_samples(num_unique_samples_);
@@ -756,11 +1344,50 @@ TableInfo Table::info() const {
         absl::ToInt64Milliseconds(worker_time_distribution_.GetTotalTimeIn(
             TableWorkerState::kWaitingForInserts)));
   }
+  *info.mutable_histograms() = HistogramsProto();
 
   return info;
 }
 
+TableHistograms Table::HistogramsProto() const {
+  const Histograms* histograms = &histograms_;
+  std::unique_ptr<Histograms> merged;
+  if (!shards_.empty()) {
+    merged = std::make_unique<Histograms>();
+    auto merge = [&merged](const Histograms& other) {
+      merged->insert_to_commit_us.Merge(other.insert_to_commit_us);
+      merged->sample_wait_us.Merge(other.sample_wait_us);
+      merged->rate_limiter_blocked_us.Merge(other.rate_limiter_blocked_us);
+      merged->lock_hold_us.Merge(other.lock_hold_us);
+      merged->sample_response_bytes.Merge(other.sample_response_bytes);
+      merged->sample_response_bytes_saved.Merge(
+          other.sample_response_bytes_saved);
+    };
+    merge(histograms_);
+    for (const auto& shard : shards_) {
+      merge(shard->histograms_);
+    }
+    histograms = merged.get();
+  }
+
+  TableHistograms proto;
+  *proto.mutable_insert_to_commit_us() =
+      histograms->insert_to_commit_us.ToProto();
+  *proto.mutable_sample_wait_us() = histograms->sample_wait_us.ToProto();
+  *proto.mutable_rate_limiter_blocked_us() =
+      histograms->rate_limiter_blocked_us.ToProto();
+  *proto.mutable_lock_hold_us() = histograms->lock_hold_us.ToProto();
+  *proto.mutable_sample_response_bytes() =
+      histograms->sample_response_bytes.ToProto();
+  *proto.mutable_sample_response_bytes_saved() =
+      histograms->sample_response_bytes_saved.ToProto();
+  return proto;
+}
+
 void Table::Close() {
+  for (auto& shard : shards_) {
+    shard->Close();
+  }
   {
     absl::MutexLock lock(&mu_);
     closed_ = true;
@@ -774,11 +1401,11 @@ void Table::Close() {
 
 absl::Status Table::DeleteItem(Table::Key key,
                                std::shared_ptr<Item>* deleted_item) {
-  auto it = data_.find(key);
-  if (it == data_.end()) return absl::OkStatus();
+  const std::shared_ptr<Item>* found = FindItem(key);
+  if (found == nullptr) return absl::OkStatus();
 
   // Decrement counts to the episodes the item is referencing.
-  for (const auto& chunk : it->second->chunks()) {
+  for (const auto& chunk : (*found)->chunks()) {
     auto ep_it = episode_refs_.find(chunk->episode_id());
     if (ep_it == episode_refs_.end()) {
       return absl::FailedPreconditionError(
@@ -790,10 +1417,11 @@ absl::Status Table::DeleteItem(Table::Key key,
       num_deleted_episodes_++;
     }
   }
-  auto item = std::move(it->second);
-  data_.erase(it);
+  std::shared_ptr<Item> item = *found;
+  EraseItem(key);
   rate_limiter_->Delete(&mu_);
   REVERB_RETURN_IF_ERROR(sampler_->Delete(key));
+  presampled_.clear();
   REVERB_RETURN_IF_ERROR(remover_->Delete(key));
   ExtensionOperation(ExtensionRequest::CallType::kDelete, item);
   if (deleted_item) {
@@ -803,6 +1431,136 @@ absl::Status Table::DeleteItem(Table::Key key,
   return absl::OkStatus();
 }
 
+std::shared_ptr<Table::Item>* Table::FindLiveItem(Key key) {
+  if (dense_keys_) return dense_data_.Find(key);
+  auto it = data_.find(key);
+  return it == data_.end() ? nullptr : &it->second;
+}
+
+const std::shared_ptr<Table::Item>* Table::FindFrozenItem(Key key) const {
+  if (frozen_items_ == nullptr || shadowed_keys_.contains(key)) return nullptr;
+  if (dense_keys_) return frozen_items_->dense_data.Find(key);
+  auto it = frozen_items_->data.find(key);
+  return it == frozen_items_->data.end() ? nullptr : &it->second;
+}
+
+const std::shared_ptr<Table::Item>* Table::FindItem(Key key) {
+  if (const std::shared_ptr<Item>* item = FindLiveItem(key); item != nullptr) {
+    return item;
+  }
+  return FindFrozenItem(key);
+}
+
+const std::shared_ptr<Table::Item>* Table::FindMutableItem(Key key) {
+  if (const std::shared_ptr<Item>* item = FindLiveItem(key); item != nullptr) {
+    return item;
+  }
+  const std::shared_ptr<Item>* frozen = FindFrozenItem(key);
+  if (frozen == nullptr) return nullptr;
+
+  // The snapshot is being serialized so the item is copied before it is
+  // modified.
+  StoreItem(std::make_shared<Item>(**frozen));
+  return FindLiveItem(key);
+}
+
+void Table::StoreItem(std::shared_ptr<Item> item) {
+  const Key key = item->key();
+  if (FindFrozenItem(key) != nullptr) {
+    shadowed_keys_.insert(key);
+  }
+  if (dense_keys_) {
+    dense_data_.Insert(key, std::move(item));
+  } else {
+    data_[key] = std::move(item);
+  }
+}
+
+void Table::EraseItem(Key key) {
+  if (FindFrozenItem(key) != nullptr) {
+    shadowed_keys_.insert(key);
+  }
+  if (dense_keys_) {
+    dense_data_.Erase(key);
+    if (const Key* writer_key = writer_keys_.Find(key); writer_key != nullptr) {
+      dense_keys_by_writer_key_.erase(*writer_key);
+      writer_keys_.Erase(key);
+    }
+  } else {
+    data_.erase(key);
+  }
+}
+
+size_t Table::NumItems() const {
+  size_t size = dense_keys_ ? dense_data_.size() : data_.size();
+  if (frozen_items_ != nullptr) {
+    // Shadowed keys are always present in the snapshot.
+    size += (dense_keys_ ? frozen_items_->dense_data.size()
+                         : frozen_items_->data.size()) -
+            shadowed_keys_.size();
+  }
+  return size;
+}
+
+void Table::ForEachItem(
+    absl::FunctionRef<void(const std::shared_ptr<Item>&)> fn) const {
+  if (dense_keys_) {
+    dense_data_.ForEach(
+        [&](Key, const std::shared_ptr<Item>& item) { fn(item); });
+  } else {
+    for (const auto& entry : data_) {
+      fn(entry.second);
+    }
+  }
+  if (frozen_items_ == nullptr) return;
+  auto visit_frozen = [&](Key key, const std::shared_ptr<Item>& item) {
+    if (!shadowed_keys_.contains(key)) fn(item);
+  };
+  if (dense_keys_) {
+    frozen_items_->dense_data.ForEach(visit_frozen);
+  } else {
+    for (const auto& entry : frozen_items_->data) {
+      visit_frozen(entry.first, entry.second);
+    }
+  }
+}
+
+std::shared_ptr<const Table::FrozenItems> Table::FreezeItems() {
+  REVERB_CHECK(frozen_items_ == nullptr);
+  frozen_items_ = std::make_shared<FrozenItems>();
+  frozen_items_->data = std::move(data_);
+  data_.clear();
+  frozen_items_->dense_data = std::move(dense_data_);
+  dense_data_.Clear();
+  return frozen_items_;
+}
+
+void Table::ThawItems(const std::shared_ptr<const FrozenItems>& frozen) {
+  if (frozen_items_ != frozen) return;
+  std::shared_ptr<FrozenItems> store = std::move(frozen_items_);
+  frozen_items_ = nullptr;
+
+  for (Key key : shadowed_keys_) {
+    if (dense_keys_) {
+      store->dense_data.Erase(key);
+    } else {
+      store->data.erase(key);
+    }
+  }
+  shadowed_keys_.clear();
+  if (dense_keys_) {
+    dense_data_.ForEach([&](Key key, const std::shared_ptr<Item>& item) {
+      store->dense_data.Insert(key, item);
+    });
+    dense_data_ = std::move(store->dense_data);
+  } else {
+    for (auto& entry : data_) {
+      store->data.emplace(entry.first, std::move(entry.second));
+    }
+    data_ = std::move(store->data);
+  }
+}
+
 void Table::ExtensionOperation(ExtensionRequest::CallType type,
                                const std::shared_ptr<Item>& item) {
   ExtensionItem e_item(item);
@@ -854,19 +1612,24 @@ void Table::WaitForBackgroundWork() {
 }
 
 absl::Status Table::UpdateItem(Key key, double priority) {
-  auto it = data_.find(key);
-  if (it == data_.end()) {
+  const std::shared_ptr<Item>* found = FindMutableItem(key);
+  if (found == nullptr) {
     return absl::OkStatus();
   }
-  it->second->set_priority(priority);
+  std::shared_ptr<Item> item = *found;
+  item->set_priority(priority);
   REVERB_RETURN_IF_ERROR(sampler_->Update(key, priority));
+  presampled_.clear();
   REVERB_RETURN_IF_ERROR(remover_->Update(key, priority));
-  ExtensionOperation(ExtensionRequest::CallType::kUpdate, it->second);
+  ExtensionOperation(ExtensionRequest::CallType::kUpdate, item);
   WaitForBackgroundWork();
   return absl::OkStatus();
 }
 
 absl::Status Table::Reset() {
+  for (auto& shard : shards_) {
+    REVERB_RETURN_IF_ERROR(shard->Reset());
+  }
   {
     absl::MutexLock table_lock(&mu_);
     if (extension_worker_) {
@@ -886,6 +1649,7 @@ absl::Status Table::Reset() {
       }
     }
     sampler_->Clear();
+    presampled_.clear();
     remover_->Clear();
 
     num_deleted_episodes_ = 0;
@@ -893,6 +1657,12 @@ absl::Status Table::Reset() {
     episode_refs_.clear();
 
     data_.clear();
+    dense_data_.Clear();
+    dense_keys_by_writer_key_.clear();
+    writer_keys_.Clear();
+    // An in-progress checkpoint keeps its own reference to the snapshot.
+    frozen_items_ = nullptr;
+    shadowed_keys_.clear();
 
     rate_limiter_->Reset(&mu_);
   }
@@ -917,23 +1687,94 @@ Table::CheckpointAndChunks Table::Checkpoint() {
     *checkpoint.mutable_signature() = signature_.value();
   }
 
-  absl::MutexLock lock(&mu_);
-
-  checkpoint.set_num_deleted_episodes(num_deleted_episodes_);
-  checkpoint.set_num_unique_samples(num_unique_samples_);
-
-  *checkpoint.mutable_sampler() = sampler_->options();
-  *checkpoint.mutable_remover() = remover_->options();
+  if (!shards_.empty()) {
+    checkpoint.set_num_shards(shards_.size());
+    {
+      absl::MutexLock lock(&mu_);
+      *checkpoint.mutable_sampler() = sampler_->options();
+      *checkpoint.mutable_remover() = remover_->options();
+      *checkpoint.mutable_rate_limiter() =
+          rate_limiter_->CheckpointReader(&mu_);
+    }
 
-  // Note that is is important that the rate limiter checkpoint is
-  // finalized before the items are added
-  *checkpoint.mutable_rate_limiter() = rate_limiter_->CheckpointReader(&mu_);
+    // The shards are checkpointed one at a time so the result is not an
+    // atomic snapshot of the whole table.
+    internal::flat_hash_set<std::shared_ptr<ChunkStore::Chunk>> chunks;
+    std::vector<PrioritizedItem> items;
+    auto* limiter = checkpoint.mutable_rate_limiter();
+    for (auto& shard : shards_) {
+      auto shard_checkpoint = shard->Checkpoint();
+      const auto& shard_limiter = shard_checkpoint.checkpoint.rate_limiter();
+      limiter->set_insert_count(limiter->insert_count() +
+                                shard_limiter.insert_count());
+      limiter->set_sample_count(limiter->sample_count() +
+                                shard_limiter.sample_count());
+      limiter->set_delete_count(limiter->delete_count() +
+                                shard_limiter.delete_count());
+      checkpoint.set_num_deleted_episodes(
+          checkpoint.num_deleted_episodes() +
+          shard_checkpoint.checkpoint.num_deleted_episodes());
+      checkpoint.set_num_unique_samples(
+          checkpoint.num_unique_samples() +
+          shard_checkpoint.checkpoint.num_unique_samples());
+      chunks.merge(shard_checkpoint.chunks);
+      items.insert(items.end(),
+                   std::make_move_iterator(shard_checkpoint.items.begin()),
+                   std::make_move_iterator(shard_checkpoint.items.end()));
+    }
+    std::sort(items.begin(), items.end(), IsInsertedBefore);
+    return {std::move(checkpoint), std::move(items), std::move(chunks)};
+  }
 
+  absl::MutexLock checkpoint_lock(&checkpoint_mu_);
+  std::shared_ptr<const FrozenItems> frozen;
   internal::flat_hash_set<std::shared_ptr<ChunkStore::Chunk>> chunks;
   std::vector<PrioritizedItem> items;
-  for (const auto& entry : data_) {
-    items.push_back(entry.second->AsPrioritizedItem());
-    chunks.insert(entry.second->chunks().begin(), entry.second->chunks().end());
+  auto add_item = [&](const std::shared_ptr<Item>& item) {
+    items.push_back(item->AsPrioritizedItem());
+    chunks.insert(item->chunks().begin(), item->chunks().end());
+  };
+  {
+    absl::MutexLock lock(&mu_);
+
+    checkpoint.set_num_deleted_episodes(num_deleted_episodes_);
+    checkpoint.set_num_unique_samples(num_unique_samples_);
+    if (dense_keys_) {
+      checkpoint.set_dense_keys(true);
+      checkpoint.set_next_dense_key(next_dense_key_);
+    }
+
+    // The selectors are rebuilt from the items when the checkpoint is loaded
+    // so only their options are stored.
+    *checkpoint.mutable_sampler() = sampler_->options();
+    *checkpoint.mutable_remover() = remover_->options();
+
+    // Note that is is important that the rate limiter checkpoint is
+    // finalized before the items are added
+    *checkpoint.mutable_rate_limiter() = rate_limiter_->CheckpointReader(&mu_);
+
+    // Extensions may access `data_` directly (see `RawLookup`) so the items of
+    // tables with extensions are serialized while holding the lock.
+    if (sync_extensions_.empty() && !has_async_extensions_) {
+      frozen = FreezeItems();
+    } else {
+      ForEachItem(add_item);
+    }
+  }
+
+  if (frozen != nullptr) {
+    // Items in the snapshot are never modified (see `FindMutableItem`) so they
+    // can be read without holding `mu_`.
+    if (dense_keys_) {
+      frozen->dense_data.ForEach(
+          [&](Key, const std::shared_ptr<Item>& item) { add_item(item); });
+    } else {
+      for (const auto& entry : frozen->data) {
+        add_item(entry.second);
+      }
+    }
+    absl::MutexLock lock(&mu_);
+    ThawItems(frozen);
   }
 
   // Sort the items in ascending order based on their insertion time. This makes
@@ -945,37 +1786,58 @@ Table::CheckpointAndChunks Table::Checkpoint() {
 }
 
 absl::Status Table::InsertCheckpointItem(Table::Item&& item) {
+  if (!shards_.empty()) {
+    // The global size limit is enforced rather than the limit of the shard
+    // as the items of a full table are rarely spread perfectly evenly. Excess
+    // items are removed by the shard's remover on subsequent inserts.
+    const size_t shard = ShardIndex(item.key());
+    REVERB_RETURN_IF_ERROR(shards_[shard]->InsertCheckpointItemInternal(
+        std::move(item), max_size_ - (size() - shards_[shard]->size())));
+    OnShardItemsInserted();
+    return absl::OkStatus();
+  }
+  return InsertCheckpointItemInternal(std::move(item), max_size_);
+}
+
+absl::Status Table::InsertCheckpointItemInternal(Table::Item&& item,
+                                                 int64_t max_size) {
   absl::MutexLock lock(&mu_);
-  if (data_.size() + 1 > max_size_) {
+  if (NumItems() + 1 > max_size) {
     return absl::FailedPreconditionError(absl::StrCat(
         "InsertCheckpointItem called on already full Table. table size: ",
-        data_.size(), ", maximum size: ", max_size_));
+        NumItems(), ", maximum size: ", max_size));
   }
-  if (data_.contains(item.key())) {
+  if (FindItem(item.key()) != nullptr) {
     return absl::FailedPreconditionError(absl::StrCat(
         "InsertCheckpointItem called for item with already present key: ",
         item.key()));
   }
 
   REVERB_RETURN_IF_ERROR(sampler_->Insert(item.key(), item.priority()));
+  presampled_.clear();
   REVERB_RETURN_IF_ERROR(remover_->Insert(item.key(), item.priority()));
 
-  const auto key = item.key();
-  auto it = data_.emplace(key, std::make_shared<Item>(std::move(item))).first;
+  if (dense_keys_) {
+    next_dense_key_ = std::max(next_dense_key_, item.key() + 1);
+  }
+  auto stored = std::make_shared<Item>(std::move(item));
+  StoreItem(stored);
 
-  for (const auto& chunk : it->second->chunks()) {
+  for (const auto& chunk : stored->chunks()) {
     ++episode_refs_[chunk->episode_id()];
   }
-  ExtensionOperation(ExtensionRequest::CallType::kInsert, it->second);
+  ExtensionOperation(ExtensionRequest::CallType::kInsert, stored);
   WaitForBackgroundWork();
   return absl::OkStatus();
 }
 
 absl::StatusOr<Table::Item> Table::Get(Table::Key key) {
+  if (!shards_.empty()) {
+    return shards_[ShardIndex(key)]->Get(key);
+  }
   absl::MutexLock lock(&mu_);
-  auto it = data_.find(key);
-  if (it != data_.end()) {
-    return *it->second;
+  if (const std::shared_ptr<Item>* item = FindItem(key); item != nullptr) {
+    return **item;
   }
   return absl::NotFoundError(absl::StrCat("Key not found: ", key));
 }
@@ -983,13 +1845,18 @@ absl::StatusOr<Table::Item> Table::Get(Table::Key key) {
 const internal::flat_hash_map<Table::Key, std::shared_ptr<Table::Item>>*
 Table::RawLookup() {
   mu_.AssertHeld();
+  REVERB_CHECK(!dense_keys_) << "Tables with dense keys have no extensions.";
   return &data_;
 }
 
 void Table::UnsafeAddExtension(std::shared_ptr<TableExtension> extension) {
+  REVERB_CHECK(shards_.empty())
+      << "Extensions are not supported by sharded tables.";
+  REVERB_CHECK(!dense_keys_)
+      << "Extensions are not supported by tables with dense keys.";
   REVERB_CHECK_OK(extension->RegisterTable(&mu_, this));
   absl::MutexLock lock(&mu_);
-  REVERB_CHECK(data_.empty());
+  REVERB_CHECK(NumItems() == 0);
   if (extension->CanRunAsync() && extension_worker_) {
     absl::MutexLock lock(&async_extensions_mu_);
     async_extensions_.push_back(std::move(extension));
@@ -1004,16 +1871,41 @@ const absl::optional<tensorflow::StructuredValue>& Table::signature() const {
 }
 
 bool Table::CanSample(int num_samples) const {
+  if (!shards_.empty()) {
+    // Samples can be served by any shard.
+    return std::any_of(shards_.begin(), shards_.end(),
+                       [num_samples](const std::unique_ptr<Table>& shard) {
+                         return shard->CanSample(num_samples);
+                       });
+  }
   absl::MutexLock lock(&mu_);
   return rate_limiter_->CanSample(&mu_, num_samples);
 }
 
 bool Table::CanInsert(int num_inserts) const {
+  if (!shards_.empty()) {
+    // The keys of future inserts are unknown so every shard must accept them.
+    return std::all_of(shards_.begin(), shards_.end(),
+                       [num_inserts](const std::unique_ptr<Table>& shard) {
+                         return shard->CanInsert(num_inserts);
+                       });
+  }
   absl::MutexLock lock(&mu_);
   return rate_limiter_->CanInsert(&mu_, num_inserts);
 }
 
 int64_t Table::num_episodes() const {
+  if (!shards_.empty()) {
+    // Items of the same episode may be spread across several shards.
+    internal::flat_hash_set<uint64_t> episodes;
+    for (const auto& shard : shards_) {
+      absl::MutexLock lock(&shard->mu_);
+      for (const auto& entry : shard->episode_refs_) {
+        episodes.insert(entry.first);
+      }
+    }
+    return episodes.size();
+  }
   absl::MutexLock lock(&mu_);
   return episode_refs_.size();
 }
@@ -1028,7 +1920,7 @@ std::vector<std::shared_ptr<TableExtension>> Table::UnsafeClearExtensions() {
   {
     absl::MutexLock lock(&mu_);
     absl::MutexLock extension_lock(&async_extensions_mu_);
-    REVERB_CHECK(data_.empty());
+    REVERB_CHECK(NumItems() == 0);
     extensions.swap(sync_extensions_);
     for (auto& extension : async_extensions_) {
       extensions.push_back(extension);
@@ -1044,22 +1936,52 @@ std::vector<std::shared_ptr<TableExtension>> Table::UnsafeClearExtensions() {
 }
 
 int64_t Table::num_deleted_episodes() const {
+  if (!shards_.empty()) {
+    // Note that an episode which is spread across several shards is counted
+    // once for every shard it was deleted from.
+    int64_t num_deleted_episodes = 0;
+    for (const auto& shard : shards_) {
+      num_deleted_episodes += shard->num_deleted_episodes();
+    }
+    return num_deleted_episodes;
+  }
   absl::MutexLock lock(&mu_);
   return num_deleted_episodes_;
 }
 
 void Table::set_num_deleted_episodes_from_checkpoint(int64_t value) {
+  if (!shards_.empty()) {
+    // Split like the counters of the rate limiter (see `CreateShards`).
+    for (int i = 0; i < shards_.size(); i++) {
+      shards_[i]->set_num_deleted_episodes_from_checkpoint(
+          ShareOf(value, shards_.size(), i));
+    }
+    return;
+  }
   absl::MutexLock lock(&mu_);
-  REVERB_CHECK(data_.empty() && num_deleted_episodes_ == 0);
+  REVERB_CHECK(NumItems() == 0 && num_deleted_episodes_ == 0);
   num_deleted_episodes_ = value;
 }
 
 void Table::set_num_unique_samples_from_checkpoint(int64_t value) {
+  if (!shards_.empty()) {
+    for (int i = 0; i < shards_.size(); i++) {
+      shards_[i]->set_num_unique_samples_from_checkpoint(
+          ShareOf(value, shards_.size(), i));
+    }
+    return;
+  }
   absl::MutexLock lock(&mu_);
-  REVERB_CHECK(data_.empty() && num_unique_samples_ == 0);
+  REVERB_CHECK(NumItems() == 0 && num_unique_samples_ == 0);
   num_unique_samples_ = value;
 }
 
+void Table::set_next_dense_key_from_checkpoint(Key value) {
+  absl::MutexLock lock(&mu_);
+  REVERB_CHECK(dense_keys_);
+  next_dense_key_ = std::max(next_dense_key_, value);
+}
+
 std::string Table::DebugString() const {
   absl::MutexLock lock(&mu_);
   std::string str = absl::StrCat(
@@ -1068,6 +1990,9 @@ std::string Table::DebugString() const {
       ", max_times_sampled=", max_times_sampled_, ", name=", name_,
       ", rate_limiter=", rate_limiter_->DebugString(), ", signature=",
       (signature_.has_value() ? signature_.value().DebugString() : "nullptr"));
+  if (!shards_.empty()) {
+    absl::StrAppend(&str, ", num_shards=", shards_.size());
+  }
 
   {
     absl::MutexLock lock(&async_extensions_mu_);
@@ -1094,17 +2019,36 @@ std::string Table::DebugString() const {
 }
 
 bool Table::worker_is_sleeping() const {
+  if (!shards_.empty()) {
+    return std::all_of(shards_.begin(), shards_.end(),
+                       [](const std::unique_ptr<Table>& shard) {
+                         return shard->worker_is_sleeping();
+                       });
+  }
   absl::MutexLock lock(&worker_mu_);
   return worker_time_distribution_.CurrentState() >=
          TableWorkerState::kSleeping;
 }
 
 int Table::num_pending_async_sample_requests() const {
+  if (!shards_.empty()) {
+    int num_requests = 0;
+    for (const auto& shard : shards_) {
+      num_requests += shard->num_pending_async_sample_requests();
+    }
+    return num_requests;
+  }
   absl::MutexLock lock(&worker_mu_);
   return pending_sampling_.size();
 }
 
 bool Table::all_extensions_are_up_to_date() const {
+  if (!shards_.empty()) {
+    return std::all_of(shards_.begin(), shards_.end(),
+                       [](const std::unique_ptr<Table>& shard) {
+                         return shard->all_extensions_are_up_to_date();
+                       });
+  }
   absl::MutexLock lock(&mu_);
   return extension_requests_.empty() && extension_worker_sleeps_;
 }
@@ -1118,6 +2062,8 @@ TableItem::TableItem(PrioritizedItem item,
 
 uint64_t TableItem::key() const { return item_.key(); }
 
+void TableItem::set_key(uint64_t key) { item_.set_key(key); }
+
 absl::string_view TableItem::table() const { return item_.table(); }
 
 double TableItem::priority() const { return priority_; }
@@ -15,14 +15,18 @@
 #ifndef REVERB_CC_TABLE_H_
 #define REVERB_CC_TABLE_H_
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "absl/base/thread_annotations.h"
+#include "absl/functional/function_ref.h"
+#include "absl/random/random.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
@@ -36,6 +40,8 @@
 #include "reverb/cc/rate_limiter.h"
 #include "reverb/cc/schema.pb.h"
 #include "reverb/cc/selectors/interface.h"
+#include "reverb/cc/support/atomic_histogram.h"
+#include "reverb/cc/support/dense_key_map.h"
 #include "reverb/cc/support/state_statistics.h"
 #include "reverb/cc/support/task_executor.h"
 #include "reverb/cc/table_extensions/interface.h"
@@ -65,6 +71,10 @@ class TableItem {
   // Unique identifier of this item in the table.
   uint64_t key() const;
 
+  // Replaces the key chosen by the writer. Only called by tables with dense
+  // keys before the item is inserted.
+  void set_key(uint64_t key);
+
   // The name of the table that the item belongs to.
   absl::string_view table() const;
 
@@ -149,6 +159,34 @@ struct ExtensionItem {
 // two tables would not share any chunks and would this require twice the
 // amount of memory compared to two tables with the same type of remover.
 //
+// When constructed with `num_shards > 1` the table hash-partitions its items
+// across `num_shards` internal sub-tables. Every shard owns its own lock,
+// table worker, sampler, remover and rate limiter so inserts, mutations and
+// sampling on different shards no longer contend on a single mutex. Sample
+// requests are routed to shards in proportion to the shards' total sampling
+// mass (`ItemSelector::TotalWeight`) and the returned probabilities are
+// rescaled to the global distribution. Shards whose rate limiter currently
+// blocks sampling are skipped while any other shard can sample, in which case
+// the probabilities are relative to the shards which can. Deterministic selectors (FIFO, LIFO,
+// heap) are served from the shard holding the globally "best" item, which
+// returns that item until it reaches `max_times_sampled`. Requests made while
+// all shards are empty wait on the table until any shard receives an item.
+// The `max_size` and rate limiter constraints are split evenly
+// between the shards, which means they are enforced per shard rather than
+// exactly across the whole table. Extensions are not supported in this mode.
+//
+// When constructed with `dense_keys = true` the table ignores the keys chosen
+// by the writers and assigns monotonically increasing keys to the items in the
+// order they are inserted. The items are then stored in a ring buffer indexed
+// by key (see `internal::DenseKeyMap`) rather than in a hash map, which makes
+// the per operation item lookup an array access for tables which mostly evict
+// their oldest items (e.g FIFO removers). Inserts are confirmed to the
+// writers using the keys they chose, while sampled
+// items carry the assigned keys, which `MutateItems` expects. A writer which
+// reuses the key of an item that is still in the table assigns to that item,
+// as it would without dense keys. Dense keys are incompatible with sharding
+// and extensions.
+//
 class Table {
  public:
   // Maximum number of enqueued inserts that are allowed on the table without
@@ -170,6 +208,12 @@ class Table {
   static constexpr int64_t kMaxSampleResponseSizeBytes =
       1 * 1024 * 1024;  // 1MB.
 
+  // Maximum number of inserts committed by the table worker in one go. While
+  // sample requests are waiting the worker commits at most as many inserts as
+  // samples it committed in the previous sampling turn (and at least one), so
+  // that neither side starves the other.
+  static constexpr int kMaxInsertsPerBatch = 64;
+
   struct SampleRequest;
   using Key = ItemSelector::Key;
   using Item = TableItem;
@@ -196,6 +240,8 @@ class Table {
   struct SampleRequest {
     std::vector<SampledItem> samples;
     absl::Time deadline;
+    // Time when the request was received by the table.
+    absl::Time created_at;
     absl::Status status;
     std::weak_ptr<SamplingCallback> on_batch_done;
   };
@@ -204,8 +250,15 @@ class Table {
   struct InsertRequest {
     std::shared_ptr<Item> item;
     std::weak_ptr<InsertCallback> insert_completed;
+    // Time when the request was received by the table.
+    absl::Time created_at;
   };
 
+  // Keys of the inserts committed by the table worker, grouped by the callback
+  // (i.e stream) which should be notified about them.
+  using CompletedInserts =
+      std::vector<std::pair<std::weak_ptr<InsertCallback>, std::vector<Key>>>;
+
   // Used when checkpointing to ensure that none of the chunks referenced by the
   // checkpointed items are removed before the checkpoint operations has
   // completed.
@@ -228,11 +281,17 @@ class Table {
   // `signature` allows an optional declaration of the data that can be stored
   //   in this table.  writers and readers are responsible for checking against
   //   this signature, as it is available via RPC request.
+  // `num_shards` is the number of sub-tables the items are partitioned across.
+  //   Values > 1 enable the sharded mode described above and require that
+  //   `extensions` is empty.
+  // `dense_keys` enables the dense key mode described above. Requires that
+  //   `num_shards` is 1 and that `extensions` is empty.
   Table(std::string name, std::shared_ptr<ItemSelector> sampler,
         std::shared_ptr<ItemSelector> remover, int64_t max_size,
         int32_t max_times_sampled, std::shared_ptr<RateLimiter> rate_limiter,
         std::vector<std::shared_ptr<TableExtension>> extensions = {},
-        absl::optional<tensorflow::StructuredValue> signature = absl::nullopt);
+        absl::optional<tensorflow::StructuredValue> signature = absl::nullopt,
+        int num_shards = 1, bool dense_keys = false);
 
   ~Table();
 
@@ -359,6 +418,8 @@ class Table {
   absl::StatusOr<Item> Get(Key key) ABSL_LOCKS_EXCLUDED(mu_);
 
   // Get pointer to `data_`. Must only be called by extensions while lock held.
+  // Tables with extensions are never checkpointed from a snapshot (see
+  // `Checkpoint`) so `data_` always holds all the items.
   const internal::flat_hash_map<Key, std::shared_ptr<Item>>* RawLookup()
       ABSL_ASSERT_EXCLUSIVE_LOCK(mu_);
 
@@ -366,6 +427,15 @@ class Table {
   absl::Status Reset();
 
   // Generate a checkpoint from the table's current state.
+  //
+  // Unless the table has extensions, the items are captured by moving the item
+  // store into a frozen snapshot, which takes constant time, and the (slow)
+  // serialization of the snapshot happens without holding `mu_`. Until it
+  // completes, mutated items are copied out of the snapshot before being
+  // modified and deleted items are hidden from it. The changes are then folded
+  // back into the store in time proportional to the number of items which were
+  // changed while the checkpoint was being built. Concurrent calls are
+  // serialized.
   CheckpointAndChunks Checkpoint() ABSL_LOCKS_EXCLUDED(mu_);
 
   // Number of items in the table distribution.
@@ -387,8 +457,19 @@ class Table {
   void set_num_unique_samples_from_checkpoint(int64_t value)
       ABSL_LOCKS_EXCLUDED(mu_);
 
+  // Sets the key assigned to the next inserted item when the table uses dense
+  // keys. Keys of items inserted from the checkpoint are never reassigned.
+  void set_next_dense_key_from_checkpoint(Key value) ABSL_LOCKS_EXCLUDED(mu_);
+
   const std::string& name() const;
 
+  // Number of sub-tables the items are partitioned across. 1 if the table is
+  // not sharded.
+  int num_shards() const;
+
+  // True if the table assigns the keys of inserted items itself.
+  bool dense_keys() const;
+
   // Metadata about the table, including the current state of the rate limiter
   // and table worker execution time. Execution time is slightly out of sync, as
   // it is updated periodically by the table worker thread.
@@ -419,6 +500,11 @@ class Table {
   // yet. This method is only exposed for testing purposes.
   int num_pending_async_sample_requests() const ABSL_LOCKS_EXCLUDED(worker_mu_);
 
+  // Number of items of a table with dense keys which are held outside of the
+  // ring buffer (see `internal::DenseKeyMap`). This method is only exposed for
+  // testing purposes.
+  size_t num_dense_key_stragglers() const ABSL_LOCKS_EXCLUDED(mu_);
+
   // Checks whether all extensions requests, async and sync, have been
   // processed. This is the case if there are no pending requests AND the
   // extension worker is sleeping.
@@ -428,7 +514,33 @@ class Table {
   // further inserts.
   int max_enqueued_inserts() const { return max_enqueued_inserts_; }
 
+  // Records the serialized size of a sample response sent for the table. The
+  // distribution is reported by `info()`.
+  void RecordSampleResponseBytes(int64_t bytes) {
+    histograms_.sample_response_bytes.Record(bytes);
+  }
+
+  // Records the number of bytes saved in a sample response sent for the table
+  // by slicing its chunks. The distribution is reported by `info()`.
+  void RecordSampleResponseBytesSaved(int64_t bytes) {
+    histograms_.sample_response_bytes_saved.Record(bytes);
+  }
+
  private:
+  // Distributions recorded on the hot paths of the table. See
+  // `TableHistograms` in schema.proto for the meaning of each of them.
+  struct Histograms {
+    internal::AtomicHistogram insert_to_commit_us;
+    internal::AtomicHistogram sample_wait_us;
+    internal::AtomicHistogram rate_limiter_blocked_us;
+    internal::AtomicHistogram lock_hold_us;
+    internal::AtomicHistogram sample_response_bytes;
+    internal::AtomicHistogram sample_response_bytes_saved;
+  };
+
+  // Snapshot of `histograms_`, merged with those of the shards (if any).
+  TableHistograms HistogramsProto() const;
+
   // State of the table worker.
   enum class TableWorkerState {
     // Worker is performing general work.
@@ -464,13 +576,49 @@ class Table {
   // and performs enqueued table operations (inserts, mutations, sampling...).
   absl::Status TableWorkerLoop();
 
+  // Creates `num_shards` sub-tables which the items are partitioned across.
+  // Each shard is given a fresh copy of the sampler and remover, an even share
+  // of `max_size_` and a rate limiter with an even share of the state and
+  // constraints of `rate_limiter_`.
+  void CreateShards(int num_shards);
+
+  // Returns the index of the shard which is responsible for `key`. Must only
+  // be called when the table is sharded.
+  size_t ShardIndex(Key key) const;
+
+  // Implementation of `EnqueSampleRequest` for sharded tables. The request is
+  // split into per shard requests whose results are merged before `callback`
+  // is called. If all shards are empty then the request is parked in
+  // `pending_sampling_` until an item is inserted into any of the shards.
+  void EnqueShardedSampleRequest(int num_samples,
+                                 std::weak_ptr<SamplingCallback> callback,
+                                 absl::Duration timeout);
+
+  // Worker loop of sharded tables. Dispatches the parked sample requests once
+  // items have been inserted into the shards and terminates the requests
+  // which exceed their deadline while parked.
+  void ShardedSampleWorkerLoop();
+
+  // Called by the shards after they have committed inserts. Wakes up the
+  // sharded sample worker if there are parked requests.
+  void OnShardItemsInserted() ABSL_LOCKS_EXCLUDED(worker_mu_);
+
+  // Inserts a checkpointed item, failing if the table already holds
+  // `max_size` items or more.
+  absl::Status InsertCheckpointItemInternal(Item&& item, int64_t max_size)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
   // Updates item priority in `data_`, `samper_`, `remover_` and calls
   // `OnUpdate` on all extensions.
   absl::Status UpdateItem(Key key, double priority)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
-  // Used by the table worker to perform sampling.
-  absl::Status SampleInternal(bool rate_limited, SampledItem* result)
+  // Used by the table worker to perform sampling. `batch_size` is the number
+  // of samples still missing from the request being processed. Keys are drawn
+  // from `sampler_` that many at a time (see `ItemSelector::SampleBatch`) and
+  // buffered in `presampled_` until they are consumed.
+  absl::Status SampleInternal(bool rate_limited, int batch_size,
+                              SampledItem* result)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
   // Finalize sampling request with a given status.
@@ -478,6 +626,10 @@ class Table {
                              absl::Status status)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
+  // Schedules one callback per stream which notifies it about all of its
+  // `completed` inserts and clears `completed`.
+  void NotifyCompletedInserts(CompletedInserts* completed);
+
   // Performs insertion of the `item` into the table.
   absl::Status InsertOrAssignInternal(std::shared_ptr<Item> item)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
@@ -493,6 +645,44 @@ class Table {
                           std::shared_ptr<Item>* deleted_item = nullptr)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
 
+  // Item store captured by `Checkpoint` (see `frozen_items_`).
+  struct FrozenItems {
+    internal::flat_hash_map<Key, std::shared_ptr<Item>> data;
+    internal::DenseKeyMap<std::shared_ptr<Item>> dense_data;
+  };
+
+  // Accessors of `data_` or `dense_data_`, depending on `dense_keys_`, and of
+  // the items in `frozen_items_` which have not been shadowed. `FindItem`
+  // returns nullptr if `key` is not present. The item returned by
+  // `FindMutableItem` is never part of a snapshot so it can be modified in
+  // place. `ForEachItem` calls `fn` for every item in no particular order.
+  const std::shared_ptr<Item>* FindItem(Key key)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  const std::shared_ptr<Item>* FindMutableItem(Key key)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void StoreItem(std::shared_ptr<Item> item) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void EraseItem(Key key) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  size_t NumItems() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void ForEachItem(absl::FunctionRef<void(const std::shared_ptr<Item>&)> fn)
+      const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Lookups in `data_`/`dense_data_` and in the unshadowed part of
+  // `frozen_items_` respectively.
+  std::shared_ptr<Item>* FindLiveItem(Key key)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  const std::shared_ptr<Item>* FindFrozenItem(Key key) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Moves the items of the store into `frozen_items_` and returns them.
+  std::shared_ptr<const FrozenItems> FreezeItems()
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Merges the items changed since `FreezeItems` into the frozen store and
+  // makes it the live one again. No-op if `frozen` is no longer the current
+  // snapshot (i.e the table was reset in the meantime).
+  void ThawItems(const std::shared_ptr<const FrozenItems>& frozen)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
   // Executes a given extension operation for all extensions registered with the
   // table. If extension worker is enabled, operation is executed asynchronously
   // for all extensions that support asynchronous execution. For synchronous
@@ -525,10 +715,47 @@ class Table {
   // Distribution used for removing.
   std::shared_ptr<ItemSelector> remover_ ABSL_GUARDED_BY(mu_);
 
+  // Keys drawn from `sampler_` by `SampleInternal` which have not been used
+  // yet. Consumed from the back. Cleared whenever `sampler_` is modified as
+  // the keys and their probabilities might then be stale.
+  std::vector<ItemSelector::KeyWithProbability> presampled_
+      ABSL_GUARDED_BY(mu_);
+
   // Bijection of key to item. Used for storing the chunks and timestep range of
-  // each item.
+  // each item. Only one of the two is used depending on `dense_keys_` so use
+  // `FindItem` and friends rather than accessing them directly.
   internal::flat_hash_map<Key, std::shared_ptr<Item>> data_
       ABSL_GUARDED_BY(mu_);
+  internal::DenseKeyMap<std::shared_ptr<Item>> dense_data_
+      ABSL_GUARDED_BY(mu_);
+
+  // True if the table assigns the keys of inserted items (see class comment).
+  const bool dense_keys_;
+
+  // Key assigned to the next inserted item when `dense_keys_` is set. Not reset
+  // by `Reset` so that keys which clients may still hold are never reused.
+  Key next_dense_key_ ABSL_GUARDED_BY(mu_) = 0;
+
+  // Keys chosen by the writers of the items inserted when `dense_keys_` is set
+  // and the keys assigned to them, in both directions. Used to assign to the
+  // existing item when a writer reuses a key. Items restored from a checkpoint
+  // have no entry.
+  internal::flat_hash_map<Key, Key> dense_keys_by_writer_key_
+      ABSL_GUARDED_BY(mu_);
+  internal::DenseKeyMap<Key> writer_keys_ ABSL_GUARDED_BY(mu_);
+
+  // Items captured by a `Checkpoint` which is being serialized. The snapshot is
+  // immutable, the items in `data_`/`dense_data_` are the ones which have been
+  // inserted (or copied out of the snapshot to be modified) since it was taken
+  // and `shadowed_keys_` holds the keys of the snapshot which have since been
+  // modified or deleted. The live items are `data_`/`dense_data_` plus the
+  // items of the snapshot which are not shadowed. Null when no checkpoint is
+  // in progress.
+  std::shared_ptr<FrozenItems> frozen_items_ ABSL_GUARDED_BY(mu_);
+  internal::flat_hash_set<Key> shadowed_keys_ ABSL_GUARDED_BY(mu_);
+
+  // Held while checkpointing so that at most one snapshot exists at a time.
+  absl::Mutex checkpoint_mu_ ABSL_ACQUIRED_BEFORE(mu_);
 
   // Count of references from chunks referenced by items.
   internal::flat_hash_map<uint64_t, int64_t> episode_refs_ ABSL_GUARDED_BY(mu_);
@@ -571,7 +798,8 @@ class Table {
   // Optional signature for data in the table.
   const absl::optional<tensorflow::StructuredValue> signature_;
 
-  // Worker thread which processes asynchronous insert and sample requests.
+  // Worker thread which processes asynchronous insert and sample requests. For
+  // sharded tables it runs `ShardedSampleWorkerLoop` instead.
   std::unique_ptr<internal::Thread> table_worker_;
 
   // Pending asynchronous insert requests to the table.
@@ -591,6 +819,11 @@ class Table {
   internal::StateStatistics<TableWorkerState> worker_time_distribution_
       ABSL_GUARDED_BY(worker_mu_);
 
+  // Lock-free so they can be recorded without holding any of the mutexes.
+  // When the table is sharded the histograms of the shards are merged with
+  // those of the parent table (which only records the response sizes).
+  Histograms histograms_;
+
   // Should worker terminate. Set to true upon table termination to stop the
   // worker.
   bool stop_worker_ ABSL_GUARDED_BY(worker_mu_) = false;
@@ -622,6 +855,32 @@ class Table {
   // stop the worker.
   bool stop_extension_worker_ ABSL_GUARDED_BY(mu_) = false;
 
+  // Sub-tables the items are partitioned across. Empty unless the table was
+  // constructed with `num_shards > 1`, in which case all item operations are
+  // forwarded to the shards and the fields above (except the configuration
+  // and the worker state used to park sample requests) are left unused.
+  std::vector<std::unique_ptr<Table>> shards_;
+
+  // Options of the shards' samplers. Only set when the table is sharded and
+  // never modified after construction.
+  KeyDistributionOptions shard_sampler_options_;
+
+  // Number of times the shards have notified the table about inserts. Used to
+  // detect inserts which race with a request being parked.
+  std::atomic<int64_t> shard_insert_generation_{0};
+
+  // Set when items have been inserted into a shard while sample requests are
+  // parked.
+  bool shard_items_inserted_ ABSL_GUARDED_BY(worker_mu_) = false;
+
+  // Set on shards to notify the parent table after inserts were committed.
+  // Called without holding any of the shard's mutexes.
+  std::function<void()> on_items_inserted_;
+
+  // Random source used to select which shard a sample is drawn from.
+  mutable absl::Mutex shard_bit_gen_mu_;
+  absl::BitGen shard_bit_gen_ ABSL_GUARDED_BY(shard_bit_gen_mu_);
+
   // Extensions implement hooks that are executed as part of insert, delete,
   // update or reset operations. There are two types of extensions supported:
   //   - synchronous, which run while holding table's `mu_` mutex.
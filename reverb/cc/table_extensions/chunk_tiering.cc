@@ -0,0 +1,64 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reverb/cc/table_extensions/chunk_tiering.h"
+
+#include <string>
+
+#include "absl/strings/str_format.h"
+#include "reverb/cc/platform/logging.h"
+
+namespace deepmind::reverb {
+namespace {
+
+void MarkChunksCold(const TableItem& item) {
+  for (const auto& chunk : item.chunks()) chunk->MarkCold();
+}
+
+void PrefetchChunks(const TableItem& item) {
+  for (const auto& chunk : item.chunks()) chunk->Prefetch();
+}
+
+}  // namespace
+
+ChunkTieringExtension::ChunkTieringExtension(double cold_priority_threshold,
+                                             double hot_priority_threshold)
+    : cold_priority_threshold_(cold_priority_threshold),
+      hot_priority_threshold_(hot_priority_threshold) {
+  REVERB_CHECK_LT(cold_priority_threshold_, hot_priority_threshold_);
+}
+
+void ChunkTieringExtension::ApplyOnInsert(const ExtensionItem& item) {
+  if (item.priority <= cold_priority_threshold_) MarkChunksCold(*item.ref);
+}
+
+void ChunkTieringExtension::ApplyOnUpdate(const ExtensionItem& item) {
+  if (item.priority <= cold_priority_threshold_) {
+    MarkChunksCold(*item.ref);
+  } else if (item.priority >= hot_priority_threshold_) {
+    PrefetchChunks(*item.ref);
+  }
+}
+
+void ChunkTieringExtension::ApplyOnSample(const ExtensionItem& item) {
+  PrefetchChunks(*item.ref);
+}
+
+std::string ChunkTieringExtension::DebugString() const {
+  return absl::StrFormat("ChunkTieringExtension(cold_priority_threshold=%f, "
+                         "hot_priority_threshold=%f)",
+                         cold_priority_threshold_, hot_priority_threshold_);
+}
+
+}  // namespace deepmind::reverb
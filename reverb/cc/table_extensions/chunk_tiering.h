@@ -0,0 +1,57 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REVERB_CC_TABLE_EXTENSIONS_CHUNK_TIERING_H_
+#define REVERB_CC_TABLE_EXTENSIONS_CHUNK_TIERING_H_
+
+#include <string>
+
+#include "reverb/cc/table.h"
+#include "reverb/cc/table_extensions/base.h"
+
+namespace deepmind::reverb {
+
+// Forwards access hints of a table to the `ChunkSpillTier` (see
+// chunk_spill_tier.h) which owns the chunks referenced by its items.
+//
+// Chunks of items whose priority is at or below `cold_priority_threshold` are
+// marked as cold when the item is inserted or updated so they are the first to
+// be spilled to disk. Chunks of items which are sampled, or whose priority is
+// raised to at least `hot_priority_threshold`, are prefetched so that they are
+// likely to be resident the next time they are sampled.
+//
+// The hints are ignored for chunks which are not managed by a spill tier so the
+// extension is harmless (but useless) on tables without one.
+class ChunkTieringExtension : public TableExtensionBase {
+ public:
+  ChunkTieringExtension(double cold_priority_threshold,
+                        double hot_priority_threshold);
+
+  void ApplyOnInsert(const ExtensionItem& item) override;
+  void ApplyOnUpdate(const ExtensionItem& item) override;
+  void ApplyOnSample(const ExtensionItem& item) override;
+
+  // Returns a summary string description.
+  std::string DebugString() const override;
+
+  bool CanRunAsync() const override { return true; }
+
+ private:
+  const double cold_priority_threshold_;
+  const double hot_priority_threshold_;
+};
+
+}  // namespace deepmind::reverb
+
+#endif  // REVERB_CC_TABLE_EXTENSIONS_CHUNK_TIERING_H_
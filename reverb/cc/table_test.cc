@@ -16,6 +16,7 @@
 
 #include <atomic>
 #include <cfloat>
+#include <map>
 #include <memory>
 #include <string>
 #include <utility>
@@ -26,18 +27,23 @@
 #include "absl/flags/flag.h"
 #include "absl/memory/memory.h"
 #include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/blocking_counter.h"
 #include "absl/synchronization/notification.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "reverb/cc/checkpointing/checkpoint.pb.h"
 #include "reverb/cc/chunk_store.h"
+#include "reverb/cc/errors.h"
 #include "reverb/cc/platform/status_matchers.h"
 #include "reverb/cc/platform/thread.h"
 #include "reverb/cc/rate_limiter.h"
 #include "reverb/cc/schema.pb.h"
 #include "reverb/cc/selectors/fifo.h"
+#include "reverb/cc/selectors/prioritized.h"
 #include "reverb/cc/selectors/uniform.h"
 #include "reverb/cc/support/task_executor.h"
+#include "reverb/cc/table_extensions/base.h"
 #include "reverb/cc/table_extensions/interface.h"
 #include "reverb/cc/testing/proto_test_util.h"
 #include "tensorflow/core/framework/tensor_shape.h"
@@ -56,6 +62,7 @@ using ::deepmind::reverb::testing::Partially;
 using ::testing::ElementsAre;
 using ::testing::IsEmpty;
 using ::testing::SizeIs;
+using ::testing::UnorderedElementsAre;
 
 MATCHER_P(HasItemKey, key, "") { return arg.key() == key; }
 MATCHER_P(HasSampledItemKey, key, "") { return arg.ref->key() == key; }
@@ -256,6 +263,36 @@ TEST(TableTest, SampleNotFullBatch) {
   EXPECT_EQ(items.size(), 1);
 }
 
+TEST(TableTest, SampleFlexibleBatchFromPrioritizedTable) {
+  auto table = MakeTable("dist", std::make_shared<PrioritizedSelector>(1),
+                         std::make_shared<FifoSelector>(), 1000, 0,
+                         MakeLimiter(1));
+  for (int i = 1; i <= 4; i++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(i, i)));
+  }
+
+  std::vector<Table::SampledItem> items;
+  REVERB_ASSERT_OK(table->SampleFlexibleBatch(&items, 100));
+  ASSERT_THAT(items, SizeIs(100));
+  for (const auto& item : items) {
+    EXPECT_DOUBLE_EQ(item.probability, item.ref->key() / 10.0);
+    EXPECT_EQ(item.table_size, 4);
+  }
+
+  // Keys drawn ahead of time must not outlive changes to the priorities.
+  REVERB_EXPECT_OK(table->MutateItems(
+      {testing::MakeKeyWithPriority(1, 0), testing::MakeKeyWithPriority(2, 0),
+       testing::MakeKeyWithPriority(3, 0)},
+      {}));
+  items.clear();
+  REVERB_ASSERT_OK(table->SampleFlexibleBatch(&items, 10));
+  ASSERT_THAT(items, SizeIs(10));
+  for (const auto& item : items) {
+    EXPECT_EQ(item.ref->key(), 4);
+    EXPECT_EQ(item.probability, 1);
+  }
+}
+
 TEST(TableTest, EnqueSampleRequestSetsRateLimitedIfBlocked) {
   auto table = MakeUniformTable("table");
 
@@ -385,6 +422,173 @@ TEST(TableTest, UseAsQueue) {
   sample_thread = nullptr;  // Joins the thread.
 }
 
+// Records the order in which the table commits inserts ('I') and samples
+// ('S'). If `release_first_insert` is set then the first insert blocks the
+// table worker until it is notified.
+class EventRecorder : public TableExtensionBase {
+ public:
+  explicit EventRecorder(absl::Notification* release_first_insert = nullptr)
+      : release_first_insert_(release_first_insert) {}
+
+  void ApplyOnInsert(const ExtensionItem& item) override {
+    bool first;
+    {
+      absl::MutexLock lock(&mu_);
+      first = events_.empty();
+      events_.push_back('I');
+    }
+    if (first && release_first_insert_ != nullptr) {
+      first_insert_blocked_.Notify();
+      release_first_insert_->WaitForNotification();
+    }
+  }
+
+  void ApplyOnSample(const ExtensionItem& item) override {
+    absl::MutexLock lock(&mu_);
+    events_.push_back('S');
+  }
+
+  bool CanRunAsync() const override { return false; }
+
+  std::string DebugString() const override { return "EventRecorder"; }
+
+  std::string events() const {
+    absl::MutexLock lock(&mu_);
+    return events_;
+  }
+
+  void WaitUntilFirstInsertBlocked() {
+    first_insert_blocked_.WaitForNotification();
+  }
+
+ private:
+  absl::Notification* release_first_insert_;
+  absl::Notification first_insert_blocked_;
+  mutable absl::Mutex mu_;
+  std::string events_ ABSL_GUARDED_BY(mu_);
+};
+
+TEST(TableTest, AsyncInsertsRespectRateLimiterAndNotifyEachStream) {
+  auto recorder = std::make_shared<EventRecorder>();
+  Table table(
+      /*name=*/"queue",
+      /*sampler=*/std::make_shared<FifoSelector>(),
+      /*remover=*/std::make_shared<FifoSelector>(),
+      /*max_size=*/1000,
+      /*max_times_sampled=*/1,
+      std::make_shared<RateLimiter>(
+          /*samples_per_insert=*/1.0,
+          /*min_size_to_sample=*/1,
+          /*min_diff=*/0,
+          /*max_diff=*/100.0),
+      std::vector<std::shared_ptr<TableExtension>>{recorder});
+
+  absl::Mutex mu;
+  std::vector<std::vector<uint64_t>> notified(2);
+  absl::Notification max_diff_reached;
+  absl::BlockingCounter all_notified(300);
+  std::vector<std::shared_ptr<Table::InsertCallback>> callbacks;
+  for (int stream = 0; stream < 2; stream++) {
+    callbacks.push_back(
+        std::make_shared<Table::InsertCallback>([&, stream](uint64_t key) {
+          absl::MutexLock lock(&mu);
+          notified[stream].push_back(key);
+          if (notified[0].size() + notified[1].size() == 100) {
+            max_diff_reached.Notify();
+          }
+          all_notified.DecrementCount();
+        }));
+  }
+
+  // Interleave the inserts of the two streams so that every batch committed by
+  // the worker contains items of both.
+  for (int i = 0; i < 300; i++) {
+    bool can_insert_more;
+    REVERB_ASSERT_OK(table.InsertOrAssignAsync(MakeItem(i, 123),
+                                               &can_insert_more,
+                                               callbacks[i % 2]));
+  }
+
+  // Only `max_diff` inserts are allowed before anything is sampled. The rate
+  // limiter blocks the worker until then so no more inserts are committed.
+  max_diff_reached.WaitForNotification();
+  EXPECT_EQ(recorder->events(), std::string(100, 'I'));
+  EXPECT_EQ(table.size(), 100);
+
+  for (int i = 0; i < 300; i++) {
+    Table::SampledItem item;
+    REVERB_ASSERT_OK(table.Sample(&item));
+    EXPECT_THAT(item, HasSampledItemKey(i));
+  }
+  all_notified.Wait();
+
+  // The rate limiter must have held at every point in time.
+  int inserts = 0;
+  int samples = 0;
+  for (char event : recorder->events()) {
+    event == 'I' ? inserts++ : samples++;
+    ASSERT_LE(inserts - samples, 100);
+    ASSERT_GE(inserts - samples, 0);
+  }
+  EXPECT_EQ(inserts, 300);
+  EXPECT_EQ(samples, 300);
+
+  absl::MutexLock lock(&mu);
+  for (int stream = 0; stream < 2; stream++) {
+    ASSERT_THAT(notified[stream], SizeIs(150));
+    for (int i = 0; i < 150; i++) {
+      EXPECT_EQ(notified[stream][i], 2 * i + stream);
+    }
+  }
+}
+
+TEST(TableTest, InsertBatchesTakeTurnsWithWaitingSampleRequests) {
+  absl::Notification release_first_insert;
+  auto recorder = std::make_shared<EventRecorder>(&release_first_insert);
+  auto table = MakeTable(
+      /*name=*/"dist",
+      /*sampler=*/std::make_shared<UniformSelector>(),
+      /*remover=*/std::make_shared<FifoSelector>(),
+      /*max_size=*/1000,
+      /*max_times_sampled=*/0,
+      std::make_shared<RateLimiter>(1.0, 1, -DBL_MAX, DBL_MAX),
+      std::vector<std::shared_ptr<TableExtension>>{recorder});
+
+  absl::BlockingCounter inserts_done(201);
+  auto insert_callback = std::make_shared<Table::InsertCallback>(
+      [&](uint64_t) { inserts_done.DecrementCount(); });
+  bool can_insert_more;
+  REVERB_ASSERT_OK(table->InsertOrAssignAsync(MakeItem(0, 1), &can_insert_more,
+                                              insert_callback));
+
+  // Queue up inserts and sample requests while the worker is blocked so that
+  // it picks them up at the same time.
+  recorder->WaitUntilFirstInsertBlocked();
+  for (int i = 1; i <= 200; i++) {
+    REVERB_ASSERT_OK(table->InsertOrAssignAsync(
+        MakeItem(i, 1), &can_insert_more, insert_callback));
+  }
+  absl::BlockingCounter samples_done(2);
+  auto sample_callback = std::make_shared<Table::SamplingCallback>(
+      [&](Table::SampleRequest* request) {
+        EXPECT_THAT(request->samples, SizeIs(8));
+        samples_done.DecrementCount();
+      });
+  table->EnqueSampleRequest(8, sample_callback, kLongTimeout);
+  table->EnqueSampleRequest(8, sample_callback, kLongTimeout);
+  release_first_insert.Notify();
+
+  inserts_done.Wait();
+  samples_done.Wait();
+
+  // While sample requests are waiting the worker commits as many inserts as
+  // samples in the previous turn (at least one). Once they are done the
+  // remaining inserts are committed in full batches.
+  EXPECT_EQ(recorder->events(),
+            absl::StrCat("I", "I", std::string(8, 'S'), std::string(8, 'I'),
+                         std::string(8, 'S'), std::string(191, 'I')));
+}
+
 TEST(TableTest, ConcurrentInsertOfTheSameKey) {
   auto table = MakeTable(
       /*name=*/"dist",
@@ -596,6 +800,47 @@ TEST(TableTest, CheckpointSanityCheck) {
               ElementsAre(Partially(testing::EqualsProto("key: 1"))));
 }
 
+TEST(TableTest, CheckpointIsConsistentWhileTableIsMutated) {
+  constexpr int kSize = 20000;
+  auto table = MakeUniformTable("dist", 2 * kSize);
+  for (int i = 0; i < kSize; i++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(i, 1)));
+  }
+
+  // Every iteration inserts one item, raises the priority of an item half way
+  // through the table and deletes the oldest item.
+  std::atomic<bool> stop(false);
+  std::atomic<uint64_t> next_key(kSize);
+  auto mutator = internal::StartThread("", [&] {
+    while (!stop) {
+      const uint64_t key = next_key;
+      REVERB_CHECK_OK(table->InsertOrAssign(MakeItem(key, 1)));
+      REVERB_CHECK_OK(table->MutateItems(
+          {testing::MakeKeyWithPriority(key - kSize / 2, 5)}, {key - kSize}));
+      next_key = key + 1;
+    }
+  });
+
+  for (int i = 0; i < 5; i++) {
+    auto checkpoint = table->Checkpoint();
+    const auto& limiter = checkpoint.checkpoint.rate_limiter();
+    EXPECT_EQ(checkpoint.items.size(),
+              limiter.insert_count() - limiter.delete_count());
+    EXPECT_EQ(checkpoint.chunks.size(), checkpoint.items.size());
+  }
+  stop = true;
+  mutator = nullptr;
+
+  // Changes made while the checkpoints were built are not lost.
+  EXPECT_EQ(table->size(), kSize);
+  for (const auto& item : table->Copy()) {
+    EXPECT_GE(item.key(), next_key - kSize);
+    const bool updated =
+        item.key() >= kSize / 2 && item.key() < next_key - kSize / 2;
+    EXPECT_EQ(item.priority(), updated ? 5 : 1);
+  }
+}
+
 TEST(TableTest, BlocksSamplesWhenSizeToSmallDueToAutoDelete) {
   auto table = MakeTable(
       /*name=*/"dist",
@@ -842,6 +1087,7 @@ TEST(TableTest, Info) {
   REVERB_EXPECT_OK(table->Sample(&sample));
   auto info = table->info();
   info.clear_table_worker_time();
+  info.clear_histograms();
 
   EXPECT_THAT(info, testing::EqualsProto(R"pb(
                 name: 'dist'
@@ -868,6 +1114,27 @@ TEST(TableTest, Info) {
               )pb"));
 }
 
+TEST(TableTest, InfoHistograms) {
+  auto table = MakeUniformTable("dist");
+  for (int i = 1; i <= 3; i++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(i, 1)));
+  }
+  Table::SampledItem sample;
+  REVERB_EXPECT_OK(table->Sample(&sample));
+  REVERB_EXPECT_OK(table->Sample(&sample));
+  table->RecordSampleResponseBytes(100);
+  table->RecordSampleResponseBytesSaved(40);
+
+  auto histograms = table->info().histograms();
+  EXPECT_EQ(histograms.insert_to_commit_us().count(), 3);
+  EXPECT_EQ(histograms.sample_wait_us().count(), 2);
+  EXPECT_GT(histograms.lock_hold_us().count(), 0);
+  EXPECT_EQ(histograms.sample_response_bytes().count(), 1);
+  EXPECT_EQ(histograms.sample_response_bytes().sum(), 100);
+  EXPECT_EQ(histograms.sample_response_bytes_saved().count(), 1);
+  EXPECT_EQ(histograms.sample_response_bytes_saved().sum(), 40);
+}
+
 TEST(TableTest, InsertOrAssignOfItemWithoutTrajectory) {
   auto table = MakeUniformTable("dist");
 
@@ -979,6 +1246,434 @@ TEST(TableTest, SampleFromClosedTable) {
   notification.WaitForNotification();
 }
 
+std::unique_ptr<Table> MakeShardedTable(const std::string& name,
+                                        std::shared_ptr<ItemSelector> sampler,
+                                        int num_shards,
+                                        int32_t max_times_sampled = 0) {
+  return MakeTable(name, std::move(sampler), std::make_shared<FifoSelector>(),
+                   1000, max_times_sampled, MakeLimiter(1),
+                   std::vector<std::shared_ptr<TableExtension>>(),
+                   absl::nullopt, num_shards);
+}
+
+TEST(ShardedTableTest, InsertGetAndMutate) {
+  auto table =
+      MakeShardedTable("dist", std::make_shared<UniformSelector>(), 4);
+  EXPECT_EQ(table->num_shards(), 4);
+  for (int i = 1; i <= 100; i++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(i, i)));
+  }
+  EXPECT_EQ(table->size(), 100);
+  EXPECT_THAT(table->Copy(), SizeIs(100));
+  EXPECT_THAT(table->Copy(10), SizeIs(10));
+
+  REVERB_EXPECT_OK(table->MutateItems({testing::MakeKeyWithPriority(5, 555)},
+                                      {1, 2, 3}));
+  EXPECT_EQ(table->size(), 97);
+  EXPECT_EQ(table->Get(2).status().code(), absl::StatusCode::kNotFound);
+  auto item_or_status = table->Get(5);
+  REVERB_ASSERT_OK(item_or_status);
+  EXPECT_EQ(item_or_status.value().priority(), 555);
+  EXPECT_EQ(table->info().current_size(), 97);
+}
+
+TEST(ShardedTableTest, SampleReturnsGlobalProbabilityAndSize) {
+  auto table =
+      MakeShardedTable("dist", std::make_shared<UniformSelector>(), 4);
+  for (int i = 1; i <= 10; i++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(i, 1)));
+  }
+
+  std::vector<Table::SampledItem> items;
+  REVERB_ASSERT_OK(table->SampleFlexibleBatch(&items, 20));
+  EXPECT_THAT(items, SizeIs(20));
+  for (const auto& item : items) {
+    EXPECT_NEAR(item.probability, 0.1, 1e-9);
+    EXPECT_EQ(item.table_size, 10);
+  }
+}
+
+TEST(ShardedTableTest, FifoSamplesInInsertionOrder) {
+  auto table = MakeShardedTable("dist", std::make_shared<FifoSelector>(), 4,
+                                /*max_times_sampled=*/1);
+  for (int i = 1; i <= 20; i++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(i, 1)));
+  }
+  for (int i = 1; i <= 20; i++) {
+    Table::SampledItem item;
+    REVERB_ASSERT_OK(table->Sample(&item));
+    EXPECT_EQ(item.ref->key(), i);
+  }
+  EXPECT_EQ(table->size(), 0);
+}
+
+TEST(ShardedTableTest, CheckpointMergesShards) {
+  auto table =
+      MakeShardedTable("dist", std::make_shared<UniformSelector>(), 3);
+  for (int i = 1; i <= 10; i++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(i, 1)));
+  }
+
+  auto checkpoint = table->Checkpoint();
+  EXPECT_THAT(checkpoint.checkpoint, Partially(testing::EqualsProto(R"pb(
+                table_name: 'dist'
+                max_size: 1000
+                num_shards: 3
+                rate_limiter: { insert_count: 10 sample_count: 0 }
+                sampler: { uniform: true }
+                remover: { fifo: true }
+              )pb")));
+  ASSERT_THAT(checkpoint.items, SizeIs(10));
+  for (int i = 0; i < 10; i++) {
+    EXPECT_EQ(checkpoint.items[i].key(), i + 1);
+  }
+  EXPECT_THAT(checkpoint.chunks, SizeIs(10));
+}
+
+TEST(ShardedTableTest, InfoMergesShardHistograms) {
+  auto table =
+      MakeShardedTable("dist", std::make_shared<UniformSelector>(), 4);
+  for (int i = 1; i <= 10; i++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(i, 1)));
+  }
+  table->RecordSampleResponseBytes(100);
+
+  auto histograms = table->info().histograms();
+  EXPECT_EQ(histograms.insert_to_commit_us().count(), 10);
+  EXPECT_EQ(histograms.sample_response_bytes().count(), 1);
+}
+
+TEST(ShardedTableTest, SampleFromEmptyTableIsServedByAnyShard) {
+  auto table =
+      MakeShardedTable("dist", std::make_shared<UniformSelector>(), 4);
+  constexpr int kNumRequests = 16;
+  absl::BlockingCounter done(kNumRequests);
+  absl::Mutex mu;
+  std::vector<absl::Status> statuses;
+  std::vector<Table::Key> keys;
+  auto callback = std::make_shared<Table::SamplingCallback>(
+      [&](Table::SampleRequest* sample) {
+        {
+          absl::MutexLock lock(&mu);
+          statuses.push_back(sample->status);
+          for (const auto& item : sample->samples) {
+            keys.push_back(item.ref->key());
+          }
+        }
+        done.DecrementCount();
+      });
+  for (int i = 0; i < kNumRequests; i++) {
+    table->EnqueSampleRequest(1, callback, absl::Seconds(10));
+  }
+
+  // The item only lands in one of the shards but every request is served.
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(7, 1)));
+  done.Wait();
+  absl::MutexLock lock(&mu);
+  for (const auto& status : statuses) {
+    REVERB_EXPECT_OK(status);
+  }
+  EXPECT_THAT(keys, ::testing::Each(7));
+  EXPECT_THAT(keys, SizeIs(kNumRequests));
+}
+
+TEST(ShardedTableTest, SampleFromEmptyTableTimesOut) {
+  auto table =
+      MakeShardedTable("dist", std::make_shared<UniformSelector>(), 4);
+  std::vector<Table::SampledItem> items;
+  auto status =
+      table->SampleFlexibleBatch(&items, 1, absl::Milliseconds(10));
+  EXPECT_TRUE(errors::IsRateLimiterTimeout(status)) << status;
+}
+
+TEST(ShardedTableTest, CloseCancelsSampleFromEmptyTable) {
+  auto table =
+      MakeShardedTable("dist", std::make_shared<UniformSelector>(), 4);
+  absl::Notification notification;
+  auto callback = std::make_shared<Table::SamplingCallback>(
+      [&](Table::SampleRequest* sample) {
+        EXPECT_EQ(sample->status.code(), absl::StatusCode::kCancelled);
+        notification.Notify();
+      });
+  table->EnqueSampleRequest(1, callback, absl::Seconds(10));
+  table->Close();
+  notification.WaitForNotification();
+}
+
+TEST(ShardedTableTest, FifoSamplesBatchOfHeadItem) {
+  auto table = MakeShardedTable("dist", std::make_shared<FifoSelector>(), 4,
+                                /*max_times_sampled=*/3);
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1, 1)));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(2, 1)));
+
+  // The head item can be sampled 3 times before it is removed.
+  std::vector<Table::SampledItem> items;
+  REVERB_ASSERT_OK(table->SampleFlexibleBatch(&items, 5));
+  ASSERT_THAT(items, SizeIs(3));
+  for (const auto& item : items) {
+    EXPECT_EQ(item.ref->key(), 1);
+  }
+  EXPECT_EQ(table->size(), 1);
+}
+
+TEST(ShardedTableTest, ProbabilitiesMatchSamplesWhileShardIsBlocked) {
+  // Every shard needs 5 items before its rate limiter allows sampling.
+  auto table =
+      MakeTable("dist", std::make_shared<UniformSelector>(),
+                std::make_shared<FifoSelector>(), 1000,
+                /*max_times_sampled=*/0,
+                std::make_shared<RateLimiter>(
+                    /*samples_per_insert=*/1.0, /*min_size_to_sample=*/10,
+                    /*min_diff=*/-DBL_MAX, /*max_diff=*/DBL_MAX),
+                std::vector<std::shared_ptr<TableExtension>>(),
+                absl::nullopt, /*num_shards=*/2);
+
+  // Insert items until one of the shards can be sampled. The other shard
+  // holds the remaining items but is blocked by its rate limiter.
+  std::vector<Table::SampledItem> items;
+  for (int key = 1; items.empty(); key++) {
+    ASSERT_LT(key, 10);
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(key, 1)));
+    table->SampleFlexibleBatch(&items, 1, absl::Milliseconds(1))
+        .IgnoreError();
+  }
+  ASSERT_GT(table->size(), 5);
+
+  std::map<Table::Key, int> counts;
+  std::map<Table::Key, double> probabilities;
+  int num_samples = 0;
+  for (int i = 0; i < 500; i++) {
+    items.clear();
+    REVERB_ASSERT_OK(table->SampleFlexibleBatch(&items, 10));
+    for (const auto& item : items) {
+      counts[item.ref->key()]++;
+      probabilities[item.ref->key()] = item.probability;
+      num_samples++;
+    }
+  }
+
+  // The samples are only drawn from the shard which can be sampled, so the
+  // probabilities must be relative to that shard rather than to the table.
+  double total_probability = 0;
+  for (const auto& [key, probability] : probabilities) {
+    total_probability += probability;
+    EXPECT_NEAR(static_cast<double>(counts[key]) / num_samples, probability,
+                0.03);
+  }
+  EXPECT_NEAR(total_probability, 1, 1e-9);
+}
+
+TEST(ShardedTableTest, CheckpointRoundTripKeepsCounters) {
+  auto table =
+      MakeShardedTable("dist", std::make_shared<UniformSelector>(), 3);
+  for (int i = 1; i <= 10; i++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(i, 1)));
+  }
+  std::vector<Table::SampledItem> items;
+  REVERB_ASSERT_OK(table->SampleFlexibleBatch(&items, 20));
+  REVERB_EXPECT_OK(table->MutateItems({}, {1, 2, 3}));
+  const auto info = table->info();
+  EXPECT_EQ(info.num_deleted_episodes(), 3);
+  EXPECT_GT(info.num_unique_samples(), 0);
+
+  auto checkpoint = table->Checkpoint();
+  EXPECT_EQ(checkpoint.checkpoint.num_deleted_episodes(),
+            info.num_deleted_episodes());
+  EXPECT_EQ(checkpoint.checkpoint.num_unique_samples(),
+            info.num_unique_samples());
+
+  auto restored = MakeShardedTable("dist", std::make_shared<UniformSelector>(),
+                                   checkpoint.checkpoint.num_shards());
+  restored->set_num_deleted_episodes_from_checkpoint(
+      checkpoint.checkpoint.num_deleted_episodes());
+  restored->set_num_unique_samples_from_checkpoint(
+      checkpoint.checkpoint.num_unique_samples());
+  for (auto& item : table->Copy()) {
+    REVERB_EXPECT_OK(restored->InsertCheckpointItem(std::move(item)));
+  }
+
+  const auto restored_info = restored->info();
+  EXPECT_EQ(restored_info.num_deleted_episodes(),
+            info.num_deleted_episodes());
+  EXPECT_EQ(restored_info.num_unique_samples(), info.num_unique_samples());
+  EXPECT_EQ(restored->num_deleted_episodes(), info.num_deleted_episodes());
+
+  auto restored_checkpoint = restored->Checkpoint();
+  EXPECT_EQ(restored_checkpoint.checkpoint.num_deleted_episodes(),
+            info.num_deleted_episodes());
+  EXPECT_EQ(restored_checkpoint.checkpoint.num_unique_samples(),
+            info.num_unique_samples());
+}
+
+TEST(ShardedTableDeathTest, DiesIfExtensionsUsed) {
+  ::testing::GTEST_FLAG(death_test_style) = "threadsafe";
+  auto table =
+      MakeShardedTable("dist", std::make_shared<UniformSelector>(), 2);
+  EXPECT_DEATH(table->UnsafeAddExtension(nullptr), "");
+}
+
+std::unique_ptr<Table> MakeDenseTable(const std::string& name,
+                                      std::shared_ptr<ItemSelector> sampler,
+                                      int64_t max_size,
+                                      int32_t max_times_sampled = 0) {
+  return MakeTable(name, std::move(sampler), std::make_shared<FifoSelector>(),
+                   max_size, max_times_sampled, MakeLimiter(1),
+                   std::vector<std::shared_ptr<TableExtension>>(),
+                   absl::nullopt, /*num_shards=*/1, /*dense_keys=*/true);
+}
+
+TEST(DenseKeysTableTest, AssignsKeysInInsertionOrder) {
+  auto table = MakeDenseTable("dist", std::make_shared<FifoSelector>(), 100,
+                              /*max_times_sampled=*/1);
+  EXPECT_TRUE(table->dense_keys());
+  for (uint64_t key : {1000, 7, 42}) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(key, 1)));
+  }
+  EXPECT_EQ(table->size(), 3);
+  for (int i = 0; i < 3; i++) {
+    Table::SampledItem item;
+    REVERB_ASSERT_OK(table->Sample(&item));
+    EXPECT_EQ(item.ref->key(), i);
+  }
+}
+
+TEST(DenseKeysTableTest, InsertOrAssignUpdatesExistingItem) {
+  auto table = MakeDenseTable("dist", std::make_shared<FifoSelector>(), 100);
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1000, 1)));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(7, 1)));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1000, 5)));
+  EXPECT_EQ(table->size(), 2);
+  auto item_or_status = table->Get(0);
+  REVERB_ASSERT_OK(item_or_status);
+  EXPECT_EQ(item_or_status.value().priority(), 5);
+
+  // Once the item has been deleted the writer key refers to a new item.
+  REVERB_EXPECT_OK(table->MutateItems({}, {0}));
+  REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1000, 1)));
+  EXPECT_EQ(table->size(), 2);
+  REVERB_EXPECT_OK(table->Get(2).status());
+}
+
+TEST(DenseKeysTableTest, ConfirmsInsertsWithWriterKeys) {
+  Table table("dist", std::make_shared<FifoSelector>(),
+              std::make_shared<FifoSelector>(), 100, 0, MakeLimiter(1), {},
+              absl::nullopt, /*num_shards=*/1, /*dense_keys=*/true);
+
+  absl::Mutex mu;
+  std::vector<uint64_t> notified;
+  auto callback =
+      std::make_shared<Table::InsertCallback>([&](uint64_t key) {
+        absl::MutexLock lock(&mu);
+        notified.push_back(key);
+      });
+  for (uint64_t key : {500, 600, 700}) {
+    bool can_insert_more;
+    REVERB_ASSERT_OK(
+        table.InsertOrAssignAsync(MakeItem(key, 1), &can_insert_more, callback));
+  }
+  auto num_notified = [&] {
+    absl::MutexLock lock(&mu);
+    return notified.size();
+  };
+  for (int retry = 0; retry < 1000 && num_notified() < 3; retry++) {
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+  absl::MutexLock lock(&mu);
+  EXPECT_THAT(notified, ElementsAre(500, 600, 700));
+}
+
+TEST(DenseKeysTableTest, MutateItemsUsesAssignedKeys) {
+  auto table = MakeDenseTable("dist", std::make_shared<UniformSelector>(), 100);
+  for (int i = 0; i < 10; i++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1000 + i, 1)));
+  }
+  REVERB_EXPECT_OK(
+      table->MutateItems({testing::MakeKeyWithPriority(5, 555)}, {1, 2, 3}));
+  EXPECT_EQ(table->size(), 7);
+  EXPECT_EQ(table->Get(2).status().code(), absl::StatusCode::kNotFound);
+  EXPECT_EQ(table->Get(1001).status().code(), absl::StatusCode::kNotFound);
+  auto item_or_status = table->Get(5);
+  REVERB_ASSERT_OK(item_or_status);
+  EXPECT_EQ(item_or_status.value().priority(), 555);
+}
+
+TEST(DenseKeysTableTest, EvictsOldestItemsWhenFull) {
+  auto table = MakeDenseTable("dist", std::make_shared<UniformSelector>(), 10);
+  for (int i = 0; i < 1000; i++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1000 + i, 1)));
+  }
+  EXPECT_EQ(table->size(), 10);
+  std::vector<uint64_t> keys;
+  for (const auto& item : table->Copy()) {
+    keys.push_back(item.key());
+  }
+  EXPECT_THAT(keys, UnorderedElementsAre(990, 991, 992, 993, 994, 995, 996,
+                                         997, 998, 999));
+}
+
+TEST(DenseKeysTableTest, CheckpointRoundTrip) {
+  auto table = MakeDenseTable("dist", std::make_shared<UniformSelector>(), 100);
+  for (int i = 0; i < 10; i++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(1000 + i, 1)));
+  }
+  REVERB_EXPECT_OK(table->MutateItems({}, {9}));
+
+  auto checkpoint = table->Checkpoint();
+  EXPECT_TRUE(checkpoint.checkpoint.dense_keys());
+  EXPECT_EQ(checkpoint.checkpoint.next_dense_key(), 10);
+  ASSERT_THAT(checkpoint.items, SizeIs(9));
+
+  auto restored =
+      MakeDenseTable("dist", std::make_shared<UniformSelector>(), 100);
+  restored->set_next_dense_key_from_checkpoint(
+      checkpoint.checkpoint.next_dense_key());
+  for (auto& item : table->Copy()) {
+    REVERB_EXPECT_OK(restored->InsertCheckpointItem(std::move(item)));
+  }
+  EXPECT_EQ(restored->size(), 9);
+  REVERB_EXPECT_OK(restored->InsertOrAssign(MakeItem(3, 1)));
+  REVERB_EXPECT_OK(restored->Get(10).status());
+  EXPECT_EQ(restored->Get(9).status().code(), absl::StatusCode::kNotFound);
+}
+
+TEST(DenseKeysTableTest, CheckpointWhileMutatedKeepsItemsInRing) {
+  constexpr int kSize = 20000;
+  auto table = MakeDenseTable("dist", std::make_shared<UniformSelector>(),
+                              2 * kSize);
+  for (int i = 0; i < kSize; i++) {
+    REVERB_EXPECT_OK(table->InsertOrAssign(MakeItem(i, 1)));
+  }
+
+  // Every iteration inserts one item, raises the priority of an item half way
+  // through the table and deletes the oldest item, so the checkpoints below
+  // freeze the items while they are mutated and thaw them afterwards.
+  std::atomic<bool> stop(false);
+  std::atomic<uint64_t> next_key(kSize);
+  auto mutator = internal::StartThread("", [&] {
+    while (!stop) {
+      const uint64_t key = next_key;
+      REVERB_CHECK_OK(table->InsertOrAssign(MakeItem(key, 1)));
+      REVERB_CHECK_OK(table->MutateItems(
+          {testing::MakeKeyWithPriority(key - kSize / 2, 5)}, {key - kSize}));
+      next_key = key + 1;
+    }
+  });
+  for (int i = 0; i < 5; i++) {
+    table->Checkpoint();
+  }
+  stop = true;
+  mutator = nullptr;
+
+  EXPECT_EQ(table->size(), kSize);
+  EXPECT_EQ(table->num_dense_key_stragglers(), 0);
+}
+
+TEST(DenseKeysTableDeathTest, DiesIfExtensionsUsed) {
+  ::testing::GTEST_FLAG(death_test_style) = "threadsafe";
+  auto table = MakeDenseTable("dist", std::make_shared<UniformSelector>(), 10);
+  EXPECT_DEATH(table->UnsafeAddExtension(nullptr), "");
+}
+
 }  // namespace
 }  // namespace reverb
 }  // namespace deepmind
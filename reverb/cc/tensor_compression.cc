@@ -15,9 +15,17 @@
 #include "reverb/cc/tensor_compression.h"
 
 #include <cstdint>
+#include <cstring>
+#include <string>
 
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "reverb/cc/platform/logging.h"
+#include "reverb/cc/platform/lz4.h"
 #include "reverb/cc/platform/snappy.h"
+#include "reverb/cc/platform/zstd.h"
+#include "reverb/cc/support/delta_kernels.h"
 #include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/types.h"
@@ -27,29 +35,26 @@ namespace deepmind {
 namespace reverb {
 namespace {
 
-template <typename T>
-tensorflow::Tensor DeltaEncode(const tensorflow::Tensor& tensor, bool encode) {
-  tensorflow::Tensor output(tensor.dtype(), tensor.shape());
-
-  tensorflow::Tensor tensor_reinterpret;
-  TF_CHECK_OK(tensor_reinterpret.BitcastFrom(
-      tensor, tensorflow::DataTypeToEnum<T>::v(), tensor.shape()));
-
-  tensorflow::Tensor output_reinterpret;
-  TF_CHECK_OK(output_reinterpret.BitcastFrom(
-      output, tensorflow::DataTypeToEnum<T>::v(), output.shape()));
+// Level used when compressing with `COMPRESSION_CODEC_ZSTD`. Level 3 is the
+// zstd default and a good trade-off between compression speed and ratio.
+constexpr int kZstdCompressionLevel = 3;
 
-  auto src = tensor_reinterpret.flat_outer_dims<T>();
-  auto dst = output_reinterpret.flat_outer_dims<T>();
-  for (int j = 0; j < src.dimension(1); j++) {
-    dst(0, j) = src(0, j);
-  }
-  for (int i = 1; i < src.dimension(0); i++) {
-    for (int j = 0; j < src.dimension(1); j++) {
-      dst(i, j) = src(i, j) + (encode ? -src(i - 1, j) : dst(i - 1, j));
-    }
+// Applies the delta kernels to the buffer of `src` and writes the result to
+// the buffer of `dst`. Both tensors must have the same shape and type and
+// `dst` may be `src`.
+template <typename T>
+void DeltaEncode(const tensorflow::Tensor& src, tensorflow::Tensor* dst,
+                 bool encode) {
+  const int64_t rows = src.dim_size(0);
+  const int64_t cols = rows == 0 ? 0 : src.NumElements() / rows;
+  const T* src_data = reinterpret_cast<const T*>(src.tensor_data().data());
+  T* dst_data =
+      reinterpret_cast<T*>(const_cast<char*>(dst->tensor_data().data()));
+  if (encode) {
+    internal::DeltaEncodeRows(src_data, dst_data, rows, cols);
+  } else {
+    internal::DeltaDecodeRows(src_data, dst_data, rows, cols);
   }
-  return output;
 }
 
 }  // namespace
@@ -58,9 +63,12 @@ tensorflow::Tensor DeltaEncode(const tensorflow::Tensor& tensor, bool encode) {
   if (tensor.dims() < 2) return tensor;
 
   switch (tensor.dtype()) {
-#define DELTA_ENCODE(T)                      \
-  case tensorflow::DataTypeToEnum<T>::value: \
-    return DeltaEncode<UnsignedType<T>::Type>(tensor, encode);
+#define DELTA_ENCODE(T)                                          \
+  case tensorflow::DataTypeToEnum<T>::value: {                   \
+    tensorflow::Tensor output(tensor.dtype(), tensor.shape());   \
+    DeltaEncode<UnsignedType<T>::Type>(tensor, &output, encode); \
+    return output;                                               \
+  }
     TF_CALL_INTEGRAL_TYPES(DELTA_ENCODE)
 #undef DELTA_ENCODE
     default:
@@ -68,6 +76,26 @@ tensorflow::Tensor DeltaEncode(const tensorflow::Tensor& tensor, bool encode) {
   }
 }
 
+void DeltaEncodeInPlace(tensorflow::Tensor* tensor, bool encode) {
+  if (tensor->dims() < 2) return;
+  if (!tensor->RefCountIsOne()) {
+    // Other tensors are backed by the same buffer so it must not be mutated.
+    *tensor = DeltaEncode(*tensor, encode);
+    return;
+  }
+
+  switch (tensor->dtype()) {
+#define DELTA_ENCODE(T)                                          \
+  case tensorflow::DataTypeToEnum<T>::value:                     \
+    DeltaEncode<UnsignedType<T>::Type>(*tensor, tensor, encode); \
+    return;
+    TF_CALL_INTEGRAL_TYPES(DELTA_ENCODE)
+#undef DELTA_ENCODE
+    default:
+      return;
+  }
+}
+
 std::vector<tensorflow::Tensor> DeltaEncodeList(
     const std::vector<tensorflow::Tensor>& tensors, bool encode) {
   std::vector<tensorflow::Tensor> outputs;
@@ -78,33 +106,95 @@ std::vector<tensorflow::Tensor> DeltaEncodeList(
   return outputs;
 }
 
-void CompressTensorAsProto(const tensorflow::Tensor& tensor,
-                           tensorflow::TensorProto* proto) {
+CompressionCodec CompressTensorAsProto(const tensorflow::Tensor& tensor,
+                                       tensorflow::TensorProto* proto,
+                                       CompressionCodec codec) {
   if (tensor.dtype() == tensorflow::DT_STRING) {
     tensor.AsProtoTensorContent(proto);
-  } else {
-    proto->set_dtype(tensor.dtype());
-    tensor.shape().AsProto(proto->mutable_tensor_shape());
-    SnappyCompressFromString(tensor.tensor_data(),
-                             proto->mutable_tensor_content());
+    return codec;
+  }
+  proto->set_dtype(tensor.dtype());
+  tensor.shape().AsProto(proto->mutable_tensor_shape());
+  const auto tensor_data = tensor.tensor_data();
+  switch (codec) {
+    case CompressionCodec::COMPRESSION_CODEC_NONE:
+      break;
+    case CompressionCodec::COMPRESSION_CODEC_SNAPPY:
+      SnappyCompressFromString(tensor_data, proto->mutable_tensor_content());
+      return codec;
+    case CompressionCodec::COMPRESSION_CODEC_ZSTD:
+      if (ZstdCompressFromString(tensor_data, kZstdCompressionLevel,
+                                 proto->mutable_tensor_content()) != 0) {
+        return codec;
+      }
+      break;
+    case CompressionCodec::COMPRESSION_CODEC_LZ4:
+      if (Lz4CompressFromString(tensor_data,
+                                proto->mutable_tensor_content()) != 0) {
+        return codec;
+      }
+      break;
+    default:
+      break;
   }
+
+  // Store the raw content rather than a payload that cannot be decoded.
+  if (codec != CompressionCodec::COMPRESSION_CODEC_NONE) {
+    REVERB_LOG_EVERY_N(REVERB_WARNING, 100)
+        << "Failed to compress tensor of " << tensor_data.size()
+        << " bytes with codec " << static_cast<int>(codec)
+        << ". Storing it uncompressed instead.";
+  }
+  proto->set_tensor_content(std::string(tensor_data));
+  return CompressionCodec::COMPRESSION_CODEC_NONE;
 }
 
-tensorflow::Tensor DecompressTensorFromProto(
-    const tensorflow::TensorProto& proto) {
+absl::StatusOr<tensorflow::Tensor> DecompressTensorFromProto(
+    const tensorflow::TensorProto& proto, CompressionCodec codec) {
+  if (!CompressionCodec_IsValid(codec)) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Unknown compression codec ", static_cast<int>(codec), "."));
+  }
+
   if (proto.dtype() == tensorflow::DT_STRING) {
     tensorflow::Tensor tensor;
-    REVERB_CHECK(tensor.FromProto(proto));
-    return tensor;
-  } else {
-    tensorflow::Tensor tensor(proto.dtype(),
-                              tensorflow::TensorShape(proto.tensor_shape()));
-    const auto& tensor_content = proto.tensor_content();
-    SnappyUncompressToString(tensor_content,
-                             tensor.tensor_data().size(),
-                             const_cast<char*>(tensor.tensor_data().data()));
+    if (!tensor.FromProto(proto)) {
+      return absl::DataLossError("Failed to parse string tensor from proto.");
+    }
     return tensor;
   }
+
+  tensorflow::Tensor tensor(proto.dtype(),
+                            tensorflow::TensorShape(proto.tensor_shape()));
+  const auto& tensor_content = proto.tensor_content();
+  const size_t size = tensor.tensor_data().size();
+  char* data = const_cast<char*>(tensor.tensor_data().data());
+  if (size == 0) return tensor;
+
+  bool ok = false;
+  switch (codec) {
+    case CompressionCodec::COMPRESSION_CODEC_NONE:
+      ok = tensor_content.size() == size;
+      if (ok) std::memcpy(data, tensor_content.data(), size);
+      break;
+    case CompressionCodec::COMPRESSION_CODEC_ZSTD:
+      ok = ZstdUncompressToString(tensor_content, size, data);
+      break;
+    case CompressionCodec::COMPRESSION_CODEC_LZ4:
+      ok = Lz4UncompressToString(tensor_content, size, data);
+      break;
+    case CompressionCodec::COMPRESSION_CODEC_SNAPPY:
+      ok = SnappyUncompressToString(tensor_content, size, data);
+      break;
+    default:
+      break;
+  }
+  if (!ok) {
+    return absl::DataLossError(absl::StrCat(
+        "Failed to decompress tensor of ", size, " bytes with codec ",
+        CompressionCodec_Name(codec), "."));
+  }
+  return tensor;
 }
 
 }  // namespace reverb
@@ -15,6 +15,8 @@
 #ifndef LEARNING_DEEPMIND_REPLAY_REVERB_TENSOR_COMPRESSION_H_
 #define LEARNING_DEEPMIND_REPLAY_REVERB_TENSOR_COMPRESSION_H_
 
+#include "absl/status/statusor.h"
+#include "reverb/cc/schema.pb.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 
@@ -27,18 +29,31 @@ namespace reverb {
 // `encode=true` should be passed, for decoding `encode=false`.
 tensorflow::Tensor DeltaEncode(const tensorflow::Tensor& tensor, bool encode);
 
+// Same as `DeltaEncode` but overwrites the buffer of `tensor` rather than
+// allocating a new one. Falls back to `DeltaEncode` if the buffer is shared
+// with other tensors.
+void DeltaEncodeInPlace(tensorflow::Tensor* tensor, bool encode);
+
 // Applies `DeltaEncode` on a vector of tensors.
 std::vector<tensorflow::Tensor> DeltaEncodeList(
     const std::vector<tensorflow::Tensor>& tensors, bool encode);
 
-// Compresses a Tensor with Zippy. The resulting `proto` must be read with
-// `DecompressTensorFromProto`. Note that string tensors are not compressed.
-void CompressTensorAsProto(const tensorflow::Tensor& tensor,
-                           tensorflow::TensorProto* proto);
+// Compresses a Tensor with `codec` (Zippy by default) and returns the codec
+// that was actually used. The resulting `proto` must be read with
+// `DecompressTensorFromProto` using the returned codec. If `codec` is unknown
+// or fails to compress the tensor (e.g. as it exceeds the LZ4 input limit) then
+// the raw content is stored and `COMPRESSION_CODEC_NONE` is returned. Note that
+// string tensors are not compressed.
+CompressionCodec CompressTensorAsProto(
+    const tensorflow::Tensor& tensor, tensorflow::TensorProto* proto,
+    CompressionCodec codec = CompressionCodec::COMPRESSION_CODEC_SNAPPY);
 
-// Assumes that the TensorProto was built by calling `CompressTensorAsProto`.
-tensorflow::Tensor DecompressTensorFromProto(
-    const tensorflow::TensorProto& proto);
+// Assumes that the TensorProto was built by calling `CompressTensorAsProto`
+// with `codec`. Returns `InvalidArgumentError` if `codec` is unknown and
+// `DataLossError` if the content cannot be decompressed.
+absl::StatusOr<tensorflow::Tensor> DecompressTensorFromProto(
+    const tensorflow::TensorProto& proto,
+    CompressionCodec codec = CompressionCodec::COMPRESSION_CODEC_SNAPPY);
 
 template <typename T>
 struct UnsignedType {
@@ -0,0 +1,114 @@
+// Copyright 2019 DeepMind Technologies Limited.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+
+#include "benchmark/benchmark.h"
+#include "reverb/cc/schema.pb.h"
+#include "reverb/cc/tensor_compression.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor.pb.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/types.h"
+
+namespace deepmind {
+namespace reverb {
+namespace {
+
+constexpr int64_t kBatchSize = 16;
+
+// A batch of stacked 84x84 uint8 frames (i.e Atari observations). Consecutive
+// timesteps share most of their pixels which is what delta encoding exploits.
+tensorflow::Tensor MakeFrames() {
+  tensorflow::Tensor tensor(tensorflow::DT_UINT8,
+                            tensorflow::TensorShape({kBatchSize, 4, 84, 84}));
+  auto flat = tensor.flat<tensorflow::uint8>();
+  const int64_t frame_size = flat.size() / kBatchSize;
+  for (int64_t i = 0; i < flat.size(); i++) {
+    const int64_t t = i / frame_size;
+    const int64_t pixel = i % frame_size;
+    // Mostly background with a small moving sprite.
+    flat(i) = (pixel / 84 + t) % 21 == 0 ? 200 : (pixel % 7) * 3;
+  }
+  return tensor;
+}
+
+// A batch of slowly changing float features (e.g proprioceptive state).
+tensorflow::Tensor MakeFeatures() {
+  tensorflow::Tensor tensor(tensorflow::DT_FLOAT,
+                            tensorflow::TensorShape({kBatchSize, 1024}));
+  auto flat = tensor.flat<float>();
+  for (int64_t i = 0; i < flat.size(); i++) {
+    flat(i) = static_cast<float>((i % 1024) / 64) * 0.5f;
+  }
+  return tensor;
+}
+
+void ReportRatio(benchmark::State& state, const tensorflow::Tensor& tensor,
+                 const tensorflow::TensorProto& proto) {
+  state.SetBytesProcessed(state.iterations() * tensor.TotalBytes());
+  state.counters["ratio"] = static_cast<double>(tensor.TotalBytes()) /
+                            proto.tensor_content().size();
+}
+
+template <tensorflow::Tensor (*MakeTensor)()>
+void BM_Compress(benchmark::State& state) {
+  const auto codec = static_cast<CompressionCodec>(state.range(0));
+  const bool delta_encode = state.range(1);
+  const tensorflow::Tensor tensor = MakeTensor();
+  tensorflow::TensorProto proto;
+  for (auto _ : state) {
+    proto.Clear();
+    CompressTensorAsProto(delta_encode ? DeltaEncode(tensor, true) : tensor,
+                          &proto, codec);
+    benchmark::DoNotOptimize(proto);
+  }
+  ReportRatio(state, tensor, proto);
+}
+
+template <tensorflow::Tensor (*MakeTensor)()>
+void BM_Decompress(benchmark::State& state) {
+  const auto codec = static_cast<CompressionCodec>(state.range(0));
+  const bool delta_encode = state.range(1);
+  const tensorflow::Tensor tensor = MakeTensor();
+  tensorflow::TensorProto proto;
+  CompressTensorAsProto(delta_encode ? DeltaEncode(tensor, true) : tensor,
+                        &proto, codec);
+  for (auto _ : state) {
+    tensorflow::Tensor result = DecompressTensorFromProto(proto, codec).value();
+    if (delta_encode) DeltaEncodeInPlace(&result, false);
+    benchmark::DoNotOptimize(result);
+  }
+  ReportRatio(state, tensor, proto);
+}
+
+void CodecArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"codec", "delta"});
+  for (auto codec : {CompressionCodec::COMPRESSION_CODEC_NONE,
+                     CompressionCodec::COMPRESSION_CODEC_SNAPPY,
+                     CompressionCodec::COMPRESSION_CODEC_ZSTD,
+                     CompressionCodec::COMPRESSION_CODEC_LZ4}) {
+    b->Args({codec, false});
+    b->Args({codec, true});
+  }
+}
+
+BENCHMARK_TEMPLATE(BM_Compress, MakeFrames)->Apply(CodecArgs);
+BENCHMARK_TEMPLATE(BM_Decompress, MakeFrames)->Apply(CodecArgs);
+BENCHMARK_TEMPLATE(BM_Compress, MakeFeatures)->Apply(CodecArgs);
+BENCHMARK_TEMPLATE(BM_Decompress, MakeFeatures)->Apply(CodecArgs);
+
+}  // namespace
+}  // namespace reverb
+}  // namespace deepmind
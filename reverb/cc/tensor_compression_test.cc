@@ -17,11 +17,14 @@
 #include <string>
 
 #include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "reverb/cc/schema.pb.h"
 #include "reverb/cc/testing/tensor_testutil.h"
 #include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_util.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/types.pb.h"
 
@@ -48,6 +51,40 @@ TEST(TensorCompressionTest, EncodeMatchesDecode) {
   EncodeMatchesDecodeT<bool>();
 }
 
+template <typename T>
+void InPlaceMatchesCopyT() {
+  tensorflow::Tensor tensor(tensorflow::DataTypeToEnum<T>::v(),
+                            tensorflow::TensorShape({16, 37, 6}));
+  tensor.flat<T>().setRandom();
+  tensorflow::Tensor expected = DeltaEncode(tensor, true);
+
+  tensorflow::Tensor in_place = tensorflow::tensor::DeepCopy(tensor);
+  DeltaEncodeInPlace(&in_place, true);
+  test::ExpectTensorEqual<T>(expected, in_place);
+
+  DeltaEncodeInPlace(&in_place, false);
+  test::ExpectTensorEqual<T>(tensor, in_place);
+}
+
+TEST(TensorCompressionTest, InPlaceMatchesCopy) {
+#define IN_PLACE_MATCHES_COPY(T) InPlaceMatchesCopyT<T>();
+  TF_CALL_INTEGRAL_TYPES(IN_PLACE_MATCHES_COPY)
+#undef IN_PLACE_MATCHES_COPY
+}
+
+TEST(TensorCompressionTest, InPlaceDoesNotMutateSharedBuffer) {
+  tensorflow::Tensor tensor(tensorflow::DT_UINT8,
+                            tensorflow::TensorShape({4, 3}));
+  tensor.flat<tensorflow::uint8>().setRandom();
+  tensorflow::Tensor original = tensorflow::tensor::DeepCopy(tensor);
+
+  tensorflow::Tensor shared = tensor;
+  DeltaEncodeInPlace(&shared, true);
+  test::ExpectTensorEqual<tensorflow::uint8>(original, tensor);
+  test::ExpectTensorEqual<tensorflow::uint8>(DeltaEncode(original, true),
+                                             shared);
+}
+
 TEST(TensorCompressionTest, EncodeListMatchesDecode) {
   tensorflow::Tensor tensor(tensorflow::DT_INT32,
                             tensorflow::TensorShape({16, 37, 6}));
@@ -70,7 +107,7 @@ TEST(TensorCompressionTest, StringTensor) {
   tensorflow::TensorProto proto;
   CompressTensorAsProto(tensor, &proto);
 
-  tensorflow::Tensor result = DecompressTensorFromProto(proto);
+  tensorflow::Tensor result = DecompressTensorFromProto(proto).value();
   test::ExpectTensorEqual<tensorflow::tstring>(tensor, result);
 }
 
@@ -82,10 +119,107 @@ TEST(TensorCompressionTest, NonStringTensor) {
   tensorflow::TensorProto proto;
   CompressTensorAsProto(tensor, &proto);
 
-  tensorflow::Tensor result = DecompressTensorFromProto(proto);
+  tensorflow::Tensor result = DecompressTensorFromProto(proto).value();
   test::ExpectTensorEqual<int>(tensor, result);
 }
 
+class TensorCompressionCodecTest
+    : public ::testing::TestWithParam<CompressionCodec> {};
+
+template <typename T>
+void CodecRoundTripsT(CompressionCodec codec) {
+  tensorflow::Tensor tensor(tensorflow::DataTypeToEnum<T>::v(),
+                            tensorflow::TensorShape({16, 37, 6}));
+  tensor.flat<T>().setRandom();
+
+  tensorflow::TensorProto proto;
+  EXPECT_EQ(CompressTensorAsProto(tensor, &proto, codec), codec);
+  test::ExpectTensorEqual<T>(tensor,
+                             DecompressTensorFromProto(proto, codec).value());
+}
+
+TEST_P(TensorCompressionCodecTest, RoundTrips) {
+#define CODEC_ROUND_TRIPS(T) CodecRoundTripsT<T>(GetParam());
+  TF_CALL_INTEGRAL_TYPES(CODEC_ROUND_TRIPS)
+#undef CODEC_ROUND_TRIPS
+  CodecRoundTripsT<float>(GetParam());
+  CodecRoundTripsT<double>(GetParam());
+}
+
+TEST_P(TensorCompressionCodecTest, EmptyTensorRoundTrips) {
+  tensorflow::Tensor tensor(tensorflow::DT_FLOAT,
+                            tensorflow::TensorShape({0, 3}));
+  tensorflow::TensorProto proto;
+  EXPECT_EQ(CompressTensorAsProto(tensor, &proto, GetParam()), GetParam());
+  test::ExpectTensorEqual<float>(
+      tensor, DecompressTensorFromProto(proto, GetParam()).value());
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    AllCodecs, TensorCompressionCodecTest,
+    ::testing::Values(CompressionCodec::COMPRESSION_CODEC_SNAPPY,
+                      CompressionCodec::COMPRESSION_CODEC_NONE,
+                      CompressionCodec::COMPRESSION_CODEC_ZSTD,
+                      CompressionCodec::COMPRESSION_CODEC_LZ4));
+
+TEST(TensorCompressionTest, SnappyIsTheDefaultCodec) {
+  tensorflow::Tensor tensor(tensorflow::DT_INT32,
+                            tensorflow::TensorShape({8, 8}));
+  tensor.flat<int>().setRandom();
+
+  // Protos written before the codec was configurable are decoded without
+  // specifying one.
+  tensorflow::TensorProto proto;
+  CompressTensorAsProto(tensor, &proto,
+                        CompressionCodec::COMPRESSION_CODEC_SNAPPY);
+  test::ExpectTensorEqual<int>(tensor,
+                               DecompressTensorFromProto(proto).value());
+  EXPECT_EQ(ChunkData().compression_codec(),
+            CompressionCodec::COMPRESSION_CODEC_SNAPPY);
+}
+
+TEST(TensorCompressionTest, UnknownCodecIsStoredUncompressed) {
+  tensorflow::Tensor tensor(tensorflow::DT_INT32,
+                            tensorflow::TensorShape({8, 8}));
+  tensor.flat<int>().setRandom();
+
+  tensorflow::TensorProto proto;
+  EXPECT_EQ(CompressTensorAsProto(tensor, &proto,
+                                  static_cast<CompressionCodec>(100)),
+            CompressionCodec::COMPRESSION_CODEC_NONE);
+  test::ExpectTensorEqual<int>(
+      tensor,
+      DecompressTensorFromProto(proto, CompressionCodec::COMPRESSION_CODEC_NONE)
+          .value());
+}
+
+TEST(TensorCompressionTest, DecompressRejectsUnknownCodec) {
+  tensorflow::Tensor tensor(tensorflow::DT_INT32,
+                            tensorflow::TensorShape({8, 8}));
+  tensor.flat<int>().setRandom();
+
+  tensorflow::TensorProto proto;
+  CompressTensorAsProto(tensor, &proto);
+  EXPECT_EQ(
+      DecompressTensorFromProto(proto, static_cast<CompressionCodec>(100))
+          .status()
+          .code(),
+      absl::StatusCode::kInvalidArgument);
+}
+
+TEST_P(TensorCompressionCodecTest, DecompressFailsOnCorruptContent) {
+  tensorflow::Tensor tensor(tensorflow::DT_INT32,
+                            tensorflow::TensorShape({8, 8}));
+  tensor.flat<int>().setRandom();
+
+  tensorflow::TensorProto proto;
+  CompressTensorAsProto(tensor, &proto, GetParam());
+  proto.set_tensor_content(
+      proto.tensor_content().substr(0, proto.tensor_content().size() / 2));
+  EXPECT_EQ(DecompressTensorFromProto(proto, GetParam()).status().code(),
+            absl::StatusCode::kDataLoss);
+}
+
 TEST(TensorCompressionTest, NonStringTensorWithDeltaEncoding) {
   tensorflow::Tensor tensor(tensorflow::DT_INT32,
                             tensorflow::TensorShape({2, 2}));
@@ -94,7 +228,7 @@ TEST(TensorCompressionTest, NonStringTensorWithDeltaEncoding) {
   tensorflow::TensorProto proto;
   CompressTensorAsProto(DeltaEncode(tensor, true), &proto);
 
-  tensorflow::Tensor result = DecompressTensorFromProto(proto);
+  tensorflow::Tensor result = DecompressTensorFromProto(proto).value();
   test::ExpectTensorEqual<int>(tensor, DeltaEncode(result, false));
 }
 
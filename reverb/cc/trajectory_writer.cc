@@ -332,16 +332,22 @@ TrajectoryWriter::TrajectoryWriter(
 TrajectoryWriter::~TrajectoryWriter() {
   {
     absl::MutexLock lock(&mu_);
-    if (closed_) return;
-
-    absl::Status status = FlushLocked(/*ignore_last_num_items=*/0,
-                                      /*timeout=*/absl::InfiniteDuration());
-    REVERB_LOG_IF(REVERB_WARNING, !status.ok())
-        << "TrajectoryWriter destroyed before content finalized. Encountered "
-           "error when trying to finalize content: "
-        << status;
+    if (!closed_) {
+      absl::Status status = FlushLocked(/*ignore_last_num_items=*/0,
+                                        /*timeout=*/absl::InfiniteDuration());
+      REVERB_LOG_IF(REVERB_WARNING, !status.ok())
+          << "TrajectoryWriter destroyed before content finalized. Encountered "
+             "error when trying to finalize content: "
+          << status;
+    }
   }
   Close();
+
+  // Chunks which are compressed in the background signal `data_cv_` when done
+  // so they must not outlive the writer.
+  for (auto& [_, chunker] : chunkers_) {
+    chunker->WaitForPendingChunks();
+  }
 }
 
 absl::Status TrajectoryWriter::Append(
@@ -379,10 +385,17 @@ absl::Status TrajectoryWriter::AppendInternal(
       const std::shared_ptr<ChunkerOptions>& chunker_options =
           options_override_.contains(i) ? options_override_[i]
                                         : options_.chunker_options;
-      chunkers_[i] = std::make_shared<Chunker>(
+      auto chunker = std::make_shared<Chunker>(
           internal::TensorSpec{std::to_string(i), tensor.dtype(),
                                tensor.shape()},
-          chunker_options->Clone());
+          chunker_options->Clone(), options_.compression_pool,
+          // Wake up the stream worker in case it is waiting for the chunk.
+          [this] {
+            absl::MutexLock lock(&mu_);
+            data_cv_.Signal();
+          });
+      absl::MutexLock lock(&mu_);
+      chunkers_[i] = std::move(chunker);
     }
   }
 
@@ -797,6 +810,22 @@ int TrajectoryWriter::max_num_keep_alive_refs() const {
   return max_value;
 }
 
+internal::flat_hash_map<int, ChunkStatistics>
+TrajectoryWriter::GetChunkStatistics() const {
+  // The chunkers are copied so that their locks aren't acquired while holding
+  // `mu_`.
+  std::vector<std::pair<int, std::shared_ptr<Chunker>>> chunkers;
+  {
+    absl::MutexLock lock(&mu_);
+    chunkers.assign(chunkers_.begin(), chunkers_.end());
+  }
+  internal::flat_hash_map<int, ChunkStatistics> statistics;
+  for (const auto& [column, chunker] : chunkers) {
+    statistics[column] = chunker->GetStatistics();
+  }
+  return statistics;
+}
+
 TrajectoryColumn::TrajectoryColumn(std::vector<std::weak_ptr<CellRef>> refs,
                                    bool squeeze)
     : refs_(std::move(refs)), squeeze_(squeeze) {}
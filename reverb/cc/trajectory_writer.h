@@ -27,6 +27,7 @@
 #include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 #include "absl/types/span.h"
+#include "reverb/cc/chunk_compression_pool.h"
 #include "reverb/cc/chunker.h"
 #include "reverb/cc/platform/hash_map.h"
 #include "reverb/cc/platform/hash_set.h"
@@ -243,6 +244,10 @@ class TrajectoryWriter : public ColumnWriter,
 
     std::shared_ptr<ChunkerOptions> chunker_options;
 
+    // Pool on which full chunks are encoded and compressed. If null then
+    // chunks are compressed by the thread calling `Append` or `Flush`.
+    std::shared_ptr<ChunkCompressionPool> compression_pool;
+
     // Optional mapping from table names to optional flattened signatures. The
     // two layers of optional allows us to distinguish between tables that we
     // know exist but no signature is specified and a server were we have no
@@ -315,6 +320,12 @@ class TrajectoryWriter : public ColumnWriter,
   // Get the maximum value for `keep_alive_refs` for any of the columns.
   int max_num_keep_alive_refs() const;
 
+  // Statistics of the chunks created so far, keyed by column index. Columns
+  // which have not yet been appended to are not included. Unlike most other
+  // methods this may be called concurrently with `Append`.
+  internal::flat_hash_map<int, ChunkStatistics> GetChunkStatistics() const
+      ABSL_LOCKS_EXCLUDED(mu_);
+
   // Number of `Append` calls since last `EndEpisode` call. Note that
   // `AppendPartial` calls does not increment this counter.
   int episode_steps() const;
@@ -403,7 +414,9 @@ class TrajectoryWriter : public ColumnWriter,
 
   // Mapping from column index to Chunker. Shared pointers are used as the
   // `CellRef`s created by the chunker will own a weak_ptr created using
-  // `weak_from_this()` on the Chunker.
+  // `weak_from_this()` on the Chunker. Chunkers are only added while holding
+  // `mu_` so that `GetChunkStatistics` can read the map under the lock while
+  // the appending thread reads it without.
   internal::flat_hash_map<int, std::shared_ptr<Chunker>> chunkers_;
 
   mutable absl::Mutex mu_;
@@ -640,6 +640,71 @@ TEST(TrajectoryWriter, ConfigureChunkerOnExistingColumn) {
   EXPECT_TRUE(third[0]->lock()->IsReady());
 }
 
+TEST(TrajectoryWriter, GetChunkStatisticsIsPerColumn) {
+  AsyncInterface async;
+  auto stub = std::make_shared<MockReverbServiceAsyncStub>();
+  EXPECT_CALL(*stub, async())
+      .WillRepeatedly(Return(&async));
+
+  TrajectoryWriter writer(
+      stub, MakeOptions(/*max_chunk_length=*/1, /*num_keep_alive_refs=*/2));
+  EXPECT_TRUE(writer.GetChunkStatistics().empty());
+
+  // Only the first column creates chunks of a single step.
+  REVERB_ASSERT_OK(writer.ConfigureChunker(
+      1, std::make_shared<ConstantChunkerOptions>(/*max_chunk_length=*/2,
+                                                  /*num_keep_alive_refs=*/2)));
+  StepRef refs;
+  for (int i = 0; i < 3; i++) {
+    REVERB_ASSERT_OK(writer.Append(
+        Step({MakeTensor(kIntSpec), MakeTensor(kIntSpec)}), &refs));
+  }
+
+  auto statistics = writer.GetChunkStatistics();
+  ASSERT_EQ(statistics.size(), 2);
+  EXPECT_EQ(statistics[0].num_chunks, 3);
+  EXPECT_EQ(statistics[0].num_rows, 3);
+  EXPECT_EQ(statistics[1].num_chunks, 1);
+  EXPECT_EQ(statistics[1].num_rows, 2);
+}
+
+TEST(TrajectoryWriter, GetChunkStatisticsConcurrentlyWithAppend) {
+  AsyncInterface async;
+  auto stub = std::make_shared<MockReverbServiceAsyncStub>();
+  EXPECT_CALL(*stub, async())
+      .WillRepeatedly(Return(&async));
+
+  TrajectoryWriter writer(
+      stub, MakeOptions(/*max_chunk_length=*/1, /*num_keep_alive_refs=*/1));
+
+  // Every step adds a new column (and thus a new chunker) while the
+  // statistics are read from another thread.
+  constexpr int kNumColumns = 100;
+  absl::Notification done;
+  auto reader = internal::StartThread("GetChunkStatistics", [&] {
+    size_t num_columns = 0;
+    while (!done.HasBeenNotified()) {
+      auto statistics = writer.GetChunkStatistics();
+      EXPECT_GE(statistics.size(), num_columns);
+      num_columns = statistics.size();
+    }
+  });
+  Step step;
+  StepRef refs;
+  for (int i = 0; i < kNumColumns; i++) {
+    step.push_back(MakeTensor(kIntSpec));
+    REVERB_ASSERT_OK(writer.Append(step, &refs));
+    refs.clear();
+  }
+  done.Notify();
+  reader = nullptr;  // Joins the thread.
+
+  auto statistics = writer.GetChunkStatistics();
+  ASSERT_EQ(statistics.size(), kNumColumns);
+  EXPECT_EQ(statistics[0].num_chunks, kNumColumns);
+  EXPECT_EQ(statistics[kNumColumns - 1].num_chunks, 1);
+}
+
 TEST(TrajectoryWriter, ConfigureChunkerOnFutureColumn) {
   AsyncInterface async;
   auto stub = std::make_shared<MockReverbServiceAsyncStub>();
@@ -796,6 +861,9 @@ TEST(TrajectoryWriter, ChunkersNotifiedWhenAllChunksDone) {
     int GetNumKeepAliveRefs() const override { return 1; }
     bool GetDeltaEncode() const override { return false; }
     bool GetCompressionDisabled() const override { return false; }
+    CompressionCodec GetCompressionCodec() const override {
+      return CompressionCodec::COMPRESSION_CODEC_SNAPPY;
+    }
 
     absl::Status OnItemFinalized(
         const PrioritizedItem& item,
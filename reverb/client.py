@@ -531,7 +531,8 @@ class Client:
   def trajectory_writer(self,
                         num_keep_alive_refs: int,
                         *,
-                        validate_items: bool = True):
+                        validate_items: bool = True,
+                        background_compression: bool = False):
     """Constructs a new `TrajectoryWriter`.
 
     Note: The chunk length is auto tuned by default. Use
@@ -549,6 +550,10 @@ class Client:
       validate_items: Whether to validate items against the table signature
         before they are sent to the server. This requires table signature to be
         fetched from the server and cached locally.
+      background_compression: Whether full chunks should be compressed on a
+        process wide thread pool rather than by the thread calling `append`.
+        When the pool falls behind, chunks are compressed by the calling thread
+        again, which bounds the amount of uncompressed data held in memory.
 
     Returns:
       A `TrajectoryWriter` with auto tuned chunk lengths in each column.
@@ -564,7 +569,8 @@ class Client:
 
     chunker_options = pybind.AutoTunedChunkerOptions(num_keep_alive_refs, 1.0)
     cpp_writer = self._client.NewTrajectoryWriter(chunker_options,
-                                                  validate_items)
+                                                  validate_items,
+                                                  background_compression)
     return trajectory_writer_lib.TrajectoryWriter(cpp_writer)
 
   def structured_writer(self, configs: Sequence[structured_writer_lib.Config]):
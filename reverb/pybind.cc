@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <map>
 #include <memory>
 #include <string>
 
@@ -26,6 +27,7 @@
 #include "pybind11/pytypes.h"
 #include "pybind11/stl.h"
 #include "reverb/cc/checkpointing/interface.h"
+#include "reverb/cc/chunk_compression_pool.h"
 #include "reverb/cc/chunker.h"
 #include "reverb/cc/client.h"
 #include "reverb/cc/conversions.h"
@@ -253,7 +255,8 @@ PYBIND11_MODULE(libpybind, m) {
                   const std::vector<std::shared_ptr<TableExtension>>
                       &extensions,
                   const absl::optional<std::string> &serialized_signature =
-                      absl::nullopt) -> Table * {
+                      absl::nullopt,
+                  int num_shards = 1, bool dense_keys = false) -> Table * {
                  absl::optional<tensorflow::StructuredValue> signature =
                      absl::nullopt;
                  if (serialized_signature) {
@@ -269,11 +272,13 @@ PYBIND11_MODULE(libpybind, m) {
                  }
                  return new Table(name, sampler, remover, max_size,
                                   max_times_sampled, rate_limiter, extensions,
-                                  std::move(signature));
+                                  std::move(signature), num_shards,
+                                  dense_keys);
                }),
            py::arg("name"), py::arg("sampler"), py::arg("remover"),
            py::arg("max_size"), py::arg("max_times_sampled"),
-           py::arg("rate_limiter"), py::arg("extensions"), py::arg("signature"))
+           py::arg("rate_limiter"), py::arg("extensions"), py::arg("signature"),
+           py::arg("num_shards") = 1, py::arg("dense_keys") = false)
       .def("name", &Table::name)
       .def("can_sample", &Table::CanSample,
            py::call_guard<py::gil_scoped_release>())
@@ -385,11 +390,14 @@ PYBIND11_MODULE(libpybind, m) {
            })
       .def("NewTrajectoryWriter",
            [](Client *client, std::shared_ptr<ChunkerOptions> chunker_options,
-              bool validate_items) {
+              bool validate_items, bool background_compression) {
              std::unique_ptr<TrajectoryWriter> writer;
 
              TrajectoryWriter::Options options;
              options.chunker_options = std::move(chunker_options);
+             if (background_compression) {
+               options.compression_pool = ChunkCompressionPool::Default();
+             }
 
              // Release the GIL only when waiting for the call to complete. If
              // the GIL is not held when `MaybeRaiseFromStatus` is called it can
@@ -637,6 +645,23 @@ PYBIND11_MODULE(libpybind, m) {
         return self->GetNumKeepAliveRefs() == other->GetNumKeepAliveRefs();
       });
 
+  py::class_<ByteBudgetChunkerOptions, ChunkerOptions,
+             std::shared_ptr<ByteBudgetChunkerOptions>>(
+      m, "ByteBudgetChunkerOptions")
+      .def(py::init<int64_t, int, bool>(), py::arg("target_chunk_bytes"),
+           py::arg("num_keep_alive_refs"), py::arg("target_compressed_bytes"))
+      .def("__eq__", [](ByteBudgetChunkerOptions *self,
+                        std::shared_ptr<ByteBudgetChunkerOptions> other) {
+        return self->GetNumKeepAliveRefs() == other->GetNumKeepAliveRefs() &&
+               self->GetMaxChunkBytes() == other->GetMaxChunkBytes();
+      });
+
+  py::class_<ChunkStatistics>(m, "ChunkStatistics")
+      .def_readonly("num_chunks", &ChunkStatistics::num_chunks)
+      .def_readonly("num_rows", &ChunkStatistics::num_rows)
+      .def_readonly("uncompressed_bytes", &ChunkStatistics::uncompressed_bytes)
+      .def_readonly("compressed_bytes", &ChunkStatistics::compressed_bytes);
+
   py::class_<TrajectoryWriter, std::shared_ptr<TrajectoryWriter>>(
       m, "TrajectoryWriter")
       .def(
@@ -736,6 +761,14 @@ PYBIND11_MODULE(libpybind, m) {
            py::call_guard<py::gil_scoped_release>())
       .def("ConfigureChunker", &TrajectoryWriter::ConfigureChunker,
            py::call_guard<py::gil_scoped_release>())
+      .def("GetChunkStatistics",
+           [](TrajectoryWriter *writer) {
+             std::map<int, ChunkStatistics> statistics;
+             for (const auto &[column, stats] : writer->GetChunkStatistics()) {
+               statistics[column] = stats;
+             }
+             return statistics;
+           })
       .def_property_readonly("max_num_keep_alive_refs",
                              &TrajectoryWriter::max_num_keep_alive_refs)
       .def_property_readonly("episode_steps", &TrajectoryWriter::episode_steps,
@@ -1,5 +1,5 @@
 # LINT.IfChange
-from typing import List, Optional, Sequence, Any, Tuple
+from typing import Any, Dict, List, Optional, Sequence, Tuple
 
 import numpy as np
 
@@ -38,7 +38,8 @@ class RateLimiter:
 class Table:
   def __init__(self, name: str, sampler: ItemSelector, remover: ItemSelector,
                max_size: int, max_times_sampled: int, rate_limiter: RateLimiter,
-               extensions: Sequence[TableExtension], signature: Optional[str]):
+               extensions: Sequence[TableExtension], signature: Optional[str],
+               num_shards: int = ...):
     ...
   def name(self) -> str: ...
   def can_sample(self, num_samples: int) -> bool: ...
@@ -87,7 +88,8 @@ class Client:
   def NewTrajectoryWriter(
       self,
       chunker_options,
-      validate_items: bool) -> TrajectoryWriter:
+      validate_items: bool,
+      background_compression: bool) -> TrajectoryWriter:
     ...
 
   def NewStructuredWriter(
@@ -154,6 +156,22 @@ class AutoTunedChunkerOptions:
   def __init__(self, num_keep_alive_refs: int, throughput_weight: float): ...
 
 
+class ByteBudgetChunkerOptions(ChunkerOptions):
+  def __init__(self, target_chunk_bytes: int, num_keep_alive_refs: int,
+               target_compressed_bytes: bool): ...
+
+
+class ChunkStatistics:
+  @property
+  def num_chunks(self) -> int: ...
+  @property
+  def num_rows(self) -> int: ...
+  @property
+  def uncompressed_bytes(self) -> int: ...
+  @property
+  def compressed_bytes(self) -> int: ...
+
+
 class TrajectoryWriter:
 
   def Append(
@@ -195,6 +213,9 @@ class TrajectoryWriter:
       options: ChunkerOptions):
     ...
 
+  def GetChunkStatistics(self) -> Dict[int, ChunkStatistics]:
+    ...
+
   @property
   def max_num_keep_alive_refs(self) -> int:
     ...
@@ -14,6 +14,9 @@
 
 """Sanity tests for the pybind.py."""
 
+import sys
+import time
+
 from absl.testing import absltest
 from absl.testing import parameterized
 import numpy as np
@@ -79,6 +82,88 @@ class TestNdArrayToTensorAndBack(parameterized.TestCase):
       got = sample[0].data[0]
       np.testing.assert_array_equal(got, b'string_' + (b'a' * 100 * i))
 
+  def test_array_modified_after_append(self):
+    data = np.arange(84 * 84 * 4, dtype=np.uint8).reshape([84, 84, 4])
+    expected = data.copy()
+    with self._client.writer(1) as writer:
+      writer.append([data])
+      data[:] = 0
+      writer.create_item(TABLE_NAME, 1, 1)
+
+    sample = next(self._client.sample(TABLE_NAME))
+    np.testing.assert_array_equal(sample[0].data[0], expected)
+
+  def test_read_only_array(self):
+    data = np.arange(84 * 84 * 4, dtype=np.uint8).reshape([84, 84, 4])
+    data.setflags(write=False)
+    with self._client.writer(1) as writer:
+      writer.append([data])
+      writer.create_item(TABLE_NAME, 1, 1)
+
+    sample = next(self._client.sample(TABLE_NAME))
+    np.testing.assert_array_equal(sample[0].data[0], data)
+
+  def test_read_only_view_modified_after_append(self):
+    data = np.arange(84 * 84 * 4, dtype=np.uint8).reshape([84, 84, 4])
+    expected = data.copy()
+    view = data.view()
+    view.setflags(write=False)
+    with self._client.writer(1) as writer:
+      writer.append([view])
+      data[:] = 0
+      writer.create_item(TABLE_NAME, 1, 1)
+
+    sample = next(self._client.sample(TABLE_NAME))
+    np.testing.assert_array_equal(sample[0].data[0], expected)
+
+  def test_read_only_array_made_writeable_after_append(self):
+    data = np.arange(84 * 84 * 4, dtype=np.uint8).reshape([84, 84, 4])
+    expected = data.copy()
+    data.setflags(write=False)
+    with self._client.writer(1) as writer:
+      writer.append([data])
+      data.setflags(write=True)
+      data[:] = 0
+      writer.create_item(TABLE_NAME, 1, 1)
+
+    sample = next(self._client.sample(TABLE_NAME))
+    np.testing.assert_array_equal(sample[0].data[0], expected)
+
+  def test_array_from_bytes(self):
+    expected = np.arange(84 * 84 * 4, dtype=np.uint8)
+    data = np.frombuffer(expected.tobytes(), dtype=np.uint8)
+    with self._client.writer(1) as writer:
+      writer.append([data])
+      writer.create_item(TABLE_NAME, 1, 1)
+
+    sample = next(self._client.sample(TABLE_NAME))
+    np.testing.assert_array_equal(sample[0].data[0], expected)
+
+  def test_aliased_array_is_released_after_writer_closes(self):
+    data = np.frombuffer(
+        np.arange(84 * 84 * 4, dtype=np.uint8).tobytes(), dtype=np.uint8)
+    refcount = sys.getrefcount(data)
+    with self._client.writer(1) as writer:
+      writer.append([data])
+      writer.create_item(TABLE_NAME, 1, 1)
+
+    # The tensors which alias the array may be destroyed by background threads
+    # without holding the GIL, so the reference is released asynchronously.
+    deadline = time.time() + 10
+    while sys.getrefcount(data) > refcount and time.time() < deadline:
+      time.sleep(0.01)
+    self.assertEqual(sys.getrefcount(data), refcount)
+
+  def test_sampled_array_is_writeable(self):
+    data = np.arange(16, dtype=np.float32).reshape([4, 4])
+    with self._client.writer(1) as writer:
+      writer.append([data])
+      writer.create_item(TABLE_NAME, 1, 1)
+
+    got = next(self._client.sample(TABLE_NAME))[0].data[0]
+    got += 1
+    np.testing.assert_array_equal(got, data + 1)
+
 
 if __name__ == '__main__':
   absltest.main()
@@ -64,6 +64,8 @@ class TableInfo:
   num_deleted_episodes: int
   num_unique_samples: int
   table_worker_time: schema_pb2.TableWorkerTime
+  chunk_deduplication: schema_pb2.ChunkDeduplicationStats
+  histograms: schema_pb2.TableHistograms
   # LINT.ThenChange(../../reverb/schema.proto)
 
   @classmethod
@@ -87,4 +89,6 @@ class TableInfo:
         num_deleted_episodes=proto.num_deleted_episodes,
         num_unique_samples=proto.num_unique_samples,
         table_worker_time=proto.table_worker_time,
+        chunk_deduplication=proto.chunk_deduplication,
+        histograms=proto.histograms,
         )
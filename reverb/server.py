@@ -107,7 +107,9 @@ class Table:
                rate_limiter: rate_limiters.RateLimiter,
                max_times_sampled: int = 0,
                extensions: Sequence[TableExtensionBase] = (),
-               signature: Optional[reverb_types.SpecNest] = None):
+               signature: Optional[reverb_types.SpecNest] = None,
+               num_shards: int = 1,
+               dense_keys: bool = False):
     """Constructor of the Table.
 
     Args:
@@ -126,20 +128,41 @@ class Table:
         the table.
       signature: Optional nested structure containing `tf.TypeSpec` objects,
         describing the schema of items in this table.
+      num_shards: Number of sub-tables the items are hash-partitioned across.
+        Each shard has its own lock, selectors and share of the rate limiter
+        which reduces lock contention when many clients use the table
+        concurrently. Extensions are not supported when `num_shards > 1`.
+      dense_keys: If True then the table assigns sequential keys to the items
+        in insertion order, ignoring the keys chosen by the writers, and stores
+        the items in a ring buffer indexed by key instead of a hash map. Keys
+        of sampled items can still be used to update priorities and delete
+        items. Requires `num_shards == 1` and no extensions.
 
     Raises:
       ValueError: If name is empty.
       ValueError: If max_size <= 0.
+      ValueError: If num_shards <= 0 or extensions are used with num_shards > 1.
+      ValueError: If dense_keys is used with num_shards > 1 or extensions.
     """
     if not name:
       raise ValueError('name must be nonempty')
     if max_size <= 0:
       raise ValueError('max_size (%d) must be a positive integer' % max_size)
+    if num_shards <= 0:
+      raise ValueError(
+          'num_shards (%d) must be a positive integer' % num_shards)
+    if num_shards > 1 and extensions:
+      raise ValueError('extensions are not supported when num_shards > 1')
+    if dense_keys and (num_shards > 1 or extensions):
+      raise ValueError(
+          'dense_keys is not supported with num_shards > 1 or extensions')
     self._sampler = sampler
     self._remover = remover
     self._rate_limiter = rate_limiter
     self._extensions = extensions
     self._signature = signature
+    self._num_shards = num_shards
+    self._dense_keys = dense_keys
 
     # Merge the c++ extensions into a single list.
     internal_extensions = []
@@ -165,7 +188,9 @@ class Table:
         max_times_sampled=max_times_sampled,
         rate_limiter=rate_limiter.internal_limiter,
         extensions=internal_extensions,
-        signature=signature_proto_str)
+        signature=signature_proto_str,
+        num_shards=num_shards,
+        dense_keys=dense_keys)
 
   @classmethod
   def queue(cls,
@@ -294,7 +319,9 @@ class Table:
         rate_limiter=rate_limiter,
         max_times_sampled=pick(max_times_sampled, info.max_times_sampled),
         extensions=pick(extensions, self._extensions),
-        signature=pick(signature, self._signature))
+        signature=pick(signature, self._signature),
+        num_shards=self._num_shards,
+        dense_keys=self._dense_keys)
 
   def __repr__(self) -> str:
     return repr(self.internal_table)
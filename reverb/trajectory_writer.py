@@ -194,8 +194,13 @@ class TrajectoryWriter:
     """
     return self._writer.episode_steps
 
-  def configure(self, path: Tuple[Union[int, str], ...], *,
-                num_keep_alive_refs: int, max_chunk_length: Optional[int]):
+  def configure(self,
+                path: Tuple[Union[int, str], ...],
+                *,
+                num_keep_alive_refs: int,
+                max_chunk_length: Optional[int],
+                target_chunk_bytes: Optional[int] = None,
+                target_compressed_bytes: bool = False):
     """Override chunking options for a single column.
 
     Args:
@@ -205,11 +210,20 @@ class TrajectoryWriter:
       max_chunk_length: Override value for the chunk length used by this column.
         When set to None, an auto tuned chunk length is used. When set to a
         number, a constant chunk length is used.
+      target_chunk_bytes: If set then chunks of this column are closed once
+        they hold this many bytes rather than after a number of steps (chunks
+        never exceed `num_keep_alive_refs` steps). `max_chunk_length` must be
+        None when this is set.
+      target_compressed_bytes: Whether `target_chunk_bytes` refers to the size
+        of the chunks after compression, as estimated from the compression
+        ratio of the chunks created so far, rather than before compression.
 
     Raises:
       ValueError: If num_keep_alive_refs is < 1.
       ValueError: If max_chunk_length set to a value < 1 or to a value > than
         num_keep_alive_refs.
+      ValueError: If target_chunk_bytes is set to a value < 1 or if both
+        target_chunk_bytes and max_chunk_length are set.
     """
     if num_keep_alive_refs < 1:
       raise ValueError(
@@ -220,8 +234,21 @@ class TrajectoryWriter:
       raise ValueError(
           f'max_chunk_length ({max_chunk_length}) must be None or a positive '
           f'integer <= num_keep_alive_refs ({num_keep_alive_refs})')
-
-    if max_chunk_length is None:
+    if target_chunk_bytes is not None:
+      if target_chunk_bytes < 1:
+        raise ValueError(
+            f'target_chunk_bytes ({target_chunk_bytes}) must be None or a '
+            f'positive integer')
+      if max_chunk_length is not None:
+        raise ValueError(
+            'max_chunk_length must be None when target_chunk_bytes is set.')
+
+    if target_chunk_bytes is not None:
+      chunker_options = pybind.ByteBudgetChunkerOptions(
+          target_chunk_bytes=target_chunk_bytes,
+          num_keep_alive_refs=num_keep_alive_refs,
+          target_compressed_bytes=target_compressed_bytes)
+    elif max_chunk_length is None:
       chunker_options = pybind.AutoTunedChunkerOptions(
           num_keep_alive_refs=num_keep_alive_refs, throughput_weight=1.0)
     else:
@@ -235,6 +262,23 @@ class TrajectoryWriter:
     else:
       self._path_to_column_config[path] = chunker_options
 
+  def chunk_statistics(self) -> MutableMapping[Tuple[Union[int, str], ...],
+                                               pybind.ChunkStatistics]:
+    """Statistics of the chunks created so far, keyed by column path.
+
+    Columns which have not yet received any data are not included. Use the
+    statistics to pick the `max_chunk_length` or `target_chunk_bytes` passed
+    to `configure`.
+
+    Returns:
+      Mapping from the structured path of each column to the number of chunks,
+      rows, uncompressed bytes and compressed bytes of the chunks it created.
+    """
+    return {
+        self._get_path_for_column_index(column): statistics
+        for column, statistics in self._writer.GetChunkStatistics().items()
+    }
+
   def append(self, data: Any, *, partial_step: bool = False):
     """Columnwise append of data leaf nodes to internal buffers.
 
@@ -336,6 +336,65 @@ class TrajectoryWriterTest(parameterized.TestCase):
                               num_keep_alive_refs=num_keep_alive_refs,
                               max_chunk_length=max_chunk_length)
 
+  def test_configure_uses_byte_budget_when_target_chunk_bytes_set(self):
+    self.writer.append({'x': 3, 'y': 2})
+    self.writer.configure(('x',),
+                          num_keep_alive_refs=2,
+                          max_chunk_length=None,
+                          target_chunk_bytes=1024,
+                          target_compressed_bytes=True)
+    self.cpp_writer_mock.ConfigureChunker.assert_called_with(
+        0,
+        pybind.ByteBudgetChunkerOptions(
+            target_chunk_bytes=1024,
+            num_keep_alive_refs=2,
+            target_compressed_bytes=True))
+
+  @parameterized.parameters(
+      (None, 1024, True),
+      (None, 0, False),
+      (None, -1, False),
+      (1, 1024, False),
+  )
+  def test_configure_validates_target_chunk_bytes(
+      self, max_chunk_length: Optional[int], target_chunk_bytes: int,
+      valid: bool):
+    if valid:
+      self.writer.configure(('a',),
+                            num_keep_alive_refs=2,
+                            max_chunk_length=max_chunk_length,
+                            target_chunk_bytes=target_chunk_bytes)
+    else:
+      with self.assertRaises(ValueError):
+        self.writer.configure(('a',),
+                              num_keep_alive_refs=2,
+                              max_chunk_length=max_chunk_length,
+                              target_chunk_bytes=target_chunk_bytes)
+
+  def test_chunk_statistics(self):
+    server = server_lib.Server([server_lib.Table.queue('queue', 10)])
+    client = client_lib.Client(f'localhost:{server.port}')
+    writer = client.trajectory_writer(num_keep_alive_refs=10)
+    writer.configure(('x',),
+                     num_keep_alive_refs=10,
+                     max_chunk_length=None,
+                     target_chunk_bytes=4 * 8)
+
+    for _ in range(8):
+      writer.append({'x': np.zeros([2], np.float32), 'y': 1})
+
+    statistics = writer.chunk_statistics()
+    self.assertCountEqual(statistics.keys(), [('x',), ('y',)])
+
+    # Each step of `x` holds 8 bytes so every chunk holds 4 steps.
+    self.assertEqual(statistics[('x',)].num_chunks, 2)
+    self.assertEqual(statistics[('x',)].num_rows, 8)
+    self.assertEqual(statistics[('x',)].uncompressed_bytes, 8 * 8)
+    self.assertGreater(statistics[('x',)].compressed_bytes, 0)
+
+    writer.close()
+    server.stop()
+
   def test_episode_steps(self):
     server = server_lib.Server([server_lib.Table.queue('queue', 1)])
     client = client_lib.Client(f'localhost:{server.port}')